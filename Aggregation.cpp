@@ -0,0 +1,281 @@
+/*
+ * Hash aggregation for select statements with aggregate functions (count,
+ * sum, avg, min, and max) and an optional group by clause.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include "Aggregation.h"
+
+#include <cmath>
+#include <string>
+#include "Helper.h"
+#include "Index.h"
+
+// Resolve the items in a select list and the columns in a group by clause
+Aggregation::Aggregation(const Table& table, const StrVec& items,
+                         const StrVec& groupBy) : table(table), names(items) {
+    for (const auto& colName : groupBy) {
+        const int col = table.getColumnIndex(colName);
+        if (col == -1) {
+            throw Exp("Invalid column " + colName + " in group by clause.");
+        }
+        groupCols.push_back(col);
+    }
+    for (const auto& item : items) {
+        const size_t open = item.find('(');
+        if (open == std::string::npos) {
+            // Plain columns must be one of the group by columns
+            const int pos = Helper::find(groupBy, item);
+            if (pos == -1) {
+                throw Exp("Column " + item + " must be in the group by "
+                          "clause or in an aggregate function.");
+            }
+            this->items.push_back({Func::Group, pos});
+            continue;
+        }
+        const std::string func = item.substr(0, open);
+        const std::string arg  = item.substr(open + 1,
+                                             item.size() - open - 2);
+        Func kind;
+        if (func == "count") {
+            kind = (arg == "*" ? Func::CountAll : Func::Count);
+        } else if (func == "sum") {
+            kind = Func::Sum;
+        } else if (func == "avg") {
+            kind = Func::Avg;
+        } else if (func == "min") {
+            kind = Func::Min;
+        } else if (func == "max") {
+            kind = Func::Max;
+        } else {
+            throw Exp("Unknown aggregate function " + func);
+        }
+        const int col = (kind == Func::CountAll ? -1 :
+                         table.getColumnIndex(arg));
+        if (kind != Func::CountAll && col == -1) {
+            throw Exp("Invalid column " + arg + " in " + item);
+        }
+        this->items.push_back({kind, col});
+    }
+    if (groupCols.empty()) {
+        // All rows are in a single group, even if there are no rows.
+        groups.push_back({"", std::vector<Accumulator>(items.size())});
+    }
+}
+
+// Obtain the text of a value, without copying it if possible
+const std::string& Aggregation::getText(size_t row, int col) {
+    if (!table.isColumnar()) {
+        return table.getRowValue(row, col);
+    }
+    text.clear();
+    table.appendValue(row, col, text);
+    return text;
+}
+
+// Obtain a value as a number, reading numeric columns directly
+bool Aggregation::getNumber(size_t row, int col, double& num, int64_t& ival,
+                            bool& isInt) {
+    if (table.isColumnar()) {
+        const ColumnStore::ColType type = table.columns.getColumnType(col);
+        if (type == ColumnStore::ColType::Int64) {
+            ival  = table.columns.getInt64(row, col);
+            num   = ival;
+            isInt = true;
+            return true;
+        } else if (type == ColumnStore::ColType::Double) {
+            num   = table.columns.getDouble(row, col);
+            isInt = false;
+            return true;
+        }
+    }
+    const std::string& str = getText(row, col);
+    isInt = ColumnStore::toInt64(str, ival);
+    if (isInt) {
+        num = ival;
+        return true;
+    }
+    return Index::toNumber(str, num);
+}
+
+// Add a number to a sum, keeping track of the rounding error
+void Aggregation::addSum(Accumulator& acc, double num) {
+    const double sum = acc.sum + num;
+    acc.comp += (std::fabs(acc.sum) >= std::fabs(num) ?
+                 (acc.sum - sum) + num : (num - sum) + acc.sum);
+    acc.sum = sum;
+}
+
+// Replace the minimum (or maximum) if the candidate is smaller (or larger)
+void Aggregation::addExtreme(Accumulator& acc, bool isMax,
+                             const std::string& text, bool isNum,
+                             double num) {
+    // Same semantics as Index::compare(), without converting the values
+    int cmp = 0;
+    if (isNum && acc.extremeIsNum) {
+        cmp = (num < acc.extremeNum ? -1 : (num > acc.extremeNum ? 1 : 0));
+    } else {
+        cmp = text.compare(acc.extreme);
+    }
+    if (acc.count == 0 || (isMax ? cmp > 0 : cmp < 0)) {
+        acc.extreme      = text;
+        acc.extremeNum   = num;
+        acc.extremeIsNum = isNum;
+    }
+}
+
+// Add a row to its group
+void Aggregation::add(size_t row) {
+    Group* group = nullptr;
+    if (groupCols.empty()) {
+        group = &groups.front();
+    } else {
+        key.clear();
+        for (const int col : groupCols) {
+            table.appendValue(row, col, key);
+            key += '\0';
+        }
+        const auto entry = groupIndex.try_emplace(key, groups.size());
+        if (entry.second) {
+            groups.push_back({key, std::vector<Accumulator>(items.size())});
+        }
+        group = &groups[entry.first->second];
+    }
+    for (size_t i = 0; i < items.size(); i++) {
+        const Item& item = items[i];
+        Accumulator& acc = group->values[i];
+        double num = 0;
+        int64_t ival = 0;
+        bool isInt = false;
+        switch (item.func) {
+        case Func::Group:
+            break;
+        case Func::CountAll:
+            acc.count++;
+            break;
+        case Func::Count:
+            // Values in numeric columns are never empty.
+            if ((table.isColumnar() && table.columns.getColumnType(item.col)
+                 != ColumnStore::ColType::String) ||
+                !getText(row, item.col).empty()) {
+                acc.count++;
+            }
+            break;
+        case Func::Sum:
+        case Func::Avg:
+            if (getNumber(row, item.col, num, ival, isInt)) {
+                acc.count++;
+                addSum(acc, num);
+                acc.ints = acc.ints && isInt &&
+                    !__builtin_add_overflow(acc.intSum, ival, &acc.intSum);
+            }
+            break;
+        case Func::Min:
+        case Func::Max: {
+            const bool isMax = (item.func == Func::Max);
+            const bool isNum = getNumber(row, item.col, num, ival, isInt);
+            if (isNum && acc.count > 0 && acc.extremeIsNum &&
+                (isMax ? num <= acc.extremeNum : num >= acc.extremeNum)) {
+                acc.count++;  // Not a new extreme. So its text is not needed.
+                break;
+            }
+            const std::string& value = getText(row, item.col);
+            if (!value.empty()) {
+                addExtreme(acc, isMax, value, isNum, num);
+                acc.count++;
+            }
+            break;
+        }
+        }
+    }
+}
+
+// Combine the aggregate values of a group from two partial results
+void Aggregation::mergeGroup(Group& group, const Group& other) const {
+    for (size_t i = 0; i < items.size(); i++) {
+        Accumulator& acc = group.values[i];
+        const Accumulator& part = other.values[i];
+        if (part.count == 0) {
+            continue;
+        }
+        if (items[i].func == Func::Min || items[i].func == Func::Max) {
+            addExtreme(acc, items[i].func == Func::Max, part.extreme,
+                       part.extremeIsNum, part.extremeNum);
+        }
+        acc.count += part.count;
+        addSum(acc, part.sum);
+        acc.comp  += part.comp;
+        acc.ints   = acc.ints && part.ints &&
+            !__builtin_add_overflow(acc.intSum, part.intSum, &acc.intSum);
+    }
+}
+
+// Merge the groups from another partial result, preserving their order
+void Aggregation::merge(const Aggregation& other) {
+    if (groupCols.empty()) {
+        mergeGroup(groups.front(), other.groups.front());
+        return;
+    }
+    for (const Group& group : other.groups) {
+        const auto entry = groupIndex.try_emplace(group.key, groups.size());
+        if (entry.second) {
+            groups.push_back(group);
+        } else {
+            mergeGroup(groups[entry.first->second], group);
+        }
+    }
+}
+
+// Write the headings and a line for each group
+void Aggregation::write(std::ostream& os) const {
+    if (groups.empty()) {
+        return;
+    }
+    os << names << "\n";
+    std::string line;
+    for (const Group& group : groups) {
+        // The values of the group by columns are separated by '\0'
+        std::vector<size_t> starts = {0};
+        for (size_t pos = 0; pos < group.key.size(); pos++) {
+            if (group.key[pos] == '\0') {
+                starts.push_back(pos + 1);
+            }
+        }
+        line.clear();
+        for (size_t i = 0; i < items.size(); i++) {
+            const Accumulator& acc = group.values[i];
+            line += (i > 0 ? "\t" : "");
+            switch (items[i].func) {
+            case Func::Group: {
+                const size_t start = starts[items[i].col];
+                line.append(group.key, start, starts[items[i].col + 1] -
+                            start - 1);
+                break;
+            }
+            case Func::CountAll:
+            case Func::Count:
+                line += std::to_string(acc.count);
+                break;
+            case Func::Sum:
+                if (acc.count > 0 && acc.ints) {
+                    line += std::to_string(acc.intSum);
+                } else if (acc.count > 0) {
+                    ColumnStore::formatDouble(acc.sum + acc.comp, line);
+                }
+                break;
+            case Func::Avg:
+                if (acc.count > 0) {
+                    ColumnStore::formatDouble((acc.ints ? acc.intSum :
+                        acc.sum + acc.comp) / acc.count, line);
+                }
+                break;
+            case Func::Min:
+            case Func::Max:
+                line += acc.extreme;
+                break;
+            }
+        }
+        os << line << "\n";
+    }
+}
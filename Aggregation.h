@@ -0,0 +1,235 @@
+#ifndef AGGREGATION_H
+#define AGGREGATION_H
+
+/*
+ * Hash aggregation for select statements with aggregate functions (count,
+ * sum, avg, min, and max) and an optional group by clause.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Table.h"
+
+/**
+ * The groups and aggregate values computed by a select statement with
+ * aggregate functions, e.g.,
+ *
+ *     select country, count(*), max(altitude) from airports.csv
+ *         where altitude > 5000 group by country;
+ *
+ * Each item in the select list is either an aggregate function or one of
+ * the columns in the group by clause. The supported functions are:
+ *
+ *   1. count(*) -- the number of rows. count(col) is the number of rows
+ *      whose value in col is not empty.
+ *   2. sum(col) and avg(col) -- the sum and average of the values in col
+ *      that are numbers. Other values are ignored. Sums of integers are
+ *      exact (unless they overflow 64 bits). Other sums are compensated
+ *      for rounding errors, so that they do not depend on how the rows
+ *      are split between threads.
+ *   3. min(col) and max(col) -- the smallest and largest non-empty values
+ *      in col, compared in the same way as the "<" condition (see
+ *      Index::compare()).
+ *
+ * Rows are added to a hash table keyed on their values in the group by
+ * columns. Groups are reported in the order in which they are first found.
+ * Without a group by clause, all rows form a single group that is reported
+ * even if there are no rows (with a count of 0 and empty values for the
+ * other functions). Values of numeric columns in the columnar layout are
+ * aggregated directly, without converting them to text.
+ *
+ * To aggregate rows in parallel, each thread adds a range of rows to its own
+ * copy of an (empty) aggregation. The partial results are then combined, in
+ * the order of the ranges, via merge().
+ *
+ * @note This class does not perform any locking. The caller must hold (at
+ * least) a shared lock on the table's tableMutex while rows are added.
+ */
+class Aggregation {
+public:
+    /**
+     * Creates an empty aggregation after validating the items in a select
+     * list and the columns in the group by clause.
+     *
+     * @param table The table whose rows are to be aggregated.
+     * @param items The items in the select list. Each item is either a
+     * column in the group by clause or an aggregate function of the form
+     * "sum(col)" or "count(*)".
+     * @param groupBy The columns in the group by clause, if any.
+     *
+     * @exception This method throws an exception if an item or a column is
+     * not valid.
+     */
+    Aggregation(const Table& table, const StrVec& items,
+        const StrVec& groupBy);
+
+    /**
+     * Adds a row to its group, updating the aggregate values of the group.
+     *
+     * @param row The zero-based index of the row in the table.
+     */
+    void add(size_t row);
+
+    /**
+     * Combines the groups and aggregate values of another aggregation (of
+     * the same select list) into this aggregation. Groups that are only in
+     * the other aggregation are added after the groups in this one.
+     *
+     * @param other The partial aggregation to be merged into this one.
+     */
+    void merge(const Aggregation& other);
+
+    /**
+     * Obtain the number of rows in the result of this aggregation.
+     *
+     * @return The number of groups found. This is always 1 if there is no
+     * group by clause.
+     */
+    size_t getGroupCount() const { return groups.size(); }
+
+    /**
+     * Writes the headings (i.e., the items of the select list) followed by
+     * one line for each group, in the same format as select statements.
+     * Nothing is written if there are no groups.
+     *
+     * @param os The output stream to where the results are to be written.
+     */
+    void write(std::ostream& os) const;
+
+private:
+    /** The functions that may be applied to the rows in a group. */
+    enum class Func { Group, CountAll, Count, Sum, Avg, Min, Max };
+
+    /** An item in the select list. */
+    struct Item {
+        /** The function, or Func::Group for a group by column. */
+        Func func;
+
+        /**
+         * The column to which the function is applied (-1 for count(*)) or
+         * the position of the column in the group by clause.
+         */
+        int col;
+    };
+
+    /** The aggregate value of an item for a single group. */
+    struct Accumulator {
+        /** The number of rows (or values) that have been added. */
+        int64_t count = 0;
+
+        /**
+         * The sum of the numeric values and the compensation for its
+         * rounding errors (see addSum()).
+         */
+        double sum = 0, comp = 0;
+
+        /** The exact sum, used as long as all values are integers. */
+        int64_t intSum = 0;
+
+        /** Flag to indicate if intSum holds the sum of all the values. */
+        bool ints = true;
+
+        /** The current minimum or maximum value. */
+        std::string extreme;
+
+        /** The numeric value of extreme, if it is a number. */
+        double extremeNum = 0;
+
+        /** Flag to indicate if extreme is a number. */
+        bool extremeIsNum = false;
+    };
+
+    /** The rows that have the same values in the group by columns. */
+    struct Group {
+        /** The values in the group by columns, each followed by a '\0'. */
+        std::string key;
+
+        /** The aggregate values, one for each item in the select list. */
+        std::vector<Accumulator> values;
+    };
+
+    /**
+     * Obtain the text of the value in a given row and column. The text is
+     * referred to in-place for the row layout. Otherwise, it is copied into
+     * a buffer that is overwritten by the next call.
+     *
+     * @param row The zero-based row number.
+     * @param col The zero-based column number.
+     *
+     * @return The text of the value.
+     */
+    const std::string& getText(size_t row, int col);
+
+    /**
+     * Obtain the numeric value in a given row and column, if it is a number.
+     *
+     * @param row The zero-based row number.
+     * @param col The zero-based column number.
+     * @param num The value as a double.
+     * @param ival The value as an integer, if isInt is set to true.
+     * @param isInt Set to true if the value is a canonical integer.
+     *
+     * @return This method returns false if the value is not a number.
+     */
+    bool getNumber(size_t row, int col, double& num, int64_t& ival,
+        bool& isInt);
+
+    /**
+     * Adds a number to a sum using Neumaier's variant of Kahan summation.
+     * The rounding error of each addition is accumulated separately.
+     *
+     * @param acc The accumulator that holds the sum.
+     * @param num The number to be added.
+     */
+    static void addSum(Accumulator& acc, double num);
+
+    /**
+     * Updates a minimum or maximum with a candidate value, if the candidate
+     * is smaller (or larger) than the current value.
+     *
+     * @param acc The accumulator that holds the current value.
+     * @param isMax Flag to indicate if the maximum is computed.
+     * @param text The text of the candidate value.
+     * @param isNum Flag to indicate if the candidate is a number.
+     * @param num The numeric value of the candidate, if it is a number.
+     */
+    static void addExtreme(Accumulator& acc, bool isMax,
+        const std::string& text, bool isNum, double num);
+
+    /**
+     * Combines the aggregate values of the same group from two
+     * aggregations.
+     *
+     * @param group The group in this aggregation to be updated.
+     * @param other The same group from another aggregation.
+     */
+    void mergeGroup(Group& group, const Group& other) const;
+
+    /** The table whose rows are aggregated. */
+    const Table& table;
+
+    /** The items in the select list, used as the headings in results. */
+    StrVec names;
+
+    /** The functions for each item in the select list. */
+    std::vector<Item> items;
+
+    /** The zero-based indexes of the group by columns. */
+    std::vector<int> groupCols;
+
+    /** The groups, in the order in which they were first found. */
+    std::vector<Group> groups;
+
+    /** The position of each group in groups, keyed on the group's key. */
+    std::unordered_map<std::string, size_t> groupIndex;
+
+    /** Buffers reused for the key and the text of values in each row. */
+    std::string key, text;
+};
+
+#endif /* AGGREGATION_H */
@@ -0,0 +1,88 @@
+/*
+ * A stream buffer that sends the body of an HTTP response either with a
+ * Content-Length header (for short responses) or using chunked transfer
+ * encoding (for long responses), so that memory used is bounded.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include "ChunkedStream.h"
+
+// Initially, there is no buffer to be reused on any thread.
+thread_local std::vector<char> ChunkedStreamBuf::spare;
+
+/**
+ * The size of the largest buffer kept for reuse on each thread (i.e., the
+ * default limit). Larger buffers (e.g., for responses that may be cached)
+ * are released, so that idle threads do not hold on to them.
+ */
+const size_t SpareBufferBytes = 65536;
+
+// Setup the buffer to be filled by the stream using this buffer
+ChunkedStreamBuf::ChunkedStreamBuf(std::ostream& os,
+                                   const std::string& headers, size_t limit) :
+    os(os), headers(headers) {
+    // Reuse the previous buffer on this thread. It is grown (and cleared)
+    // only if it is smaller than the limit.
+    buffer.swap(spare);
+    if (buffer.size() < limit) {
+        buffer.resize(limit);
+    }
+    setp(buffer.data(), buffer.data() + limit);
+}
+
+// Keep the larger of the two buffers for the next response, if not too large
+ChunkedStreamBuf::~ChunkedStreamBuf() {
+    if (buffer.size() > spare.size() && buffer.size() <= SpareBufferBytes) {
+        spare.swap(buffer);
+    }
+}
+
+// Write a full buffer as a chunk
+ChunkedStreamBuf::int_type ChunkedStreamBuf::overflow(int_type ch) {
+    writeChunk();
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return (os.good() ? traits_type::not_eof(ch) : traits_type::eof());
+}
+
+// Write the data in the buffer as a chunk
+void ChunkedStreamBuf::writeChunk() {
+    if (!chunked) {
+        os << headers << "Transfer-Encoding: chunked\r\n\r\n";
+        chunked = true;
+    }
+    const std::streamsize len = pptr() - pbase();
+    if (len > 0) {
+        os << std::hex << len << std::dec << "\r\n";
+        os.write(pbase(), len);
+        os << "\r\n";
+    }
+    setp(pbase(), epptr());
+}
+
+// Write the rest of the response
+void ChunkedStreamBuf::finish(std::string* copy) {
+    if (finished) {
+        return;
+    }
+    finished = true;
+    if (chunked) {
+        writeChunk();
+        os << "0\r\n\r\n";
+    } else {
+        // The whole body is in the buffer. So its length is known.
+        const std::streamsize len = pptr() - pbase();
+        if (copy != nullptr) {
+            *copy = headers + "Content-Length: " + std::to_string(len) +
+                "\r\n\r\n";
+            copy->append(pbase(), len);
+            os << *copy;
+            return;
+        }
+        os << headers << "Content-Length: " << len << "\r\n\r\n";
+        os.write(pbase(), len);
+    }
+}
@@ -0,0 +1,124 @@
+#ifndef CHUNKED_STREAM_H
+#define CHUNKED_STREAM_H
+
+/*
+ * A stream buffer that sends the body of an HTTP response either with a
+ * Content-Length header (for short responses) or using chunked transfer
+ * encoding (for long responses), so that memory used is bounded.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * A std::streambuf that writes an HTTP response to an output stream. The
+ * body of the response is buffered up to a given limit. Consequently,
+ *
+ *   1. If the whole body fits into the buffer, the response is sent with a
+ *      "Content-Length" header when finish() is called.
+ *   2. Otherwise, the response is sent with "Transfer-Encoding: chunked"
+ *      header and each time the buffer fills up, its contents are written
+ *      as a chunk. Hence, results of any size are streamed to the client
+ *      using a fixed amount of memory.
+ *
+ * Typical usage is:
+ *
+ *     ChunkedStreamBuf buf(os, headers);
+ *     std::ostream resp(&buf);
+ *     resp << ... ;   // Write the body of the response.
+ *     buf.finish();
+ *
+ * The buffer is reused by the next ChunkedStreamBuf created on the same
+ * thread, so that responses on a connection do not allocate (and clear)
+ * a fresh buffer for each response. Buffers larger than the default limit
+ * are not reused.
+ */
+class ChunkedStreamBuf : public std::streambuf {
+public:
+    /**
+     * Creates a stream buffer to write a response to a given stream.
+     *
+     * @param os The output stream to where the response is to be written.
+     *
+     * @param headers The status line and headers of the response, each
+     * terminated by "\r\n". The "Content-Length" or "Transfer-Encoding"
+     * header is added by this class and must not be included. The string
+     * is not copied and must remain valid until finish() is called.
+     *
+     * @param limit The size of the buffer. Bodies longer than this size are
+     * sent using chunked transfer encoding.
+     */
+    ChunkedStreamBuf(std::ostream& os, const std::string& headers,
+        size_t limit = 65536);
+
+    /**
+     * Returns the buffer for reuse by the next stream buffer created on
+     * this thread, unless it is larger than the default limit.
+     */
+    ~ChunkedStreamBuf();
+
+    /**
+     * Writes the remainder of the response to the output stream. This
+     * method must be called once the whole body has been written.
+     * Subsequent calls have no effect.
+     *
+     * @param copy If this pointer is not nullptr and the whole response
+     * was buffered (i.e., it is sent with a "Content-Length" header), then
+     * the complete response (including headers) is stored in this string.
+     * Otherwise this string is not changed. This is used to cache short
+     * responses.
+     */
+    void finish(std::string* copy = nullptr);
+
+protected:
+    /**
+     * Called when the buffer is full to write its contents as a chunk.
+     *
+     * @param ch An optional character to be added after the buffer has
+     * been written.
+     *
+     * @return The character or EOF if the output stream is not good.
+     */
+    int_type overflow(int_type ch) override;
+
+    /**
+     * Flushes are intentionally ignored (e.g., from std::endl) so that each
+     * line is not sent as a separate chunk.
+     *
+     * @return This method always returns 0.
+     */
+    int sync() override { return 0; }
+
+private:
+    /**
+     * Writes the data in the buffer as a chunk, sending the headers first
+     * if that has not yet been done.
+     */
+    void writeChunk();
+
+    /** The output stream to where the response is written. */
+    std::ostream& os;
+
+    /** The status line and headers of the response. */
+    const std::string& headers;
+
+    /**
+     * The buffer used for the body of the response. It may be larger than
+     * the limit, when it is reused from an earlier response.
+     */
+    std::vector<char> buffer;
+
+    /** The buffer released by the last stream buffer on each thread. */
+    static thread_local std::vector<char> spare;
+
+    /** Flag to indicate if chunked transfer encoding is being used. */
+    bool chunked = false;
+
+    /** Flag to indicate if finish() has been called. */
+    bool finished = false;
+};
+
+#endif /* CHUNKED_STREAM_H */
@@ -0,0 +1,795 @@
+/*
+ * A column-oriented, typed representation of the data in a CSV. This is an
+ * optional storage backend for SQL-Air that keeps one contiguous vector per
+ * column instead of one vector-of-strings per row.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include "ColumnStore.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <type_traits>
+#include "Helper.h"
+#include "SimdScan.h"
+
+/**
+ * The approximate size of the chunks of a mapped file that are parsed in
+ * parallel. Smaller files are parsed by just a single thread.
+ */
+const size_t LoadBytesPerChunk = 4 << 20;
+
+// Returns the dictionary code for a value, adding a copy if needed.
+uint32_t ColumnStore::Column::encode(std::string_view value) {
+    const auto entry = dictCodes.find(value);
+    if (entry != dictCodes.end()) {
+        return entry->second;
+    }
+    return encodeView(owned.emplace_back(value));
+}
+
+// Returns the dictionary code for a value, adding the value as-is if needed.
+uint32_t ColumnStore::Column::encodeView(std::string_view value) {
+    const uint32_t code = dict.size();
+    const auto entry = dictCodes.try_emplace(value, code);
+    if (!entry.second) {
+        return entry.first->second;
+    }
+    dict.push_back(value);
+    return code;
+}
+
+// Change a code, widening the codes first if it does not fit.
+void ColumnStore::CodeVector::set(size_t row, uint32_t code) {
+    widen(code);
+    visit([row, code](auto& codes) { codes.at(row) = code; });
+}
+
+// Append a code, widening the codes first if it does not fit.
+void ColumnStore::CodeVector::push_back(uint32_t code) {
+    widen(code);
+    visit([code](auto& codes) { codes.push_back(code); });
+}
+
+// Reserve space in the vector for the current width.
+void ColumnStore::CodeVector::reserve(size_t rows) {
+    visit([rows](auto& codes) { codes.reserve(rows); });
+}
+
+// Pick the width for the largest code and copy the codes.
+void ColumnStore::CodeVector::assign(const std::vector<uint32_t>& codes,
+                                     size_t dictSize) {
+    narrow.clear();
+    medium.clear();
+    wide.clear();
+    width = 1;
+    widen(dictSize > 0 ? dictSize - 1 : 0);
+    visit([&codes](auto& vec) { vec.assign(codes.begin(), codes.end()); });
+}
+
+// Count the capacity of the vector for the current width.
+size_t ColumnStore::CodeVector::getMemoryBytes() const {
+    return visit([](const auto& codes) {
+        return codes.capacity() * sizeof(codes[0]); });
+}
+
+// Move the codes to the vector of the width needed for the given code.
+void ColumnStore::CodeVector::widen(uint32_t code) {
+    const int needed = (code <= UINT8_MAX ? 1 : code <= UINT16_MAX ? 2 : 4);
+    if (needed <= width) {
+        return;
+    }
+    // Convenience lambda to copy the codes into a wider vector
+    auto copyTo = [this](auto& dest) {
+        visit([&dest](auto& codes) {
+            dest.reserve(codes.capacity());
+            dest.assign(codes.begin(), codes.end());
+            std::remove_reference_t<decltype(codes)>().swap(codes);
+        });
+    };
+    if (needed == 2) {
+        copyTo(medium);
+    } else {
+        copyTo(wide);
+    }
+    width = needed;
+}
+
+// Check if a string is an integer that is reproduced exactly when printed.
+bool ColumnStore::toInt64(std::string_view str, int64_t& val) {
+    if (str.empty() || str.size() > 20) {
+        return false;
+    }
+    const char* const end = str.data() + str.size();
+    const auto res = std::from_chars(str.data(), end, val);
+    if (res.ec != std::errc() || res.ptr != end) {
+        return false;
+    }
+    // Reject non-canonical forms such as "007" or "-0"
+    char buf[24];
+    const auto out = std::to_chars(buf, buf + sizeof(buf), val);
+    return str == std::string_view(buf, out.ptr - buf);
+}
+
+// Check if a string is a real number that is reproduced exactly when printed.
+bool ColumnStore::toDouble(std::string_view str, double& val) {
+    if (str.empty() || str.size() > 24) {
+        return false;
+    }
+    const char* const end = str.data() + str.size();
+    const auto res = std::from_chars(str.data(), end, val);
+    if (res.ec != std::errc() || res.ptr != end || !std::isfinite(val) ||
+        (val == 0 && std::signbit(val))) {
+        return false;
+    }
+    if (isPlainDecimal(str)) {
+        return true;  // Avoid the (slow) formatting for common values
+    }
+    char buf[32];
+    const int len = std::snprintf(buf, sizeof(buf), "%.15g", val);
+    return str == std::string_view(buf, len);
+}
+
+// Check if a string is a decimal that "%.15g" is sure to reproduce exactly.
+bool ColumnStore::isPlainDecimal(std::string_view str) {
+    str.remove_prefix(!str.empty() && str[0] == '-');
+    const size_t dot = std::min(str.find('.'), str.size());
+    const std::string_view whole = str.substr(0, dot);
+    const std::string_view frac = str.substr(std::min(dot + 1, str.size()));
+    auto isDigits = [](std::string_view digits) {
+        return std::all_of(digits.begin(), digits.end(),
+                           [](char c) { return c >= '0' && c <= '9'; });
+    };
+    if (whole.empty() || !isDigits(whole) || !isDigits(frac) ||
+        (dot < str.size() && (frac.empty() || frac.back() == '0'))) {
+        return false;  // Not of the form "123" or "0.45" or "-12.5"
+    }
+    if (whole == "0") {
+        // Leading zeros: "%.15g" switches to the exponent form at 1e-5
+        const size_t zeros = std::min(frac.find_first_not_of('0'),
+                                      frac.size());
+        return zeros <= 3 && frac.size() - zeros <= 15;
+    }
+    // Up to 15 significant digits are reproduced exactly (DBL_DIG).
+    return whole[0] != '0' && whole.size() + frac.size() <= 15;
+}
+
+// Format a real number with up to 15 significant digits.
+void ColumnStore::formatDouble(double val, std::string& out) {
+    char buf[32];
+    const int len = std::snprintf(buf, sizeof(buf), "%.15g", val);
+    out.append(buf, len);
+}
+
+// Build the columns from the rows in a given CSV, inferring column types.
+void ColumnStore::build(const RowStore& rowStore, const int colCount) {
+    // Only the rows that are not deleted are converted
+    std::vector<size_t> live;
+    live.reserve(rowStore.size());
+    for (size_t row = 0; row < rowStore.size(); row++) {
+        if (!rowStore.isDeleted(row)) {
+            live.push_back(row);
+        }
+    }
+    columns.clear();
+    columns.resize(colCount);
+    mapping.reset();
+    rowCount = live.size();
+    for (int col = 0; col < colCount; col++) {
+        // Convenience lambda to access a value (empty in short rows)
+        auto cell = [&](const size_t row) -> const std::string& {
+            return rowStore.get(row, col);
+        };
+        Column& column = columns[col];
+        int64_t ival;
+        double dval;
+        if (std::all_of(live.begin(), live.end(), [&](const size_t row) {
+                return toInt64(cell(row), ival); })) {
+            column.type = ColType::Int64;
+            column.ints.reserve(rowCount);
+            for (const auto row : live) {
+                toInt64(cell(row), ival);
+                column.ints.push_back(ival);
+            }
+        } else if (std::all_of(live.begin(), live.end(),
+                               [&](const size_t row) {
+                return toDouble(cell(row), dval); })) {
+            column.type = ColType::Double;
+            column.reals.reserve(rowCount);
+            for (const auto row : live) {
+                toDouble(cell(row), dval);
+                column.reals.push_back(dval);
+            }
+        } else {
+            column.type = ColType::String;
+            column.codes.reserve(rowCount);
+            for (const auto row : live) {
+                column.codes.push_back(column.encode(cell(row)));
+            }
+        }
+    }
+}
+
+// Parse the next field in a line, in the same format as CSV::load.
+std::string_view ColumnStore::nextField(const char*& pos, const char* end,
+                                        std::string& buf) {
+    // Convenience lambda to check if a position is the end of a field
+    auto atEnd = [end](const char* p) {
+        return (p == end || *p == ',' || *p == '\n' ||
+                (*p == '\r' && (p + 1 == end || p[1] == '\n')));
+    };
+    const char* const start = pos;
+    if (pos == end || (*pos != '"' && *pos != '\'')) {
+        // Unquoted field that runs up to the next comma or new line.
+        pos = findFirstOf(pos, end, ',', '\n', '\n');
+        const bool cr = (pos > start && pos[-1] == '\r' &&
+                         (pos == end || *pos == '\n'));
+        return std::string_view(start, pos - start - cr);
+    }
+    // Quoted field. Use the text as-is if nothing is escaped.
+    const char quote = *pos;
+    const char* close = findFirstOf(pos + 1, end, quote, '\\', '\n');
+    if (close != end && *close == quote && atEnd(close + 1)) {
+        pos = close + 1;
+        return std::string_view(start + 1, close - start - 1);
+    }
+    // Unescape into buf, including any text after the closing quote.
+    buf.clear();
+    for (pos++; pos != end && *pos != quote && *pos != '\n'; pos++) {
+        if (*pos == '\\' && pos + 1 != end && pos[1] != '\n') {
+            pos++;
+        }
+        buf += *pos;
+    }
+    if (pos != end && *pos == quote) {
+        for (pos++; !atEnd(pos); pos++) {
+            buf += *pos;
+        }
+    } else if (!buf.empty() && buf.back() == '\r') {
+        buf.pop_back();  // Unterminated quote at the end of the line
+    }
+    return buf;
+}
+
+// Call a function for each field of each non-empty line in a chunk.
+template<typename Function>
+size_t ColumnStore::forEachRow(std::string_view chunk, int colCount,
+                               std::string& buf, Function process) {
+    const char* pos = chunk.data();
+    const char* const end = pos + chunk.size();
+    size_t rows = 0;
+    while (pos != end) {
+        if (*pos == '\n' || (*pos == '\r' && (pos + 1 == end ||
+                                              pos[1] == '\n'))) {
+            pos++;  // Skip over empty lines
+            continue;
+        }
+        int col = 0;
+        for (; col < colCount; col++) {
+            process(col, nextField(pos, end, buf));
+            if (pos == end || *pos != ',') {
+                break;  // Fewer fields than columns in this line
+            }
+            pos++;
+        }
+        // Treat missing values as empty and ignore extra values.
+        while (++col < colCount) {
+            process(col, std::string_view());
+        }
+        pos = findFirstOf(pos, end, '\n', '\n', '\n');
+        pos += (pos != end);
+        rows++;
+    }
+    return rows;
+}
+
+// Split data into chunks of roughly equal size that end with a new line.
+std::vector<std::string_view> ColumnStore::splitChunks(std::string_view data,
+                                                       size_t numChunks) {
+    std::vector<std::string_view> chunks;
+    size_t start = 0;
+    for (size_t i = 1; i <= numChunks && start < data.size(); i++) {
+        size_t stop = data.size();
+        if (i < numChunks) {
+            stop = std::max(start, data.size() / numChunks * i);
+            stop = std::min(data.find('\n', stop), data.size() - 1) + 1;
+        }
+        chunks.push_back(data.substr(start, stop - start));
+        start = stop;
+    }
+    return chunks;
+}
+
+// Build the columns from a mapped file. The data is split into chunks that
+// are processed in parallel in two passes: the first pass infers column
+// types and the second pass stores the values.
+void ColumnStore::build(std::shared_ptr<const MappedFile> mapping,
+                        std::string_view data, int colCount,
+                        WorkerPool* pool) {
+    const size_t numChunks = (pool == nullptr ? 1 :
+                              data.size() / LoadBytesPerChunk + 1);
+    const std::vector<std::string_view> chunks = splitChunks(data, numChunks);
+    // Convenience lambda to process each chunk, in parallel if possible
+    auto forEachChunk = [&](const std::function<void(size_t)>& process) {
+        if (pool != nullptr && chunks.size() > 1) {
+            pool->run(chunks.size(), process);
+        } else {
+            for (size_t chunk = 0; chunk < chunks.size(); chunk++) {
+                process(chunk);
+            }
+        }
+    };
+    // Flags to track if all values in each column (in each chunk) are
+    // Int64 or Double, along with the number of rows in each chunk.
+    std::vector<std::vector<char>> allInts(chunks.size()),
+        allReals(chunks.size());
+    std::vector<size_t> firstRow(chunks.size() + 1);
+    forEachChunk([&](size_t chunk) {
+        std::vector<char>& ints = allInts[chunk];
+        std::vector<char>& reals = allReals[chunk];
+        ints.assign(colCount, 1);
+        reals.assign(colCount, 1);
+        std::string buf;
+        firstRow[chunk + 1] = forEachRow(chunks[chunk], colCount, buf,
+            [&](int col, std::string_view field) {
+                int64_t ival;
+                double dval;
+                const bool isInt = (ints[col] || reals[col]) &&
+                    toInt64(field, ival);
+                ints[col]  = ints[col] && isInt;
+                // Integers with up to 15 digits are also canonical reals.
+                reals[col] = reals[col] && ((isInt && field.size() <= 15) ||
+                                            toDouble(field, dval));
+            });
+    });
+    std::partial_sum(firstRow.begin(), firstRow.end(), firstRow.begin());
+    rowCount = firstRow.back();
+    // Setup the columns so that each chunk can store its rows in place.
+    // The codes of String columns are stored as 32-bit values until the
+    // dictionaries are complete, as they are written concurrently.
+    std::vector<std::vector<uint32_t>> codes(colCount);
+    columns.clear();
+    columns.resize(colCount);
+    for (int col = 0; col < colCount; col++) {
+        Column& column = columns[col];
+        auto isSet = [col](const std::vector<char>& flags) {
+            return flags[col] != 0; };
+        if (std::all_of(allInts.begin(), allInts.end(), isSet)) {
+            column.type = ColType::Int64;
+            column.ints.resize(rowCount);
+        } else if (std::all_of(allReals.begin(), allReals.end(), isSet)) {
+            column.type = ColType::Double;
+            column.reals.resize(rowCount);
+        } else {
+            column.type = ColType::String;
+            codes[col].resize(rowCount);
+        }
+    }
+    // Each chunk encodes strings using its own dictionaries, except the
+    // first chunk that uses the dictionaries in the columns directly.
+    std::vector<std::vector<Column>> dicts(chunks.size());
+    forEachChunk([&](size_t chunk) {
+        std::vector<Column>& local = dicts[chunk];
+        local.resize(chunk == 0 ? 0 : colCount);
+        size_t row = firstRow[chunk];
+        std::string buf;
+        forEachRow(chunks[chunk], colCount, buf,
+            [&](int col, std::string_view field) {
+                Column& column = columns[col];
+                Column& dict = (chunk == 0 ? column : local[col]);
+                if (column.type == ColType::Int64) {
+                    toInt64(field, column.ints[row]);
+                } else if (column.type == ColType::Double) {
+                    // Values were checked in the first pass.
+                    std::from_chars(field.data(), field.data() + field.size(),
+                                    column.reals[row]);
+                } else if (field.data() == buf.data()) {
+                    codes[col][row] = dict.encode(field);  // Unescaped
+                } else {
+                    codes[col][row] = dict.encodeView(field);
+                }
+                row += (col == colCount - 1);
+            });
+    });
+    // Merge the dictionaries of the other chunks into the columns.
+    std::vector<std::vector<std::vector<uint32_t>>> remaps(chunks.size());
+    const char* const base = (mapping ? mapping->data().data() : nullptr);
+    const char* const limit = base + (mapping ? mapping->data().size() : 0);
+    for (size_t chunk = 1; chunk < chunks.size(); chunk++) {
+        remaps[chunk].resize(colCount);
+        for (int col = 0; col < colCount; col++) {
+            Column& column = columns[col];
+            for (const std::string_view value : dicts[chunk][col].dict) {
+                // Values in the mapping do not need to be copied.
+                const bool mapped = (value.data() >= base &&
+                                     value.data() < limit);
+                remaps[chunk][col].push_back(mapped ?
+                    column.encodeView(value) : column.encode(value));
+            }
+        }
+    }
+    forEachChunk([&](size_t chunk) {
+        for (int col = 0; chunk > 0 && col < colCount; col++) {
+            const std::vector<uint32_t>& remap = remaps[chunk][col];
+            std::vector<uint32_t>& colCodes = codes[col];
+            for (size_t row = firstRow[chunk]; !remap.empty() &&
+                     row < firstRow[chunk + 1]; row++) {
+                colCodes[row] = remap[colCodes[row]];
+            }
+        }
+    });
+    for (int col = 0; col < colCount; col++) {
+        Column& column = columns[col];
+        if (column.type == ColType::String) {
+            column.codes.assign(codes[col], column.dict.size());
+        }
+    }
+    this->mapping = std::move(mapping);
+}
+
+// Append the text for a given value to a string.
+void ColumnStore::appendValue(size_t row, int col, std::string& out) const {
+    const Column& column = columns[col];
+    switch (column.type) {
+    case ColType::Int64: {
+        char buf[24];
+        const auto res = std::to_chars(buf, buf + sizeof(buf),
+                                       column.ints[row]);
+        out.append(buf, res.ptr - buf);
+        break;
+    }
+    case ColType::Double:
+        formatDouble(column.reals[row], out);
+        break;
+    case ColType::String:
+        out += column.dict[column.codes[row]];
+        break;
+    }
+}
+
+// Return the text for a given value.
+std::string ColumnStore::getValue(size_t row, int col) const {
+    std::string value;
+    appendValue(row, col, value);
+    return value;
+}
+
+// Convert a numeric column to a dictionary-encoded string column.
+void ColumnStore::toStringColumn(int col) {
+    Column& column = columns[col];
+    CodeVector codes;
+    codes.reserve(rowCount);
+    for (size_t row = 0; row < rowCount; row++) {
+        codes.push_back(column.encode(getValue(row, col)));
+    }
+    column.codes = std::move(codes);
+    column.ints = std::vector<int64_t>();
+    column.reals = std::vector<double>();
+    column.type = ColType::String;
+}
+
+// Change the value in a given row and column.
+void ColumnStore::setValue(size_t row, int col, const std::string& value) {
+    Column& column = columns.at(col);
+    if (column.type == ColType::Int64) {
+        int64_t ival;
+        if (toInt64(value, ival)) {
+            column.ints.at(row) = ival;
+            return;
+        }
+        toStringColumn(col);
+    } else if (column.type == ColType::Double) {
+        double dval;
+        if (toDouble(value, dval)) {
+            column.reals.at(row) = dval;
+            return;
+        }
+        toStringColumn(col);
+    }
+    column.codes.set(row, column.encode(value));
+}
+
+// Append a new row at the end of each column.
+void ColumnStore::appendRow(const StrVec& row) {
+    for (int col = 0; col < getColumnCount(); col++) {
+        const std::string& value = row.at(col);
+        Column& column = columns[col];
+        int64_t ival;
+        double dval;
+        if (column.type == ColType::Int64 && toInt64(value, ival)) {
+            column.ints.push_back(ival);
+        } else if (column.type == ColType::Double && toDouble(value, dval)) {
+            column.reals.push_back(dval);
+        } else {
+            if (column.type != ColType::String) {
+                toStringColumn(col);
+            }
+            column.codes.push_back(column.encode(value));
+        }
+    }
+    rowCount++;
+}
+
+// Remove a given set of rows, preserving the order of remaining rows.
+void ColumnStore::eraseRows(const std::vector<size_t>& rows) {
+    if (rows.empty()) {
+        return;
+    }
+    std::vector<char> drop(rowCount);
+    for (const size_t row : rows) {
+        drop[row] = 1;
+    }
+    // Convenience lambda to compact a vector by removing dropped rows
+    auto compact = [&drop](auto& vec) {
+        size_t dest = 0;
+        for (size_t src = 0; src < vec.size(); src++) {
+            if (!drop[src]) {
+                vec[dest++] = vec[src];
+            }
+        }
+        vec.resize(dest);
+    };
+    for (auto& column : columns) {
+        compact(column.ints);
+        compact(column.reals);
+        column.codes.visit(compact);
+    }
+    rowCount -= rows.size();
+}
+
+// Find the rows whose value in a given column satisfies a condition.
+void ColumnStore::filter(int col, const Predicate& pred,
+                         std::vector<size_t>& rows, size_t first,
+                         size_t last) const {
+    const Column& column = columns.at(col);
+    last = std::min(last, rowCount);
+    // Convenience lambda to collect rows that satisfy a given test
+    auto collect = [&](auto test) {
+        for (size_t row = first; row < last; row++) {
+            if (test(row)) {
+                rows.push_back(row);
+            }
+        }
+    };
+    const std::string& value = pred.getValue();
+    if (pred.isEquality()) {
+        const bool equal = (pred.getCond() == "=");
+        // Values that cannot be stored in the column never match with "=".
+        bool found = false;
+        int64_t ival = 0;
+        double dval = 0;
+        uint32_t code = 0;
+        if (column.type == ColType::Int64) {
+            found = toInt64(value, ival);
+        } else if (column.type == ColType::Double) {
+            found = toDouble(value, dval);
+        } else {
+            const auto entry = column.dictCodes.find(value);
+            found = (entry != column.dictCodes.end());
+            code  = (found ? entry->second : 0);
+        }
+        if (!found) {
+            collect([equal](size_t) { return !equal; });
+        } else if (column.type == ColType::Int64) {
+            collect([&](size_t r) { return (column.ints[r] == ival) == equal;});
+        } else if (column.type == ColType::Double) {
+            collect([&](size_t r) {return (column.reals[r] == dval) == equal;});
+        } else {
+            column.codes.visit([&](const auto& codes) {
+                collect([&](size_t r) { return (codes[r] == code) == equal; });
+            });
+        }
+    } else if (column.type == ColType::String) {
+        // Check the condition just once for each distinct value in the
+        // range of rows: 0 = not yet checked, 1 = no match, 2 = match.
+        std::vector<char> hits(column.dict.size());
+        column.codes.visit([&](const auto& codes) {
+            collect([&](size_t r) {
+                char& hit = hits[codes[r]];
+                if (hit == 0) {
+                    hit = (pred(std::string(column.dict[codes[r]])) ? 2 : 1);
+                }
+                return hit == 2;
+            });
+        });
+    } else if (pred.isNumeric() && column.type == ColType::Int64) {
+        collect([&](size_t r) {
+            return pred(static_cast<double>(column.ints[r])); });
+    } else if (pred.isNumeric()) {
+        collect([&](size_t r) { return pred(column.reals[r]); });
+    } else {
+        std::string colVal;
+        collect([&](size_t r) {
+            colVal.clear();
+            appendValue(r, col, colVal);
+            return pred(colVal);
+        });
+    }
+}
+
+// Write the data in the same format as CSV::save
+void ColumnStore::save(std::ostream& os, const StrVec& colNames,
+    const std::string& delim, bool quote, const std::string& nl) const {
+    if (!os.good()) {
+        throw Exp("The supplied stream was not good.");
+    }
+    // Convenience lambda to write a value, escaping quotes as needed
+    auto write = [&](const std::string& value) {
+        if (!quote) {
+            os << value;
+            return;
+        }
+        os << '"';
+        for (const char c : value) {
+            if (c == '"') {
+                os << '\\';
+            }
+            os << c;
+        }
+        os << '"';
+    };
+    std::string sep;
+    for (const auto& name : colNames) {
+        os << sep;
+        write(name);
+        sep = delim;
+    }
+    os << nl;
+    std::string value;
+    for (size_t row = 0; row < rowCount; row++) {
+        for (int col = 0; col < getColumnCount(); col++) {
+            value.clear();
+            appendValue(row, col, value);
+            os << (col > 0 ? delim : "");
+            write(value);
+        }
+        os << nl;
+    }
+}
+
+// Write the columns in the binary format read by loadBinary
+void ColumnStore::saveBinary(std::ostream& os) const {
+    auto put = [&os](const void* data, size_t len) {
+        os.write(static_cast<const char*>(data), len);
+    };
+    const uint64_t rows = rowCount;
+    const uint32_t cols = columns.size();
+    put(&rows, sizeof(rows));
+    put(&cols, sizeof(cols));
+    for (const Column& column : columns) {
+        const uint8_t type = static_cast<uint8_t>(column.type);
+        put(&type, sizeof(type));
+        if (column.type == ColType::Int64) {
+            put(column.ints.data(), rows * sizeof(int64_t));
+        } else if (column.type == ColType::Double) {
+            put(column.reals.data(), rows * sizeof(double));
+        } else {
+            // The dictionary page: lengths of the values and then the values
+            const uint32_t size = column.dict.size();
+            put(&size, sizeof(size));
+            for (const std::string_view value : column.dict) {
+                const uint32_t len = value.size();
+                put(&len, sizeof(len));
+            }
+            for (const std::string_view value : column.dict) {
+                put(value.data(), value.size());
+            }
+            // Codes are written as 32-bit values, whatever their width
+            column.codes.visit([&put](const auto& codes) {
+                uint32_t block[4096];
+                for (size_t i = 0; i < codes.size(); i += 4096) {
+                    const size_t len = std::min(codes.size() - i, size_t(4096));
+                    std::copy_n(codes.begin() + i, len, block);
+                    put(block, len * sizeof(uint32_t));
+                }
+            });
+        }
+    }
+}
+
+// Load the columns from data written by saveBinary
+bool ColumnStore::loadBinary(std::shared_ptr<const MappedFile> mapping,
+                             std::string_view data) {
+    const char* pos = data.data();
+    const char* const end = pos + data.size();
+    // Convenience lambda to copy the next few bytes, if they are present.
+    auto get = [&pos, end](void* dest, size_t len) {
+        if (static_cast<size_t>(end - pos) < len) {
+            return false;
+        }
+        std::memcpy(dest, pos, len);
+        pos += len;
+        return true;
+    };
+    uint64_t rows;
+    uint32_t cols;
+    // Each row takes some bytes. So larger counts are not valid.
+    if (!get(&rows, sizeof(rows)) || !get(&cols, sizeof(cols)) ||
+        rows > data.size() || cols > data.size()) {
+        return false;
+    }
+    std::vector<Column> loaded(cols);
+    for (Column& column : loaded) {
+        uint8_t type;
+        if (!get(&type, sizeof(type)) ||
+            type > static_cast<uint8_t>(ColType::String)) {
+            return false;
+        }
+        column.type = static_cast<ColType>(type);
+        if (column.type == ColType::Int64) {
+            column.ints.resize(rows);
+            if (!get(column.ints.data(), rows * sizeof(int64_t))) {
+                return false;
+            }
+            continue;
+        } else if (column.type == ColType::Double) {
+            column.reals.resize(rows);
+            if (!get(column.reals.data(), rows * sizeof(double))) {
+                return false;
+            }
+            continue;
+        }
+        uint32_t size;
+        if (!get(&size, sizeof(size)) || size > data.size()) {
+            return false;
+        }
+        std::vector<uint32_t> lengths(size);
+        if (!get(lengths.data(), size * sizeof(uint32_t))) {
+            return false;
+        }
+        column.dict.reserve(size);
+        column.dictCodes.reserve(size);
+        for (const uint32_t len : lengths) {
+            if (static_cast<size_t>(end - pos) < len) {
+                return false;
+            }
+            column.encodeView(std::string_view(pos, len));
+            pos += len;
+        }
+        std::vector<uint32_t> codes(rows);
+        if (!get(codes.data(), rows * sizeof(uint32_t)) ||
+            column.dict.size() != size ||
+            std::any_of(codes.begin(), codes.end(),
+                        [size](uint32_t code) { return code >= size; })) {
+            return false;
+        }
+        column.codes.assign(codes, size);
+    }
+    if (pos != end) {
+        return false;
+    }
+    columns = std::move(loaded);
+    rowCount = rows;
+    this->mapping = std::move(mapping);
+    return true;
+}
+
+// Add up the vectors of each column, counting each hash node as its value
+// plus a link and a cached hash
+size_t ColumnStore::getMemoryBytes() const {
+    const size_t inlineChars = std::string().capacity();
+    size_t bytes = (mapping != nullptr ? mapping->data().size() : 0);
+    for (const Column& column : columns) {
+        bytes += column.ints.capacity() * sizeof(int64_t) +
+            column.reals.capacity() * sizeof(double) +
+            column.codes.getMemoryBytes() +
+            column.dict.capacity() * sizeof(std::string_view) +
+            column.dictCodes.bucket_count() * sizeof(void*) +
+            column.dictCodes.size() * (sizeof(std::string_view) +
+                                       sizeof(uint32_t) + 2 * sizeof(void*));
+        for (const std::string& value : column.owned) {
+            bytes += sizeof(std::string) +
+                (value.capacity() > inlineChars ? value.capacity() + 1 : 0);
+        }
+    }
+    return bytes;
+}
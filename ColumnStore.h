@@ -0,0 +1,565 @@
+#ifndef COLUMN_STORE_H
+#define COLUMN_STORE_H
+
+/*
+ * A column-oriented, typed representation of the data in a CSV. This is an
+ * optional storage backend for SQL-Air that keeps one contiguous vector per
+ * column instead of one vector-of-strings per row.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "CSV.h"
+#include "MappedFile.h"
+#include "Predicate.h"
+#include "RowStore.h"
+#include "WorkerPool.h"
+
+/**
+ * A column-oriented store of the data rows in a CSV. The type of each column
+ * is inferred when the store is built from a CSV:
+ *
+ *   1. Int64  -- every value in the column is a canonical integer (e.g.,
+ *                "5282" or "-12", but not "0012" or "+5").
+ *   2. Double -- every value is a real number whose text is reproduced
+ *                exactly when it is printed back (e.g., "4.375").
+ *   3. String -- all other columns. These values are dictionary encoded,
+ *                i.e., each distinct value is stored once and the rows only
+ *                hold a code into the dictionary. Codes take 1, 2, or 4
+ *                bytes depending on the number of distinct values (see
+ *                CodeVector). So low-cardinality columns (e.g., countries)
+ *                take just a byte per row.
+ *
+ * Type inference is strict so that getValue() always returns the exact text
+ * that was loaded. If an update stores a value that does not fit the type
+ * of a numeric column, the column is converted to a String column.
+ *
+ * A store can also be built directly from a memory-mapped CSV file (see
+ * MappedFile). In this case, the dictionaries of String columns refer to
+ * the values in place in the mapping rather than holding copies. Values
+ * are copied only if they need unescaping or if an update (or insert)
+ * adds a new value to a dictionary.
+ *
+ * @note This class does not perform any locking. The caller (i.e., SQLAir)
+ * is responsible for ensuring operations are MT-safe.
+ */
+class ColumnStore {
+public:
+    /** The different types of columns supported by this store. */
+    enum class ColType { Int64, Double, String };
+
+    /**
+     * Builds this column store from the rows of a table in the row layout.
+     * Rows that are marked as deleted are skipped. Any existing data in
+     * this store is lost.
+     *
+     * @param rowStore The rows to be converted to columns. The rows are
+     * not modified by this method.
+     * @param colCount The number of columns in each row.
+     */
+    void build(const RowStore& rowStore, const int colCount);
+
+    /**
+     * Builds this column store from the data rows in a memory-mapped CSV
+     * file. Fields are parsed in the same format as CSV::load(). Any
+     * existing data in this store is lost.
+     *
+     * Delimiters are found with vectorized comparisons (see findFirstOf()).
+     * Large files are split into chunks ending at new lines, which are
+     * parsed concurrently. Each chunk encodes strings using its own
+     * dictionaries, which are then merged into the columns.
+     *
+     * @param mapping The mapped file. This store holds on to the mapping
+     * as long as its dictionaries refer to values in the mapping.
+     * @param data The part of the mapping with the data rows, i.e., after
+     * the line with the column names.
+     * @param colCount The number of columns in each row. Missing values in
+     * short rows are treated as empty strings and extra values are ignored.
+     * @param pool The worker pool used to parse chunks in parallel. If this
+     * pointer is nullptr, then the data is parsed by the calling thread.
+     */
+    void build(std::shared_ptr<const MappedFile> mapping,
+        std::string_view data, int colCount, WorkerPool* pool = nullptr);
+
+    /**
+     * Obtain the number of rows in this column store.
+     *
+     * @return The number of rows in each column.
+     */
+    size_t getRowCount() const { return rowCount; }
+
+    /**
+     * Obtain the number of columns in this store.
+     *
+     * @return The number of columns.
+     */
+    int getColumnCount() const { return columns.size(); }
+
+    /**
+     * Obtain the inferred type of a given column.
+     *
+     * @param col The zero-based index of the column.
+     *
+     * @return The type of data stored in the column.
+     */
+    ColType getColumnType(int col) const { return columns.at(col).type; }
+
+    /**
+     * Returns the value in a given row of an Int64 column, without
+     * converting it to text.
+     *
+     * @param row The zero-based row number.
+     * @param col The zero-based column number. The type of the column must
+     * be ColType::Int64.
+     *
+     * @return The value in the given row and column.
+     */
+    int64_t getInt64(size_t row, int col) const {
+        return columns[col].ints[row];
+    }
+
+    /**
+     * Returns the value in a given row of a Double column, without
+     * converting it to text.
+     *
+     * @param row The zero-based row number.
+     * @param col The zero-based column number. The type of the column must
+     * be ColType::Double.
+     *
+     * @return The value in the given row and column.
+     */
+    double getDouble(size_t row, int col) const {
+        return columns[col].reals[row];
+    }
+
+    /**
+     * Returns the text of the value in a given row of a String column,
+     * without copying it. The text remains valid until the column is
+     * modified.
+     *
+     * @param row The zero-based row number.
+     * @param col The zero-based column number. The type of the column must
+     * be ColType::String.
+     *
+     * @return The text of the value in the given row and column.
+     */
+    std::string_view getText(size_t row, int col) const {
+        return columns[col].dict[columns[col].codes[row]];
+    }
+
+    /**
+     * Returns the text of the value in a given row and column, exactly as
+     * it was loaded or last updated.
+     *
+     * @param row The zero-based row number.
+     * @param col The zero-based column number.
+     *
+     * @return The value as a string.
+     */
+    std::string getValue(size_t row, int col) const;
+
+    /**
+     * Appends the text of the value in a given row and column to a string.
+     * This method is used when generating outputs to avoid creating
+     * temporary strings for each value.
+     *
+     * @param row The zero-based row number.
+     * @param col The zero-based column number.
+     * @param out The string to which the value is to be appended.
+     */
+    void appendValue(size_t row, int col, std::string& out) const;
+
+    /**
+     * Changes the value in a given row and column. If the value does not
+     * fit into the type of a numeric column, then the column is converted
+     * to a String column first.
+     *
+     * @param row The zero-based row number.
+     * @param col The zero-based column number.
+     * @param value The new value to be stored.
+     */
+    void setValue(size_t row, int col, const std::string& value);
+
+    /**
+     * Appends a new row at the end of this store. Values that do not
+     * fit into the type of a numeric column cause the column to be converted
+     * to a String column.
+     *
+     * @param row The values for each column in the new row.
+     */
+    void appendRow(const StrVec& row);
+
+    /**
+     * Removes a given set of rows from this store. The order of the
+     * remaining rows is unchanged.
+     *
+     * @param rows The zero-based indexes of the rows to be removed, in
+     * ascending order.
+     */
+    void eraseRows(const std::vector<size_t>& rows);
+
+    /**
+     * Determines the rows whose value in a given column satisfies a
+     * predicate. The predicate is evaluated directly on the typed data for
+     * "=" and "<>" by converting the value to the column's type just once.
+     * Numeric predicates (see Predicate::isNumeric()) are applied directly
+     * to numeric columns. For String columns, other conditions are evaluated
+     * only once for each distinct value in the dictionary. Remaining cases
+     * are checked on the text of each value.
+     *
+     * @param col The zero-based column in the where clause.
+     * @param pred The compiled condition in the where clause.
+     * @param rows The vector to which the zero-based row numbers that
+     * satisfy the condition are appended, in ascending order. Callers reuse
+     * this vector across queries to avoid allocating memory for each one.
+     * @param first The first row to be checked. Different ranges of rows
+     * may be checked concurrently from different threads.
+     * @param last The row after the last row to be checked.
+     */
+    void filter(int col, const Predicate& pred, std::vector<size_t>& rows,
+        size_t first = 0, size_t last = SIZE_MAX) const;
+
+    /**
+     * Writes the rows in this store in the same format as CSV::save().
+     *
+     * @param os The output stream to where the data is to be written.
+     * @param colNames The names of the columns for the header line.
+     * @param delim The delimiter to use between each column.
+     * @param quote If this flag is true then each value is quoted.
+     * @param nl The string to be used for new lines.
+     */
+    void save(std::ostream& os, const StrVec& colNames,
+        const std::string& delim = ",", bool quote = true,
+        const std::string& nl = "\n") const;
+
+    /**
+     * Writes the columns in this store in a compact binary format that is
+     * loaded by loadBinary(). For each column, the type is followed by the
+     * typed values of each row. For String columns, the values are the
+     * dictionary codes, preceded by a dictionary page, i.e., the length of
+     * each distinct value followed by the values. Numbers are written in
+     * the native byte order.
+     *
+     * @param os The output stream to where the data is to be written.
+     */
+    void saveBinary(std::ostream& os) const;
+
+    /**
+     * Loads this store from data written by saveBinary() in a memory-mapped
+     * file. The typed values are copied, but the dictionaries of String
+     * columns refer to the values in place in the mapping. Hence this is
+     * much faster than parsing a CSV file. Any existing data in this store
+     * is lost, unless the data is invalid.
+     *
+     * @param mapping The mapped file. This store holds on to the mapping
+     * as long as its dictionaries refer to values in the mapping.
+     * @param data The part of the mapping written by saveBinary().
+     *
+     * @return This method returns false (without changing this store) if
+     * the data is truncated or otherwise not valid.
+     */
+    bool loadBinary(std::shared_ptr<const MappedFile> mapping,
+        std::string_view data);
+
+    /**
+     * Estimates the memory used by this store, i.e., the typed values, the
+     * dictionaries, and the mapped file (if any) that the dictionaries
+     * refer to.
+     *
+     * @return The approximate number of bytes used by this store.
+     */
+    size_t getMemoryBytes() const;
+
+    /**
+     * Convenience method to check if a string is a canonical integer, i.e.,
+     * the string is reproduced exactly by std::to_string.
+     *
+     * @param str The string to be checked.
+     * @param val The integer value, if the string is a canonical integer.
+     *
+     * @return This method returns true if str is a canonical integer.
+     */
+    static bool toInt64(std::string_view str, int64_t& val);
+
+    /**
+     * Convenience method to check if a string is a real number whose text
+     * is reproduced exactly by formatDouble().
+     *
+     * @param str The string to be checked.
+     * @param val The real value, if the string is a canonical real number.
+     *
+     * @return This method returns true if str is a canonical real number.
+     */
+    static bool toDouble(std::string_view str, double& val);
+
+    /**
+     * Formats a real number using up to 15 significant digits without
+     * trailing zeros (i.e., the "%.15g" format).
+     *
+     * @param val The value to be formatted.
+     * @param out The string to which the formatted value is appended.
+     */
+    static void formatDouble(double val, std::string& out);
+
+private:
+    /**
+     * Checks if a string is a plain decimal number (e.g., "-12.5") with few
+     * enough digits that formatDouble() is sure to reproduce it exactly.
+     * This check is used to avoid formatting values in toDouble().
+     *
+     * @param str The string to be checked.
+     *
+     * @return This method returns true if str is definitely reproduced by
+     * formatDouble(). A false value means that formatDouble() must be used.
+     */
+    static bool isPlainDecimal(std::string_view str);
+
+    /**
+     * The dictionary codes of a String column, stored with the fewest bytes
+     * per code that fit the size of its dictionary: 1 byte for up to 256
+     * distinct values, 2 bytes for up to 65536, and 4 bytes otherwise. The
+     * codes are widened when a code that does not fit is stored. Only the
+     * vector corresponding to the current width is used.
+     */
+    class CodeVector {
+    public:
+        /**
+         * Returns the code in a given row.
+         *
+         * @param row The zero-based row number.
+         *
+         * @return The dictionary code in the row.
+         */
+        uint32_t operator[](size_t row) const {
+            return (width == 1 ? narrow[row] :
+                    width == 2 ? medium[row] : wide[row]);
+        }
+
+        /**
+         * Obtain the number of codes (i.e., rows) in this vector.
+         *
+         * @return The number of codes.
+         */
+        size_t size() const {
+            return (width == 1 ? narrow.size() :
+                    width == 2 ? medium.size() : wide.size());
+        }
+
+        /**
+         * Changes the code in a given row, widening the codes if needed.
+         *
+         * @param row The zero-based row number, which must be less than
+         * size().
+         * @param code The new code for the row.
+         */
+        void set(size_t row, uint32_t code);
+
+        /**
+         * Appends a code, widening the codes if needed.
+         *
+         * @param code The code to be appended.
+         */
+        void push_back(uint32_t code);
+
+        /**
+         * Reserves space for a given number of codes of the current width.
+         *
+         * @param rows The number of codes to reserve space for.
+         */
+        void reserve(size_t rows);
+
+        /**
+         * Replaces the codes in this vector, using the width that fits the
+         * size of the dictionary.
+         *
+         * @param codes The new codes, each of which must be less than
+         * dictSize.
+         * @param dictSize The number of values in the dictionary.
+         */
+        void assign(const std::vector<uint32_t>& codes, size_t dictSize);
+
+        /**
+         * Estimates the memory used by this vector.
+         *
+         * @return The number of bytes allocated for the codes.
+         */
+        size_t getMemoryBytes() const;
+
+        /**
+         * Calls a given function with the vector holding the codes, so that
+         * loops over the codes are compiled for each width (instead of
+         * checking the width for each row).
+         *
+         * @param process The function called with a reference to the
+         * std::vector of uint8_t, uint16_t, or uint32_t in use. It must not
+         * store codes that do not fit in that type.
+         *
+         * @return The value returned by process.
+         */
+        template<typename Function>
+        auto visit(Function process) const {
+            return (width == 1 ? process(narrow) : width == 2 ?
+                    process(medium) : process(wide));
+        }
+
+        /** The non-const version of the visit() method. */
+        template<typename Function>
+        auto visit(Function process) {
+            return (width == 1 ? process(narrow) : width == 2 ?
+                    process(medium) : process(wide));
+        }
+
+    private:
+        /**
+         * Copies the codes into the vector of a wider type, if a given code
+         * does not fit the current width.
+         *
+         * @param code The code that is to be stored.
+         */
+        void widen(uint32_t code);
+
+        /** The number of bytes per code: 1, 2, or 4. */
+        int width = 1;
+
+        /** The codes for each of the widths. */
+        std::vector<uint8_t> narrow;
+        std::vector<uint16_t> medium;
+        std::vector<uint32_t> wide;
+    };
+
+    /**
+     * The data associated with a single column. Only the vector(s)
+     * corresponding to the column's type are used.
+     */
+    struct Column {
+        Column() = default;
+
+        // Copies would refer to the strings owned by the original.
+        Column(const Column&) = delete;
+        Column(Column&&) = default;
+        Column& operator=(Column&&) = default;
+
+        /** The inferred type of this column. */
+        ColType type = ColType::String;
+
+        /** The values in each row for Int64 columns. */
+        std::vector<int64_t> ints;
+
+        /** The values in each row for Double columns. */
+        std::vector<double> reals;
+
+        /** The dictionary codes in each row for String columns. */
+        CodeVector codes;
+
+        /**
+         * The distinct values in a String column, indexed by code. The
+         * values refer either to the strings in owned or to the mapped
+         * file from which the store was built.
+         */
+        std::vector<std::string_view> dict;
+
+        /** Reverse look-up of the code for each value in dict. */
+        std::unordered_map<std::string_view, uint32_t> dictCodes;
+
+        /**
+         * Copies of the values in dict that are not in the mapped file.
+         * A deque is used so that adding values does not move the
+         * existing strings.
+         */
+        std::deque<std::string> owned;
+
+        /**
+         * Returns the code for a given value, adding a copy of it to the
+         * dictionary if it is not already present.
+         *
+         * @param value The value whose code is to be returned.
+         *
+         * @return The dictionary code for the value.
+         */
+        uint32_t encode(std::string_view value);
+
+        /**
+         * Returns the code for a given value, adding it to the dictionary
+         * without a copy if it is not already present.
+         *
+         * @param value The value whose code is to be returned. The value
+         * must remain valid as long as this column is used.
+         *
+         * @return The dictionary code for the value.
+         */
+        uint32_t encodeView(std::string_view value);
+    };
+
+    /**
+     * Parses the next field in a mapped CSV file, in the same format as
+     * CSV::load(). Quoted fields that do not need unescaping are returned
+     * without making a copy.
+     *
+     * @param pos The start of the field. On return, it is the position of
+     * the comma or new line after the field (or end).
+     * @param end The end of the data being parsed.
+     * @param buf The string used to hold the field if it needs unescaping.
+     *
+     * @return The field, which refers to either the data or buf.
+     */
+    static std::string_view nextField(const char*& pos, const char* end,
+        std::string& buf);
+
+    /**
+     * Calls a given function for each field in each non-empty line of a
+     * chunk of a mapped CSV file. Trailing carriage returns are removed.
+     *
+     * @param chunk The data to be parsed. It must end with a new line.
+     * @param colCount The number of columns. The function is called exactly
+     * colCount times for each line, with empty values for missing fields.
+     * @param buf The string used to hold fields that need unescaping.
+     * @param process The function to be called with the zero-based column
+     * and the value of each field.
+     *
+     * @return The number of (non-empty) lines in the chunk.
+     */
+    template<typename Function>
+    static size_t forEachRow(std::string_view chunk, int colCount,
+        std::string& buf, Function process);
+
+    /**
+     * Splits data into (at most) a given number of chunks of roughly equal
+     * size. Each chunk, except possibly the last one, ends with a new line.
+     *
+     * @param data The data to be split.
+     * @param numChunks The number of chunks desired.
+     *
+     * @return The chunks, in the order in which they occur in data.
+     */
+    static std::vector<std::string_view> splitChunks(std::string_view data,
+        size_t numChunks);
+
+    /**
+     * Converts a numeric column into a dictionary-encoded String column.
+     * This method is used when an update stores a non-numeric value.
+     *
+     * @param col The zero-based index of the column to be converted.
+     */
+    void toStringColumn(int col);
+
+    /** The columns of data in this store. */
+    std::vector<Column> columns;
+
+    /** The number of rows in each column. */
+    size_t rowCount = 0;
+
+    /**
+     * The mapped file (if any) from which this store was built. It is
+     * held here because the dictionaries refer to values in it.
+     */
+    std::shared_ptr<const MappedFile> mapping;
+};
+
+#endif /* COLUMN_STORE_H */
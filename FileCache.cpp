@@ -0,0 +1,140 @@
+/*
+ * An in-memory cache of the static files (e.g., web/sqlair.html) served by
+ * SQL-Air, with support for conditional requests and gzip compression.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include "FileCache.h"
+
+#include <strings.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include "HTTPFile.h"
+
+namespace {
+
+/**
+ * Determine if files of a given content type are worth compressing, i.e.,
+ * they are text rather than already compressed images.
+ */
+bool isCompressible(const std::string& contentType) {
+    return contentType.compare(0, 5, "text/") == 0 ||
+        contentType.find("javascript") != std::string::npos ||
+        contentType.find("json") != std::string::npos ||
+        contentType.find("xml") != std::string::npos;
+}
+
+}  // namespace
+
+// Respond with the cached entry, (re)loading the file if it changed
+bool FileCache::serve(const std::string& path, const std::string& ifNoneMatch,
+                      const std::string& ifModifiedSince, bool gzip,
+                      bool keepAlive, std::ostream& os) {
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode) ||
+        info.st_size > MaxFileBytes) {
+        return false;
+    }
+    std::shared_ptr<const Entry> entry;
+    if (!cache.find(path, entry) || entry->mtime != info.st_mtime ||
+        entry->size != info.st_size) {
+        if ((entry = load(path, info.st_mtime, info.st_size)) == nullptr) {
+            return false;
+        }
+        cache.insert(path, entry);
+    }
+    gzip = gzip && !entry->gzipBody.empty();
+    // A client that has either variant has an up to date copy of the file.
+    // The date is only checked if there are no entity tags.
+    const bool notModified = (ifNoneMatch.empty() ?
+        (!ifModifiedSince.empty() && ::strcasecmp(ifModifiedSince.c_str(),
+                                    entry->lastModified.c_str()) == 0) :
+        (ifNoneMatch == "*" ||
+         ifNoneMatch.find(entry->etag) != std::string::npos ||
+         (!entry->gzipBody.empty() &&
+          ifNoneMatch.find(entry->gzipEtag) != std::string::npos)));
+    const std::string& headers = (notModified ? entry->notModifiedHeaders :
+                                  gzip ? entry->gzipHeaders : entry->headers);
+    os << headers << "Connection: " << (keepAlive ? "keep-alive" : "Close")
+       << "\r\n\r\n";
+    if (!notModified) {
+        const std::string& body = (gzip ? entry->gzipBody : entry->body);
+        os.write(body.data(), body.size());
+    }
+    return true;
+}
+
+// Read the file and precompute its headers and gzip variant
+std::shared_ptr<const FileCache::Entry> FileCache::load(
+    const std::string& path, time_t mtime, off_t size) {
+    std::ifstream is(path, std::ios::binary);
+    std::ostringstream contents;
+    if (!is || !(contents << is.rdbuf())) {
+        return nullptr;
+    }
+    auto entry = std::make_shared<Entry>();
+    entry->mtime = mtime;
+    entry->size = size;
+    entry->body = contents.str();
+    // The entity tag is the 64-bit FNV-1a hash of the contents
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char c : entry->body) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+    }
+    char etag[24];
+    std::snprintf(etag, sizeof(etag), "\"%016llx\"",
+                  static_cast<unsigned long long>(hash));
+    entry->etag = etag;
+    entry->gzipEtag = entry->etag;
+    entry->gzipEtag.insert(entry->gzipEtag.size() - 1, "-gz");
+    char date[64];
+    struct tm tm;
+    std::strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT",
+                  gmtime_r(&mtime, &tm));
+    entry->lastModified = date;
+    // Only variants that are noticeably smaller are kept
+    const std::string contentType = http::getContentType(path);
+    const bool compressible = isCompressible(contentType);
+    if (compressible && (!compress(entry->body, entry->gzipBody) ||
+        entry->gzipBody.size() >= entry->body.size() * 9 / 10)) {
+        entry->gzipBody.clear();
+    }
+    const std::string common = "Last-Modified: " + entry->lastModified +
+        "\r\nCache-Control: no-cache\r\n" +
+        (compressible ? "Vary: Accept-Encoding\r\n" : "");
+    entry->notModifiedHeaders = "HTTP/1.1 304 Not Modified\r\nETag: " +
+        entry->etag + "\r\n" + common;
+    entry->headers = "HTTP/1.1 200 OK\r\nContent-Type: " + contentType +
+        "\r\nContent-Length: " + std::to_string(entry->body.size()) +
+        "\r\nETag: " + entry->etag + "\r\n" + common;
+    if (!entry->gzipBody.empty()) {
+        entry->gzipHeaders = "HTTP/1.1 200 OK\r\nContent-Type: " +
+            contentType + "\r\nContent-Encoding: gzip\r\nContent-Length: " +
+            std::to_string(entry->gzipBody.size()) + "\r\nETag: " +
+            entry->gzipEtag + "\r\n" + common;
+    }
+    return entry;
+}
+
+// Compress the data in one call, as the whole file is in memory
+bool FileCache::compress(const std::string& data, std::string& out) {
+    z_stream stream = {};
+    // The window bits of 15 + 16 select the gzip (and not zlib) format
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out.resize(deflateBound(&stream, data.size()));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = data.size();
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = out.size();
+    const int result = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END;
+}
@@ -0,0 +1,123 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+/*
+ * An in-memory cache of the static files (e.g., web/sqlair.html) served by
+ * SQL-Air, with support for conditional requests and gzip compression.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <sys/types.h>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "LruCache.h"
+
+/**
+ * A cache of the contents of static files, so that requests for them (e.g.,
+ * the assets of the web UI) are answered from memory rather than by opening
+ * and streaming the file for each request. Each cached file has:
+ *
+ *   1. An "ETag" (a hash of its contents) and a "Last-Modified" date, so
+ *      that conditional requests ("If-None-Match" or "If-Modified-Since")
+ *      for unchanged files are answered with "304 Not Modified".
+ *   2. A precomputed gzip variant (for text files that compress well),
+ *      which is sent to clients that accept gzip encoding.
+ *
+ * Responses have a "Content-Length" header and are written with a single
+ * call, so that serving a file holds a client thread only briefly. The
+ * modification time and size of a file are checked (via stat) on each
+ * request, so that a changed file is reloaded.
+ *
+ * @note This class is MT-safe.
+ */
+class FileCache {
+public:
+    /** The largest file that is cached. Larger files are streamed. */
+    static constexpr off_t MaxFileBytes = 4 << 20;
+
+    /**
+     * Creates an empty cache.
+     *
+     * @param capacity The maximum number of files in the cache.
+     */
+    explicit FileCache(const size_t capacity) : cache(capacity) {}
+
+    /**
+     * Writes the HTTP response for a static file, from the cache if the
+     * file is unchanged.
+     *
+     * @param path The path to the file, relative to the working directory.
+     * @param ifNoneMatch The (lower case) value of the "If-None-Match"
+     * header of the request, if any.
+     * @param ifModifiedSince The (lower case) value of the
+     * "If-Modified-Since" header of the request, if any.
+     * @param gzip Flag to indicate if the client accepts gzip encoding.
+     * @param keepAlive Flag to indicate if the connection is persistent.
+     * @param os The output stream to where the response is written.
+     *
+     * @return This method returns false (without writing anything) if the
+     * file is not a regular file or is larger than MaxFileBytes. The caller
+     * then responds as it did without the cache (e.g., with a 404 error).
+     */
+    bool serve(const std::string& path, const std::string& ifNoneMatch,
+               const std::string& ifModifiedSince, bool gzip,
+               bool keepAlive, std::ostream& os);
+
+private:
+    /** The contents and response headers of a cached file. */
+    struct Entry {
+        /** The modification time and size of the file when it was read. */
+        time_t mtime;
+        off_t size;
+
+        /**
+         * The quoted entity tags of the contents and of the gzip variant,
+         * e.g., "\"5f3a0c21d2e4b7a9\"" and "\"5f3a0c21d2e4b7a9-gz\"".
+         */
+        std::string etag, gzipEtag;
+
+        /** The modification time, e.g., "Sun, 06 Nov 1994 08:49:37 GMT". */
+        std::string lastModified;
+
+        /**
+         * The headers of responses (up to and excluding the "Connection"
+         * header) with the contents and the gzip variant, and with 304
+         * responses. The gzip headers are empty if there is no variant.
+         */
+        std::string headers, gzipHeaders, notModifiedHeaders;
+
+        /** The contents of the file and its gzip variant, if any. */
+        std::string body, gzipBody;
+    };
+
+    /**
+     * Reads a file and builds its cache entry.
+     *
+     * @param path The path to the file.
+     * @param mtime The modification time of the file.
+     * @param size The size of the file.
+     *
+     * @return The entry for the file or nullptr if it could not be read.
+     */
+    static std::shared_ptr<const Entry> load(const std::string& path,
+                                             time_t mtime, off_t size);
+
+    /**
+     * Compresses data in the gzip format.
+     *
+     * @param data The data to be compressed.
+     * @param out The string set to the compressed data.
+     *
+     * @return This method returns false if the data could not be
+     * compressed.
+     */
+    static bool compress(const std::string& data, std::string& out);
+
+    /** The cached files, keyed on their paths. */
+    LruCache<std::shared_ptr<const Entry>> cache;
+};
+
+#endif /* FILE_CACHE_H */
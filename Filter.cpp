@@ -0,0 +1,307 @@
+/*
+ * A compiled form of compound where clauses, i.e., conditions combined with
+ * "and", "or", and parentheses.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include "Filter.h"
+
+#include <algorithm>
+#include <iterator>
+#include "Helper.h"
+
+const std::string Filter::Cond = "compound";
+
+namespace {
+
+/** The separator of the tokens in an encoded where clause. */
+constexpr char Separator = '\x1f';
+
+/**
+ * Estimates the fraction of rows satisfying a condition. These are just
+ * heuristics (as no statistics are kept) used to order the operands.
+ */
+double estimateSelectivity(const std::string& cond) {
+    if (cond == "=") {
+        return 0.1;
+    } else if (cond == "like") {
+        return 0.3;
+    } else if (cond == "<>") {
+        return 0.9;
+    }
+    return 0.4;  // Relational conditions
+}
+
+/** Keep the rows that are in both of the given (ascending) rows. */
+void intersect(std::vector<size_t>& rows, const std::vector<size_t>& other) {
+    rows.erase(std::set_intersection(rows.begin(), rows.end(), other.begin(),
+                                     other.end(), rows.begin()), rows.end());
+}
+
+}  // namespace
+
+// A single condition has exactly 3 tokens after the where keyword
+bool Filter::isCompound(const StrVec& sql, const int whereIdx) {
+    return whereIdx + 4 != static_cast<int>(sql.size()) ||
+        sql[whereIdx + 1] == "(";
+}
+
+// Join the tokens after the where keyword
+std::string Filter::encode(const StrVec& sql, const int whereIdx) {
+    std::string clause;
+    for (size_t i = whereIdx + 1; i < sql.size(); i++) {
+        if (sql[i].find(Separator) != std::string::npos) {
+            throw Exp("Invalid character in where clause.");
+        }
+        clause += (clause.empty() ? "" : std::string(1, Separator)) + sql[i];
+    }
+    return clause;
+}
+
+// Split the clause into tokens and parse them
+Filter::Filter(const CSV& csv, const std::string& clause,
+               const std::string& qualifier) {
+    StrVec tokens;
+    for (size_t start = 0; !clause.empty(); ) {
+        const size_t end = clause.find(Separator, start);
+        tokens.push_back(clause.substr(start, end - start));
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+    size_t pos = 0;
+    root = parse(csv, tokens, pos, Node::Kind::Or, qualifier);
+    if (pos != tokens.size()) {
+        throw Exp("Invalid where clause in query");
+    }
+}
+
+// Parse operands separated by "or" (or "and"), flattening nested operands
+Filter::Node Filter::parse(const CSV& csv, const StrVec& tokens, size_t& pos,
+                           const Node::Kind kind,
+                           const std::string& qualifier) {
+    const std::string sep = (kind == Node::Kind::Or ? "or" : "and");
+    Node node;
+    node.kind = kind;
+    while (true) {
+        Node child = (kind == Node::Kind::Or ?
+                      parse(csv, tokens, pos, Node::Kind::And, qualifier) :
+                      parseOperand(csv, tokens, pos, qualifier));
+        if (child.kind == kind) {
+            std::move(child.children.begin(), child.children.end(),
+                      std::back_inserter(node.children));
+        } else {
+            node.children.push_back(std::move(child));
+        }
+        if (pos == tokens.size() || tokens[pos] != sep) {
+            break;
+        }
+        pos++;
+    }
+    if (node.children.size() == 1) {
+        return std::move(node.children.front());
+    }
+    // Check the operands most likely to decide the result first
+    double product = 1;
+    for (const Node& child : node.children) {
+        product *= (kind == Node::Kind::And ? child.selectivity :
+                    1 - child.selectivity);
+    }
+    node.selectivity = (kind == Node::Kind::And ? product : 1 - product);
+    std::stable_sort(node.children.begin(), node.children.end(),
+        [kind](const Node& lhs, const Node& rhs) {
+            return (kind == Node::Kind::And ?
+                    lhs.selectivity < rhs.selectivity :
+                    lhs.selectivity > rhs.selectivity);
+        });
+    return node;
+}
+
+// Parse "( <clause> )" or "<col> <cond> <value>"
+Filter::Node Filter::parseOperand(const CSV& csv, const StrVec& tokens,
+                                  size_t& pos, const std::string& qualifier) {
+    if (pos < tokens.size() && tokens[pos] == "(") {
+        Node node = parse(csv, tokens, ++pos, Node::Kind::Or, qualifier);
+        if (pos == tokens.size() || tokens[pos] != ")") {
+            throw Exp("Invalid where clause in query");
+        }
+        pos++;
+        return node;
+    }
+    if (pos + 3 > tokens.size()) {
+        throw Exp("Invalid where clause in query");
+    }
+    Node node;
+    node.colName = tokens[pos];
+    node.col = csv.getColumnIndex(node.colName);
+    if (node.col == -1 && !qualifier.empty() &&
+        node.colName.compare(0, qualifier.size() + 1, qualifier + ".") == 0) {
+        node.col = csv.getColumnIndex(node.colName.substr(qualifier.size() +
+                                                          1));
+    }
+    if (node.col == -1) {
+        throw Exp("Invalid column " + node.colName + " in where clause.");
+    }
+    const std::string& cond = tokens[pos + 1];
+    if (cond != "=" && cond != "<>" && cond != "like" && cond != "<" &&
+        cond != ">" && cond != "<=" && cond != ">=") {
+        throw Exp("Invalid condition " + cond + " in where clause.");
+    }
+    node.pred.emplace_back(cond, tokens[pos + 2]);
+    node.selectivity = estimateSelectivity(cond);
+    pos += 3;
+    return node;
+}
+
+// Check the operands in order, stopping once the result is known
+bool Filter::matches(const Node& node, const Table& table, const size_t row) {
+    switch (node.kind) {
+    case Node::Kind::Leaf:
+        return (table.isColumnar() ?
+                node.pred[0](table.getValue(row, node.col)) :
+                node.pred[0](table.getRowValue(row, node.col)));
+    case Node::Kind::And:
+        for (const Node& child : node.children) {
+            if (!matches(child, table, row)) {
+                return false;
+            }
+        }
+        return true;
+    default:
+        for (const Node& child : node.children) {
+            if (matches(child, table, row)) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+// An "and" needs one indexed operand, while an "or" needs all of them
+bool Filter::isIndexed(const Node& node, const Table& table) {
+    switch (node.kind) {
+    case Node::Kind::Leaf: {
+        // A "<>" condition matches most rows. So a scan is cheaper.
+        const std::string& cond = node.pred[0].getCond();
+        return cond != "<>" && Index::supports(cond) &&
+            table.getIndex(node.col) != nullptr;
+    }
+    case Node::Kind::And:
+        return std::any_of(node.children.begin(), node.children.end(),
+            [&table](const Node& child) { return isIndexed(child, table); });
+    default:
+        return std::all_of(node.children.begin(), node.children.end(),
+            [&table](const Node& child) { return isIndexed(child, table); });
+    }
+}
+
+// Intersect or merge the rows found via indexes
+void Filter::findRows(const Node& node, const Table& table,
+                      std::vector<size_t>& rows, size_t& scanned) {
+    if (node.kind == Node::Kind::Leaf) {
+        const Predicate& pred = node.pred[0];
+        table.getIndex(node.col)->find(pred.getCond(), pred.getValue(),
+                                       table.getRowCount(), rows);
+        scanned += rows.size();
+        return;
+    }
+    std::vector<size_t> other;
+    if (node.kind == Node::Kind::Or) {
+        rows.clear();
+        std::vector<size_t> merged;
+        for (const Node& child : node.children) {
+            findRows(child, table, other, scanned);
+            merged.clear();
+            std::set_union(rows.begin(), rows.end(), other.begin(),
+                           other.end(), std::back_inserter(merged));
+            rows.swap(merged);
+        }
+        return;
+    }
+    // The rows of the indexed operands (most selective first) are
+    // intersected and the remaining rows are checked against the others.
+    std::vector<const Node*> unindexed;
+    bool first = true;
+    for (const Node& child : node.children) {
+        if (!isIndexed(child, table)) {
+            unindexed.push_back(&child);
+        } else if (first) {
+            findRows(child, table, rows, scanned);
+            first = false;
+        } else if (!rows.empty()) {
+            findRows(child, table, other, scanned);
+            intersect(rows, other);
+        }
+    }
+    if (!unindexed.empty()) {
+        scanned += rows.size();
+        rows.erase(std::remove_if(rows.begin(), rows.end(),
+            [&](size_t row) {
+                return table.isDeleted(row) ||
+                    std::any_of(unindexed.begin(), unindexed.end(),
+                        [&](const Node* child) {
+                            return !matches(*child, table, row); });
+            }), rows.end());
+    }
+}
+
+// Use the indexes only if they avoid a scan of the table
+bool Filter::findIndexed(const Table& table, std::vector<size_t>& rows,
+                         size_t& scanned) const {
+    if (!isIndexed(root, table)) {
+        return false;
+    }
+    scanned = 0;
+    findRows(root, table, rows, scanned);
+    return true;
+}
+
+// List the indexed columns in the order used by findRows()
+void Filter::addIndexedColumns(const Node& node, const Table& table,
+                               StrVec& cols) {
+    if (node.kind == Node::Kind::Leaf) {
+        if (std::find(cols.begin(), cols.end(), node.colName) == cols.end()) {
+            cols.push_back(node.colName);
+        }
+        return;
+    }
+    for (const Node& child : node.children) {
+        if (isIndexed(child, table)) {
+            addIndexedColumns(child, table, cols);
+        }
+    }
+}
+
+// Obtain the indexed columns, if the indexes are used
+StrVec Filter::getIndexedColumns(const Table& table) const {
+    StrVec cols;
+    if (isIndexed(root, table)) {
+        addIndexedColumns(root, table, cols);
+    }
+    return cols;
+}
+
+// Write the conditions in the order in which they are checked
+void Filter::append(const Node& node, std::string& out) {
+    if (node.kind == Node::Kind::Leaf) {
+        out += node.colName + " " + node.pred[0].getCond() + " " +
+            node.pred[0].getValue();
+        return;
+    }
+    const char* const sep = (node.kind == Node::Kind::And ? " and " : " or ");
+    out += "(";
+    for (size_t i = 0; i < node.children.size(); i++) {
+        out += (i > 0 ? sep : "");
+        append(node.children[i], out);
+    }
+    out += ")";
+}
+
+// Convert the expression tree to a string
+std::string Filter::toString() const {
+    std::string out;
+    append(root, out);
+    return out;
+}
@@ -0,0 +1,247 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+/*
+ * A compiled form of compound where clauses, i.e., conditions combined with
+ * "and", "or", and parentheses.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <string>
+#include <vector>
+#include "Predicate.h"
+#include "Table.h"
+
+/**
+ * A compound where clause (e.g., "where country = 'Canada' and (altitude >
+ * 5000 or dst = 'N')") compiled into an expression tree. Each leaf of the
+ * tree is a single condition on a column, compiled into a Predicate. The
+ * usual precedence applies: "and" binds tighter than "or".
+ *
+ * Rows are checked with short-circuit evaluation. The operands of each
+ * "and" are checked in increasing order of their estimated selectivity
+ * (i.e., the operand most likely to be false first), and the operands of
+ * each "or" in decreasing order (the operand most likely to be true
+ * first). The selectivity of a condition is estimated from its operator.
+ *
+ * Indexes are used where possible (see findIndexed()): the rows matching
+ * indexed operands of an "and" are intersected (and only those rows are
+ * checked against the other operands), and the rows matching the operands
+ * of an "or" are merged if all of its operands can use indexes.
+ *
+ * Compound where clauses are passed through the existing query methods as
+ * a where clause on the column Filter::Column, with the condition
+ * Filter::Cond and the clause (see encode()) as the value. So query plans
+ * and logged statements need no other changes.
+ */
+class Filter {
+public:
+    /** The column (in place of a column index) for compound clauses. */
+    static constexpr int Column = -2;
+
+    /** The condition (in place of an operator) for compound clauses. */
+    static const std::string Cond;
+
+    /**
+     * Determine if the where clause in a query is compound, i.e., it is not
+     * just "where <col> <cond> <value>".
+     *
+     * @param sql The tokens of the query.
+     * @param whereIdx The index of the "where" token in sql.
+     *
+     * @return This method returns true if the where clause should be
+     * compiled into a Filter.
+     */
+    static bool isCompound(const StrVec& sql, const int whereIdx);
+
+    /**
+     * Encodes the tokens of a where clause into a single string, with the
+     * tokens separated by the ASCII unit separator. Quoted values have
+     * already been unquoted by the tokenizer, so this separator (and not a
+     * quote or white space) is used.
+     *
+     * @param sql The tokens of the query. The where clause is from the
+     * token after whereIdx to the end.
+     * @param whereIdx The index of the "where" token in sql.
+     *
+     * @return The encoded where clause.
+     *
+     * @exception This method throws Exp if a value contains the separator.
+     */
+    static std::string encode(const StrVec& sql, const int whereIdx);
+
+    /**
+     * Compiles an encoded where clause on the columns of a table.
+     *
+     * @param csv The table whose columns are referenced in the clause.
+     * @param clause The where clause returned by encode().
+     * @param qualifier The optional name by which columns may be qualified,
+     * e.g., "a" for "a.name" in a join (see SQLAir::joinQuery()).
+     *
+     * @exception This method throws Exp if the clause is not valid, e.g.,
+     * it has an unknown column or mismatched parentheses.
+     */
+    Filter(const CSV& csv, const std::string& clause,
+           const std::string& qualifier = "");
+
+    /**
+     * Checks if a row of a table satisfies this where clause.
+     *
+     * @param table The table with the row. The caller must hold a lock on
+     * the table.
+     * @param row The zero-based position of the row.
+     *
+     * @return This method returns true if the row satisfies the clause.
+     */
+    bool operator()(const Table& table, const size_t row) const {
+        return matches(root, table, row);
+    }
+
+    /**
+     * Finds the rows that satisfy this where clause using the indexes of a
+     * table, if the indexes suffice to avoid a scan of all the rows.
+     *
+     * @param table The table whose rows are found. The caller must hold a
+     * lock on the table.
+     * @param rows The vector set to the matching rows (which may include
+     * deleted rows, as indexes do), in ascending order.
+     * @param scanned The number of index entries and rows checked.
+     *
+     * @return This method returns false (without changing rows) if the
+     * table must be scanned instead.
+     */
+    bool findIndexed(const Table& table, std::vector<size_t>& rows,
+                     size_t& scanned) const;
+
+    /**
+     * Obtains the columns whose indexes are used by findIndexed().
+     *
+     * @param table The table whose indexes are checked.
+     *
+     * @return The distinct names of the columns, in the order in which
+     * their indexes are first used. This is empty if the table must be scanned.
+     */
+    StrVec getIndexedColumns(const Table& table) const;
+
+    /**
+     * Returns this where clause in the order in which conditions are
+     * checked, with parentheses around each "and" and "or", e.g.,
+     * "(iata = CVG or (country = Canada and altitude > 5000))".
+     *
+     * @return The where clause as a string.
+     */
+    std::string toString() const;
+
+private:
+    /** A node of the expression tree. */
+    struct Node {
+        /** The kinds of nodes. */
+        enum class Kind { Leaf, And, Or };
+
+        /** The kind of this node. */
+        Kind kind = Kind::Leaf;
+
+        /** The column of a leaf. */
+        int col = -1;
+
+        /** The name of the column of a leaf. */
+        std::string colName;
+
+        /** The compiled condition of a leaf (empty for other nodes). */
+        std::vector<Predicate> pred;
+
+        /** The operands of an "and" or "or", in the order checked. */
+        std::vector<Node> children;
+
+        /** The estimated fraction of rows satisfying this node. */
+        double selectivity = 1;
+    };
+
+    /**
+     * Parses the operands of "or" (or of "and") from the tokens, starting
+     * at a given position.
+     *
+     * @param csv The table whose columns are referenced.
+     * @param tokens The tokens of the where clause.
+     * @param pos The position of the next token, which is advanced past
+     * the tokens parsed.
+     * @param kind The kind of node to be parsed (Or or And).
+     * @param qualifier The optional qualifier of column names.
+     *
+     * @return The node parsed.
+     */
+    static Node parse(const CSV& csv, const StrVec& tokens, size_t& pos,
+                      const Node::Kind kind, const std::string& qualifier);
+
+    /**
+     * Parses a parenthesized clause or a single condition.
+     *
+     * @param csv The table whose columns are referenced.
+     * @param tokens The tokens of the where clause.
+     * @param pos The position of the next token, which is advanced past
+     * the tokens parsed.
+     * @param qualifier The optional qualifier of column names.
+     *
+     * @return The node parsed.
+     */
+    static Node parseOperand(const CSV& csv, const StrVec& tokens,
+                             size_t& pos, const std::string& qualifier);
+
+    /**
+     * Checks if a row satisfies a node, with short-circuit evaluation.
+     *
+     * @param node The node to be checked.
+     * @param table The table with the row.
+     * @param row The zero-based position of the row.
+     *
+     * @return This method returns true if the row satisfies the node.
+     */
+    static bool matches(const Node& node, const Table& table,
+                        const size_t row);
+
+    /**
+     * Determine if the rows satisfying a node can be found via indexes.
+     *
+     * @param node The node to be checked.
+     * @param table The table whose indexes are checked.
+     *
+     * @return This method returns true if findRows() can be used.
+     */
+    static bool isIndexed(const Node& node, const Table& table);
+
+    /**
+     * Finds the rows satisfying a node for which isIndexed() is true.
+     *
+     * @param node The node whose rows are found.
+     * @param table The table with the indexes.
+     * @param rows The vector set to the matching rows, in ascending order.
+     * @param scanned The number of index entries and rows checked is added
+     * to this value.
+     */
+    static void findRows(const Node& node, const Table& table,
+                         std::vector<size_t>& rows, size_t& scanned);
+
+    /**
+     * Adds the columns whose indexes are used to find the rows of a node.
+     *
+     * @param node The node for which isIndexed() is true.
+     * @param table The table whose indexes are checked.
+     * @param cols The names of the columns are added to this vector.
+     */
+    static void addIndexedColumns(const Node& node, const Table& table,
+                                  StrVec& cols);
+
+    /**
+     * Writes a node in the format of toString().
+     *
+     * @param node The node to be written.
+     * @param out The string to which the node is appended.
+     */
+    static void append(const Node& node, std::string& out);
+
+    /** The root of the expression tree. */
+    Node root;
+};
+
+#endif /* FILTER_H */
@@ -0,0 +1,309 @@
+/*
+ * A stream buffer that downloads a file from a web-server in a background
+ * thread, so that SQL-Air parses the data while it is being downloaded.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include "HttpDownload.h"
+
+#include <zlib.h>
+#include <algorithm>
+#include <cstdio>
+#include <future>
+#include <sstream>
+#include "CSV.h"
+#include "Helper.h"
+
+/**
+ * The size of the blocks in which the body of a response is read and
+ * queued for the reader.
+ */
+const size_t DownloadBlockBytes = 64 << 10;
+
+/**
+ * The maximum number of blocks downloaded ahead of the reader. The
+ * download pauses when the reader falls behind, so that memory used is
+ * bounded.
+ */
+const size_t DownloadQueueBlocks = 64;
+
+/**
+ * The size of each segment of a file requested via a range request. Files
+ * that are not larger than this size are downloaded via just one request.
+ */
+const uint64_t DownloadSegmentBytes = 8 << 20;
+
+/**
+ * The maximum number of connections used to download segments of a file
+ * concurrently.
+ */
+const size_t DownloadConnections = 4;
+
+/**
+ * The time for which a web-server may not send any data before the
+ * download is abandoned.
+ */
+const auto DownloadTimeout = std::chrono::seconds(30);
+
+// Start downloading the file in a background thread
+HttpDownloadBuf::HttpDownloadBuf(const std::string& host,
+    const std::string& port, const std::string& path) :
+    host(host), port(port), path(path) {
+    downloader = std::thread(&HttpDownloadBuf::download, this);
+}
+
+// Stop the download and wait for the background thread
+HttpDownloadBuf::~HttpDownloadBuf() {
+    {
+        std::scoped_lock<std::mutex> guard(mutex);
+        stopped = true;
+    }
+    space.notify_all();
+    if (downloader.joinable()) {
+        downloader.join();
+    }
+    if (inflater != nullptr) {
+        inflateEnd(inflater.get());
+    }
+}
+
+// Wait for the download to finish and report errors
+void HttpDownloadBuf::finish() {
+    if (downloader.joinable()) {
+        downloader.join();
+    }
+    if (error != nullptr) {
+        std::rethrow_exception(error);
+    }
+}
+
+// Move on to the next block downloaded by the background thread
+HttpDownloadBuf::int_type HttpDownloadBuf::underflow() {
+    std::unique_lock<std::mutex> lock(mutex);
+    ready.wait(lock, [this]() { return !blocks.empty() || done; });
+    if (blocks.empty()) {
+        return traits_type::eof();
+    }
+    current = std::move(blocks.front());
+    blocks.pop_front();
+    lock.unlock();
+    space.notify_one();
+    setg(current.data(), current.data(), current.data() + current.size());
+    return traits_type::to_int_type(current[0]);
+}
+
+// Add a block to the queue, waiting for the reader if the queue is full
+void HttpDownloadBuf::push(std::string&& block) {
+    std::unique_lock<std::mutex> lock(mutex);
+    space.wait(lock, [this]() {
+        return blocks.size() < DownloadQueueBlocks || stopped;
+    });
+    if (stopped) {
+        throw Exp("Download of " + path + " stopped");
+    }
+    blocks.push_back(std::move(block));
+    lock.unlock();
+    ready.notify_one();
+}
+
+// Decompress (if needed) and queue a block of the body
+void HttpDownloadBuf::deliver(const char* data, size_t len) {
+    if (inflater == nullptr) {
+        push(std::string(data, len));
+        return;
+    }
+    inflater->next_in  = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    inflater->avail_in = len;
+    while (inflater->avail_in > 0) {
+        if (inflated) {
+            // Concatenated gzip members are decompressed one after another.
+            inflateReset(inflater.get());
+            inflated = false;
+        }
+        std::string block(DownloadBlockBytes, '\0');
+        inflater->next_out  = reinterpret_cast<Bytef*>(block.data());
+        inflater->avail_out = block.size();
+        const int rc = inflate(inflater.get(), Z_NO_FLUSH);
+        if (rc != Z_OK && rc != Z_STREAM_END) {
+            throw Exp("Invalid compressed data in " + path + " from " +
+                      host + " at port " + port);
+        }
+        inflated = (rc == Z_STREAM_END);
+        block.resize(block.size() - inflater->avail_out);
+        if (!block.empty()) {
+            push(std::move(block));
+        }
+    }
+}
+
+// Connect to the web-server, request the file, and read the headers
+HttpDownloadBuf::Response HttpDownloadBuf::request(
+    boost::asio::ip::tcp::iostream& conn, const std::string& range) const {
+    conn.expires_after(DownloadTimeout);
+    conn.connect(host, port);
+    conn << "GET " << path << " HTTP/1.1\r\n"
+         << "Host: " << host << "\r\n"
+         << "Accept-Encoding: gzip\r\n"
+         << "Range: bytes=" << range << "\r\n"
+         << "Connection: Close\r\n\r\n" << std::flush;
+    if (!conn.good()) {
+        throw Exp("Unable to connect to " + host + " at port " + port);
+    }
+    std::string line, version;
+    std::getline(conn, line);
+    Response resp;
+    std::istringstream(line) >> version >> resp.code;
+    if (resp.code != 200 && resp.code != 206) {
+        throw Exp("Error (" + Helper::trim(line) + ") getting " + path +
+                  " from " + host + " at port " + port);
+    }
+    for (std::string hdr; std::getline(conn, hdr) && hdr != "" &&
+             hdr != "\r";) {
+        const size_t colon = hdr.find(':');
+        const std::string name = CSV::toLower(Helper::trim(hdr.substr(0,
+                                                                  colon)));
+        const std::string value = (colon == std::string::npos ? "" :
+            CSV::toLower(Helper::trim(hdr.substr(colon + 1))));
+        if (name == "content-length") {
+            resp.hasLength = true;
+            resp.length = std::stoull(value);
+        } else if (name == "transfer-encoding") {
+            resp.chunked = (value.find("chunked") != std::string::npos);
+        } else if (name == "content-encoding") {
+            resp.gzip = (value == "gzip" || value == "x-gzip");
+        } else if (name == "content-range") {
+            unsigned long long first, last, total;
+            if (std::sscanf(value.c_str(), "bytes %llu-%llu/%llu", &first,
+                            &last, &total) == 3) {
+                resp.start = first;
+                resp.total = total;
+            }
+        }
+    }
+    return resp;
+}
+
+// Read the body of a response, decoding chunked transfer encoding
+void HttpDownloadBuf::readBody(boost::asio::ip::tcp::iostream& conn,
+    const Response& resp,
+    const std::function<void(const char*, size_t)>& sink) const {
+    std::string buf(DownloadBlockBytes, '\0');
+    // Convenience lambda to read a given number of bytes (or up to the end
+    // of the body if the size is not known).
+    auto readBytes = [&](uint64_t len, bool toEnd) {
+        while (len > 0 || toEnd) {
+            conn.expires_after(DownloadTimeout);
+            conn.read(&buf[0], toEnd ? buf.size() :
+                      std::min<uint64_t>(len, buf.size()));
+            const size_t count = conn.gcount();
+            if (count == 0 && toEnd) {
+                return;
+            } else if (count == 0) {
+                throw Exp("Incomplete response getting " + path + " from " +
+                          host + " at port " + port);
+            }
+            sink(buf.data(), count);
+            len -= std::min<uint64_t>(len, count);
+        }
+    };
+    if (!resp.chunked) {
+        readBytes(resp.length, !resp.hasLength);
+        return;
+    }
+    // Each chunk is preceded by its size (in hex) and followed by a new
+    // line. The last chunk is empty and is followed by optional trailers.
+    for (std::string line; std::getline(conn, line);) {
+        const uint64_t size = std::strtoull(line.c_str(), nullptr, 16);
+        if (size == 0) {
+            while (std::getline(conn, line) && line != "" && line != "\r") {
+            }
+            return;
+        }
+        readBytes(size, false);
+        std::getline(conn, line);
+    }
+    throw Exp("Incomplete response getting " + path + " from " + host +
+              " at port " + port);
+}
+
+// Download a segment of the file via a separate connection
+std::string HttpDownloadBuf::fetchRange(uint64_t first, uint64_t last,
+                                        const Response& expected) const {
+    boost::asio::ip::tcp::iostream conn;
+    const Response resp = request(conn, std::to_string(first) + "-" +
+                                  std::to_string(last));
+    if (resp.code != 206 || resp.start != first ||
+        resp.total != expected.total || resp.gzip != expected.gzip) {
+        throw Exp("Unexpected response to range request for " + path +
+                  " from " + host + " at port " + port);
+    }
+    std::string data;
+    data.reserve(last - first + 1);
+    readBody(conn, resp, [&data](const char* block, size_t len) {
+        data.append(block, len);
+    });
+    if (data.size() != last - first + 1) {
+        throw Exp("Incomplete response getting " + path + " from " + host +
+                  " at port " + port);
+    }
+    return data;
+}
+
+// Download the file and queue its data for the reader
+void HttpDownloadBuf::download() {
+    try {
+        boost::asio::ip::tcp::iostream conn;
+        const Response resp = request(conn, "0-" +
+                                      std::to_string(DownloadSegmentBytes - 1));
+        if (resp.code == 206 && resp.start != 0) {
+            throw Exp("Unexpected response to range request for " + path +
+                      " from " + host + " at port " + port);
+        }
+        if (resp.gzip) {
+            inflater = std::make_unique<z_stream_s>();
+            if (inflateInit2(inflater.get(), 16 + MAX_WBITS) != Z_OK) {
+                inflater.reset();
+                throw Exp("Unable to decompress " + path);
+            }
+        }
+        // If the server supports ranges, the next few segments are
+        // downloaded while the first segment is being received.
+        std::deque<std::future<std::string>> segments;
+        uint64_t next = DownloadSegmentBytes;
+        auto requestSegments = [&]() {
+            while (resp.code == 206 && next < resp.total &&
+                   segments.size() + 1 < DownloadConnections) {
+                const uint64_t last = std::min(next + DownloadSegmentBytes,
+                                               resp.total) - 1;
+                segments.push_back(std::async(std::launch::async,
+                    &HttpDownloadBuf::fetchRange, this, next, last,
+                    std::cref(resp)));
+                next = last + 1;
+            }
+        };
+        requestSegments();
+        readBody(conn, resp, [this](const char* block, size_t len) {
+            deliver(block, len);
+        });
+        conn.close();
+        while (!segments.empty()) {
+            const std::string data = segments.front().get();
+            segments.pop_front();
+            requestSegments();
+            deliver(data.data(), data.size());
+        }
+        if (inflater != nullptr && !inflated) {
+            throw Exp("Incomplete compressed data in " + path + " from " +
+                      host + " at port " + port);
+        }
+    } catch (...) {
+        std::scoped_lock<std::mutex> guard(mutex);
+        error = std::current_exception();
+    }
+    {
+        std::scoped_lock<std::mutex> guard(mutex);
+        done = true;
+    }
+    ready.notify_all();
+}
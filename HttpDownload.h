@@ -0,0 +1,217 @@
+#ifndef HTTP_DOWNLOAD_H
+#define HTTP_DOWNLOAD_H
+
+/*
+ * A stream buffer that downloads a file from a web-server in a background
+ * thread, so that SQL-Air parses the data while it is being downloaded.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <boost/asio.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Forward declaration of zlib's decompression state to avoid its header.
+struct z_stream_s;
+
+/**
+ * A std::streambuf that reads the body of a file from a web-server. The
+ * file is downloaded by a background thread into a bounded queue of
+ * blocks, from which the stream is read. Hence, the data can be parsed
+ * (e.g., via CSV::load()) while the rest of the file is being received.
+ * In addition, this class:
+ *
+ *   1. Requests the file in segments (via HTTP range requests). If the
+ *      server supports ranges, several segments of a large file are
+ *      downloaded concurrently over separate connections. The segments
+ *      are read from the stream in order.
+ *   2. Decodes responses with "Transfer-Encoding: chunked".
+ *   3. Accepts and decompresses responses with "Content-Encoding: gzip".
+ *   4. Reports an error if the server does not send any data for a while.
+ *
+ * Typical usage is:
+ *
+ *     HttpDownloadBuf buf(host, port, path);
+ *     std::istream is(&buf);
+ *     csv.load(is);   // Parse the data as it is downloaded.
+ *     buf.finish();   // Report errors that occurred during the download.
+ */
+class HttpDownloadBuf : public std::streambuf {
+public:
+    /**
+     * Starts downloading a file from a web-server in a background thread.
+     *
+     * @param host The host name of the web-server.
+     * @param port The port number of the web-server.
+     * @param path The path to the file on the web-server.
+     */
+    HttpDownloadBuf(const std::string& host, const std::string& port,
+        const std::string& path);
+
+    /**
+     * Stops the download (if it is still in progress) and waits for the
+     * background thread to finish.
+     */
+    ~HttpDownloadBuf();
+
+    /**
+     * Waits for the download to finish. This method must be called after
+     * the stream has been read, as errors (e.g., a connection that was
+     * closed early) cannot be reported when the stream is read. Instead,
+     * the stream just ends early and the error is reported here.
+     *
+     * @exception This method rethrows the error, if any, that occurred
+     * when downloading the file.
+     */
+    void finish();
+
+protected:
+    /**
+     * Called when the current block has been read, to move on to the next
+     * block downloaded by the background thread. This method waits for
+     * the block to be downloaded, if needed.
+     *
+     * @return The next character or EOF at the end of the file.
+     */
+    int_type underflow() override;
+
+private:
+    /** The status and the relevant headers of a response. */
+    struct Response {
+        /** The status code, i.e., 200 (OK) or 206 (Partial Content). */
+        int code = 0;
+
+        /** Flag to indicate if the size of the body is known. */
+        bool hasLength = false;
+
+        /** The value of the "Content-Length" header, if any. */
+        uint64_t length = 0;
+
+        /** Flag to indicate if the body uses chunked transfer encoding. */
+        bool chunked = false;
+
+        /** Flag to indicate if the body is compressed via gzip. */
+        bool gzip = false;
+
+        /** The first byte and the size of the file from "Content-Range". */
+        uint64_t start = 0, total = 0;
+    };
+
+    /**
+     * Connects to the web-server, sends a request for the file, and reads
+     * the status line and headers of the response.
+     *
+     * @param conn The stream to be connected to the web-server.
+     * @param range The range of bytes to be requested (e.g., "0-99"), which
+     * is used by the server only if it supports ranges.
+     *
+     * @return The status and headers of the response.
+     *
+     * @exception This method throws an exception if the connection fails
+     * or if the status is not 200 or 206.
+     */
+    Response request(boost::asio::ip::tcp::iostream& conn,
+        const std::string& range) const;
+
+    /**
+     * Reads the body of a response. The body is passed to a function in
+     * blocks, after chunked transfer encoding (if any) is decoded.
+     *
+     * @param conn The stream from which the body is to be read.
+     * @param resp The headers of the response.
+     * @param sink The function to be called with each block of the body.
+     *
+     * @exception This method throws an exception if the body is incomplete
+     * (e.g., due to a timeout).
+     */
+    void readBody(boost::asio::ip::tcp::iostream& conn, const Response& resp,
+        const std::function<void(const char*, size_t)>& sink) const;
+
+    /**
+     * Downloads a segment of the file via a separate connection. This
+     * method is run concurrently for different segments.
+     *
+     * @param first The first byte in the segment.
+     * @param last The last byte in the segment.
+     * @param expected The response to the first request. The response for
+     * the segment must have the same encoding and file size.
+     *
+     * @return The (possibly compressed) data in the segment.
+     */
+    std::string fetchRange(uint64_t first, uint64_t last,
+        const Response& expected) const;
+
+    /**
+     * The method run by the background thread to download the file. The
+     * first segment of the file is requested first. If the server supports
+     * ranges, then subsequent segments are downloaded concurrently.
+     */
+    void download();
+
+    /**
+     * Decompresses (if needed) a block of the body and adds the data to
+     * the queue of blocks to be read.
+     *
+     * @param data The block of the (possibly compressed) body.
+     * @param len The number of bytes in the block.
+     */
+    void deliver(const char* data, size_t len);
+
+    /**
+     * Adds a block to the queue of blocks to be read, waiting if the queue
+     * is full.
+     *
+     * @param block The block to be added.
+     *
+     * @exception This method throws an exception if the download has been
+     * stopped by the destructor.
+     */
+    void push(std::string&& block);
+
+    /** The host name, port, and path of the file being downloaded. */
+    const std::string host, port, path;
+
+    /** The decompression state used if the response is compressed. */
+    std::unique_ptr<z_stream_s> inflater;
+
+    /** Flag to indicate if the end of the compressed data was reached. */
+    bool inflated = false;
+
+    /** The blocks downloaded but not yet read. */
+    std::deque<std::string> blocks;
+
+    /** The block currently being read from the stream. */
+    std::string current;
+
+    /** Flag to indicate if all the blocks have been downloaded. */
+    bool done = false;
+
+    /** Flag set by the destructor to stop downloading. */
+    bool stopped = false;
+
+    /** The error, if any, that ended the download. */
+    std::exception_ptr error;
+
+    /** The mutex to protect the queue of blocks and the flags. */
+    std::mutex mutex;
+
+    /** The condition variable on which the reader waits for blocks. */
+    std::condition_variable ready;
+
+    /** The condition variable on which the downloader waits for space. */
+    std::condition_variable space;
+
+    /** The background thread that downloads the file. */
+    std::thread downloader;
+};
+
+#endif /* HTTP_DOWNLOAD_H */
@@ -0,0 +1,212 @@
+/*
+ * A secondary index on a column of a table in SQL-Air. Indexes are created
+ * via the "create index on <file>(<col>)" statement.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include "Index.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+
+// Check if a string is a finite number
+bool Index::toNumber(const std::string& str, double& val) {
+    if (str.empty()) {
+        return false;
+    }
+    errno = 0;
+    char* end = nullptr;
+    val = std::strtod(str.c_str(), &end);
+    return (errno == 0 && end == str.c_str() + str.size() &&
+            std::isfinite(val));
+}
+
+// Compare values numerically if both are numbers, otherwise as strings.
+int Index::compare(const std::string& lhs, const std::string& rhs) {
+    double lval, rval;
+    if (toNumber(lhs, lval) && toNumber(rhs, rval)) {
+        return (lval < rval ? -1 : (lval > rval ? 1 : 0));
+    }
+    const int cmp = lhs.compare(rhs);
+    return (cmp < 0 ? -1 : (cmp > 0 ? 1 : 0));
+}
+
+// Check if the result of a comparison satisfies a relational condition
+bool Index::satisfies(int cmp, const std::string& cond) {
+    if (cond == "<") {
+        return cmp < 0;
+    } else if (cond == "<=") {
+        return cmp <= 0;
+    } else if (cond == ">") {
+        return cmp > 0;
+    }
+    return (cond == ">=" && cmp >= 0);
+}
+
+// Check if this index can be used to evaluate a given condition
+bool Index::supports(const std::string& cond) {
+    return (cond == "=" || cond == "<>" || cond == "<" || cond == ">" ||
+            cond == "<=" || cond == ">=");
+}
+
+// Add an entry for a given row
+void Index::add(const std::string& value, size_t row) {
+    hash[value].push_back(row);
+    double num;
+    if (toNumber(value, num)) {
+        numbers.emplace(num, row);
+    } else {
+        texts.emplace(value, row);
+    }
+}
+
+// Remove the entry for a given row
+void Index::remove(const std::string& value, size_t row) {
+    const auto entry = hash.find(value);
+    if (entry == hash.end()) {
+        return;  // The row was not indexed under this value.
+    }
+    auto& rows = entry->second;
+    rows.erase(std::remove(rows.begin(), rows.end(), row), rows.end());
+    if (rows.empty()) {
+        hash.erase(entry);
+    }
+    // Convenience lambda to remove the row from an ordered index
+    auto removeFrom = [row](auto& ordered, const auto& key) {
+        const auto range = ordered.equal_range(key);
+        for (auto curr = range.first; curr != range.second; curr++) {
+            if (curr->second == row) {
+                ordered.erase(curr);
+                return;
+            }
+        }
+    };
+    double num;
+    if (toNumber(value, num)) {
+        removeFrom(numbers, num);
+    } else {
+        removeFrom(texts, value);
+    }
+}
+
+// Remove all entries
+void Index::clear() {
+    hash.clear();
+    numbers.clear();
+    texts.clear();
+}
+
+// Count each hash node as its entry plus a link and a cached hash, and each
+// tree node as its entry plus the color and three links
+size_t Index::getMemoryBytes() const {
+    const size_t inlineChars = std::string().capacity();
+    auto heapBytes = [inlineChars](const std::string& str) {
+        return (str.capacity() > inlineChars ? str.capacity() + 1 : 0);
+    };
+    size_t bytes = hash.bucket_count() * sizeof(void*) +
+        hash.size() * (sizeof(*hash.begin()) + 2 * sizeof(void*)) +
+        numbers.size() * (sizeof(*numbers.begin()) + 4 * sizeof(void*)) +
+        texts.size() * (sizeof(*texts.begin()) + 4 * sizeof(void*));
+    for (const auto& entry : hash) {
+        bytes += heapBytes(entry.first) +
+            entry.second.capacity() * sizeof(size_t);
+    }
+    for (const auto& entry : texts) {
+        bytes += heapBytes(entry.first);
+    }
+    return bytes;
+}
+
+// Find the rows that satisfy a given condition
+void Index::find(const std::string& cond, const std::string& value,
+                 size_t rowCount, std::vector<size_t>& rows) const {
+    rows.clear();
+    const auto entry = hash.find(value);
+    if (cond == "=") {
+        if (entry != hash.end()) {
+            rows.assign(entry->second.begin(), entry->second.end());
+        }
+    } else if (cond == "<>") {
+        std::vector<char> equal(rowCount);
+        if (entry != hash.end()) {
+            for (const size_t row : entry->second) {
+                equal[row] = 1;
+            }
+        }
+        for (size_t row = 0; row < rowCount; row++) {
+            if (!equal[row]) {
+                rows.push_back(row);
+            }
+        }
+        return;
+    } else {
+        // Convenience lambda to add rows in a range of an ordered index
+        // that satisfies the relational condition with the given key.
+        auto addRange = [&rows, &cond](const auto& ordered, const auto& key) {
+            auto first = ordered.begin(), last = ordered.end();
+            if (cond == "<") {
+                last  = ordered.lower_bound(key);
+            } else if (cond == "<=") {
+                last  = ordered.upper_bound(key);
+            } else if (cond == ">") {
+                first = ordered.upper_bound(key);
+            } else {
+                first = ordered.lower_bound(key);
+            }
+            for (; first != last; first++) {
+                rows.push_back(first->second);
+            }
+        };
+        // Non-numbers are always compared as strings.
+        addRange(texts, value);
+        double num;
+        if (toNumber(value, num)) {
+            addRange(numbers, num);
+        } else {
+            // Numbers are compared as strings with a non-numeric value.
+            for (const auto& distinct : hash) {
+                double ignored;
+                if (toNumber(distinct.first, ignored) &&
+                    satisfies(compare(distinct.first, value), cond)) {
+                    rows.insert(rows.end(), distinct.second.begin(),
+                                distinct.second.end());
+                }
+            }
+        }
+    }
+    std::sort(rows.begin(), rows.end());
+}
+
+// Visit the rows in the order of their values, with ties in row order
+void Index::forEachOrdered(bool descending,
+                           const std::function<bool(size_t)>& visit) const {
+    std::vector<size_t> ties;
+    // Convenience lambda to visit the rows in a range of an ordered index,
+    // a group of equal values at a time. Returns false if visit stopped.
+    auto walk = [&](auto first, const auto last) {
+        while (first != last) {
+            ties.clear();
+            const auto& key = first->first;
+            for (; first != last && first->first == key; first++) {
+                ties.push_back(first->second);
+            }
+            std::sort(ties.begin(), ties.end());
+            for (const size_t row : ties) {
+                if (!visit(row)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+    if (descending) {
+        walk(texts.rbegin(), texts.rend()) &&
+            walk(numbers.rbegin(), numbers.rend());
+    } else {
+        walk(numbers.begin(), numbers.end()) &&
+            walk(texts.begin(), texts.end());
+    }
+}
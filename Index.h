@@ -0,0 +1,149 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+/*
+ * A secondary index on a column of a table in SQL-Air. Indexes are created
+ * via the "create index on <file>(<col>)" statement.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A secondary index on one column of a table. The index maps the values in
+ * the column to the zero-based positions of the rows containing them. Two
+ * look-up structures are maintained:
+ *
+ *   1. A hash index used for the "=" and "<>" conditions.
+ *   2. An ordered index used for the "<", ">", "<=", and ">=" conditions.
+ *      These conditions compare values numerically if both values are
+ *      numbers and as strings otherwise (see compare()). To be consistent
+ *      with these semantics, numeric and non-numeric values are ordered
+ *      separately.
+ *
+ * @note This class does not perform any locking. The index is part of a
+ * Table and is protected by the table's tableMutex.
+ */
+class Index {
+public:
+    /**
+     * Adds an entry for a given row to this index.
+     *
+     * @param value The value in the indexed column of the row.
+     * @param row The zero-based position of the row in the table.
+     */
+    void add(const std::string& value, size_t row);
+
+    /**
+     * Removes the entry for a given row from this index. This method is
+     * used when the value in the indexed column of a row is updated.
+     *
+     * @param value The value in the indexed column of the row.
+     * @param row The zero-based position of the row in the table.
+     */
+    void remove(const std::string& value, size_t row);
+
+    /**
+     * Removes all the entries in this index.
+     */
+    void clear();
+
+    /**
+     * Estimates the memory used by this index, i.e., its hash and ordered
+     * entries along with the copies of the values in them.
+     *
+     * @return The approximate number of bytes allocated by this index.
+     */
+    size_t getMemoryBytes() const;
+
+    /**
+     * Determines if this index can be used to evaluate a given condition.
+     *
+     * @param cond The condition in the where clause.
+     *
+     * @return This method returns true if cond is one of "=", "<>", "<",
+     * ">", "<=", or ">=".
+     */
+    static bool supports(const std::string& cond);
+
+    /**
+     * Returns the rows whose value in the indexed column satisfies a given
+     * condition.
+     *
+     * @param cond The condition to be checked. It must be one of the
+     * conditions for which supports() returns true.
+     * @param value The value specified by the user in the where clause.
+     * @param rowCount The number of rows in the table. This is used to
+     * determine the rows for the "<>" condition.
+     * @param rows The vector set to the zero-based positions of the matching
+     * rows, in ascending order. Its existing contents are replaced, but
+     * its memory is reused.
+     */
+    void find(const std::string& cond, const std::string& value,
+        size_t rowCount, std::vector<size_t>& rows) const;
+
+    /**
+     * Visits the rows of the table in the order of their values in the
+     * indexed column, as used by order by clauses (see RowOrder): numbers
+     * (in numeric order) before other values (in string order), or the
+     * reverse if the order is descending. Rows with equal values are
+     * visited in ascending order of their positions.
+     *
+     * @param descending Flag to indicate if the order is descending.
+     * @param visit The function called with the zero-based position of each
+     * row. The walk stops once this function returns false.
+     */
+    void forEachOrdered(bool descending,
+        const std::function<bool(size_t row)>& visit) const;
+
+    /**
+     * Compares two values using the semantics of the "<", ">", "<=", and
+     * ">=" conditions. Values are compared numerically if both values are
+     * numbers. Otherwise, the values are compared as strings.
+     *
+     * @param lhs The value on the left-hand-side of the comparison.
+     * @param rhs The value on the right-hand-side of the comparison.
+     *
+     * @return A negative value, zero, or a positive value if lhs is less
+     * than, equal to, or greater than rhs respectively.
+     */
+    static int compare(const std::string& lhs, const std::string& rhs);
+
+    /**
+     * Checks if the result of compare() satisfies a given relational
+     * condition.
+     *
+     * @param cmp The result from compare().
+     * @param cond One of "<", ">", "<=", or ">=".
+     *
+     * @return This method returns true if the condition is satisfied.
+     */
+    static bool satisfies(int cmp, const std::string& cond);
+
+    /**
+     * Convenience method to check if a string is a (finite) number.
+     *
+     * @param str The string to be checked.
+     * @param val The numeric value, if the string is a number.
+     *
+     * @return This method returns true if all of str is a number.
+     */
+    static bool toNumber(const std::string& str, double& val);
+
+private:
+    /** The hash index from each value to the rows containing it. */
+    std::unordered_map<std::string, std::vector<size_t>> hash;
+
+    /** The ordered index for the values that are numbers. */
+    std::multimap<double, size_t> numbers;
+
+    /** The ordered index for the values that are not numbers. */
+    std::multimap<std::string, size_t> texts;
+};
+
+#endif /* INDEX_H */
@@ -0,0 +1,110 @@
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+/*
+ * A bounded, MT-safe cache with least-recently-used (LRU) eviction. This is
+ * used by SQL-Air to cache query plans and the results of queries.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * A bounded cache from strings to values with least-recently-used (LRU)
+ * eviction. Values are returned by copy. Hence, large values are typically
+ * held via std::shared_ptr so that an evicted value remains valid while it
+ * is in use.
+ *
+ * @note This class is MT-safe. All operations are protected by a mutex.
+ *
+ * @tparam Value The type of values in the cache. It must be default
+ * constructible and copyable.
+ */
+template<typename Value>
+class LruCache {
+public:
+    /**
+     * Creates an empty cache.
+     *
+     * @param capacity The maximum number of entries in the cache. A value
+     * of zero disables caching.
+     */
+    explicit LruCache(const size_t capacity) : capacity(capacity) {}
+
+    /**
+     * Obtain the value for a given key, marking it as recently used.
+     *
+     * @param key The key to be looked up.
+     * @param value The value for the key, if it is in the cache.
+     *
+     * @return This method returns true if the key is in the cache.
+     */
+    bool find(const std::string& key, Value& value) {
+        std::scoped_lock<std::mutex> guard(mutex);
+        const auto entry = positions.find(key);
+        if (entry == positions.end()) {
+            return false;
+        }
+        entries.splice(entries.begin(), entries, entry->second);
+        value = entry->second->second;
+        return true;
+    }
+
+    /**
+     * Adds (or replaces) the value for a given key. The least recently used
+     * entry is evicted if the cache is full.
+     *
+     * @param key The key whose value is to be set.
+     * @param value The value for the key.
+     */
+    void insert(const std::string& key, Value value) {
+        if (capacity == 0) {
+            return;
+        }
+        std::scoped_lock<std::mutex> guard(mutex);
+        const auto entry = positions.find(key);
+        if (entry != positions.end()) {
+            entry->second->second = std::move(value);
+            entries.splice(entries.begin(), entries, entry->second);
+            return;
+        }
+        if (entries.size() >= capacity) {
+            positions.erase(entries.back().first);
+            entries.pop_back();
+        }
+        entries.emplace_front(key, std::move(value));
+        positions.emplace(key, entries.begin());
+    }
+
+    /**
+     * Removes all the entries from this cache.
+     */
+    void clear() {
+        std::scoped_lock<std::mutex> guard(mutex);
+        positions.clear();
+        entries.clear();
+    }
+
+private:
+    /** The entries in the cache, with the most recently used first. */
+    using Entries = std::list<std::pair<std::string, Value>>;
+
+    /** The maximum number of entries in the cache. */
+    const size_t capacity;
+
+    /** The entries in the cache, in the order in which they were used. */
+    Entries entries;
+
+    /** The position of each entry in the entries list. */
+    std::unordered_map<std::string, typename Entries::iterator> positions;
+
+    /** The mutex to protect entries and positions. */
+    std::mutex mutex;
+};
+
+#endif /* LRU_CACHE_H */
@@ -0,0 +1,40 @@
+/*
+ * A read-only memory mapping of a local file. This is used by SQL-Air to
+ * load large CSV files without copying their contents.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Map the file into memory, leaving addr as nullptr on errors
+MappedFile::MappedFile(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* const ptr = ::mmap(nullptr, info.st_size, PROT_READ,
+                                 MAP_PRIVATE, fd, 0);
+        if (ptr != MAP_FAILED) {
+            addr = ptr;
+            size = info.st_size;
+            // The file is mostly read sequentially when it is loaded.
+            ::madvise(addr, size, MADV_SEQUENTIAL);
+        }
+    }
+    ::close(fd);  // The mapping remains valid after the file is closed.
+}
+
+// Unmap the file, if it was mapped
+MappedFile::~MappedFile() {
+    if (addr != nullptr) {
+        ::munmap(addr, size);
+    }
+}
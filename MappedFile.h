@@ -0,0 +1,66 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+/*
+ * A read-only memory mapping of a local file. This is used by SQL-Air to
+ * load large CSV files without copying their contents.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <string>
+#include <string_view>
+
+/**
+ * A read-only, private memory mapping of a local file. The file is mapped
+ * when this object is created and unmapped when it is destroyed. Hence,
+ * views into the data remain valid for the lifetime of this object.
+ * Objects of this class are typically shared (via std::shared_ptr) by the
+ * data structures that hold views into the mapping.
+ */
+class MappedFile {
+public:
+    /**
+     * Maps a given file into memory. Use isOpen() to check if the file was
+     * successfully mapped.
+     *
+     * @param path The path to the local file to be mapped.
+     */
+    explicit MappedFile(const std::string& path);
+
+    /**
+     * Unmaps the file.
+     */
+    ~MappedFile();
+
+    // Mappings cannot be copied as they own the mapped memory.
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * Determine if the file was successfully mapped. Files that cannot be
+     * opened, are empty, or are not regular files are not mapped.
+     *
+     * @return This method returns true if the file was mapped.
+     */
+    bool isOpen() const { return addr != nullptr; }
+
+    /**
+     * Obtain the contents of the mapped file.
+     *
+     * @return A view of the whole file. The view is empty if the file was
+     * not mapped.
+     */
+    std::string_view data() const {
+        return std::string_view(static_cast<const char*>(addr), size);
+    }
+
+private:
+    /** The address at which the file is mapped, or nullptr on errors. */
+    void* addr = nullptr;
+
+    /** The size of the mapped file in bytes. */
+    size_t size = 0;
+};
+
+#endif /* MAPPED_FILE_H */
@@ -0,0 +1,184 @@
+/*
+ * Low-overhead counters and latency histograms of the work done by SQL-Air,
+ * reported in the Prometheus text format via the "/stats" endpoint.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include "Metrics.h"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+std::atomic<int> Metrics::waiters{0};
+std::atomic<uint64_t> Metrics::tableBytes{0};
+
+namespace {
+
+/**
+ * The upper bounds (in seconds) of the buckets of the latency histograms.
+ * The last bucket ("+Inf") has the latencies above the last bound.
+ */
+const double BucketBounds[Metrics::NumBuckets] = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1,
+    0.25, 0.5, 1, 2.5, 5, 10};
+
+/** The names of the statements in Metrics::Statement order. */
+const char* const StatementNames[Metrics::NumStatements] = {
+    "select", "aggregate", "update", "insert", "delete"};
+
+/** The slots of the threads that are running and of those that exited. */
+struct Registry {
+    std::mutex mutex;
+    std::vector<const Metrics::Slot*> slots;
+    Metrics::Slot retired;
+};
+
+/**
+ * Obtain the registry of slots. It is never destroyed, as threads (e.g.,
+ * detached client threads) may still exit during static destruction.
+ */
+Registry& getRegistry() {
+    static Registry* const registry = new Registry();
+    return *registry;
+}
+
+/** Add the values in one slot to another slot. */
+void addTo(Metrics::Slot& total, const Metrics::Slot& slot) {
+    // Convenience lambda to add one value
+    auto add = [](std::atomic<uint64_t>& sum,
+                  const std::atomic<uint64_t>& val) {
+        sum.fetch_add(val.load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+    };
+    for (int i = 0; i < Metrics::NumCounters; i++) {
+        add(total.counters[i], slot.counters[i]);
+    }
+    for (int stmt = 0; stmt < Metrics::NumStatements; stmt++) {
+        for (int b = 0; b <= Metrics::NumBuckets; b++) {
+            add(total.buckets[stmt][b], slot.buckets[stmt][b]);
+        }
+        add(total.latencies[stmt], slot.latencies[stmt]);
+    }
+}
+
+/** The slot of a thread, which is registered while the thread runs. */
+struct ThreadSlot {
+    Metrics::Slot slot;
+
+    ThreadSlot() {
+        Registry& registry = getRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.slots.push_back(&slot);
+    }
+
+    ~ThreadSlot() {
+        Registry& registry = getRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        addTo(registry.retired, slot);
+        registry.slots.erase(std::find(registry.slots.begin(),
+                                       registry.slots.end(), &slot));
+    }
+};
+
+}  // namespace
+
+// The slot is created (and registered) on the first use by each thread
+Metrics::Slot& Metrics::local() {
+    thread_local ThreadSlot threadSlot;
+    return threadSlot.slot;
+}
+
+// Add the latency to its bucket and to the total latency
+void Metrics::record(const Statement stmt, const uint64_t nanos) {
+    Slot& slot = local();
+    const double secs = nanos / 1e9;
+    const int bucket = std::lower_bound(BucketBounds, BucketBounds +
+                                        NumBuckets, secs) - BucketBounds;
+    increment(slot.buckets[stmt][bucket], 1);
+    increment(slot.latencies[stmt], nanos);
+}
+
+// Add up the slots and write them in the Prometheus text format
+void Metrics::write(std::ostream& os) {
+    Slot total;
+    {
+        Registry& registry = getRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        addTo(total, registry.retired);
+        for (const Slot* slot : registry.slots) {
+            addTo(total, *slot);
+        }
+    }
+    // Convenience lambda to write a metric with a single value
+    auto metric = [&os](const char* name, const char* type,
+                        const char* help, const auto value) {
+        os << "# HELP sqlair_" << name << ' ' << help << "\n# TYPE sqlair_"
+           << name << ' ' << type << "\nsqlair_" << name << ' ' << value
+           << '\n';
+    };
+    auto count = [&total](const Counter counter) {
+        return total.counters[counter].load();
+    };
+    auto secs = [&count](const Counter counter) {
+        return count(counter) / 1e9;
+    };
+    os << "# HELP sqlair_statement_duration_seconds Latency of statements.\n"
+       << "# TYPE sqlair_statement_duration_seconds histogram\n";
+    for (int stmt = 0; stmt < NumStatements; stmt++) {
+        const std::string labels =
+            std::string("{statement=\"") + StatementNames[stmt] + "\"";
+        uint64_t cumulative = 0;
+        for (int b = 0; b <= NumBuckets; b++) {
+            cumulative += total.buckets[stmt][b].load();
+            os << "sqlair_statement_duration_seconds_bucket" << labels
+               << ",le=\"";
+            if (b < NumBuckets) {
+                os << BucketBounds[b];
+            } else {
+                os << "+Inf";
+            }
+            os << "\"} " << cumulative << '\n';
+        }
+        os << "sqlair_statement_duration_seconds_sum" << labels << "} "
+           << total.latencies[stmt].load() / 1e9 << '\n'
+           << "sqlair_statement_duration_seconds_count" << labels << "} "
+           << cumulative << '\n';
+    }
+    metric("rows_scanned_total", "counter",
+           "Rows (or index entries) checked by queries.", count(RowsScanned));
+    metric("rows_matched_total", "counter",
+           "Rows that satisfied the where clauses of queries.",
+           count(RowsMatched));
+    metric("rows_inserted_total", "counter", "Rows inserted.",
+           count(RowsInserted));
+    metric("rows_deleted_total", "counter", "Rows deleted.",
+           count(RowsDeleted));
+    metric("lock_wait_seconds_total", "counter",
+           "Time spent acquiring table locks.", secs(LockWaitNanos));
+    metric("scan_seconds_total", "counter",
+           "Time spent finding the rows for queries.", secs(ScanNanos));
+    metric("table_loads_total", "counter", "Tables loaded.",
+           count(TableLoads));
+    metric("table_load_seconds_total", "counter",
+           "Time spent loading tables.", secs(TableLoadNanos));
+    metric("table_evictions_total", "counter",
+           "Tables evicted to stay within the memory budget.",
+           count(TableEvictions));
+    metric("table_memory_bytes", "gauge",
+           "Estimated memory used by the tables in memory.",
+           tableBytes.load());
+    metric("waiters", "gauge", "Queries waiting for rows to change.",
+           waiters.load());
+    metric("waiter_wakeups_total", "counter",
+           "Times waiting queries were woken up.", count(WaiterWakeups));
+    metric("result_cache_hits_total", "counter",
+           "Queries answered from the result cache.", count(ResultCacheHits));
+    os << "# HELP sqlair_http_requests_total HTTP requests by kind.\n"
+       << "# TYPE sqlair_http_requests_total counter\n"
+       << "sqlair_http_requests_total{kind=\"query\"} " << count(HttpQueries)
+       << "\nsqlair_http_requests_total{kind=\"file\"} " << count(HttpFiles)
+       << "\nsqlair_http_requests_total{kind=\"stats\"} " << count(HttpStats)
+       << '\n';
+}
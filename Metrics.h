@@ -0,0 +1,200 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/*
+ * Low-overhead counters and latency histograms of the work done by SQL-Air,
+ * reported in the Prometheus text format via the "/stats" endpoint.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+/**
+ * The metrics of this process. Each thread updates its own set of counters
+ * (a slot), so that updates on the hot paths of queries are just an
+ * uncontended load and store of a relaxed atomic, without any locks or
+ * shared cache lines. The slots of all threads are added up only when the
+ * metrics are read (see write()). The counters of threads that exit are
+ * added to a retired slot, so that they are not lost.
+ *
+ * The methods of this class are static as the slots are per thread (and
+ * not per SQLAir object).
+ */
+class Metrics {
+public:
+    /** The counters of events (or amounts of time) that only increase. */
+    enum Counter {
+        RowsScanned,      ///< Rows (or index entries) checked by queries
+        RowsMatched,      ///< Rows that satisfied the where clauses
+        RowsInserted,     ///< Rows added by insert statements
+        RowsDeleted,      ///< Rows removed by delete statements
+        LockWaitNanos,    ///< Time spent acquiring table locks
+        ScanNanos,        ///< Time spent finding the rows for queries
+        TableLoads,       ///< Tables loaded from files or URLs
+        TableLoadNanos,   ///< Time spent loading tables
+        TableEvictions,   ///< Tables evicted to stay within the budget
+        WaiterWakeups,    ///< Times waiting queries were woken up
+        HttpQueries,      ///< HTTP requests with queries
+        HttpFiles,        ///< HTTP requests for files
+        HttpStats,        ///< HTTP requests for these metrics
+        ResultCacheHits,  ///< Queries answered from the result cache
+        NumCounters
+    };
+
+    /** The kinds of statements whose latencies are recorded. */
+    enum Statement { Select, Aggregate, Update, Insert, Delete,
+                     NumStatements };
+
+    /** The number of (finite) upper bounds of the latency histograms. */
+    static constexpr int NumBuckets = 16;
+
+    /**
+     * Adds a given amount to a counter of the calling thread.
+     *
+     * @param counter The counter to be increased.
+     * @param amount The amount to be added.
+     */
+    static void add(const Counter counter, const uint64_t amount = 1) {
+        increment(local().counters[counter], amount);
+    }
+
+    /**
+     * Obtains the value of a counter of the calling thread (and not of all
+     * threads), e.g., to find the work done by a statement.
+     *
+     * @param counter The counter whose value is returned.
+     *
+     * @return The value of the counter.
+     */
+    static uint64_t get(const Counter counter) {
+        return local().counters[counter].load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Obtains the current time, for use with the elapsed() method.
+     *
+     * @return The time from a monotonic clock, in nanoseconds.
+     */
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * Adds the time elapsed since a given start time to a counter, e.g.,
+     * the time waited for a lock.
+     *
+     * @param counter The counter (of nanoseconds) to be increased.
+     * @param start The start time, from now().
+     */
+    static void elapsed(const Counter counter, const uint64_t start) {
+        add(counter, now() - start);
+    }
+
+    /**
+     * Records the latency of a statement in its histogram.
+     *
+     * @param stmt The kind of statement.
+     * @param nanos The latency of the statement, in nanoseconds.
+     */
+    static void record(const Statement stmt, const uint64_t nanos);
+
+    /**
+     * Changes the number of queries that are waiting (e.g., "wait select")
+     * for rows to be changed. This is a gauge shared by all threads, as
+     * waiters are not frequent.
+     *
+     * @param delta The change in the number of waiting queries.
+     */
+    static void addWaiters(const int delta) { waiters += delta; }
+
+    /**
+     * Sets the estimated memory used by the tables in memory. This gauge
+     * is updated only if SQLAir has a memory budget (see
+     * SQLAir::setMemoryBudget()).
+     *
+     * @param bytes The memory used by all the tables.
+     */
+    static void setTableBytes(const uint64_t bytes) { tableBytes = bytes; }
+
+    /**
+     * Writes the metrics (added up over all threads) in the Prometheus
+     * text exposition format. All metric names have the "sqlair_" prefix.
+     *
+     * @param os The output stream to where the metrics are written.
+     */
+    static void write(std::ostream& os);
+
+    /**
+     * Records the latency of a statement (of the calling thread) when it
+     * goes out of scope, including statements that throw exceptions.
+     */
+    class Timer {
+    public:
+        /**
+         * Starts timing a statement.
+         *
+         * @param stmt The kind of statement being timed.
+         */
+        explicit Timer(const Statement stmt) : stmt(stmt), start(now()) {}
+
+        /** Records the latency of the statement. */
+        ~Timer() { record(stmt, now() - start); }
+
+    private:
+        /** The kind of statement being timed. */
+        const Statement stmt;
+
+        /** The time at which the statement started. */
+        const uint64_t start;
+    };
+
+    /**
+     * The counters and histograms of one thread. Only the thread owning a
+     * slot modifies it, while write() may read it concurrently.
+     */
+    struct Slot {
+        /** The values of the counters. */
+        std::atomic<uint64_t> counters[NumCounters] = {};
+
+        /** The number of statements in each bucket of each histogram. */
+        std::atomic<uint64_t> buckets[NumStatements][NumBuckets + 1] = {};
+
+        /** The total latency (in nanoseconds) of each kind of statement. */
+        std::atomic<uint64_t> latencies[NumStatements] = {};
+    };
+
+private:
+    /**
+     * Adds an amount to a counter owned by the calling thread. A (relaxed)
+     * load and store suffices, instead of an atomic read-modify-write, as
+     * there is just one writer.
+     *
+     * @param value The counter to be increased.
+     * @param amount The amount to be added.
+     */
+    static void increment(std::atomic<uint64_t>& value,
+                          const uint64_t amount) {
+        value.store(value.load(std::memory_order_relaxed) + amount,
+                    std::memory_order_relaxed);
+    }
+
+    /**
+     * Obtains the slot of the calling thread, registering it on first use.
+     *
+     * @return The slot of the calling thread.
+     */
+    static Slot& local();
+
+    /** The number of queries that are waiting for rows to be changed. */
+    static std::atomic<int> waiters;
+
+    /** The estimated memory used by the tables, see setTableBytes(). */
+    static std::atomic<uint64_t> tableBytes;
+};
+
+#endif /* METRICS_H */
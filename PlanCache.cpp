@@ -0,0 +1,41 @@
+/*
+ * A bounded cache of the plans for recently processed queries. This is used
+ * by SQL-Air to skip parsing and validating queries that are repeated.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include "PlanCache.h"
+
+#include <cctype>
+
+// Normalize a query into a new string
+std::string PlanCache::normalize(const std::string& sql) {
+    std::string key;
+    normalize(sql, key);
+    return key;
+}
+
+// Collapse runs of white space before the first quote into a single space
+void PlanCache::normalize(const std::string& sql, std::string& key) {
+    key.clear();
+    key.reserve(sql.size());
+    bool space = false;
+    for (size_t i = 0; i < sql.size(); i++) {
+        const char c = sql[i];
+        if (c == '"' || c == '\'') {
+            // Copy the rest as-is, as the exact rules for quoting are the
+            // tokenizer's business.
+            key += (space ? " " : "");
+            key.append(sql, i, std::string::npos);
+            return;
+        }
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            space = !key.empty();
+            continue;
+        }
+        key += (space ? " " : "");
+        key += c;
+        space = false;
+    }
+}
@@ -0,0 +1,118 @@
+#ifndef PLAN_CACHE_H
+#define PLAN_CACHE_H
+
+/*
+ * A bounded cache of the plans for recently processed queries. This is used
+ * by SQL-Air to skip parsing and validating queries that are repeated.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "CSV.h"
+#include "LruCache.h"
+#include "RowOrder.h"
+
+/**
+ * The parsed and validated form of a select, update, insert, or delete
+ * statement. The fields correspond to the parameters of the respective
+ * query methods in SQLAirBase, e.g., SQLAirBase::selectQuery(), or of
+ * SQLAir::aggregateQuery() for select statements with aggregate functions.
+ */
+struct QueryPlan {
+    /** The different kinds of statements that can be planned. */
+    enum class Kind { Select, Update, Insert, Delete, Aggregate };
+
+    /** The kind of statement. */
+    Kind kind = Kind::Select;
+
+    /**
+     * The file or URL of the table, exactly as it was passed to
+     * loadAndGet(). An empty string indicates the most recent table. Such
+     * plans are neither cached nor prepared, as the column indexes in them
+     * refer to whichever table was the most recent one.
+     */
+    std::string fileOrURL;
+
+    /** Flag to indicate if the statement has a "wait" clause. */
+    bool mustWait = false;
+
+    /**
+     * The columns to be selected, updated, or inserted. For aggregate
+     * queries, these are the items in the select list.
+     */
+    StrVec colNames;
+
+    /**
+     * The values to be stored by update and insert statements. For
+     * aggregate queries, these are the columns in the group by clause.
+     */
+    StrVec values;
+
+    /** The column in the where clause or -1 if there is none. */
+    int whereColIdx = -1;
+
+    /** The condition in the where clause. */
+    std::string cond;
+
+    /** The value in the where clause. */
+    std::string value;
+
+    /**
+     * The placeholders ("?") for parameters in a prepared statement, in the
+     * order in which parameters are supplied. Each entry is an index into
+     * values or -1 for the value in the where clause.
+     */
+    std::vector<int> params;
+
+    /** The order by and limit clauses of select statements, if any. */
+    OrderLimit orderLimit;
+
+    /**
+     * The name of the column in the where clause (i.e., at whereColIdx when
+     * the statement was planned). The column is looked up again by name
+     * when the plan is run, as a table reloaded from its file (e.g., after
+     * being evicted) may have different columns.
+     */
+    std::string whereCol;
+};
+
+/**
+ * A bounded cache of query plans with least-recently-used (LRU) eviction.
+ * The plans are keyed on the normalized text of queries (see normalize()).
+ *
+ * @note This class is MT-safe. Plans are immutable once they are added to
+ * the cache and are shared with the callers via std::shared_ptr. Hence an
+ * evicted plan remains valid while it is in use.
+ */
+class PlanCache : public LruCache<std::shared_ptr<const QueryPlan>> {
+public:
+    using LruCache::LruCache;
+
+    /**
+     * Normalizes the text of a query so that queries differing only in
+     * white space share a plan. Leading white space is removed and other
+     * runs of white space are replaced by a single space. The text from the
+     * first quote onwards is not changed, so that quoted values (and any
+     * escapes in them) are never altered.
+     *
+     * @param sql The query to be normalized.
+     *
+     * @return The normalized query.
+     */
+    static std::string normalize(const std::string& sql);
+
+    /**
+     * Normalizes the text of a query into a given string. This method is
+     * the same as normalize() above, except that the memory of the string
+     * is reused (e.g., for successive queries on a connection).
+     *
+     * @param sql The query to be normalized.
+     * @param key The string that is set to the normalized query.
+     */
+    static void normalize(const std::string& sql, std::string& key);
+};
+
+#endif /* PLAN_CACHE_H */
@@ -0,0 +1,72 @@
+/*
+ * A compiled form of the condition in a where clause. The condition is
+ * interpreted once per query rather than once per row.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include "Predicate.h"
+
+#include <utility>
+#include "Index.h"
+
+// Resolve the condition and convert the value just once
+Predicate::Predicate(const std::string& cond, const std::string& value,
+                     MatchFn matches) : cond(cond), value(value),
+                                        matches(std::move(matches)) {
+    if (cond == "=") {
+        op = Op::Equal;
+    } else if (cond == "<>") {
+        op = Op::NotEqual;
+    } else if (cond == "like") {
+        op = Op::Like;
+    } else if (cond == "<") {
+        op = Op::Less;
+    } else if (cond == "<=") {
+        op = Op::LessEqual;
+    } else if (cond == ">") {
+        op = Op::Greater;
+    } else if (cond == ">=") {
+        op = Op::GreaterEqual;
+    } else {
+        op = Op::Other;
+    }
+    numeric = (op >= Op::Less && op <= Op::GreaterEqual &&
+               Index::toNumber(value, number));
+}
+
+// Check a value in a column against this predicate
+bool Predicate::operator()(const std::string& colVal) const {
+    switch (op) {
+    case Op::Equal:    return colVal == value;
+    case Op::NotEqual: return colVal != value;
+    case Op::Like:     return colVal.find(value) != std::string::npos;
+    case Op::Other:    return matches && matches(colVal, cond, value);
+    default:
+        break;
+    }
+    // Relational condition. Only the column value needs conversion.
+    double colNum;
+    if (numeric && Index::toNumber(colVal, colNum)) {
+        return (*this)(colNum);
+    }
+    const int cmp = colVal.compare(value);
+    return satisfies(cmp < 0 ? -1 : (cmp > 0 ? 1 : 0));
+}
+
+// Check a numeric value in a column against this predicate
+bool Predicate::operator()(double colVal) const {
+    return satisfies(colVal < number ? -1 : (colVal > number ? 1 : 0));
+}
+
+// Check the result of a comparison against the relational operator
+bool Predicate::satisfies(int cmp) const {
+    switch (op) {
+    case Op::Less:         return cmp < 0;
+    case Op::LessEqual:    return cmp <= 0;
+    case Op::Greater:      return cmp > 0;
+    case Op::GreaterEqual: return cmp >= 0;
+    default:
+        return false;
+    }
+}
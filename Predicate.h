@@ -0,0 +1,132 @@
+#ifndef PREDICATE_H
+#define PREDICATE_H
+
+/*
+ * A compiled form of the condition in a where clause. The condition is
+ * interpreted once per query rather than once per row.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <functional>
+#include <string>
+
+/**
+ * A condition in a where clause (e.g., "where year >= 2006") compiled into
+ * a form that can be applied to many rows efficiently. When a predicate is
+ * created, the condition string is resolved to an operator and a numeric
+ * value is converted to a double just once. Applying the predicate to a row
+ * then does not need any string comparisons of the condition or conversions
+ * of the value.
+ *
+ * The semantics are the same as SQLAir::matches(): "=" and "<>" compare
+ * strings, "like" checks for a sub-string, while "<", ">", "<=", and ">="
+ * compare values numerically if both values are numbers and as strings
+ * otherwise (see Index::compare()).
+ */
+class Predicate {
+public:
+    /**
+     * The callback used to check conditions that are not known to this
+     * class. This is typically SQLAir::matches().
+     */
+    using MatchFn = std::function<bool(const std::string& colVal,
+        const std::string& cond, const std::string& value)>;
+
+    /**
+     * Compiles the condition in a where clause.
+     *
+     * @param cond The condition to be checked (e.g., "=", "<>", "like").
+     * @param value The value specified by the user in the where clause.
+     * @param matches The fall-back method to check conditions that are not
+     * known to this class.
+     */
+    Predicate(const std::string& cond, const std::string& value,
+        MatchFn matches = nullptr);
+
+    /**
+     * Checks if a value in a column satisfies this predicate.
+     *
+     * @param colVal The value in a column of the CSV to be checked.
+     *
+     * @return This method returns true if the condition is met.
+     */
+    bool operator()(const std::string& colVal) const;
+
+    /**
+     * Checks if a numeric value in a column satisfies this predicate. This
+     * method must be used only if isNumeric() returns true.
+     *
+     * @param colVal The numeric value in a column of the CSV.
+     *
+     * @return This method returns true if the condition is met.
+     */
+    bool operator()(double colVal) const;
+
+    /**
+     * Determine if this predicate can be applied directly to numeric
+     * values in a column, i.e., the condition is relational and the value
+     * in the where clause is a number.
+     *
+     * @return This method returns true if operator()(double) can be used.
+     */
+    bool isNumeric() const { return numeric; }
+
+    /**
+     * Determine if the condition in this predicate is "=" or "<>".
+     *
+     * @return This method returns true for "=" and "<>" conditions.
+     */
+    bool isEquality() const { return op == Op::Equal || op == Op::NotEqual; }
+
+    /**
+     * Obtain the condition from which this predicate was compiled.
+     *
+     * @return The condition specified in the where clause.
+     */
+    const std::string& getCond() const { return cond; }
+
+    /**
+     * Obtain the value specified in the where clause.
+     *
+     * @return The value specified by the user in the where clause.
+     */
+    const std::string& getValue() const { return value; }
+
+private:
+    /** The conditions that are directly evaluated by this class. */
+    enum class Op { Equal, NotEqual, Like, Less, LessEqual,
+                    Greater, GreaterEqual, Other };
+
+    /**
+     * Checks if the result of a comparison satisfies the relational
+     * operator in this predicate.
+     *
+     * @param cmp A negative value, zero, or a positive value if the value
+     * in the column is less than, equal to, or greater than the value in
+     * the where clause.
+     *
+     * @return This method returns true if the condition is met.
+     */
+    bool satisfies(int cmp) const;
+
+    /** The operator resolved from the condition. */
+    Op op;
+
+    /** The condition specified in the where clause. */
+    std::string cond;
+
+    /** The value specified in the where clause. */
+    std::string value;
+
+    /** Flag to indicate if the condition is relational and value a number */
+    bool numeric = false;
+
+    /** The numeric value in the where clause, if numeric is true. */
+    double number = 0;
+
+    /** The fall-back method used for the Op::Other operator. */
+    MatchFn matches;
+};
+
+#endif /* PREDICATE_H */
@@ -0,0 +1,97 @@
+/*
+ * Ordering of the rows selected by select statements with order by and
+ * limit clauses.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include "RowOrder.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include "Table.h"
+
+// Check if a string (that need not be null-terminated) is a number
+bool RowOrder::toNumber(std::string_view str, double& val) {
+    if (str.empty()) {
+        return false;
+    }
+    // strtod needs a null-terminated string. Short values are copied to
+    // the stack to avoid allocating memory for each one.
+    char buf[64];
+    std::string longStr;
+    const char* start = buf;
+    if (str.size() < sizeof(buf)) {
+        str.copy(buf, str.size());
+        buf[str.size()] = '\0';
+    } else {
+        longStr.assign(str);
+        start = longStr.c_str();
+    }
+    errno = 0;
+    char* end = nullptr;
+    val = std::strtod(start, &end);
+    return (errno == 0 && end == start + str.size() && std::isfinite(val));
+}
+
+// Obtain the key of a row, reading numeric columns directly
+RowOrder::Key RowOrder::getKey(size_t row) const {
+    Key key{0, {}, row, false};
+    if (table.isColumnar()) {
+        switch (table.columns.getColumnType(col)) {
+        case ColumnStore::ColType::Int64:
+            key.num   = table.columns.getInt64(row, col);
+            key.isNum = true;
+            return key;
+        case ColumnStore::ColType::Double:
+            key.num   = table.columns.getDouble(row, col);
+            key.isNum = true;
+            return key;
+        case ColumnStore::ColType::String:
+            key.text = table.columns.getText(row, col);
+            break;
+        }
+    } else {
+        key.text = table.getRowValue(row, col);
+    }
+    key.isNum = toNumber(key.text, key.num);
+    return key;
+}
+
+// Check if a row comes before another, with ties in table order
+bool RowOrder::operator()(const Key& lhs, const Key& rhs) const {
+    int cmp = 0;
+    if (lhs.isNum != rhs.isNum) {
+        cmp = (lhs.isNum ? -1 : 1);  // Numbers come before other values
+    } else if (lhs.isNum) {
+        cmp = (lhs.num < rhs.num ? -1 : (lhs.num > rhs.num ? 1 : 0));
+    } else {
+        cmp = lhs.text.compare(rhs.text);
+    }
+    if (cmp == 0) {
+        return lhs.row < rhs.row;
+    }
+    return (descending ? cmp > 0 : cmp < 0);
+}
+
+// Add a key to a bounded heap of the first keys in this order
+void RowOrder::keep(const Key& key, size_t count, std::vector<Key>& heap)
+    const {
+    if (heap.size() < count) {
+        heap.push_back(key);
+        std::push_heap(heap.begin(), heap.end(), *this);
+    } else if (count > 0 && (*this)(key, heap.front())) {
+        // Replace the last of the keys in the heap
+        std::pop_heap(heap.begin(), heap.end(), *this);
+        heap.back() = key;
+        std::push_heap(heap.begin(), heap.end(), *this);
+    }
+}
+
+// Sort the keys in a heap into this order
+void RowOrder::sort(std::vector<Key>& heap) const {
+    std::sort_heap(heap.begin(), heap.end(), *this);
+}
@@ -0,0 +1,168 @@
+#ifndef ROW_ORDER_H
+#define ROW_ORDER_H
+
+/*
+ * Ordering of the rows selected by select statements with order by and
+ * limit clauses.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Forward declaration to avoid including Table.h in PlanCache.h
+class Table;
+
+/**
+ * The optional order by and limit clauses at the end of a select statement,
+ * e.g.,
+ *
+ *     select name, altitude from airports.csv where country = 'Peru'
+ *         order by altitude desc limit 10 offset 20;
+ *
+ * Without an order by clause, rows are selected in the order in which they
+ * are in the table. The limit and offset apply after rows are ordered.
+ */
+struct OrderLimit {
+    /** The column in the order by clause or -1 if there is none. */
+    int orderColIdx = -1;
+
+    /** Flag to indicate if rows are ordered by descending values. */
+    bool descending = false;
+
+    /** The maximum number of rows to be selected. */
+    size_t limit = SIZE_MAX;
+
+    /** The number of (ordered) rows to be skipped before selecting rows. */
+    size_t offset = 0;
+
+    /**
+     * Obtain the number of ordered rows that are needed to produce the
+     * result, i.e., the rows skipped by the offset and the rows selected.
+     *
+     * @return The sum of offset and limit (SIZE_MAX if there is no limit).
+     */
+    size_t end() const {
+        return (limit > SIZE_MAX - offset ? SIZE_MAX : offset + limit);
+    }
+
+    /**
+     * Determine if these clauses change the rows that are selected.
+     *
+     * @return This method returns true if there is an order by clause, a
+     * limit, or an offset.
+     */
+    bool isSet() const {
+        return orderColIdx != -1 || limit != SIZE_MAX || offset != 0;
+    }
+};
+
+/**
+ * The order of rows imposed by an order by clause. Values are ordered in
+ * the same way as the ordered part of an Index: all values that are numbers
+ * (see Index::toNumber()) come before the values that are not, numbers are
+ * ordered numerically and other values as strings (in descending order the
+ * whole order is reversed). Rows with equal values remain in the order in
+ * which they are in the table, so that successive pages of results (via
+ * limit and offset) never skip or repeat rows.
+ *
+ * Rather than sorting all the matching rows, the first k rows (in order)
+ * are found via a bounded heap of keys (see keep()) that holds the k best
+ * rows seen so far. Different ranges of rows may be added to separate heaps
+ * from different threads and then combined.
+ *
+ * @note The keys refer to the values in the table in-place. Hence the
+ * caller must hold (at least) a shared lock on the table's tableMutex while
+ * keys are used.
+ */
+class RowOrder {
+public:
+    /** The value of a row in the order by column and the row's position. */
+    struct Key {
+        /** The value as a number, if isNum is true. */
+        double num;
+
+        /** The text of the value, if isNum is false. */
+        std::string_view text;
+
+        /** The zero-based position of the row in the table. */
+        size_t row;
+
+        /** Flag to indicate if the value is a number. */
+        bool isNum;
+    };
+
+    /**
+     * Creates an order on a given column of a table.
+     *
+     * @param table The table whose rows are ordered.
+     * @param col The zero-based column in the order by clause.
+     * @param descending Flag to indicate if the order is descending.
+     */
+    RowOrder(const Table& table, int col, bool descending) :
+        table(table), col(col), descending(descending) {}
+
+    /**
+     * Obtain the key of a given row. Numeric columns in the columnar layout
+     * are read directly, without converting them to text.
+     *
+     * @param row The zero-based position of the row in the table.
+     *
+     * @return The key used to order the row.
+     */
+    Key getKey(size_t row) const;
+
+    /**
+     * Determine if one row comes before another in this order.
+     *
+     * @param lhs The key of the first row.
+     * @param rhs The key of the second row.
+     *
+     * @return This method returns true if lhs comes before rhs.
+     */
+    bool operator()(const Key& lhs, const Key& rhs) const;
+
+    /**
+     * Adds a key to a bounded heap that holds (at most) the first count
+     * keys in this order. The last of these keys is at the top of the
+     * heap. So a key is added only if it comes before that key.
+     *
+     * @param key The key to be added.
+     * @param count The maximum number of keys in the heap.
+     * @param heap The heap of keys, which is initially empty.
+     */
+    void keep(const Key& key, size_t count, std::vector<Key>& heap) const;
+
+    /**
+     * Sorts the keys of a heap built via keep() into this order.
+     *
+     * @param heap The heap of keys to be sorted.
+     */
+    void sort(std::vector<Key>& heap) const;
+
+    /**
+     * Convenience method to check if a string is a (finite) number. This
+     * is the same as Index::toNumber(), except that it works with values
+     * that are not null-terminated.
+     *
+     * @param str The string to be checked.
+     * @param val The numeric value, if the string is a number.
+     *
+     * @return This method returns true if all of str is a number.
+     */
+    static bool toNumber(std::string_view str, double& val);
+
+private:
+    /** The table whose rows are ordered. */
+    const Table& table;
+
+    /** The zero-based column in the order by clause. */
+    const int col;
+
+    /** Flag to indicate if the order is descending. */
+    const bool descending;
+};
+
+#endif /* ROW_ORDER_H */
@@ -0,0 +1,339 @@
+/*
+ * The storage for the rows of a table in the (default) row layout of
+ * SQL-Air, i.e., one vector-of-strings per row, with the values of
+ * low-cardinality columns stored as dictionary codes.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include "RowStore.h"
+
+#include <algorithm>
+#include <unordered_set>
+#include "Helper.h"
+
+// Columns beyond the values in a row are empty.
+const std::string RowStore::empty;
+
+// Rows in a new segment are empty and not deleted
+RowStore::Segment::Segment(const size_t codesPerRow) :
+    codes(codesPerRow > 0 ? new uint32_t[SegmentRows * codesPerRow]() :
+          nullptr) {
+    for (auto& flag : deleted) {
+        flag.store(false, std::memory_order_relaxed);
+    }
+}
+
+// Look up the code of a value, adding the value if it is new
+uint32_t RowStore::Dictionary::encode(const std::string& value) {
+    const auto entry = codes.find(value);
+    if (entry != codes.end()) {
+        return entry->second;
+    }
+    const uint32_t code = values.size();
+    values.push_back(value);
+    codes.emplace(values.back(), code);
+    return code;
+}
+
+// Move the rows from another store into this store
+RowStore& RowStore::operator=(RowStore&& other) noexcept {
+    directory = std::move(other.directory);
+    capacity  = other.capacity;
+    count.store(other.count.load());
+    deleted.store(other.deleted.load());
+    slots = std::move(other.slots);
+    dicts = std::move(other.dicts);
+    other.clear();
+    return *this;
+}
+
+// Check that the rows fit in the directory and their values are encoded
+bool RowStore::canAppend(const std::vector<StrVec>& rows) const {
+    if ((size() + rows.size() + SegmentRows - 1) / SegmentRows > capacity) {
+        return false;
+    }
+    for (size_t col = 0; col < slots.size(); col++) {
+        if (slots[col] >= 0) {
+            continue;
+        }
+        const Dictionary& dict = dicts[-1 - slots[col]];
+        for (const StrVec& row : rows) {
+            const std::string& value = (col < row.size() ? row[col] : empty);
+            if (dict.codes.find(value) == dict.codes.end()) {
+                return false;  // The dictionary would grow.
+            }
+        }
+    }
+    return true;
+}
+
+// Grow the directory (doubling its size) to have room for more rows
+void RowStore::reserve(size_t rows) {
+    const size_t needed = (size() + rows + SegmentRows - 1) / SegmentRows;
+    if (needed <= capacity) {
+        return;
+    }
+    const size_t newCapacity = std::max({needed, 2 * capacity, size_t(16)});
+    auto entries = std::make_unique<std::unique_ptr<Segment>[]>(newCapacity);
+    std::move(directory.get(), directory.get() + capacity, entries.get());
+    directory = std::move(entries);
+    capacity  = newCapacity;
+}
+
+// Append a row, publishing it only after it has been stored
+void RowStore::append(StrVec row) {
+    reserve(1);
+    const size_t pos = size();
+    std::unique_ptr<Segment>& segment = directory[pos / SegmentRows];
+    if (segment == nullptr) {
+        segment = std::make_unique<Segment>(dicts.size());
+    }
+    if (slots.empty()) {
+        values(pos) = std::move(row);
+    } else {
+        // Encoded values are replaced by codes. The others are kept in
+        // order (as the slots of those columns are in ascending order).
+        row.resize(slots.size());
+        StrVec& stored = values(pos);
+        stored.clear();
+        stored.reserve(slots.size() - dicts.size());
+        for (size_t col = 0; col < slots.size(); col++) {
+            if (slots[col] < 0) {
+                code(pos, -1 - slots[col]) =
+                    dicts[-1 - slots[col]].encode(row[col]);
+            } else {
+                stored.push_back(std::move(row[col]));
+            }
+        }
+    }
+    count.store(pos + 1, std::memory_order_release);
+}
+
+// Change a value, encoding it for dictionary-encoded columns
+void RowStore::set(size_t row, int col, const std::string& value) {
+    const int slot = (static_cast<size_t>(col) < slots.size() ? slots[col] :
+                      col);
+    if (slot < 0) {
+        code(row, -1 - slot) = dicts[-1 - slot].encode(value);
+    } else {
+        values(row).at(slot) = value;
+    }
+}
+
+// Find the matching rows, checking encoded values via their codes
+void RowStore::filter(int col, const Predicate& pred,
+                      std::vector<size_t>& rows, size_t first,
+                      size_t last) const {
+    last = std::min(last, size());
+    const int slot = (static_cast<size_t>(col) < slots.size() ? slots[col] :
+                      col);
+    if (slot >= 0) {
+        for (size_t row = first; row < last; row++) {
+            if (pred(get(row, col)) && !isDeleted(row)) {
+                rows.push_back(row);
+            }
+        }
+        return;
+    }
+    const size_t dictIdx = -1 - slot;
+    const Dictionary& dict = dicts[dictIdx];
+    if (pred.isEquality()) {
+        // Values that are not in the dictionary never match with "="
+        const bool equal = (pred.getCond() == "=");
+        const auto entry = dict.codes.find(pred.getValue());
+        const bool found = (entry != dict.codes.end());
+        const uint32_t target = (found ? entry->second : 0);
+        for (size_t row = first; row < last; row++) {
+            if ((found && code(row, dictIdx) == target) == equal &&
+                !isDeleted(row)) {
+                rows.push_back(row);
+            }
+        }
+        return;
+    }
+    // Check the condition just once for each distinct value in the range
+    // of rows: 0 = not yet checked, 1 = no match, 2 = match.
+    std::vector<char> hits(dict.values.size());
+    for (size_t row = first; row < last; row++) {
+        const uint32_t value = code(row, dictIdx);
+        char& hit = hits[value];
+        if (hit == 0) {
+            hit = (pred(dict.values[value]) ? 2 : 1);
+        }
+        if (hit == 2 && !isDeleted(row)) {
+            rows.push_back(row);
+        }
+    }
+}
+
+// Mark a row as deleted
+bool RowStore::erase(size_t row) {
+    std::atomic<bool>& flag =
+        directory[row / SegmentRows]->deleted[row % SegmentRows];
+    if (flag.exchange(true, std::memory_order_release)) {
+        return false;
+    }
+    deleted++;
+    return true;
+}
+
+// Move the remaining rows to the front, preserving their order
+void RowStore::compact() {
+    const size_t total = size();
+    size_t dest = 0;
+    for (size_t src = 0; src < total; src++) {
+        if (!isDeleted(src)) {
+            if (dest != src) {
+                values(dest).swap(values(src));
+                for (size_t dict = 0; dict < dicts.size(); dict++) {
+                    code(dest, dict) = code(src, dict);
+                }
+            }
+            dest++;
+        }
+    }
+    // The rows after the remaining rows are now the deleted rows
+    for (size_t row = 0; row < total; row++) {
+        directory[row / SegmentRows]->deleted[row % SegmentRows].store(false);
+        if (row >= dest) {
+            StrVec().swap(values(row));
+        }
+    }
+    for (size_t seg = (dest + SegmentRows - 1) / SegmentRows; seg < capacity;
+         seg++) {
+        directory[seg].reset();
+    }
+    count.store(dest);
+    deleted.store(0);
+}
+
+// Remove all the rows, segments, and dictionaries
+void RowStore::clear() {
+    directory.reset();
+    capacity = 0;
+    count.store(0);
+    deleted.store(0);
+    slots.clear();
+    dicts.clear();
+}
+
+// Encode the low-cardinality columns and move the values into this store
+template<typename Rows>
+void RowStore::assignRows(Rows& rows, const int colCount) {
+    clear();
+    const bool uniform = std::all_of(rows.begin(), rows.end(),
+        [colCount](const StrVec& row) {
+            return row.size() == static_cast<size_t>(colCount); });
+    std::vector<bool> encoded(colCount);
+    for (int col = 0; uniform && col < colCount; col++) {
+        // Count the distinct values, up to the limit
+        std::unordered_set<std::string_view> distinct;
+        for (const StrVec& row : rows) {
+            distinct.insert(row[col]);
+            if (distinct.size() > DictionaryValues) {
+                break;
+            }
+        }
+        encoded[col] = (distinct.size() <= DictionaryValues &&
+                        4 * distinct.size() <= rows.size());
+    }
+    if (std::find(encoded.begin(), encoded.end(), true) != encoded.end()) {
+        int plain = 0;
+        for (int col = 0; col < colCount; col++) {
+            if (encoded[col]) {
+                slots.push_back(-1 - static_cast<int>(dicts.size()));
+                dicts.emplace_back();
+            } else {
+                slots.push_back(plain++);
+            }
+        }
+    }
+    reserve(rows.size());
+    for (auto& row : rows) {
+        append(std::move(static_cast<StrVec&>(row)));
+    }
+}
+
+// Move the values in the rows of a CSV into this store
+void RowStore::assign(std::vector<CSVRow>& rows, const int colCount) {
+    assignRows(rows, colCount);
+}
+
+// Move the values in the rows into this store
+void RowStore::assign(std::vector<StrVec>& rows, const int colCount) {
+    assignRows(rows, colCount);
+}
+
+// Write the rows that are not deleted in the same format as CSV::save
+void RowStore::save(std::ostream& os, const StrVec& colNames,
+    const std::string& delim, bool quote, const std::string& nl) const {
+    if (!os.good()) {
+        throw Exp("The supplied stream was not good.");
+    }
+    // Convenience lambda to write a value, escaping quotes as needed
+    auto write = [&](const std::string& value) {
+        if (!quote) {
+            os << value;
+            return;
+        }
+        os << '"';
+        for (const char c : value) {
+            if (c == '"') {
+                os << '\\';
+            }
+            os << c;
+        }
+        os << '"';
+    };
+    std::string sep;
+    for (const auto& name : colNames) {
+        os << sep;
+        write(name);
+        sep = delim;
+    }
+    os << nl;
+    for (size_t row = 0; row < size(); row++) {
+        if (isDeleted(row)) {
+            continue;
+        }
+        const size_t cols = (slots.empty() ? values(row).size() :
+                             slots.size());
+        for (size_t col = 0; col < cols; col++) {
+            os << (col > 0 ? delim : "");
+            write(get(row, col));
+        }
+        os << nl;
+    }
+}
+
+// Add up the segments, the (heap allocated) strings in each row, and the
+// dictionaries
+size_t RowStore::getMemoryBytes() const {
+    // Short strings are stored within the std::string object itself
+    const size_t inlineChars = std::string().capacity();
+    auto stringBytes = [inlineChars](const std::string& value) {
+        return sizeof(std::string) + (value.capacity() > inlineChars ?
+                                      value.capacity() + 1 : 0);
+    };
+    const size_t segmentBytes = sizeof(Segment) +
+        SegmentRows * dicts.size() * sizeof(uint32_t);
+    size_t bytes = capacity * sizeof(std::unique_ptr<Segment>);
+    for (size_t seg = 0; seg < capacity; seg++) {
+        bytes += (directory[seg] != nullptr ? segmentBytes : 0);
+    }
+    for (size_t row = 0; row < size(); row++) {
+        const StrVec& stored = values(row);
+        bytes += (stored.capacity() - stored.size()) * sizeof(std::string);
+        for (const std::string& value : stored) {
+            bytes += stringBytes(value);
+        }
+    }
+    for (const Dictionary& dict : dicts) {
+        for (const std::string& value : dict.values) {
+            // Each value also has an entry (of about 4 words) in the map
+            bytes += stringBytes(value) + 4 * sizeof(void*);
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,364 @@
+#ifndef ROW_STORE_H
+#define ROW_STORE_H
+
+/*
+ * The storage for the rows of a table in the (default) row layout of
+ * SQL-Air, i.e., one vector-of-strings per row, with the values of
+ * low-cardinality columns stored as dictionary codes.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "CSV.h"
+#include "Predicate.h"
+
+/**
+ * The rows of a table in the row layout. Rows are stored in fixed-size
+ * segments of SegmentRows rows each. Segments are never moved or resized.
+ * So, unlike a std::vector, appending a row never moves existing rows and
+ * references to rows remain valid as rows are appended. The segments are
+ * found via a small directory with a pointer to each segment.
+ *
+ * Deleting a row does not remove it. Instead, the row is marked as deleted
+ * (a tombstone) in O(1) time and is skipped by scans. So the positions of
+ * the remaining rows (and hence the entries in indexes) do not change. The
+ * deleted rows are removed by compact(), which moves the remaining rows (in
+ * order) to the front.
+ *
+ * When rows are loaded via assign(), columns that repeat a few distinct
+ * values (e.g., the country of airports) are dictionary-encoded: each row
+ * stores a 4-byte code for them instead of a std::string, and the distinct
+ * values are kept once in the column's dictionary. Rows hold the values of
+ * the other columns, in order. Values are accessed via get(), which
+ * returns the same strings in either case. Conditions on an encoded column
+ * are checked once per distinct value (see filter()).
+ *
+ * @note This class does not perform any locking, but it is designed to let
+ * readers run concurrently with a single writer (see Table): append() (as
+ * long as canAppend() is true) and erase() modify only rows that readers
+ * do not yet see, or atomic tombstones. The number of rows is updated
+ * after a row is appended. So readers see only whole rows. All other
+ * methods that modify the store (including appending values that are new
+ * to a dictionary) require exclusive access.
+ */
+class RowStore {
+public:
+    /** The number of rows in each segment. */
+    static constexpr size_t SegmentRows = 1024;
+
+    /**
+     * The largest number of distinct values in a column that is
+     * dictionary-encoded by assign(). Columns are encoded only if each
+     * value occurs (on average) at least 4 times as well.
+     */
+    static constexpr size_t DictionaryValues = 4096;
+
+    /** Creates an empty store. */
+    RowStore() = default;
+
+    /**
+     * Move the rows from another store into this store.
+     *
+     * @param other The store whose rows are moved. It is empty afterwards.
+     *
+     * @return A reference to this store.
+     */
+    RowStore& operator=(RowStore&& other) noexcept;
+
+    // Rows are not copied.
+    RowStore(const RowStore&) = delete;
+    RowStore& operator=(const RowStore&) = delete;
+
+    /**
+     * Obtain the number of rows in this store, including deleted rows.
+     * Rows are numbered from zero and the number of a row changes only
+     * when the store is compacted.
+     *
+     * @return The number of rows.
+     */
+    size_t size() const { return count.load(std::memory_order_acquire); }
+
+    /**
+     * Obtain the number of rows that are marked as deleted.
+     *
+     * @return The number of deleted rows.
+     */
+    size_t getDeletedCount() const { return deleted.load(); }
+
+    /**
+     * Returns the value in a given row and column, without copying it.
+     *
+     * @param row The zero-based row number, which must be less than size().
+     * @param col The zero-based column number. Columns beyond the values
+     * in a (short) row are empty.
+     *
+     * @return The value, which remains valid until the row is changed or
+     * the store is modified by a writer with exclusive access.
+     */
+    const std::string& get(size_t row, int col) const {
+        const int slot = (static_cast<size_t>(col) < slots.size() ?
+                          slots[col] : col);
+        if (slot < 0) {
+            const size_t dict = -1 - slot;
+            return dicts[dict].values[code(row, dict)];
+        }
+        const StrVec& stored = values(row);
+        return (static_cast<size_t>(slot) < stored.size() ? stored[slot] :
+                empty);
+    }
+
+    /**
+     * Changes the value in a given row and column. The caller must have
+     * exclusive access to the store.
+     *
+     * @param row The zero-based row number, which must be less than size().
+     * @param col The zero-based column number.
+     * @param value The new value to be stored.
+     */
+    void set(size_t row, int col, const std::string& value);
+
+    /**
+     * Determine if a given row has been deleted.
+     *
+     * @param row The zero-based row number, which must be less than size().
+     *
+     * @return This method returns true if the row is marked as deleted.
+     */
+    bool isDeleted(size_t row) const {
+        return directory[row / SegmentRows]->deleted[row % SegmentRows].load(
+            std::memory_order_acquire);
+    }
+
+    /**
+     * Determine if rows can be appended (while readers are accessing the
+     * store) without the directory of segments or the dictionaries having
+     * to grow.
+     *
+     * @param rows The rows to be appended.
+     *
+     * @return This method returns true if the directory has room for the
+     * segments of the rows and the dictionaries have all their values.
+     */
+    bool canAppend(const std::vector<StrVec>& rows) const;
+
+    /**
+     * Grows the directory of segments (if needed) to have room for a given
+     * number of additional rows. The caller must have exclusive access.
+     *
+     * @param rows The number of rows to be appended.
+     */
+    void reserve(size_t rows);
+
+    /**
+     * Appends a row at the end of this store. If canAppend() is false,
+     * then the caller must have exclusive access (as the directory or a
+     * dictionary grows).
+     *
+     * @param row The values in the row, which are moved into the store.
+     */
+    void append(StrVec row);
+
+    /**
+     * Determines the rows (that are not deleted) whose value in a given
+     * column satisfies a predicate. For dictionary-encoded columns, "="
+     * and "<>" compare codes, and other conditions are checked just once
+     * for each distinct value. Otherwise, the predicate is checked on the
+     * value in each row.
+     *
+     * @param col The zero-based column in the where clause.
+     * @param pred The compiled condition in the where clause.
+     * @param rows The vector to which the zero-based row numbers that
+     * satisfy the condition are appended, in ascending order.
+     * @param first The first row to be checked. Different ranges of rows
+     * may be checked concurrently from different threads.
+     * @param last The row after the last row to be checked.
+     */
+    void filter(int col, const Predicate& pred, std::vector<size_t>& rows,
+        size_t first = 0, size_t last = SIZE_MAX) const;
+
+    /**
+     * Marks a given row as deleted.
+     *
+     * @param row The zero-based row number, which must be less than size().
+     *
+     * @return This method returns false if the row was already deleted.
+     */
+    bool erase(size_t row);
+
+    /**
+     * Removes the deleted rows. The remaining rows are moved to the front,
+     * in order, and segments that are no longer needed are released. The
+     * caller must have exclusive access.
+     */
+    void compact();
+
+    /**
+     * Removes all the rows (and dictionaries) from this store.
+     */
+    void clear();
+
+    /**
+     * Replaces the rows in this store with the rows of a CSV (e.g., just
+     * after it is loaded via CSV::load()). Columns with at most
+     * DictionaryValues distinct values, each occurring at least 4 times on
+     * average, are dictionary-encoded.
+     *
+     * @param rows The rows to be moved into this store. The values in the
+     * rows are moved, but the rows themselves are left in the vector.
+     * @param colCount The number of columns. Columns are encoded only if
+     * each row has this many values.
+     */
+    void assign(std::vector<CSVRow>& rows, int colCount);
+
+    /** The version of assign() for rows that are not CSVRows. */
+    void assign(std::vector<StrVec>& rows, int colCount);
+
+    /**
+     * Writes the rows (that are not deleted) in the same format as
+     * CSV::save().
+     *
+     * @param os The output stream to where the data is to be written.
+     * @param colNames The names of the columns for the header line.
+     * @param delim The delimiter to use between each column.
+     * @param quote If this flag is true then each value is quoted.
+     * @param nl The string to be used for new lines.
+     */
+    void save(std::ostream& os, const StrVec& colNames,
+        const std::string& delim = ",", bool quote = true,
+        const std::string& nl = "\n") const;
+
+    /**
+     * Estimates the memory used by this store, i.e., the segments, the
+     * values in them (including deleted rows), and the dictionaries, for
+     * the memory budget of SQLAir (see SQLAir::setMemoryBudget()).
+     *
+     * @return The approximate number of bytes allocated by this store.
+     */
+    size_t getMemoryBytes() const;
+
+private:
+    /** A fixed-size block of consecutive rows. */
+    struct Segment {
+        /**
+         * Creates a segment whose rows are empty and not deleted.
+         *
+         * @param codesPerRow The number of dictionary-encoded columns.
+         */
+        explicit Segment(size_t codesPerRow);
+
+        /** The values in each row, except for dictionary-encoded ones. */
+        StrVec rows[SegmentRows];
+
+        /** The codes of the dictionary-encoded values, row by row. */
+        std::unique_ptr<uint32_t[]> codes;
+
+        /** The tombstone of each row. */
+        std::atomic<bool> deleted[SegmentRows];
+    };
+
+    /** The distinct values of a dictionary-encoded column. */
+    struct Dictionary {
+        /**
+         * The values, indexed by code. A deque is used so that adding
+         * values does not move the existing strings.
+         */
+        std::deque<std::string> values;
+
+        /** Reverse look-up of the code for each value. */
+        std::unordered_map<std::string_view, uint32_t> codes;
+
+        /**
+         * Returns the code for a given value, adding it to the dictionary
+         * if it is not already present.
+         *
+         * @param value The value whose code is to be returned.
+         *
+         * @return The dictionary code for the value.
+         */
+        uint32_t encode(const std::string& value);
+    };
+
+    /**
+     * Moves the rows of a CSV into this store (see assign()).
+     *
+     * @param rows The rows (CSVRows or StrVecs) to be moved.
+     * @param colCount The number of columns.
+     */
+    template<typename Rows>
+    void assignRows(Rows& rows, int colCount);
+
+    /**
+     * Returns the values stored in a given row, i.e., the values of the
+     * columns that are not dictionary-encoded.
+     *
+     * @param row The zero-based row number, which must be less than size().
+     *
+     * @return The values in the row.
+     */
+    const StrVec& values(size_t row) const {
+        return directory[row / SegmentRows]->rows[row % SegmentRows];
+    }
+
+    /** The non-const version of the values() method. */
+    StrVec& values(size_t row) {
+        return directory[row / SegmentRows]->rows[row % SegmentRows];
+    }
+
+    /**
+     * Returns the code of a dictionary-encoded value in a given row.
+     *
+     * @param row The zero-based row number, which must be less than size().
+     * @param dict The index of the column's dictionary in dicts.
+     *
+     * @return The code, which may be changed with exclusive access.
+     */
+    uint32_t& code(size_t row, size_t dict) {
+        return directory[row / SegmentRows]->codes[
+            (row % SegmentRows) * dicts.size() + dict];
+    }
+
+    /** The const version of the code() method. */
+    uint32_t code(size_t row, size_t dict) const {
+        return directory[row / SegmentRows]->codes[
+            (row % SegmentRows) * dicts.size() + dict];
+    }
+
+    /** The value of columns beyond the values in a row. */
+    static const std::string empty;
+
+    /**
+     * The pointers to the segments. Entries for segments that are yet to
+     * be used may be nullptr.
+     */
+    std::unique_ptr<std::unique_ptr<Segment>[]> directory;
+
+    /** The number of entries in the directory. */
+    size_t capacity = 0;
+
+    /** The number of rows, including deleted rows. */
+    std::atomic<size_t> count{0};
+
+    /** The number of rows that are marked as deleted. */
+    std::atomic<size_t> deleted{0};
+
+    /**
+     * The position of each column in the values stored in a row (if >= 0),
+     * or -1 - the index of its dictionary in dicts. This vector is empty if
+     * no column is dictionary-encoded, and rows then hold all the values.
+     */
+    std::vector<int> slots;
+
+    /** The dictionaries of the dictionary-encoded columns. */
+    std::vector<Dictionary> dicts;
+};
+
+#endif /* ROW_STORE_H */
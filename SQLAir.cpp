@@ -8,55 +8,1817 @@
 
 #include "SQLAir.h"
 
+#include <sys/stat.h>
+#include <unistd.h>
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
 #include <fstream>
+#include <list>
+#include <future>
 #include <memory>
+#include <sstream>
+#include <numeric>
 #include <string>
 #include <tuple>
+#include <vector>
 
+#include "ChunkedStream.h"
+#include "Filter.h"
 #include "HTTPFile.h"
+#include "HttpDownload.h"
+#include "Metrics.h"
 
 using namespace boost::asio;
 using namespace boost::asio::ip;
 using namespace std;
 
 /**
- * A fixed HTTP response header that is used by the runServer method below.
- * Note that this a constant (and not a global variable)
+ * A fixed HTTP response header that is used by the serveClient method below.
+ * The value of the "Connection" header (and the rest of the headers) follow
+ * this header. Note that this a constant (and not a global variable)
  */
 const std::string HTTPRespHeader =
     "HTTP/1.1 200 OK\r\n"
     "Server: localhost\r\n"
-    "Connection: Close\r\n"
-    "Content-Type: text/plain\r\n"
-    "Content-Length: ";
+    "Connection: ";
+
+/**
+ * The remaining HTTP response headers that follow HTTPRespHeader. The
+ * "Content-Length" or "Transfer-Encoding" header is added by ChunkedStreamBuf.
+ */
+const std::string HTTPRespFields =
+    "\r\nContent-Type: text/plain\r\n";
+
+/**
+ * The complete headers for query responses on persistent and
+ * non-persistent connections. These are built just once, instead of for
+ * each response.
+ */
+const std::string HTTPKeepAliveRespHeaders =
+    HTTPRespHeader + "keep-alive" + HTTPRespFields;
+const std::string HTTPCloseRespHeaders =
+    HTTPRespHeader + "Close" + HTTPRespFields;
+
+/**
+ * The complete headers for responses to "/stats" requests, which have the
+ * content type of the Prometheus text format.
+ */
+const std::string HTTPStatsFields =
+    "\r\nContent-Type: text/plain; version=0.0.4\r\n";
+const std::string HTTPKeepAliveStatsHeaders =
+    HTTPRespHeader + "keep-alive" + HTTPStatsFields;
+const std::string HTTPCloseStatsHeaders =
+    HTTPRespHeader + "Close" + HTTPStatsFields;
+
+/**
+ * The minimum number of rows checked by each task of a parallel scan. Tables
+ * with fewer rows are scanned by just a single thread.
+ */
+const size_t ScanRowsPerTask = 16384;
+
+/**
+ * The number of rows formatted by each task in processSelectRow. Results
+ * are formatted and written in batches of these tasks so that memory used
+ * is bounded for large results.
+ */
+const size_t FormatRowsPerTask = 1024;
+
+/**
+ * The number of rows checked in the first round of a scan that stops after
+ * a given number of matching rows (for a limit clause). Each round checks
+ * twice as many rows as the previous one, so that small limits stop early
+ * while large ones are still scanned in parallel.
+ */
+const size_t LimitScanRows = 1024;
+
+/**
+ * The size up to which a response is buffered for each client by the
+ * asynchronous server. Longer responses are written to the client in parts
+ * of this size (see AsyncResponseBuf).
+ */
+const size_t AsyncResponseBytes = 1 << 16;
+
+/**
+ * The number of parts of a long response that may be queued for a client
+ * in the asynchronous server. Once more parts are queued (as the client is
+ * slow to read), the worker generating the response waits for them to be
+ * written (see SQLAir::writeAsync()).
+ */
+const size_t AsyncQueuedParts = 4;
+
+/**
+ * The duration for which a server waits for a client to read a part of a
+ * response (e.g., the next chunk of a large select). Queries write their
+ * response while holding their table's lock. So a client that stops
+ * reading has its response aborted and its connection closed, rather than
+ * blocking the writers of the table.
+ */
+const auto ResponseWriteTimeout = std::chrono::seconds(10);
+
+/**
+ * The interval at which the background thread checks if tables need to be
+ * checkpointed, when write-ahead logging is enabled.
+ */
+const std::chrono::seconds CheckpointInterval(30);
+
+/**
+ * The size of a write-ahead log beyond which its table is checkpointed by
+ * the background thread. Smaller logs are just replayed on load, which is
+ * cheaper than rewriting large CSV files often.
+ */
+const uint64_t CheckpointLogBytes = 16 << 20;
+
+/**
+ * The HTTP headers used when sending file contents on a persistent
+ * connection. These are the same as http::DefaultHttpHeaders except for
+ * the "Connection" header.
+ */
+const std::string HTTPKeepAliveFileHeaders =
+    "HTTP/1.1 200 OK\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Type: ";
+
+/**
+ * The duration for which a thread (in runServer) waits for the next request
+ * on a persistent connection before closing the connection.
+ */
+const auto KeepAliveTimeout = std::chrono::seconds(15);
+
+/**
+ * The interval at which an idle worker started by blockWorker() checks if
+ * it is no longer needed (i.e., the blocked workers have resumed).
+ */
+const auto WorkerRetireInterval = std::chrono::seconds(1);
+
+/**
+ * The size of the largest response that is cached when result caching is
+ * enabled. Longer responses are streamed and not cached.
+ */
+const size_t CachedResultBytes = 1 << 20;
+
+/**
+ * The size beyond which the buffers in QueryBuffers are released at the end
+ * of a query. Smaller buffers are kept for reuse by the next query.
+ */
+const size_t RetainedBufferBytes = 1 << 20;
+
+/**
+ * The maximum size of the body of a request (e.g., a POST request with a
+ * batch of statements) that is served. The connection is closed without a
+ * response if a client sends a larger body.
+ */
+const size_t MaxRequestBodyBytes = 64 << 20;
+
+/**
+ * The information gathered about a query while the base class processes it,
+ * to build a plan for the query. See SQLAir::process().
+ */
+struct PlanRecorder {
+    /** The plan built from the parameters of the query method. */
+    QueryPlan plan;
+
+    /** The file or URL passed to the most recent call to loadAndGet(). */
+    std::string fileOrURL;
+
+    /** The number of calls to loadAndGet() and to the query methods. */
+    int loads = 0, queries = 0;
+
+    /** Flag to indicate if the query is to be run (and not just planned). */
+    bool execute = true;
+};
+
+/**
+ * The recorder for the query being processed by each thread, or nullptr if
+ * plans are not being recorded.
+ */
+thread_local PlanRecorder* recorder = nullptr;
+
+/**
+ * The temporaries used to serve a request and to run a query. Each thread
+ * reuses its buffers for successive requests, so that a typical query does
+ * not allocate memory for them. See SQLAir::processSelectRow().
+ *
+ * @note Tasks run by the worker pool must not use these buffers (as they
+ * would then refer to the buffers of the worker's thread). Instead, they use
+ * the buffers of the thread running the query via references.
+ */
+struct QueryBuffers {
+    /** The parts of the request line and a header read by serveClient(). */
+    std::string method, line, version, header;
+
+    /** The values of the conditional headers of a request for a file. */
+    std::string ifNoneMatch, ifModifiedSince;
+
+    /** The body of a POST request read by serveClient(). */
+    std::string body;
+
+    /** The normalized query and the key of its cached result. */
+    std::string query, resultKey;
+
+    /** The indexes of the columns used by the query. */
+    std::vector<int> colIdx;
+
+    /** The rows found by findRows() and the rows found by each task. */
+    std::vector<size_t> rows;
+    std::vector<std::vector<size_t>> rowParts;
+
+    /** The bounded heaps of keys built by each task in sortRows(). */
+    std::vector<std::vector<RowOrder::Key>> keyParts;
+
+    /** The rows formatted by each task in processSelectRow(). */
+    std::vector<std::string> outParts;
+
+    /**
+     * Releases the buffers that have grown larger than RetainedBufferBytes,
+     * if a query used many rows, so that threads do not hold on to them.
+     */
+    void trim() {
+        auto release = [](auto& vec, size_t bytes) {
+            if (bytes > RetainedBufferBytes) {
+                std::remove_reference_t<decltype(vec)>().swap(vec);
+            }
+        };
+        release(rows, rows.capacity() * sizeof(size_t));
+        release(body, body.capacity());
+        size_t bytes = 0;
+        for (const auto& part : rowParts) {
+            bytes += part.capacity() * sizeof(size_t);
+        }
+        release(rowParts, bytes);
+        bytes = 0;
+        for (const auto& part : outParts) {
+            bytes += part.capacity();
+        }
+        release(outParts, bytes);
+        bytes = 0;
+        for (const auto& part : keyParts) {
+            bytes += part.capacity() * sizeof(RowOrder::Key);
+        }
+        release(keyParts, bytes);
+    }
+};
+
+/** The buffers for the requests and queries run by each thread. */
+thread_local QueryBuffers buffers;
+
+/**
+ * The pin counts (see SQLAir::ResidentTable) of the tables used by the
+ * request that each thread is serving, and the depth of nested PinScopes.
+ */
+struct TablePins {
+    std::vector<std::atomic<int>*> pins;
+    int depth = 0;
+};
+
+/** The tables pinned by the request run by each thread. */
+thread_local TablePins pinned;
+
+/**
+ * The scope of a request, i.e., the tables returned by loadAndGet() are
+ * unpinned (and so may be evicted) once the outermost scope ends.
+ */
+class PinScope {
+public:
+    PinScope() { pinned.depth++; }
+
+    ~PinScope() {
+        if (--pinned.depth == 0) {
+            for (std::atomic<int>* pin : pinned.pins) {
+                pin->fetch_sub(1);
+            }
+            pinned.pins.clear();
+        }
+    }
+};
+
+/**
+ * The client whose request is being processed by each worker of the
+ * asynchronous server (see SQLAir::processAsync()), or nullptr in other
+ * threads.
+ */
+thread_local const AsyncClientPtr* asyncClient = nullptr;
+
+/**
+ * Thrown by SQLAir::waitForRows() to unwind a request whose wait has been
+ * parked. It is not a std::exception, so that it is not reported to the
+ * client as an error.
+ */
+struct ParkedWait {};
+
+/**
+ * The stream buffer to which serveClient() writes a response in the
+ * asynchronous server (see SQLAir::processAsync()). The response is
+ * collected in the client's response string, which is then queued to be
+ * written. Longer responses (e.g., the chunks of a large select) are
+ * queued in parts each time AsyncResponseBytes are buffered, so that the
+ * memory used for a response is bounded whatever its size.
+ */
+class AsyncResponseBuf : public std::streambuf {
+public:
+    /**
+     * The function that queues a full buffer to be written. It takes the
+     * data out of the given string and returns false if the response can
+     * no longer be written (e.g., the client disconnected).
+     */
+    using WriteFn = std::function<bool(std::string& part)>;
+
+    AsyncResponseBuf(std::string& response, WriteFn write) :
+        response(response), write(std::move(write)) {
+        reset(0, std::min(std::max(response.capacity(), size_t(4096)),
+                          AsyncResponseBytes));
+    }
+
+    /**
+     * Trims the response to the data yet to be queued.
+     *
+     * @return This method returns false if queuing a part failed.
+     */
+    bool finish() {
+        response.resize(pptr() - pbase());
+        return !failed;
+    }
+
+protected:
+    // Grow the buffer up to the limit and then queue it to be written
+    int_type overflow(int_type ch) override {
+        const size_t len = pptr() - pbase();
+        if (len < AsyncResponseBytes) {
+            reset(len, std::min(len * 2, AsyncResponseBytes));
+        } else if (!failed) {
+            response.resize(len);
+            failed = !write(response);
+            reset(0, len);
+        }
+        if (failed) {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    // Flushes (e.g., from std::endl) do not write partial parts
+    int sync() override { return 0; }
+
+private:
+    /** Resize the buffer, keeping the first len bytes in it. */
+    void reset(const size_t len, const size_t size) {
+        response.resize(size);
+        setp(&response[0], &response[0] + size);
+        pbump(static_cast<int>(len));
+    }
+
+    /** The client's response string used as the buffer. */
+    std::string& response;
+
+    /** The function that queues full buffers to be written. */
+    WriteFn write;
+
+    /** Flag to indicate if queuing a part failed. */
+    bool failed = false;
+};
+
+/**
+ * The stream buffer to which serveClient() writes a response in the
+ * multithreaded server (see SQLAir::serveConnection()). It passes the data
+ * on to the connection's stream buffer, and sets the connection to expire
+ * ResponseWriteTimeout after each write. Queries (e.g., with wait clauses)
+ * are not subject to timeouts otherwise.
+ */
+class DeadlineStreamBuf : public std::streambuf {
+public:
+    explicit DeadlineStreamBuf(boost::asio::ip::tcp::iostream& client) :
+        client(client) {}
+
+protected:
+    int_type overflow(int_type ch) override {
+        if (traits_type::eq_int_type(ch, traits_type::eof())) {
+            return traits_type::not_eof(ch);
+        }
+        client.expires_after(ResponseWriteTimeout);
+        return client.rdbuf()->sputc(traits_type::to_char_type(ch));
+    }
+
+    std::streamsize xsputn(const char* data, std::streamsize len) override {
+        client.expires_after(ResponseWriteTimeout);
+        return client.rdbuf()->sputn(data, len);
+    }
+
+    int sync() override {
+        client.expires_after(ResponseWriteTimeout);
+        return client.rdbuf()->pubsync();
+    }
+
+private:
+    /** The connection to which the response is written. */
+    boost::asio::ip::tcp::iostream& client;
+};
 
 // Called by selectQuery() and handles the process of selecting rows
 // Returns the number of rows selected
-int SQLAir::processSelectRow(StrVec& colNames, std::string& toPrint,
+int SQLAir::processSelectRow(const StrVec& colNames, std::ostream& os,
                 CSV& csv, const int& whereColIdx, const std::string& cond,
-                const std::string& value) {
-    int count = 0;
-    CSVRow printRow;
-    for (auto& row : csv) {
-        {  // Critical section for creating a row copy
-        std::scoped_lock<std::mutex> lock(row.rowMutex);
-        printRow = row;
+                const std::string& value, const OrderLimit& order) {
+    const Table& table = asTable(csv);
+    // Resolve column indexes just once for all the rows
+    std::vector<int>& colIdx = buffers.colIdx;
+    colIdx.clear();
+    for (const auto& colName : colNames) {
+        colIdx.push_back(csv.getColumnIndex(colName));
+    }
+    // The caller holds a shared lock on the table. So rows are read in-place
+    std::vector<size_t>& rows = buffers.rows;
+    selectRows(table, whereColIdx, cond, value, order, rows);
+    // The first rows (in order) are skipped as per the offset, if any.
+    const size_t first = std::min(order.offset, rows.size());
+    if (first == rows.size()) {
+        return 0;
+    }
+    os << colNames << "\n";  // Column names precede the first row
+    // Rows are formatted in parallel (if enabled) in batches of tasks.
+    const size_t batchRows = FormatRowsPerTask * getNumParts(SIZE_MAX, 1);
+    std::vector<std::string>& parts = buffers.outParts;
+    for (size_t start = first; start < rows.size(); start += batchRows) {
+        const size_t count = std::min(batchRows, rows.size() - start);
+        parts.resize(getNumParts(count, FormatRowsPerTask));
+        runParts(parts.size(), count,
+            [&](size_t part, size_t first, size_t last) {
+                std::string& out = parts[part];
+                out.clear();
+                for (size_t i = start + first; i < start + last; i++) {
+                    for (size_t col = 0; col < colIdx.size(); col++) {
+                        out += (col > 0 ? "\t" : "");
+                        table.appendValue(rows[i], colIdx[col], out);
+                    }
+                    out += "\n";
+                }
+            });
+        // Write the parts in row order
+        for (const auto& out : parts) {
+            os << out;
+        }
+    }
+    return rows.size() - first;
+}
+
+// Determine the rows selected by a query, in order
+void SQLAir::selectRows(const Table& table, const int whereColIdx,
+                        const std::string& cond, const std::string& value,
+                        const OrderLimit& order, std::vector<size_t>& rows)
+    const {
+    const size_t end = order.end();
+    if (order.orderColIdx == -1) {
+        // Rows are in table order. So just the first rows are needed.
+        findRows(table, whereColIdx, cond, value, rows, end);
+        rows.resize(std::min(rows.size(), end));
+        return;
+    }
+    const Index* index = table.getIndex(order.orderColIdx);
+    if (whereColIdx == -1 && index != nullptr) {
+        // The index has the rows in order. So stop after the first rows.
+        const uint64_t start = Metrics::now();
+        size_t scanned = 0;
+        rows.clear();
+        if (end > 0) {
+            index->forEachOrdered(order.descending,
+                [&rows, &table, &scanned, end](size_t row) {
+                    scanned++;
+                    if (!table.isDeleted(row)) {
+                        rows.push_back(row);
+                    }
+                    return rows.size() < end;
+                });
+        }
+        Metrics::add(Metrics::RowsScanned, scanned);
+        Metrics::add(Metrics::RowsMatched, rows.size());
+        Metrics::elapsed(Metrics::ScanNanos, start);
+        return;
+    }
+    findRows(table, whereColIdx, cond, value, rows);
+    sortRows(RowOrder(table, order.orderColIdx, order.descending), end,
+             rows);
+}
+
+// Sort the first rows in order using bounded heaps
+void SQLAir::sortRows(const RowOrder& order, const size_t count,
+                      std::vector<size_t>& rows) const {
+    // Each task keeps the first rows (in order) in its range of rows. The
+    // first rows overall are among these.
+    std::vector<std::vector<RowOrder::Key>>& heaps = buffers.keyParts;
+    heaps.resize(getNumParts(rows.size(), ScanRowsPerTask));
+    runParts(heaps.size(), rows.size(),
+        [&](size_t part, size_t first, size_t last) {
+            std::vector<RowOrder::Key>& heap = heaps[part];
+            heap.clear();
+            for (size_t i = first; i < last; i++) {
+                order.keep(order.getKey(rows[i]), count, heap);
+            }
+        });
+    for (size_t part = 1; part < heaps.size(); part++) {
+        for (const auto& key : heaps[part]) {
+            order.keep(key, count, heaps[0]);
+        }
+    }
+    order.sort(heaps[0]);
+    rows.clear();
+    for (const auto& key : heaps[0]) {
+        rows.push_back(key.row);
+    }
+}
+
+// Determine the number of parts into which items are to be split
+size_t SQLAir::getNumParts(const size_t count, const size_t minPerPart) const {
+    if (pool == nullptr) {
+        return 1;
+    }
+    // More parts than threads so that threads finishing early can help
+    const size_t maxParts = 4 * parallelism;
+    return std::max<size_t>(1, std::min(maxParts, count / minPerPart));
+}
+
+// Process the parts of a range of items, in parallel if possible
+void SQLAir::runParts(const size_t numParts, const size_t count,
+    const std::function<void(size_t, size_t, size_t)>& process) const {
+    if (numParts <= 1) {
+        process(0, 0, count);
+        return;
+    }
+    pool->run(numParts, [&](size_t part) {
+        process(part, count * part / numParts,
+                count * (part + 1) / numParts);
+    });
+}
+
+// Scan ranges of rows in parallel (if enabled) and merge them in row order
+template <typename FilterRange>
+size_t SQLAir::scanRows(const Table& table, std::vector<size_t>& rows,
+                        const size_t maxRows,
+                        const FilterRange& filterRange) const {
+    // Without a limit, all rows are scanned in a single round. Otherwise,
+    // rounds stop once enough rows match.
+    const size_t rowCount = table.getRowCount();
+    std::vector<std::vector<size_t>>& parts = buffers.rowParts;
+    size_t scanned = 0;
+    rows.clear();
+    size_t round = (maxRows == SIZE_MAX ? rowCount : LimitScanRows);
+    for (size_t start = 0; start < rowCount && rows.size() < maxRows;
+         start += round, round *= 2) {
+        const size_t count = std::min(round, rowCount - start);
+        scanned += count;
+        parts.resize(getNumParts(count, ScanRowsPerTask));
+        runParts(parts.size(), count,
+            [&](size_t part, size_t first, size_t last) {
+                parts[part].clear();
+                filterRange(parts[part], start + first, start + last);
+            });
+        if (rows.empty()) {
+            // The buffers are swapped (rather than moved) to keep both
+            rows.swap(parts[0]);
+        } else {
+            rows.insert(rows.end(), parts[0].begin(), parts[0].end());
+        }
+        for (size_t part = 1; part < parts.size(); part++) {
+            rows.insert(rows.end(), parts[part].begin(), parts[part].end());
+        }
+    }
+    return scanned;
+}
+
+// Remove the deleted rows found via indexes, as deleted rows remain in
+// indexes until the table is compacted.
+void SQLAir::removeDeleted(const Table& table, std::vector<size_t>& rows) {
+    if (table.hasDeleted()) {
+        rows.erase(std::remove_if(rows.begin(), rows.end(),
+            [&table](size_t row) { return table.isDeleted(row); }),
+            rows.end());
+    }
+}
+
+// Find the rows matching a compound where clause, via indexes if possible
+size_t SQLAir::filterRows(const Table& table, const Filter& filter,
+                          std::vector<size_t>& rows,
+                          const size_t maxRows) const {
+    size_t scanned = 0;
+    if (filter.findIndexed(table, rows, scanned)) {
+        removeDeleted(table, rows);
+        return scanned;
+    }
+    return scanRows(table, rows, maxRows,
+        [&](std::vector<size_t>& out, size_t first, size_t last) {
+            for (size_t row = first; row < last; row++) {
+                if (!table.isDeleted(row) && filter(table, row)) {
+                    out.push_back(row);
+                }
+            }
+        });
+}
+
+// Finds the rows in a table that match an optional condition
+void SQLAir::findRows(const Table& table, const int whereColIdx,
+                      const std::string& cond, const std::string& value,
+                      std::vector<size_t>& rows, const size_t maxRows) const {
+    const Index* index = (whereColIdx < 0 || !Index::supports(cond) ?
+                          nullptr : table.getIndex(whereColIdx));
+    const uint64_t start = Metrics::now();
+    size_t scanned = 0;  // The number of rows (or index entries) checked
+    if (whereColIdx == -1 && !table.hasDeleted()) {
+        rows.resize(std::min<size_t>(table.getRowCount(), maxRows));
+        std::iota(rows.begin(), rows.end(), 0);
+        scanned = rows.size();
+    } else if (whereColIdx == -1) {
+        rows.clear();
+        const size_t rowCount = table.getRowCount();
+        for (; scanned < rowCount && rows.size() < maxRows; scanned++) {
+            if (!table.isDeleted(scanned)) {
+                rows.push_back(scanned);
+            }
+        }
+    } else if (whereColIdx == Filter::Column) {
+        scanned = filterRows(table, Filter(table, value), rows, maxRows);
+    } else if (index != nullptr) {
+        // Use the secondary index instead of scanning all the rows
+        index->find(cond, value, table.getRowCount(), rows);
+        scanned = rows.size();
+        removeDeleted(table, rows);
+    } else {
+        // Compile the condition once instead of interpreting it per row
+        const Predicate pred = makePredicate(cond, value);
+        scanned = scanRows(table, rows, maxRows,
+            [&](std::vector<size_t>& out, size_t first, size_t last) {
+                table.filter(whereColIdx, pred, out, first, last);
+            });
+    }
+    Metrics::add(Metrics::RowsScanned, scanned);
+    Metrics::add(Metrics::RowsMatched, rows.size());
+    Metrics::elapsed(Metrics::ScanNanos, start);
+}
+
+// Compile a condition, with matches() as fall-back
+Predicate SQLAir::makePredicate(const std::string& cond,
+                                const std::string& value) const {
+    return Predicate(cond, value,
+        [this](const std::string& colVal, const std::string& cond,
+               const std::string& value) {
+            return matches(colVal, cond, value); });
+}
+
+// Set the degree of parallelism used for scans
+void SQLAir::setParallelism(const int parallelism) {
+    this->parallelism = std::max(1, parallelism);
+    pool.reset(this->parallelism > 1 ?
+               new WorkerPool(this->parallelism - 1) : nullptr);
+}
+
+// Enable logging of changes and start the checkpointing thread
+void SQLAir::setWriteAheadLog(bool writeAheadLog) {
+    this->writeAheadLog = writeAheadLog;
+    if (writeAheadLog && !checkpointer.joinable()) {
+        checkpointer = std::thread(&SQLAir::checkpointTables, this);
+    }
+}
+
+// Stop the checkpointing and compaction threads and async workers, if any
+SQLAir::~SQLAir() {
+    stopAsyncWorkers();
+    if (checkpointer.joinable()) {
+        {
+            std::scoped_lock<std::mutex> guard(checkpointMutex);
+            stopCheckpoints = true;
+        }
+        checkpointCond.notify_one();
+        checkpointer.join();
+    }
+    std::unique_lock<std::mutex> lock(compactMutex);
+    stopCompactions = true;
+    if (compactor.joinable()) {
+        lock.unlock();
+        compactCond.notify_one();
+        compactor.join();
+    }
+}
+
+// Check conditions, including the relational conditions that are not
+// supported by the base class.
+bool SQLAir::matches(const std::string& colVal, const std::string& cond,
+                     const std::string& value) const {
+    if (isRelational(cond)) {
+        return Index::satisfies(Index::compare(colVal, value), cond);
+    }
+    return SQLAirBase::matches(colVal, cond, value);
+}
+
+// Check if a condition is one of "<", ">", "<=", or ">="
+bool SQLAir::isRelational(const std::string& cond) {
+    return (cond == "<" || cond == ">" || cond == "<=" || cond == ">=");
+}
+
+// Extract a (single condition or compound) where clause from a query
+std::tuple<int, std::string, std::string> SQLAir::getWhereClause(
+    const CSV& csv, const StrVec& sql, const int whereIdx) const {
+    if (Filter::isCompound(sql, whereIdx)) {
+        // The clause is compiled here just to validate it
+        std::string clause = Filter::encode(sql, whereIdx);
+        Filter(csv, clause);
+        return {Filter::Column, Filter::Cond, std::move(clause)};
+    }
+    const int colIdx = csv.getColumnIndex(sql[whereIdx + 1]);
+    if (colIdx == -1) {
+        throw Exp("Invalid column " + sql[whereIdx + 1] +
+                  " in where clause.");
+    }
+    const std::string& cond = sql[whereIdx + 2];
+    if (cond != "=" && cond != "<>" && cond != "like" && !isRelational(cond)) {
+        throw Exp("Invalid condition " + cond + " in where clause.");
+    }
+    return {colIdx, cond, sql[whereIdx + 3]};
+}
+
+// Check if a select statement has aggregate functions or a group by clause
+bool SQLAir::isAggregate(const StrVec& sql) {
+    // Functions are in the select list, which ends at from or where.
+    int listEnd = Helper::find(sql, "from");
+    listEnd = (listEnd == -1 ? Helper::find(sql, "where") : listEnd);
+    const int parenIdx = Helper::find(sql, "(");
+    const int groupIdx = Helper::find(sql, "group");
+    return (parenIdx != -1 && (listEnd == -1 || parenIdx < listEnd)) ||
+        (groupIdx != -1 && groupIdx + 1 < static_cast<int>(sql.size()) &&
+         sql[groupIdx + 1] == "by");
+}
+
+// Process select statements with aggregate functions or a group by clause
+void SQLAir::validateAndProcessAggregate(const StrVec& sql, bool mustWait,
+                                         std::ostream& os) {
+    // The group by clause is last. Tokens before it have the same form as
+    // a select statement.
+    const int groupIdx = Helper::find(sql, "group");
+    const StrVec query(sql.begin(), groupIdx == -1 ? sql.end() :
+                       sql.begin() + groupIdx);
+    int listEnd = Helper::find(query, "from");
+    listEnd = (listEnd == -1 ? Helper::find(query, "where") : listEnd);
+    listEnd = (listEnd == -1 ? static_cast<int>(query.size()) : listEnd);
+    // Functions are tokenized as "sum", "(", "col", ")"
+    StrVec items;
+    for (int i = 1; i < listEnd; i++) {
+        if (i + 1 < listEnd && query[i + 1] == "(") {
+            if (i + 3 >= listEnd || query[i + 3] != ")") {
+                throw Exp("Invalid aggregate function " + query[i] +
+                          ". Expected: " + query[i] + "(<column>)");
+            }
+            items.push_back(query[i] + "(" + query[i + 2] + ")");
+            i += 3;
+        } else {
+            items.push_back(query[i]);
+        }
+    }
+    if (items.empty()) {
+        throw Exp("Invalid select statement. Missing columns");
+    }
+    StrVec groupBy;
+    if (groupIdx != -1) {
+        if (groupIdx + 2 >= static_cast<int>(sql.size()) ||
+            sql[groupIdx + 1] != "by") {
+            throw Exp("Invalid group by clause. Expected: "
+                      "group by <col1>, <col2>, ...");
+        }
+        groupBy.assign(sql.begin() + groupIdx + 2, sql.end());
+    }
+    CSV& csv = loadAndGet(Helper::getCSVInfo(query, "from"));
+    const int whereIdx = Helper::find(query, "where");
+    int colIdx = -1;
+    std::string cond, value;
+    if (whereIdx != -1) {
+        std::tie(colIdx, cond, value) = getWhereClause(csv, query, whereIdx);
+    }
+    aggregateQuery(csv, mustWait, items, groupBy, colIdx, cond, value, os);
+}
+
+// Extract the order by and limit clauses at the end of a select statement
+size_t SQLAir::getOrderLimit(const StrVec& sql, std::string& orderCol,
+                             OrderLimit& order) {
+    // Convenience lambda to convert the count in a limit or offset clause
+    auto toCount = [](const std::string& count) {
+        if (count.empty() || count.size() > 18 ||
+            count.find_first_not_of("0123456789") != std::string::npos) {
+            throw Exp("Invalid count " + count + " in limit clause. "
+                      "Expected: limit <count> [offset <count>]");
+        }
+        return static_cast<size_t>(std::stoull(count));
+    };
+    // The clauses are matched from the end, so that values in the where
+    // clause (e.g., 'limit') are not mistaken for them.
+    size_t end = sql.size();
+    if (end >= 4 && sql[end - 4] == "limit" && sql[end - 2] == "offset") {
+        order.limit  = toCount(sql[end - 3]);
+        order.offset = toCount(sql[end - 1]);
+        end -= 4;
+    } else if (end >= 2 && sql[end - 2] == "limit") {
+        order.limit = toCount(sql[end - 1]);
+        end -= 2;
+    }
+    if (end >= 4 && sql[end - 4] == "order" && sql[end - 3] == "by" &&
+        (sql[end - 1] == "asc" || sql[end - 1] == "desc")) {
+        order.descending = (sql[end - 1] == "desc");
+        end--;
+    }
+    if (end >= 3 && sql[end - 3] == "order" && sql[end - 2] == "by") {
+        orderCol = sql[end - 1];
+        end -= 3;
+    }
+    return end;
+}
+
+// Process select statements with order by or limit clauses
+void SQLAir::validateAndProcessOrdered(const StrVec& sql,
+                                       const std::string& orderCol,
+                                       OrderLimit order, bool mustWait,
+                                       std::ostream& os) {
+    if (isAggregate(sql)) {
+        throw Exp("Order by and limit clauses are not supported with "
+                  "aggregate functions.");
+    }
+    const StrVec colNames = Helper::getSelectColNames(sql);
+    CSV& csv = loadAndGet(Helper::getCSVInfo(sql, "from"));
+    checkColNames(csv, colNames);
+    if (!orderCol.empty()) {
+        order.orderColIdx = csv.getColumnIndex(orderCol);
+        if (order.orderColIdx == -1) {
+            throw Exp("Invalid column " + orderCol + " in order by clause.");
+        }
+    }
+    const int whereIdx = Helper::find(sql, "where");
+    int colIdx = -1;
+    std::string cond, value;
+    if (whereIdx != -1) {
+        std::tie(colIdx, cond, value) = getWhereClause(csv, sql, whereIdx);
+    }
+    selectQuery(csv, mustWait, colNames, colIdx, cond, value, order, os);
+}
+
+// Process select statements, handling relational and compound where
+// clauses here.
+void SQLAir::validateAndProcessSelect(const StrVec& sql, bool mustWait,
+                                      std::ostream& os) {
+    if (isJoin(sql)) {
+        validateAndProcessJoin(sql, mustWait, os);
+        return;
+    }
+    std::string orderCol;
+    OrderLimit order;
+    const size_t end = getOrderLimit(sql, orderCol, order);
+    if (end < sql.size()) {
+        validateAndProcessOrdered(StrVec(sql.begin(), sql.begin() + end),
+                                  orderCol, order, mustWait, os);
+        return;
+    }
+    if (isAggregate(sql)) {
+        validateAndProcessAggregate(sql, mustWait, os);
+        return;
+    }
+    const int whereIdx = Helper::find(sql, "where");
+    if (whereIdx == -1 || (!Filter::isCompound(sql, whereIdx) &&
+                           !isRelational(sql[whereIdx + 2]))) {
+        // Not a relational or compound where clause. The base class
+        // handles it.
+        SQLAirBase::validateAndProcessSelect(sql, mustWait, os);
+        return;
+    }
+    const StrVec colNames = Helper::getSelectColNames(sql);
+    CSV& csv = loadAndGet(Helper::getCSVInfo(sql, "from"));
+    checkColNames(csv, colNames);
+    const auto [colIdx, cond, value] = getWhereClause(csv, sql, whereIdx);
+    selectQuery(csv, mustWait, colNames, colIdx, cond, value, os);
+}
+
+// Check if the table in a select statement is followed by a join clause
+bool SQLAir::isJoin(const StrVec& sql) {
+    const int fromIdx = Helper::find(sql, "from");
+    const int size = sql.size();
+    return fromIdx != -1 &&
+        ((fromIdx + 2 < size && sql[fromIdx + 2] == "join") ||
+         (fromIdx + 3 < size && sql[fromIdx + 3] == "join"));
+}
+
+// Process select statements that join two tables
+void SQLAir::validateAndProcessJoin(const StrVec& sql, bool mustWait,
+                                    std::ostream& os) {
+    // A join is run on two tables, which a plan cannot represent.
+    if (recorder != nullptr && !recorder->execute) {
+        throw Exp("Joins cannot be prepared or explained");
+    }
+    if (mustWait) {
+        throw Exp("Wait clauses are not supported with joins.");
+    }
+    if (isAggregate(sql)) {
+        throw Exp("Aggregate functions are not supported with joins.");
+    }
+    std::string orderCol;
+    OrderLimit order;
+    const size_t end = getOrderLimit(sql, orderCol, order);
+    if (!orderCol.empty()) {
+        throw Exp("Order by clauses are not supported with joins.");
+    }
+    const std::string usage = "Invalid join clause. Expected: from <table> "
+        "[<alias>] join <table> [<alias>] on <col1> = <col2>";
+    const StrVec colNames = Helper::getSelectColNames(sql);
+    // The tables are of the form "<table> [<alias>]". Columns are qualified
+    // by the alias or else by the name of the file without its extension.
+    std::array<JoinSide, 2> sides;
+    size_t pos = Helper::find(sql, "from") + 1;
+    for (int side = 0; side < 2; side++) {
+        const std::string next = (side == 0 ? "join" : "on");
+        if (pos >= end) {
+            throw Exp(usage);
+        }
+        const std::string& fileOrURL = sql[pos++];
+        std::string name = fileOrURL.substr(fileOrURL.rfind('/') + 1);
+        name = name.substr(0, name.find('.'));
+        if (pos < end && sql[pos] != next) {
+            name = sql[pos++];
+        }
+        if (pos >= end || sql[pos++] != next) {
+            throw Exp(usage);
+        }
+        sides[side].table = &asTable(loadAndGet(fileOrURL));
+        sides[side].name = name;
+    }
+    if (sides[0].name == sides[1].name) {
+        throw Exp("Tables in a join must have different names. Use aliases, "
+                  "e.g., from <table> a join <table> b");
+    }
+    // Convenience lambda to find the table and column of a column name,
+    // which may be qualified (e.g., "a.name").
+    auto resolve = [&sides](const std::string& colName) {
+        const size_t dot = colName.find('.');
+        for (int side = 0; side < 2 && dot != std::string::npos; side++) {
+            if (colName.compare(0, dot, sides[side].name) == 0) {
+                const int col = sides[side].table->getColumnIndex(
+                    colName.substr(dot + 1));
+                if (col != -1) {
+                    return std::make_pair(side, col);
+                }
+            }
+        }
+        const int left  = sides[0].table->getColumnIndex(colName);
+        const int right = sides[1].table->getColumnIndex(colName);
+        if (left != -1 && right != -1) {
+            throw Exp("Ambiguous column " + colName + " in join.");
+        } else if (left == -1 && right == -1) {
+            throw Exp("Column " + colName + " not found in join.");
+        }
+        return (left != -1 ? std::make_pair(0, left) :
+                std::make_pair(1, right));
+    };
+    if (pos + 3 > end || sql[pos + 1] != "=") {
+        throw Exp(usage);
+    }
+    const auto [lhsSide, lhsCol] = resolve(sql[pos]);
+    const auto [rhsSide, rhsCol] = resolve(sql[pos + 2]);
+    if (lhsSide == rhsSide) {
+        throw Exp("The join condition must compare a column of each table.");
+    }
+    sides[lhsSide].col = lhsCol;
+    sides[rhsSide].col = rhsCol;
+    pos += 3;
+    // The columns selected, with "*" being the columns of both tables
+    StrVec header;
+    std::vector<std::pair<int, int>> cols;
+    if (colNames.at(0) == "*") {
+        for (int side = 0; side < 2; side++) {
+            const StrVec& names = sides[side].table->getColumnNames();
+            for (size_t col = 0; col < names.size(); col++) {
+                header.push_back(names[col]);
+                cols.emplace_back(side, col);
+            }
+        }
+    } else {
+        header = colNames;
+        for (const auto& colName : colNames) {
+            cols.push_back(resolve(colName));
+        }
+    }
+    if (pos < end) {
+        if (sql[pos] != "where") {
+            throw Exp(usage);
+        }
+        pushDownWhere(Filter::encode(StrVec(sql.begin() + pos,
+                                            sql.begin() + end), 0), sides);
+    }
+    joinQuery(sides, header, cols, order, os);
+}
+
+// Apply the where clause of a join to the table whose columns it uses
+void SQLAir::pushDownWhere(const std::string& clause,
+                           std::array<JoinSide, 2>& sides) {
+    std::string errors[2];
+    for (int side = 0; side < 2; side++) {
+        try {
+            sides[side].filter.emplace(*sides[side].table, clause,
+                                       sides[side].name);
+        } catch (const std::exception& exp) {
+            errors[side] = exp.what();
+        }
+    }
+    if (sides[0].filter && sides[1].filter) {
+        throw Exp("Ambiguous where clause in join. Qualify its columns, "
+                  "e.g., " + sides[0].name + ".<col>");
+    } else if (!sides[0].filter && !sides[1].filter) {
+        // The same error (e.g., a missing parenthesis) for both tables is
+        // reported as is.
+        throw Exp(errors[0] == errors[1] ? errors[0] :
+                  "The where clause in a join must use the columns of just "
+                  "one table.");
+    }
+}
+
+// Print the columns of the rows joined from two tables
+void SQLAir::joinQuery(const std::array<JoinSide, 2>& sides,
+                       const StrVec& header,
+                       const std::vector<std::pair<int, int>>& cols,
+                       const OrderLimit& order, std::ostream& os) {
+    Metrics::Timer timer(Metrics::Select);
+    // The tables are locked in a fixed order so that joins of the same
+    // tables (in either order) cannot deadlock with pending writers.
+    Table* first = sides[0].table;
+    Table* second = sides[1].table;
+    if (second < first) {
+        std::swap(first, second);
+    }
+    size_t count = 0;
+    {
+        const uint64_t start = Metrics::now();
+        std::shared_lock<std::shared_mutex> firstLock(first->tableMutex);
+        std::shared_lock<std::shared_mutex> secondLock;
+        if (second != first) {  // A self join locks its table just once
+            secondLock = std::shared_lock<std::shared_mutex>(
+                second->tableMutex);
+        }
+        Metrics::elapsed(Metrics::LockWaitNanos, start);
+        std::vector<std::pair<size_t, size_t>> pairs;
+        joinRows(sides, pairs);
+        // The rows skipped by the offset are after the first ones found.
+        const size_t firstRow = std::min(order.offset, pairs.size());
+        const size_t lastRow = std::min(order.end(), pairs.size());
+        count = lastRow - firstRow;
+        if (count > 0) {
+            os << header << "\n";
+        }
+        // Rows are formatted in parallel (if enabled) in batches of tasks.
+        const size_t batchRows = FormatRowsPerTask * getNumParts(SIZE_MAX, 1);
+        std::vector<std::string>& parts = buffers.outParts;
+        for (size_t start = firstRow; start < lastRow; start += batchRows) {
+            const size_t rows = std::min(batchRows, lastRow - start);
+            parts.resize(getNumParts(rows, FormatRowsPerTask));
+            runParts(parts.size(), rows,
+                [&](size_t part, size_t first, size_t last) {
+                    std::string& out = parts[part];
+                    out.clear();
+                    for (size_t i = start + first; i < start + last; i++) {
+                        const size_t row[2] = {pairs[i].first,
+                                               pairs[i].second};
+                        for (size_t col = 0; col < cols.size(); col++) {
+                            const auto [side, colIdx] = cols[col];
+                            out += (col > 0 ? "\t" : "");
+                            sides[side].table->appendValue(row[side], colIdx,
+                                                           out);
+                        }
+                        out += "\n";
+                    }
+                });
+            for (const auto& out : parts) {
+                os << out;
+            }
+        }
+    }
+    os << count << " row(s) selected." << std::endl;
+}
+
+// Join the rows of two tables by building a hash table of one table (or
+// using an existing index) and probing it with the rows of the other
+void SQLAir::joinRows(const std::array<JoinSide, 2>& sides,
+                      std::vector<std::pair<size_t, size_t>>& pairs) const {
+    const uint64_t start = Metrics::now();
+    size_t scanned = 0;
+    // Convenience lambda to find the rows of a table that satisfy its
+    // (pushed down) where clause, if any.
+    std::vector<size_t> rows[2];
+    auto findSide = [&](const int side) {
+        const JoinSide& join = sides[side];
+        if (join.filter) {
+            scanned += filterRows(*join.table, *join.filter, rows[side]);
+            return;
+        }
+        const size_t rowCount = join.table->getRowCount();
+        for (size_t row = 0; row < rowCount; row++) {
+            if (!join.table->isDeleted(row)) {
+                rows[side].push_back(row);
+            }
+        }
+        scanned += rowCount;
+    };
+    // An index on a join column is used as the hash table, on the larger
+    // table if both are indexed, as the other table is then probed.
+    const Index* indexes[2] = {sides[0].table->getIndex(sides[0].col),
+                               sides[1].table->getIndex(sides[1].col)};
+    int build;
+    if (indexes[0] != nullptr || indexes[1] != nullptr) {
+        build = (indexes[1] == nullptr || (indexes[0] != nullptr &&
+                 sides[0].table->getRowCount() >=
+                 sides[1].table->getRowCount()) ? 0 : 1);
+        findSide(1 - build);
+    } else {
+        findSide(0);
+        findSide(1);
+        build = (rows[0].size() <= rows[1].size() ? 0 : 1);
+    }
+    const int probe = 1 - build;
+    const JoinSide& built = sides[build];
+    const JoinSide& probed = sides[probe];
+    const Index* index = indexes[build];
+    // Otherwise the hash table is built on the smaller set of rows
+    std::unordered_map<std::string, std::vector<size_t>> hash;
+    if (index == nullptr) {
+        hash.reserve(rows[build].size());
+        std::string key;
+        for (const size_t row : rows[build]) {
+            key.clear();
+            built.table->appendValue(row, built.col, key);
+            hash[key].push_back(row);
+        }
+    }
+    // Ranges of rows are probed in parallel (if enabled)
+    const std::vector<size_t>& probeRows = rows[probe];
+    std::vector<std::vector<std::pair<size_t, size_t>>> parts(
+        getNumParts(probeRows.size(), ScanRowsPerTask));
+    runParts(parts.size(), probeRows.size(),
+        [&](size_t part, size_t first, size_t last) {
+            std::string key;
+            std::vector<size_t> found;
+            for (size_t i = first; i < last; i++) {
+                key.clear();
+                probed.table->appendValue(probeRows[i], probed.col, key);
+                const std::vector<size_t>* matches = &found;
+                if (index != nullptr) {
+                    index->find("=", key, built.table->getRowCount(), found);
+                } else {
+                    const auto entry = hash.find(key);
+                    if (entry == hash.end()) {
+                        continue;
+                    }
+                    matches = &entry->second;
+                }
+                for (const size_t row : *matches) {
+                    // Rows from an index are not yet filtered
+                    if (index != nullptr && (built.table->isDeleted(row) ||
+                        (built.filter && !(*built.filter)(*built.table,
+                                                          row)))) {
+                        continue;
+                    }
+                    parts[part].emplace_back(probe == 0 ? probeRows[i] : row,
+                                             probe == 0 ? row : probeRows[i]);
+                }
+            }
+        });
+    pairs.clear();
+    for (const auto& part : parts) {
+        pairs.insert(pairs.end(), part.begin(), part.end());
+    }
+    // Rows are in the order of the first table and then of the second one
+    if (probe == 1) {
+        std::sort(pairs.begin(), pairs.end());
+    }
+    Metrics::add(Metrics::RowsScanned, scanned);
+    Metrics::add(Metrics::RowsMatched, pairs.size());
+    Metrics::elapsed(Metrics::ScanNanos, start);
+}
+
+// Process update statements, handling relational and compound where
+// clauses here.
+void SQLAir::validateAndProcessUpdate(const StrVec& sql, bool mustWait,
+                                      std::ostream& os) {
+    const int whereIdx = Helper::find(sql, "where");
+    if (whereIdx == -1 || (!Filter::isCompound(sql, whereIdx) &&
+                           !isRelational(sql[whereIdx + 2]))) {
+        // Not a relational or compound where clause. The base class
+        // handles it.
+        SQLAirBase::validateAndProcessUpdate(sql, mustWait, os);
+        return;
+    }
+    CSV& csv = loadAndGet(Helper::getCSVInfo(sql, "update"));
+    const int setIdx = Helper::find(sql, "set");
+    if (setIdx == -1 || setIdx > whereIdx) {
+        throw Exp("Invalid update query. Missing set clause");
+    }
+    // The set clause is of the form "col1 = val1, col2 = val2, ..."
+    StrVec colNames, values;
+    for (int i = setIdx + 1; i < whereIdx; i += 3) {
+        if (i + 2 >= whereIdx || sql[i + 1] != "=") {
+            throw Exp("Invalid set clause in update query");
+        }
+        colNames.push_back(sql[i]);
+        values.push_back(sql[i + 2]);
+    }
+    checkColNames(csv, colNames, false, false);
+    const auto [colIdx, cond, value] = getWhereClause(csv, sql, whereIdx);
+    updateQuery(csv, mustWait, colNames, values, colIdx, cond, value, os);
+}
+
+// Process delete statements, handling relational and compound where
+// clauses here.
+void SQLAir::validateAndProcessDelete(const StrVec& sql, bool mustWait,
+                                      std::ostream& os) {
+    const int whereIdx = Helper::find(sql, "where");
+    if (whereIdx == -1 || (!Filter::isCompound(sql, whereIdx) &&
+                           !isRelational(sql[whereIdx + 2]))) {
+        // Not a relational or compound where clause. The base class
+        // handles it.
+        SQLAirBase::validateAndProcessDelete(sql, mustWait, os);
+        return;
+    }
+    CSV& csv = loadAndGet(Helper::getCSVInfo(sql, "from"));
+    const auto [colIdx, cond, value] = getWhereClause(csv, sql, whereIdx);
+    deleteQuery(csv, mustWait, colIdx, cond, value, os);
+}
+
+// Process insert statements, handling inserts of several rows here.
+void SQLAir::validateAndProcessInsert(const StrVec& sql, bool mustWait,
+                                      std::ostream& os) {
+    const int valuesIdx = Helper::find(sql, "values");
+    if (valuesIdx == -1 ||
+        std::count(sql.begin() + valuesIdx, sql.end(), "(") < 2) {
+        // A single row of values. The base class handles it.
+        SQLAirBase::validateAndProcessInsert(sql, mustWait, os);
+        return;
+    }
+    CSV& csv = loadAndGet(Helper::getCSVInfo(sql, "into"));
+    // The optional column names are between the file and "values"
+    StrVec colNames;
+    if (valuesIdx > 3) {
+        if (sql[3] != "(" || sql[valuesIdx - 1] != ")") {
+            throw Exp("Invalid values and/or column names");
+        }
+        colNames.assign(sql.begin() + 4, sql.begin() + valuesIdx - 1);
+        checkColNames(csv, colNames, false, false);
+    }
+    const size_t width = (colNames.empty() ? csv.getColumnCount() :
+                          colNames.size());
+    // Each row is of the form "(val1, val2, ...)". The values of all the
+    // rows are passed to insertQuery() one after another.
+    StrVec values;
+    for (size_t pos = valuesIdx + 1; pos < sql.size();) {
+        const auto end = std::find(sql.begin() + pos, sql.end(), ")");
+        if (sql[pos] != "(" || end == sql.end()) {
+            throw Exp("Invalid values and/or column names");
+        }
+        if (static_cast<size_t>(end - sql.begin()) - pos - 1 != width) {
+            throw Exp("Insufficient number of column values in insert "
+                      "query.");
+        }
+        values.insert(values.end(), sql.begin() + pos + 1, end);
+        pos = end - sql.begin() + 1;
+    }
+    insertQuery(csv, mustWait, colNames, values, os);
+}
+
+// Process queries, using cached plans where possible and handling the
+// statements that are not supported by the base class.
+bool SQLAir::process(const std::string& sql, std::ostream& os) {
+    return processQuery(sql, PlanCache::normalize(sql), os);
+}
+
+// Process a query whose normalized text is already known
+bool SQLAir::processQuery(const std::string& sql, const std::string& key,
+                          std::ostream& os) {
+    PinScope scope;  // Tables used by the query stay in memory until it ends
+    std::shared_ptr<const QueryPlan> plan;
+    if (planCache.find(key, plan)) {
+        runPlan(*plan, os);  // Skip parsing and validating the query
+        buffers.trim();
+        return true;
+    }
+    // Several statements separated by semicolons are run as a batch
+    const size_t semi = key.find(';');
+    if (semi != std::string::npos && semi + 1 < key.size()) {
+        StrVec statements;
+        if (splitStatements(sql, statements) > 1) {
+            return processBatch(statements, os);
+        }
+    }
+    // Cheap check to avoid tokenizing other queries twice
+    const std::string cmd = CSV::toLower(key.substr(0, key.find(' ')));
+    if (cmd == "prepare") {
+        validateAndProcessPrepare(sql, os);
+        return true;
+    } else if (cmd == "explain") {
+        validateAndProcessExplain(sql, os);
+        return true;
+    } else if (cmd.compare(0, 6, "create") == 0 ||
+               cmd.compare(0, 7, "execute") == 0 || (cmd == "wait" &&
+               CSV::toLower(key.substr(5, 6)) == "create")) {
+        const auto [tokens, mustWait, unused] = preprocess(sql);
+        if (tokens.at(0) == "create") {
+            validateAndProcessCreate(tokens, mustWait, os);
+            return true;
+        } else if (tokens.at(0) == "execute") {
+            validateAndProcessExecute(tokens, os);
+            return true;
+        }
+    }
+    // Record the plan while the base class processes the query. The plan
+    // is cached only if the query ran successfully on exactly one table.
+    PlanRecorder rec;
+    recorder = &rec;
+    bool result;
+    try {
+        result = SQLAirBase::process(sql, os);
+    } catch (...) {
+        recorder = nullptr;
+        throw;
+    }
+    recorder = nullptr;
+    if (rec.loads == 1 && rec.queries == 1 && !rec.plan.fileOrURL.empty()) {
+        planCache.insert(key, std::make_shared<const QueryPlan>(rec.plan));
+    }
+    buffers.trim();
+    return result;
+}
+
+// Record the parameters of a query method, if a plan is being recorded.
+bool SQLAir::recordPlan(const CSV& csv, QueryPlan plan) {
+    if (recorder == nullptr) {
+        return true;
+    }
+    plan.fileOrURL = recorder->fileOrURL;
+    if (plan.whereColIdx >= 0) {
+        plan.whereCol = csv.getColumnNames().at(plan.whereColIdx);
+    }
+    recorder->plan = std::move(plan);
+    recorder->queries++;
+    return recorder->execute;
+}
+
+// Run a query using its plan
+void SQLAir::runPlan(const QueryPlan& plan, std::ostream& os) {
+    CSV& csv = loadAndGet(plan.fileOrURL);
+    // The columns may have changed since the plan was made (see whereCol)
+    int whereColIdx = plan.whereColIdx;
+    if (whereColIdx >= 0 &&
+        (whereColIdx = csv.getColumnIndex(plan.whereCol)) == -1) {
+        throw Exp("Invalid column " + plan.whereCol + " in where clause.");
+    }
+    switch (plan.kind) {
+    case QueryPlan::Kind::Select:  // Column names are not copied.
+        runSelect(csv, plan.mustWait, plan.colNames, whereColIdx,
+                  plan.cond, plan.value, plan.orderLimit, os);
+        break;
+    case QueryPlan::Kind::Update:
+        runUpdate(csv, plan.mustWait, plan.colNames, plan.values,
+                  whereColIdx, plan.cond, plan.value, os);
+        break;
+    case QueryPlan::Kind::Insert:
+        insertQuery(csv, plan.mustWait, plan.colNames, plan.values, os);
+        break;
+    case QueryPlan::Kind::Delete:
+        deleteQuery(csv, plan.mustWait, whereColIdx, plan.cond,
+                    plan.value, os);
+        break;
+    case QueryPlan::Kind::Aggregate:
+        aggregateQuery(csv, plan.mustWait, plan.colNames, plan.values,
+                       whereColIdx, plan.cond, plan.value, os);
+        break;
+    }
+}
+
+// Validate and plan (but do not run) a query
+bool SQLAir::planQuery(const std::string& sql, QueryPlan& plan,
+                       std::ostream& os) {
+    PlanRecorder rec;
+    rec.execute = false;
+    recorder = &rec;
+    try {
+        SQLAirBase::process(sql, os);
+    } catch (...) {
+        recorder = nullptr;
+        throw;
+    }
+    recorder = nullptr;
+    plan = std::move(rec.plan);
+    return rec.loads == 1 && rec.queries == 1;
+}
+
+// Split a batch of queries at the semicolons that are not within quotes
+size_t SQLAir::splitStatements(const std::string& sql, StrVec& statements) {
+    statements.clear();
+    char quote = '\0';
+    size_t start = 0;
+    for (size_t i = 0; i <= sql.size(); i++) {
+        const char c = (i < sql.size() ? sql[i] : ';');
+        if (quote != '\0') {
+            quote = (c == quote ? '\0' : quote);
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+        } else if (c == ';' || i == sql.size()) {
+            // Blank statements (e.g., after the last semicolon) are ignored
+            if (sql.find_first_not_of(" \t\r\n", start) < i) {
+                statements.push_back(sql.substr(start, i - start));
+            }
+            start = i + 1;
+        }
+    }
+    return statements.size();
+}
+
+// Run the statements in a batch, combining consecutive inserts
+bool SQLAir::processBatch(const StrVec& statements, std::ostream& os) {
+    // Earlier statements take effect before a later one waits. So the
+    // batch is not processed again (see waitForRows()).
+    if (asyncClient != nullptr) {
+        (*asyncClient)->restartable = false;
+    }
+    // The columns and values of the consecutive inserts into the same
+    // table (and columns) that are yet to be run, and the number of values
+    // in each of the statements.
+    QueryPlan inserts;
+    std::vector<size_t> valueCounts;
+    auto flush = [&]() {
+        if (valueCounts.empty()) {
+            return;
+        }
+        const std::vector<size_t> counts = std::move(valueCounts);
+        valueCounts.clear();  // Nothing is pending, even if inserts fail
+        CSV& csv = loadAndGet(inserts.fileOrURL);
+        insertRows(csv, inserts.colNames, inserts.values);
+        // Report the rows inserted by each of the statements
+        const size_t width = std::max<size_t>(inserts.colNames.empty() ?
+            csv.getColumnCount() : inserts.colNames.size(), 1);
+        for (const size_t count : counts) {
+            printInserted(std::max<size_t>((count + width - 1) / width, 1),
+                          os);
+        }
+    };
+    try {
+        for (const std::string& stmt : statements) {
+            const std::string key = PlanCache::normalize(stmt);
+            std::shared_ptr<const QueryPlan> plan;
+            if (CSV::toLower(key.substr(0, key.find(' '))) == "insert" &&
+                !planCache.find(key, plan)) {
+                QueryPlan newPlan;
+                if (!planQuery(stmt, newPlan, os)) {
+                    throw Exp("Invalid insert statement in batch");
+                }
+                plan = std::make_shared<const QueryPlan>(std::move(newPlan));
+                if (!plan->fileOrURL.empty()) {
+                    planCache.insert(key, plan);
+                }
+            }
+            if (plan == nullptr || plan->kind != QueryPlan::Kind::Insert) {
+                // Other statements run in order after pending inserts
+                flush();
+                if (!processQuery(stmt, key, os)) {
+                    return false;
+                }
+                continue;
+            }
+            if (!valueCounts.empty() &&
+                (plan->fileOrURL != inserts.fileOrURL ||
+                 plan->colNames != inserts.colNames)) {
+                flush();
+            }
+            if (valueCounts.empty()) {
+                inserts.fileOrURL = plan->fileOrURL;
+                inserts.colNames  = plan->colNames;
+                inserts.values.clear();
+            }
+            inserts.values.insert(inserts.values.end(), plan->values.begin(),
+                                  plan->values.end());
+            valueCounts.push_back(plan->values.size());
+        }
+        flush();
+    } catch (...) {
+        flush();  // The statements before the failed one take effect
+        throw;
+    }
+    return true;
+}
+
+// Process "prepare <name> as <query>" statements
+void SQLAir::validateAndProcessPrepare(const std::string& sql,
+                                       std::ostream& os) {
+    std::istringstream is(sql);
+    std::string cmd, name, as, query;
+    is >> cmd >> name >> as;
+    std::getline(is, query, '\0');
+    if (name.empty() || CSV::toLower(as) != "as" ||
+        query.find_first_not_of(" \t\r\n") == std::string::npos) {
+        throw Exp("Invalid prepare statement. Expected: "
+                  "prepare <name> as <query>");
+    }
+    // Check the kind of query first, as other statements cannot be planned
+    // without running them.
+    std::istringstream words(query);
+    std::string kind;
+    words >> kind;
+    kind = CSV::toLower(kind);
+    if (kind != "select" && kind != "update" && kind != "insert" &&
+        kind != "delete") {
+        throw Exp("Only select, update, insert, and delete statements "
+                  "can be prepared");
+    }
+    QueryPlan plan;
+    if (!planQuery(query, plan, os)) {
+        throw Exp("Invalid query in prepare statement");
+    }
+    if (plan.fileOrURL.empty()) {
+        throw Exp("The table must be specified in prepare statements");
+    }
+    // Placeholders are numbered in the order in which they appear.
+    for (size_t i = 0; i < plan.values.size(); i++) {
+        if (plan.values[i] == "?") {
+            plan.params.push_back(i);
+        }
+    }
+    if (plan.whereColIdx >= 0 && plan.value == "?") {
+        plan.params.push_back(-1);
+    } else if (plan.whereColIdx == Filter::Column &&
+               ("\x1f" + plan.value + "\x1f").find("\x1f?\x1f") !=
+               std::string::npos) {
+        throw Exp("Placeholders are not supported in compound where "
+                  "clauses");
+    }
+    name = CSV::toLower(name);
+    {
+        std::scoped_lock<std::mutex> guard(preparedMutex);
+        prepared[name] = std::make_shared<const QueryPlan>(std::move(plan));
+    }
+    os << "Statement " << name << " prepared." << std::endl;
+}
+
+/**
+ * The stream buffer to which "explain analyze" writes the output of the
+ * query. The output is discarded, except for the number of bytes and the
+ * last line.
+ */
+class ExplainBuf : public std::streambuf {
+public:
+    /** The number of bytes written to this buffer. */
+    size_t bytes = 0;
+
+    /** The last complete line written to this buffer. */
+    std::string last;
+
+protected:
+    int_type overflow(int_type c) override {
+        if (c != traits_type::eof()) {
+            put(traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char* str, std::streamsize count) override {
+        for (std::streamsize i = 0; i < count; i++) {
+            put(str[i]);
+        }
+        return count;
+    }
+
+private:
+    /** Add a character to the current line. */
+    void put(const char c) {
+        bytes++;
+        if (c == '\n') {
+            last.swap(line);
+            line.clear();
+        } else {
+            line.push_back(c);
+        }
+    }
+
+    /** The line being written. */
+    std::string line;
+};
+
+// Process "explain [analyze] <query>" statements
+void SQLAir::validateAndProcessExplain(const std::string& sql,
+                                       std::ostream& os) {
+    std::istringstream is(sql);
+    std::string cmd, word, query;
+    is >> cmd >> word;
+    std::getline(is, query, '\0');
+    const bool analyze = (CSV::toLower(word) == "analyze");
+    if (!analyze) {
+        query = word + query;
+    }
+    // Check the kind of query first, as other statements cannot be planned
+    // without running them.
+    std::istringstream words(CSV::toLower(query));
+    std::string kind;
+    while (words >> kind && kind == "wait") {}
+    if (kind != "select" && kind != "update" && kind != "insert" &&
+        kind != "delete") {
+        throw Exp("Only select, update, insert, and delete statements "
+                  "can be explained");
+    }
+    // Parsing includes loading the table, if needed.
+    const uint64_t loadStart = Metrics::get(Metrics::TableLoadNanos);
+    const uint64_t start = Metrics::now();
+    QueryPlan plan;
+    if (!planQuery(query, plan, os)) {
+        throw Exp("Invalid query in explain statement");
+    }
+    const uint64_t loadNanos = Metrics::get(Metrics::TableLoadNanos) -
+        loadStart;
+    const uint64_t parseNanos = Metrics::now() - start - loadNanos;
+    Table& table = asTable(loadAndGet(plan.fileOrURL));
+    std::string path;
+    {
+        std::shared_lock<std::shared_mutex> lock(table.tableMutex);
+        path = getAccessPath(table, plan);
+    }
+    static const char* const Kinds[] = {"select", "update", "insert",
+                                        "delete", "aggregate"};
+    os << "explain\tvalue\n"
+       << "statement\t" << Kinds[static_cast<int>(plan.kind)]
+       << (plan.mustWait ? " (wait)" : "") << '\n'
+       << "table\t" << (plan.fileOrURL.empty() ? "(most recent table)" :
+                        plan.fileOrURL) << '\n'
+       << "access path\t" << path << '\n';
+    if (!analyze) {
+        return;
+    }
+    // The work done by the query is the change in the counters of this
+    // thread, as the query is run (and its scans recorded) by this thread.
+    const Metrics::Counter Counters[] = {
+        Metrics::RowsScanned, Metrics::RowsMatched, Metrics::LockWaitNanos,
+        Metrics::ScanNanos};
+    uint64_t before[4], after[4];
+    for (int i = 0; i < 4; i++) {
+        before[i] = Metrics::get(Counters[i]);
+    }
+    ExplainBuf buf;
+    std::ostream out(&buf);
+    const uint64_t runStart = Metrics::now();
+    runPlan(plan, out);
+    const uint64_t runNanos = Metrics::now() - runStart;
+    for (int i = 0; i < 4; i++) {
+        after[i] = Metrics::get(Counters[i]) - before[i];
+    }
+    // Convenience lambda to print a time in milliseconds
+    char time[32];
+    auto millis = [&time](const uint64_t nanos) {
+        std::snprintf(time, sizeof(time), "%.3f", nanos / 1e6);
+        return time;
+    };
+    os << "rows scanned\t" << after[0] << '\n'
+       << "rows matched\t" << after[1] << '\n'
+       << "parse time (ms)\t" << millis(parseNanos) << '\n'
+       << "load time (ms)\t" << millis(loadNanos) << '\n'
+       << "lock wait (ms)\t" << millis(after[2]) << '\n'
+       << "scan time (ms)\t" << millis(after[3]) << '\n'
+       << "process time (ms)\t"
+       << millis(runNanos - std::min(runNanos, after[2] + after[3])) << '\n'
+       << "total time (ms)\t"
+       << millis(parseNanos + loadNanos + runNanos) << '\n'
+       << "bytes produced\t" << buf.bytes << '\n'
+       << "result\t" << buf.last << std::endl;
+}
+
+// Describe the access path chosen by findRows() and selectRows()
+std::string SQLAir::getAccessPath(const Table& table,
+                                  const QueryPlan& plan) const {
+    if (plan.kind == QueryPlan::Kind::Insert) {
+        return "append";
+    }
+    const StrVec& names = table.getColumnNames();
+    const size_t rowCount = table.getRowCount();
+    const OrderLimit& order = plan.orderLimit;
+    const bool ordered = (plan.kind == QueryPlan::Kind::Select &&
+                          order.orderColIdx != -1);
+    std::string path;
+    if (plan.whereColIdx == Filter::Column) {
+        // The conditions are listed in the order in which they are checked
+        const Filter filter(table, plan.value);
+        const StrVec cols = filter.getIndexedColumns(table);
+        if (cols.empty()) {
+            path = std::string(table.isColumnar() ? "columnar scan" : "scan") +
+                " of " + std::to_string(rowCount) + " rows in " +
+                std::to_string(getNumParts(rowCount, ScanRowsPerTask)) +
+                " part(s)";
+        } else {
+            path = (cols.size() == 1 ? "index on " : "indexes on ");
+            for (size_t i = 0; i < cols.size(); i++) {
+                path += (i > 0 ? ", " : "") + cols[i];
+            }
+        }
+        path += ", filter " + filter.toString();
+    } else if (plan.whereColIdx != -1 && Index::supports(plan.cond) &&
+        table.getIndex(plan.whereColIdx) != nullptr) {
+        path = "index on " + names.at(plan.whereColIdx) + " (" + plan.cond +
+            ")";
+    } else if (plan.whereColIdx != -1) {
+        path = std::string(table.isColumnar() ? "columnar scan" : "scan") +
+            " of " + std::to_string(rowCount) + " rows in " +
+            std::to_string(getNumParts(rowCount, ScanRowsPerTask)) +
+            " part(s)";
+    } else if (ordered && table.getIndex(order.orderColIdx) != nullptr) {
+        return "index on " + names.at(order.orderColIdx) + " in order";
+    } else {
+        path = "all " + std::to_string(rowCount) + " rows";
+    }
+    if (ordered) {
+        path += ", sorted on " + names.at(order.orderColIdx);
+    } else if (plan.kind == QueryPlan::Kind::Select &&
+               order.end() != SIZE_MAX) {
+        path += ", stopping after " + std::to_string(order.end()) + " rows";
+    }
+    return path;
+}
+
+// Process "execute <name>(<value1>, ...)" statements
+void SQLAir::validateAndProcessExecute(const StrVec& sql, std::ostream& os) {
+    if (sql.size() < 2) {
+        throw Exp("Invalid execute statement. Expected: "
+                  "execute <name>(<value1>, ...)");
+    }
+    std::shared_ptr<const QueryPlan> plan;
+    {
+        std::scoped_lock<std::mutex> guard(preparedMutex);
+        const auto entry = prepared.find(sql[1]);
+        if (entry == prepared.end()) {
+            throw Exp("Unknown prepared statement " + sql[1]);
         }
-        // Determine if this row matches "where" clause condition, if any
-        // see SQLAirBase::matches() helper method.
-        if (whereColIdx == -1 ||
-            SQLAirBase::matches(printRow.at(whereColIdx), cond, value)) {
-            std::string delim = "";
-            for (const auto& colName : colNames) {
-                toPrint += delim + printRow.at(csv.getColumnIndex(colName));
-                delim = "\t";
-            }
-            toPrint += "\n";
-            count++;
+        plan = entry->second;
+    }
+    StrVec params;
+    for (size_t i = 2; i < sql.size(); i++) {
+        if (sql[i] != "(" && sql[i] != ")" && sql[i] != ",") {
+            params.push_back(sql[i]);
         }
     }
-    return count;
+    if (params.size() != plan->params.size()) {
+        throw Exp("Statement " + sql[1] + " expects " +
+                  std::to_string(plan->params.size()) + " parameter(s)");
+    }
+    // Substitute the parameters into a copy of the plan.
+    QueryPlan query = *plan;
+    for (size_t i = 0; i < params.size(); i++) {
+        const int pos = plan->params[i];
+        (pos == -1 ? query.value : query.values.at(pos)) = params[i];
+    }
+    runPlan(query, os);
+}
+
+// Process "create index on <file>(<col>)" statements
+void SQLAir::validateAndProcessCreate(const StrVec& sql, bool mustWait,
+                                      std::ostream& os) {
+    if (mustWait) {
+        throw Exp("Wait clauses are not supported with create statements.");
+    }
+    // The file is optional. If it is not specified, recent CSV is used.
+    const int parenIdx = Helper::find(sql, "(");
+    if (sql.size() < 6 || sql[1] != "index" || sql[2] != "on" ||
+        (parenIdx != 3 && parenIdx != 4) ||
+        parenIdx + 3 != static_cast<int>(sql.size()) ||
+        sql[parenIdx + 2] != ")") {
+        throw Exp("Invalid create statement. Expected: "
+                  "create index on <file>(<column>)");
+    }
+    CSV& csv = loadAndGet(parenIdx == 4 ? sql[3] : "");
+    const std::string& colName = sql[parenIdx + 1];
+    checkColNames(csv, {colName}, false, false);
+    const int colIdx = csv.getColumnIndex(colName);
+    Table& table = asTable(csv);
+    {   // Building an index needs exclusive access to the table.
+        std::unique_lock<std::shared_mutex> lock(table.tableMutex);
+        if (table.getIndex(colIdx) != nullptr) {
+            throw Exp("Index on " + colName + " already exists");
+        }
+        table.createIndex(colIdx);
+    }
+    os << "Index on " << colName << " created." << std::endl;
+}
+
+// Save a table to its CSV file and to a binary snapshot, if requested.
+void SQLAir::validateAndProcessSave(const StrVec& sql, bool mustWait,
+                                    std::ostream& os) {
+    // The file is optional. If it is not specified, recent CSV is used.
+    const size_t size = sql.size();
+    if ((size != 3 && size != 4) || sql[size - 2] != "as" ||
+        sql[size - 1] != "binary") {
+        SQLAirBase::validateAndProcessSave(sql, mustWait, os);
+        return;
+    }
+    const auto recent = std::atomic_load(&recentCSV);
+    const std::string fileName = (size == 4 ? sql[1] :
+                                  (recent != nullptr ? *recent : ""));
+    if (fileName.empty() || fileName.find("http://") == 0) {
+        throw Exp("Saving CSV to an URL using POST is not implemented");
+    }
+    saveTable(fileName, true);
+    os << fileName << " saved as binary.\n";
 }
 
 // API method to perform operations associated with a "select" statement
@@ -64,47 +1826,164 @@ int SQLAir::processSelectRow(StrVec& colNames, std::string& toPrint,
 void SQLAir::selectQuery(CSV& csv, bool mustWait, StrVec colNames,
                          const int whereColIdx, const std::string& cond,
                          const std::string& value, std::ostream& os) {
-    // Convert any "*" to suitable column names. See CSV::getColumnNames()
-    // First print the column names.
-    if (colNames.at(0) == "*") {
-        colNames = csv.getColumnNames();
+    selectQuery(csv, mustWait, std::move(colNames), whereColIdx, cond, value,
+                OrderLimit(), os);
+}
+
+// Print the columns of the rows that match an optional condition, in order
+void SQLAir::selectQuery(CSV& csv, bool mustWait, StrVec colNames,
+                         const int whereColIdx, const std::string& cond,
+                         const std::string& value, const OrderLimit& order,
+                         std::ostream& os) {
+    if (recordPlan(csv, {QueryPlan::Kind::Select, "", mustWait, colNames,
+                         {}, whereColIdx, cond, value, {}, order, ""})) {
+        runSelect(csv, mustWait, colNames, whereColIdx, cond, value, order,
+                  os);
     }
+}
+
+// Run a select statement, without copying the column names
+void SQLAir::runSelect(CSV& csv, bool mustWait, const StrVec& selColNames,
+                       const int whereColIdx, const std::string& cond,
+                       const std::string& value, const OrderLimit& order,
+                       std::ostream& os) {
+    Metrics::Timer timer(Metrics::Select);
+    Table& table = asTable(csv);
+    // Convert any "*" to suitable column names. See Table::getColumnNames()
+    // First print the column names.
+    const StrVec& colNames = (selColNames.at(0) == "*" ?
+                              table.getColumnNames() : selColNames);
     
-    std::string toPrint = "";
-    // Print each row that matches an optional condition.
-    int count = processSelectRow(colNames, toPrint, csv,
-                                 whereColIdx, cond, value);
-    if (mustWait && count < 1) {
-        while (count < 1) {
-            std::unique_lock<std::mutex> lock(csv.csvMutex);
-            csv.csvCondVar.wait(lock);
-            count = processSelectRow(colNames, toPrint, csv,
-                                     whereColIdx, cond, value);
+    int count = 0;
+    {   // Concurrent selects share the lock. Writers wait for it.
+        const uint64_t start = Metrics::now();
+        std::shared_lock<std::shared_mutex> lock(table.tableMutex);
+        Metrics::elapsed(Metrics::LockWaitNanos, start);
+        // Print each row that matches an optional condition.
+        count = processSelectRow(colNames, os, csv, whereColIdx, cond, value,
+                                 order);
+        if (mustWait && count < 1) {
+            // Sleep (releasing our shared lock) until a writer modifies
+            // a row that satisfies the where clause. Nothing has been
+            // printed as no rows were selected.
+            const Predicate pred = makePredicate(cond, value);
+            Table::Waiter waiter(table, whereColIdx, pred);
+            // Rows may have been inserted (by a writer holding a shared
+            // lock) before the waiter was registered. So check again.
+            count = processSelectRow(colNames, os, csv, whereColIdx, cond,
+                                     value, order);
+            while (count < 1) {
+                waitForRows(waiter, lock);
+                count = processSelectRow(colNames, os, csv, whereColIdx,
+                                         cond, value, order);
+            }
         }
     }
-    if (count > 0) {
-        os << colNames << "\n" << toPrint;
-    }
     os << count << " row(s) selected." << std::endl;
 }
 
+// Compute aggregate functions over the rows that match an optional condition
+void SQLAir::aggregateQuery(CSV& csv, bool mustWait, const StrVec& items,
+                            const StrVec& groupBy, const int whereColIdx,
+                            const std::string& cond, const std::string& value,
+                            std::ostream& os) {
+    Table& table = asTable(csv);
+    Aggregation result(table, items, groupBy);  // Validates the items
+    if (recorder != nullptr &&
+        !recordPlan(csv, {QueryPlan::Kind::Aggregate, "", mustWait, items,
+                          groupBy, whereColIdx, cond, value, {}, {}, ""})) {
+        return;
+    }
+    Metrics::Timer timer(Metrics::Aggregate);
+    {   // Rows are read in-place while holding a shared lock, like selects.
+        const uint64_t start = Metrics::now();
+        std::shared_lock<std::shared_mutex> lock(table.tableMutex);
+        Metrics::elapsed(Metrics::LockWaitNanos, start);
+        size_t count = aggregateRows(table, whereColIdx, cond, value, result);
+        if (mustWait && count < 1) {
+            // Sleep (releasing our shared lock) until a writer modifies
+            // a row that satisfies the where clause.
+            const Predicate pred = makePredicate(cond, value);
+            Table::Waiter waiter(table, whereColIdx, pred);
+            // Rows may have been inserted (by a writer holding a shared
+            // lock) before the waiter was registered. So check again.
+            count = aggregateRows(table, whereColIdx, cond, value, result);
+            while (count < 1) {
+                waitForRows(waiter, lock);
+                count = aggregateRows(table, whereColIdx, cond, value,
+                                      result);
+            }
+        }
+    }
+    // The results are independent of the table. So the lock is released.
+    result.write(os);
+    os << result.getGroupCount() << " row(s) selected." << std::endl;
+}
+
+// Add the rows that match an optional condition to an aggregation
+size_t SQLAir::aggregateRows(const Table& table, const int whereColIdx,
+                             const std::string& cond, const std::string& value,
+                             Aggregation& result) const {
+    std::vector<size_t>& rows = buffers.rows;
+    findRows(table, whereColIdx, cond, value, rows);
+    const size_t numParts = getNumParts(rows.size(), ScanRowsPerTask);
+    if (numParts <= 1) {
+        for (const size_t row : rows) {
+            result.add(row);
+        }
+        return rows.size();
+    }
+    // Each task aggregates a range of rows into its own partial result.
+    // The partial results are merged in order to preserve group order.
+    std::vector<Aggregation> parts(numParts, result);
+    runParts(numParts, rows.size(),
+        [&](size_t part, size_t first, size_t last) {
+            for (size_t i = first; i < last; i++) {
+                parts[part].add(rows[i]);
+            }
+        });
+    for (const auto& part : parts) {
+        result.merge(part);
+    }
+    return rows.size();
+}
+
 // Called by updateQuery() and handles the process of updating rows
 // Returns the number of rows updated
-int SQLAir::processUpdateRow(CSV& csv, const int& whereColIdx, StrVec& colNames,
-                            const std::string& cond, const std::string& value,
-                            StrVec& values) {
+int SQLAir::processUpdateRow(CSV& csv, const int& whereColIdx,
+                            const StrVec& colNames, const std::string& cond,
+                            const std::string& value, const StrVec& values) {
     int count = 0;
-    for (auto& row : csv) {
-        // Start lock here to keep row.at() MT safe
-        std::scoped_lock<std::mutex> lock(row.rowMutex);
-        if (whereColIdx == -1 ||
-            SQLAirBase::matches(row.at(whereColIdx), cond, value)) {
-            for (size_t i = 0; i < colNames.size(); i++) {
-                row.at(csv.getColumnIndex(colNames[i])) = values[i];
+    Table& table = asTable(csv);
+    // Resolve column indexes just once for all the rows
+    std::vector<int>& colIdx = buffers.colIdx;
+    colIdx.clear();
+    for (const auto& colName : colNames) {
+        colIdx.push_back(csv.getColumnIndex(colName));
+    }
+    // The caller holds an exclusive lock on the table.
+    std::vector<size_t>& rows = buffers.rows;
+    findRows(table, whereColIdx, cond, value, rows);
+    for (const size_t row : rows) {
+        for (size_t i = 0; i < colIdx.size(); i++) {
+            table.setValue(row, colIdx[i], values[i]);
+        }
+        count++;
+    }
+    if (count > 0) {
+        table.bumpVersion();
+        if (table.getLog() != nullptr) {
+            // Log the statement (and not each row) to keep the record short
+            StrVec record = {"U", std::to_string(whereColIdx), cond, value};
+            for (size_t i = 0; i < colIdx.size(); i++) {
+                record.push_back(std::to_string(colIdx[i]));
+                record.push_back(values[i]);
             }
-            count++;
+            table.getLog()->append(record);
         }
     }
+    // Wake up only the waiters that may now find rows
+    table.notifyWaiters(rows, colIdx);
     return count;
 }
 
@@ -113,56 +1992,364 @@ void SQLAir::updateQuery(CSV& csv, bool mustWait, StrVec colNames,
                          StrVec values, const int whereColIdx,
                          const std::string& cond, const std::string& value,
                          std::ostream& os) {
+    if (recordPlan(csv, {QueryPlan::Kind::Update, "", mustWait, colNames,
+                         values, whereColIdx, cond, value, {}, {}, ""})) {
+        runUpdate(csv, mustWait, colNames, values, whereColIdx, cond, value,
+                  os);
+    }
+}
+
+// Run an update statement, without copying the column names and values
+void SQLAir::runUpdate(CSV& csv, bool mustWait, const StrVec& setColNames,
+                       const StrVec& values, const int whereColIdx,
+                       const std::string& cond, const std::string& value,
+                       std::ostream& os) {
+    Metrics::Timer timer(Metrics::Update);
+    Table& table = asTable(csv);
     // Update each row that matches an optional condition.
     // First print the column names.
-    if (colNames.at(0) == "*") {
-        colNames = csv.getColumnNames();
-    }
+    const StrVec& colNames = (setColNames.at(0) == "*" ?
+                              table.getColumnNames() : setColNames);
 
-    int count = processUpdateRow(csv, whereColIdx, colNames, cond, value,
+    int count = 0;
+    {   // Updates need exclusive access to the table.
+        const uint64_t start = Metrics::now();
+        std::unique_lock<std::shared_mutex> lock(table.tableMutex);
+        Metrics::elapsed(Metrics::LockWaitNanos, start);
+        count = processUpdateRow(csv, whereColIdx, colNames, cond, value,
                                  values);
-    if (mustWait && count < 1) {
-        while (count < 1) {
-            std::unique_lock<std::mutex> lock(csv.csvMutex);
-            csv.csvCondVar.wait(lock);
-            count = processUpdateRow(csv, whereColIdx, colNames, cond, value,
-                                     values);
+        if (mustWait && count < 1) {
+            const Predicate pred = makePredicate(cond, value);
+            Table::Waiter waiter(table, whereColIdx, pred);
+            while (count < 1) {
+                waitForRows(waiter, lock);
+                count = processUpdateRow(csv, whereColIdx, colNames, cond,
+                                         value, values);
+            }
         }
     }
-    if (count > 0) {
-        csv.csvCondVar.notify_all();
+    if (count > 0 && table.getLog() != nullptr) {
+        // Flushed without the lock so that concurrent writers share a flush
+        table.getLog()->sync();
     }
     os << count << " row(s) updated." << std::endl;
 }
 
-// This method allows threads to process queries and load files
-void SQLAir::serveClient(std::istream& is, std::ostream& os) {
-    std::ostringstream resp;
-    std::string useless, line, toPrint, tmp;
-    is >> useless >> line;
-    while (std::getline(is, tmp) && (tmp != "\r")) {
+// Adds one or more new rows at the end of a table
+void SQLAir::insertQuery(CSV& csv, bool mustWait, StrVec colNames,
+                         StrVec values, std::ostream& os) {
+    if (!recordPlan(csv, {QueryPlan::Kind::Insert, "", mustWait, colNames,
+                          values, -1, "", "", {}, {}, ""})) {
+        return;
     }
-    if (line.find('?') != std::string::npos) {
-        line = Helper::url_decode(line);
-        line = line.substr(line.find('=') + 1);
+    printInserted(insertRows(csv, colNames, values), os);
+}
 
-        try {
-            process(line, resp);
-        } catch (const std::exception& exp) {
-            resp << "Error: " << exp.what() << std::endl;
+// Appends the rows given by their values under a single lock
+size_t SQLAir::insertRows(CSV& csv, const StrVec& colNames, StrVec& values) {
+    Metrics::Timer timer(Metrics::Insert);
+    std::vector<int>& colIdx = buffers.colIdx;
+    colIdx.clear();
+    for (size_t i = 0; i < (colNames.empty() ? csv.getColumnCount() :
+                            colNames.size()); i++) {
+        colIdx.push_back(colNames.empty() ? static_cast<int>(i) :
+                         csv.getColumnIndex(colNames[i]));
+    }
+    // Columns that are not specified are set to empty strings.
+    const size_t width = std::max<size_t>(colIdx.size(), 1);
+    const size_t count = std::max<size_t>((values.size() + width - 1) / width,
+                                          1);
+    std::vector<StrVec> rows(count, StrVec(csv.getColumnCount()));
+    for (size_t i = 0; i < values.size(); i++) {
+        rows[i / width].at(colIdx.at(i % width)) = std::move(values[i]);
+    }
+    Table& table = asTable(csv);
+    std::vector<size_t> newRows(count);
+    {   // Rows are appended without moving existing rows, if possible. So
+        // selects keep running while the rows are inserted.
+        const uint64_t start = Metrics::now();
+        std::shared_lock<std::shared_mutex> shared(table.tableMutex);
+        std::unique_lock<std::mutex> writer(table.writeMutex);
+        std::unique_lock<std::shared_mutex> lock(table.tableMutex,
+                                                 std::defer_lock);
+        if (!table.canAppendShared(rows)) {
+            // Otherwise, inserts need exclusive access as the rows (or
+            // indexes) may be reallocated.
+            writer.unlock();
+            shared.unlock();
+            lock.lock();
         }
+        Metrics::elapsed(Metrics::LockWaitNanos, start);
+        std::iota(newRows.begin(), newRows.end(), table.getRowCount());
+        for (StrVec& row : rows) {
+            table.appendRow(row);
+            if (table.getLog() != nullptr) {
+                row.insert(row.begin(), "I");
+                table.getLog()->append(row);
+            }
+        }
+        table.bumpVersion();
+        table.notifyWaiters(newRows);
+    }
+    Metrics::add(Metrics::RowsInserted, count);
+    if (table.getLog() != nullptr) {
+        table.getLog()->sync();  // One flush for all the rows
+    }
+    return count;
+}
+
+// Report the number of rows inserted by an insert statement
+void SQLAir::printInserted(const size_t count, std::ostream& os) {
+    if (count == 1) {
+        os << "1 row inserted." << std::endl;
+    } else {
+        os << count << " row(s) inserted." << std::endl;
+    }
+}
 
-        toPrint = resp.str();
-        std::string output = HTTPRespHeader + to_string(toPrint.length())
-                             + "\r\n\r\n" + toPrint;
-        os << output;
+// Removes the rows that match an optional condition from a table
+void SQLAir::deleteQuery(CSV& csv, bool mustWait, const int whereColIdx,
+                         const std::string& cond, const std::string& value,
+                         std::ostream& os) {
+    if (!recordPlan(csv, {QueryPlan::Kind::Delete, "", mustWait, {}, {},
+                          whereColIdx, cond, value, {}, {}, ""})) {
+        return;
+    }
+    Metrics::Timer timer(Metrics::Delete);
+    Table& table = asTable(csv);
+    size_t count = 0;
+    {   // Rows are just marked as deleted, if possible. So selects keep
+        // running while the rows are deleted. Otherwise, deletes (and
+        // deletes that wait) need exclusive access as remaining rows are
+        // moved.
+        std::shared_lock<std::shared_mutex> shared(table.tableMutex,
+                                                   std::defer_lock);
+        std::unique_lock<std::mutex> writer(table.writeMutex,
+                                            std::defer_lock);
+        std::unique_lock<std::shared_mutex> lock(table.tableMutex,
+                                                 std::defer_lock);
+        const uint64_t start = Metrics::now();
+        if (!mustWait && table.canEraseShared()) {
+            shared.lock();
+            writer.lock();
+        } else {
+            lock.lock();
+        }
+        Metrics::elapsed(Metrics::LockWaitNanos, start);
+        std::vector<size_t>& rows = buffers.rows;
+        findRows(table, whereColIdx, cond, value, rows);
+        if (mustWait && rows.empty()) {
+            const Predicate pred = makePredicate(cond, value);
+            Table::Waiter waiter(table, whereColIdx, pred);
+            while (rows.empty()) {
+                waitForRows(waiter, lock);
+                findRows(table, whereColIdx, cond, value, rows);
+            }
+        }
+        // Removing rows never satisfies a where clause of a waiter. So
+        // waiters are not notified.
+        table.eraseRows(rows);
+        count = rows.size();
+        Metrics::add(Metrics::RowsDeleted, count);
+        if (count > 0) {
+            table.bumpVersion();
+            if (table.getLog() != nullptr) {
+                table.getLog()->append({"D", std::to_string(whereColIdx),
+                                        cond, value});
+            }
+        }
+    }
+    if (count > 0 && table.getLog() != nullptr) {
+        table.getLog()->sync();
+    }
+    if (table.needsCompaction()) {
+        scheduleCompaction(table);
+    }
+    os << count << " row(s) deleted." << std::endl;
+}
 
+// This method allows threads to process queries and load files
+bool SQLAir::serveClient(std::istream& is, std::ostream& os) {
+    // The strings are reused for the requests served by this thread
+    std::string& method = buffers.method, & line = buffers.line;
+    std::string& version = buffers.version, & header = buffers.header;
+    if (!(is >> method >> line >> version)) {
+        return false;  // Client closed the connection.
+    }
+    // The tokens in the "Connection" header(s) that decide persistence
+    bool closeToken = false, keepAliveToken = false, gzip = false;
+    size_t bodyLen = 0;
+    std::string& ifNoneMatch = buffers.ifNoneMatch;
+    std::string& ifModifiedSince = buffers.ifModifiedSince;
+    ifNoneMatch.clear();
+    ifModifiedSince.clear();
+    // Convenience lambda to copy the value of a header, without the white
+    // space around it.
+    auto getValue = [&header](const size_t nameLen, std::string& value) {
+        const size_t start = header.find_first_not_of(" \t", nameLen);
+        const size_t end = header.find_last_not_of(" \t\r");
+        value.assign(header, std::min(start, header.size()),
+                     end == std::string::npos || end < start ? 0 :
+                     end + 1 - start);
+    };
+    // Convenience lambda to check for a token in a comma-separated list
+    auto hasToken = [&header](const size_t nameLen,
+                              const std::string& token) {
+        for (size_t start = nameLen; start < header.size();) {
+            const size_t end = std::min(header.find(',', start), header.size());
+            const size_t first = header.find_first_not_of(" \t", start);
+            const size_t last = header.find_last_not_of(" \t\r", end - 1);
+            if (first < end && last != std::string::npos && last >= first &&
+                header.compare(first, last + 1 - first, token) == 0) {
+                return true;
+            }
+            start = end + 1;
+        }
+        return false;
+    };
+    for (std::getline(is, header); std::getline(is, header) &&
+         (header != "\r") && !header.empty();) {
+        std::transform(header.begin(), header.end(), header.begin(),
+                       ::tolower);
+        if (header.find("connection:") == 0) {
+            closeToken = closeToken || hasToken(11, "close");
+            keepAliveToken = keepAliveToken || hasToken(11, "keep-alive");
+        } else if (header.find("content-length:") == 0) {
+            bodyLen = std::strtoul(header.c_str() + 15, nullptr, 10);
+        } else if (header.find("accept-encoding:") == 0) {
+            gzip = (header.find("gzip") != std::string::npos);
+        } else if (header.find("if-none-match:") == 0) {
+            getValue(14, ifNoneMatch);
+        } else if (header.find("if-modified-since:") == 0) {
+            getValue(18, ifModifiedSince);
+        }
+    }
+    // HTTP/1.1 connections are persistent unless the client sends a
+    // "close" token, while older ones are persistent only if it sends a
+    // "keep-alive" token.
+    bool keepAlive = (version == "HTTP/1.1" ? !closeToken : keepAliveToken);
+    if (bodyLen > MaxRequestBodyBytes) {
+        return false;  // Refuse the request and close the connection.
+    }
+    // The body (if any) is always read, so that the next request on a
+    // persistent connection starts where it should.
+    std::string& body = buffers.body;
+    body.resize(bodyLen);
+    if (bodyLen > 0 && !is.read(&body[0], bodyLen)) {
+        return false;
+    }
+    if (method == "POST" && !body.empty()) {
+        // A batch of statements that may be too long for a query string
+        Metrics::add(Metrics::HttpQueries);
+        getQueryFromBody(body);
+        serveQuery(body, keepAlive, os);
+    } else if (line.find('?') != std::string::npos) {
+        Metrics::add(Metrics::HttpQueries);
+        line = Helper::url_decode(std::move(line));
+        line.erase(0, line.find('=') + 1);
+        serveQuery(line, keepAlive, os);
+    } else if (line == "/stats") {
+        Metrics::add(Metrics::HttpStats);
+        ChunkedStreamBuf respBuf(os, keepAlive ? HTTPKeepAliveStatsHeaders :
+                                 HTTPCloseStatsHeaders, 65536);
+        std::ostream resp(&respBuf);
+        Metrics::write(resp);
+        respBuf.finish();
     } else if (!line.empty()) {
-        line = line.substr(1);  // Remove the leading '/' sign.
-        os << http::file(line);
+        Metrics::add(Metrics::HttpFiles);
+        line.erase(0, 1);  // Remove the leading '/' sign.
+        // Files are served from memory, unless they are missing or large
+        if (fileCache.serve(line, ifNoneMatch, ifModifiedSince, gzip,
+                            keepAlive, os)) {
+            return keepAlive;
+        }
+        // Missing files are reported with "Connection: Close" headers
+        keepAlive = keepAlive && std::ifstream(line).good();
+        os << http::file(line, keepAlive ? HTTPKeepAliveFileHeaders :
+                         http::DefaultHttpHeaders);
+    }
+    return keepAlive;
+}
+
+// Run a query and send its response, using cached results where possible
+void SQLAir::serveQuery(const std::string& sql, bool keepAlive,
+                        std::ostream& os) {
+    // Only the results of select statements whose plan is known are
+    // cached, as the plan identifies the table whose version is checked.
+    std::string& query = buffers.query;
+    PlanCache::normalize(sql, query);
+    PinScope scope;  // Keeps the table below in memory for the query
+    std::shared_ptr<const QueryPlan> plan;
+    const Table* table = nullptr;
+    uint64_t version = 0;
+    if (resultCaching && planCache.find(query, plan) &&
+        (plan->kind == QueryPlan::Kind::Select ||
+         plan->kind == QueryPlan::Kind::Aggregate) && !plan->mustWait) {
+        try {
+            table = &asTable(loadAndGet(plan->fileOrURL));
+        } catch (const std::exception&) {
+            table = nullptr;  // The error is reported by process() below.
+        }
+    }
+    if (table != nullptr) {
+        // The version is read before the query is run. So a concurrent
+        // write makes the cached result out of date (and not stale).
+        version = table->getVersion();
+        // Responses differ in the "Connection" header. So it is in the key.
+        buffers.resultKey.assign(keepAlive ? "k " : "c ").append(query);
+        std::shared_ptr<const CachedResult> result;
+        if (resultCache.find(buffers.resultKey, result) &&
+            result->version == version) {
+            Metrics::add(Metrics::ResultCacheHits);
+            os.write(result->response.data(), result->response.size());
+            return;
+        }
+    }
+    // Results are streamed to the client as they are generated. Results
+    // that may be cached are buffered more to send (and cache) them whole.
+    ChunkedStreamBuf respBuf(os, keepAlive ? HTTPKeepAliveRespHeaders :
+                             HTTPCloseRespHeaders,
+                             table != nullptr ? CachedResultBytes : 65536);
+    std::ostream resp(&respBuf);
+    try {
+        processQuery(sql, query, resp);
+    } catch (const std::exception& exp) {
+        resp << "Error: " << exp.what() << std::endl;
+        table = nullptr;  // Errors are not cached.
+    }
+    std::string response;
+    respBuf.finish(table != nullptr ? &response : nullptr);
+    if (!response.empty()) {
+        resultCache.insert(buffers.resultKey,
+            std::make_shared<const CachedResult>(
+                CachedResult{version, std::move(response)}));
+    }
+}
+
+// Serve the requests on a persistent connection until it is closed
+void SQLAir::serveConnection(tcp::iostream& client) {
+    // Responses are flushed explicitly. So do not delay partial segments.
+    client.socket().set_option(tcp::no_delay(true));
+    DeadlineStreamBuf respBuf(client);
+    std::ostream resp(&respBuf);
+    while (true) {
+        // Wait (for a limited time) for the next request to arrive
+        client.expires_after(KeepAliveTimeout);
+        if (client.peek() == EOF) {
+            break;
+        }
+        // Queries (e.g., with wait clauses) are not subject to timeouts.
+        // Only writing the response is (see DeadlineStreamBuf).
+        client.expires_at(std::chrono::steady_clock::time_point::max());
+        if (!serveClient(client, resp) || !resp) {
+            break;  // Closed by the client, or writing failed.
+        }
+        // Send responses right away, unless more (pipelined) requests
+        // are already available to be processed.
+        if (client.rdbuf()->in_avail() <= 0) {
+            resp.flush();
+        }
     }
-    SQLAir::numThreads--;
-    SQLAir::thrCond.notify_one();
 }
 
 // The method to have this class run as a web-server.
@@ -180,89 +2367,727 @@ void SQLAir::runServer(boost::asio::ip::tcp::acceptor& server,
         SQLAir::thrCond.wait(lock,
         [this, maxThr]() { return SQLAir::numThreads < maxThr; });
 
-        std::thread thr([this, client]() { serveClient(*client, *client); });
+        std::thread thr([this, client]() {
+            serveConnection(*client);
+            SQLAir::numThreads--;
+            SQLAir::thrCond.notify_one();
+        });
         thr.detach();
         SQLAir::numThreads++;
     }
 }
 
-// Loads data from server responses while checking for a good connection and
-// a '200 ok' response.
-void SQLAir::setupDownload(const std::string& hostName, const std::string& path,
-                           tcp::iostream& data,
-                           const std::string& port = "80") {
-    // Create a boost socket and request the log file from the server.
-    data.connect(hostName, port);
-    data << "GET " << path << " HTTP/1.1\r\n"
-         << "Host: " << hostName << "\r\n"
-         << "Connection: Close\r\n\r\n";
-    if (!data.good()) {
-        throw Exp("Unable to connect to " + hostName + " at port " + port);
+// The method to have this class run as an asynchronous web-server.
+void SQLAir::runAsyncServer(boost::asio::io_service& service,
+                            boost::asio::ip::tcp::acceptor& server,
+                            const int numWorkers) {
+    acceptAsync(server);
+    {
+        std::scoped_lock<std::mutex> guard(workersMutex);
+        asyncService = &service;
+        runningWorkers = minRunningWorkers = numWorkers;
+        // This thread is also one of the workers running the io_service
+        for (int i = 1; i < numWorkers; i++) {
+            asyncWorkers.emplace_back([&service]() { service.run(); });
+        }
+    }
+    service.run();
+    // Blocked workers use sockets of the io_service. So they are stopped
+    // before the io_service is destroyed.
+    stopAsyncWorkers();
+}
+
+// Accept the next client connection without blocking
+void SQLAir::acceptAsync(boost::asio::ip::tcp::acceptor& server) {
+    auto client = std::make_shared<AsyncClient>(server.get_executor());
+    server.async_accept(client->socket,
+        [this, &server, client](const boost::system::error_code& ec) {
+            acceptAsync(server);  // Keep accepting other clients
+            if (!ec) {
+                readAsync(client);
+            }
+        });
+}
+
+// Read a request from a client without blocking
+void SQLAir::readAsync(AsyncClientPtr client) {
+    boost::asio::async_read_until(client->socket, client->request,
+        "\r\n\r\n",
+        [this, client](const boost::system::error_code& ec, size_t len) {
+            if (ec) {
+                return;  // Client disconnected. The socket is closed.
+            }
+            // Extract just the request line and headers
+            const auto data = client->request.data();
+            std::string request(buffers_begin(data),
+                                buffers_begin(data) + len);
+            client->request.consume(len);
+            const size_t bodyLen = getContentLength(request);
+            if (bodyLen > MaxRequestBodyBytes) {
+                boost::system::error_code ignored;
+                client->socket.shutdown(tcp::socket::shutdown_both, ignored);
+                return;
+            }
+            if (client->request.size() >= bodyLen) {
+                respondAsync(client, std::move(request), bodyLen);
+                return;
+            }
+            // Read the rest of the body first
+            boost::asio::async_read(client->socket, client->request,
+                boost::asio::transfer_exactly(bodyLen -
+                                              client->request.size()),
+                [this, client, request, bodyLen](
+                    const boost::system::error_code& ec, size_t) {
+                    if (!ec) {
+                        respondAsync(client, std::move(request), bodyLen);
+                    }
+                });
+        });
+}
+
+// Process a request whose body has been read and send the response
+void SQLAir::respondAsync(AsyncClientPtr client, std::string request,
+                          const size_t bodyLen) {
+    const auto data = client->request.data();
+    request.append(buffers_begin(data), buffers_begin(data) + bodyLen);
+    client->request.consume(bodyLen);
+    client->pending = std::move(request);
+    processAsync(client);
+}
+
+// Process the pending request of a client (again, if its wait was parked)
+void SQLAir::processAsync(AsyncClientPtr client) {
+    std::istringstream is(client->pending);
+    AsyncResponseBuf respBuf(client->response,
+        [this, &client](std::string& part) {
+            return writeAsync(client, part, false); });
+    std::ostream os(&respBuf);
+    client->restartable = true;
+    asyncClient = &client;
+    try {
+        client->keepAlive = serveClient(is, os);
+    } catch (const ParkedWait&) {
+        asyncClient = nullptr;
+        return;  // Processed again once rows may satisfy the wait.
     }
-    std::string line;
-    std::getline(data, line);
-    if (line.find("200 OK") == std::string::npos) {
-        throw Exp("Error (" + Helper::trim(line) + ") getting " + path +
-                  " from " + hostName + " at port " + port);
+    asyncClient = nullptr;
+    client->pending.clear();
+    if (!respBuf.finish() || !writeAsync(client, client->response, true)) {
+        boost::system::error_code ignored;
+        client->socket.shutdown(tcp::socket::shutdown_both, ignored);
+        return;  // The client disconnected.
+    }
+}
+
+// Wait for rows without blocking a worker of the asynchronous server
+template<typename Lock>
+void SQLAir::waitForRows(Table::Waiter& waiter, Lock& lock) {
+    if (asyncClient == nullptr) {
+        waiter.wait(lock);  // The thread serves just this client.
+        return;
+    }
+    const AsyncClientPtr client = *asyncClient;
+    if (client->restartable) {
+        // The request is processed again (by any worker) once notified
+        waiter.park([this, client]() {
+            boost::asio::post(client->socket.get_executor(),
+                              [this, client]() { processAsync(client); });
+        });
+        throw ParkedWait();
+    }
+    // Earlier statements in a batch have taken effect. So this worker
+    // blocks, and another worker runs the io_service in the meantime.
+    if (!blockWorker(true)) {
+        // The rows would then be added by requests that no worker runs
+        throw Exp("Too many requests are waiting. Try the wait again.");
+    }
+    try {
+        waiter.wait(lock);
+    } catch (...) {
+        unblockWorker();
+        throw;
+    }
+    unblockWorker();
+}
+
+// Start another worker if too few workers would run the io_service
+bool SQLAir::blockWorker(const bool mustReplace) {
+    std::scoped_lock<std::mutex> guard(workersMutex);
+    // Workers that retired have exited (or are about to). So join them.
+    for (const auto id : retiredWorkers) {
+        auto worker = std::find_if(asyncWorkers.begin(), asyncWorkers.end(),
+            [id](const std::thread& thr) { return thr.get_id() == id; });
+        worker->join();
+        asyncWorkers.erase(worker);
+    }
+    retiredWorkers.clear();
+    if (runningWorkers <= minRunningWorkers && asyncService != nullptr) {
+        if (addedWorkers >= minRunningWorkers) {
+            if (mustReplace) {
+                return false;
+            }
+        } else {
+            asyncWorkers.emplace_back([this, service = asyncService]() {
+                runAddedWorker(*service); });
+            addedWorkers++;
+            runningWorkers++;
+        }
+    }
+    runningWorkers--;
+    return true;
+}
+
+// Run the io_service until it stops or this worker is no longer needed
+void SQLAir::runAddedWorker(boost::asio::io_service& service) {
+    while (!service.stopped()) {
+        service.run_one_for(WorkerRetireInterval);
+        std::scoped_lock<std::mutex> guard(workersMutex);
+        if (runningWorkers > minRunningWorkers) {
+            // Blocked workers have resumed. So this worker retires.
+            runningWorkers--;
+            addedWorkers--;
+            retiredWorkers.push_back(std::this_thread::get_id());
+            return;
+        }
+    }
+}
+
+// Count a worker that is no longer blocked
+void SQLAir::unblockWorker() {
+    std::scoped_lock<std::mutex> guard(workersMutex);
+    runningWorkers++;
+}
+
+// Cancel the waits blocking workers and join all the workers
+void SQLAir::stopAsyncWorkers() {
+    std::vector<std::thread> workers;
+    {
+        std::scoped_lock<std::mutex> guard(workersMutex);
+        if (asyncService == nullptr) {
+            return;
+        }
+        asyncService = nullptr;  // Blocked workers are no longer replaced.
+        workers.swap(asyncWorkers);
+        retiredWorkers.clear();
+        addedWorkers = 0;
+    }
+    {
+        std::scoped_lock<std::mutex> guard(writesMutex);
+        writesStopped = true;
+    }
+    writesCond.notify_all();
+    {
+        std::shared_lock<std::shared_mutex> lock(tablesMutex);
+        for (auto& entry : inMemoryCSV) {
+            entry.second.table.cancelWaiters();
+        }
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// Obtain the value of the "Content-Length" header in an HTTP request
+size_t SQLAir::getContentLength(const std::string& request) {
+    std::istringstream is(request);
+    std::string header;
+    while (std::getline(is, header) && header != "\r" && !header.empty()) {
+        std::transform(header.begin(), header.end(), header.begin(),
+                       ::tolower);
+        if (header.find("content-length:") == 0) {
+            return std::strtoul(header.c_str() + 15, nullptr, 10);
+        }
     }
-    for (std::string str;
-         std::getline(data, str) && str != "" && str != "\r";) {
+    return 0;
+}
+
+// Obtain the query from the body of a POST request
+void SQLAir::getQueryFromBody(std::string& body) {
+    // Forms are URL encoded, with spaces as '+'. Otherwise, the body is
+    // the query itself.
+    if (body.compare(0, 6, "query=") == 0) {
+        body.erase(0, 6);
+        std::replace(body.begin(), body.end(), '+', ' ');
+        body = Helper::url_decode(std::move(body));
+    }
+}
+
+// Queue a part of a response to be written without blocking
+bool SQLAir::writeAsync(AsyncClientPtr client, std::string& part,
+                        const bool last) {
+    std::unique_lock<std::mutex> lock(writesMutex);
+    client->restartable = false;  // Parts of the response have been sent.
+    if (client->writeFailed || writesStopped) {
+        return false;
+    }
+    client->parts.push_back(std::move(part));
+    part.clear();
+    client->lastQueued = last;
+    if (!client->writing) {
+        client->writing = true;
+        writeNext(client);
+    }
+    if (!last && client->parts.size() > AsyncQueuedParts) {
+        // The client is slow to read. So this worker waits (instead of
+        // buffering more of the response) and is replaced meanwhile.
+        blockWorker(false);
+        if (!writesCond.wait_for(lock, ResponseWriteTimeout,
+                [this, &client]() {
+                    return client->parts.size() <= AsyncQueuedParts ||
+                        client->writeFailed || writesStopped; })) {
+            // The client stopped reading. Shutting the socket down fails
+            // the pending write, whose handler then drops the parts.
+            client->writeFailed = true;
+            boost::system::error_code ignored;
+            client->socket.shutdown(tcp::socket::shutdown_both, ignored);
+        }
+        unblockWorker();
     }
+    return !client->writeFailed && !writesStopped;
+}
+
+// Write the first queued part and then the rest from the handler
+void SQLAir::writeNext(AsyncClientPtr client) {
+    boost::asio::async_write(client->socket,
+        boost::asio::buffer(client->parts.front()),
+        [this, client](const boost::system::error_code& ec, size_t) {
+            std::unique_lock<std::mutex> lock(writesMutex);
+            client->parts.pop_front();
+            if (ec) {
+                client->writeFailed = true;
+                client->parts.clear();
+            }
+            writesCond.notify_all();  // Wake up the paused worker, if any
+            if (!client->parts.empty()) {
+                writeNext(client);
+                return;
+            }
+            client->writing = false;
+            if (!client->lastQueued) {
+                // More parts are yet to be queued, or the worker finds
+                // that writing failed and closes the connection.
+                return;
+            }
+            client->lastQueued = false;
+            lock.unlock();
+            if (!ec && client->keepAlive) {
+                // Read the next request. Pipelined requests may already be
+                // in the request buffer.
+                readAsync(client);
+                return;
+            }
+            boost::system::error_code ignored;
+            client->socket.shutdown(tcp::socket::shutdown_both, ignored);
+        });
 }
 
 // Helper method to obtain a reference to a pre-loaded CSV file from the
 // inMemoryCSV map.  If the requested file is not present, then this
 // method loads the data into the inMemoryCSV.
 CSV& SQLAir::loadAndGet(std::string fileOrURL) {
-    // Check if the specified fileOrURL is already loaded in a thread-safe
-    // manner to avoid race conditions on the unordered_map
-    {
-        std::scoped_lock<std::mutex> guard(recentCSVMutex);
-        // Use recent CSV if parameter was empty string.
-        fileOrURL = (fileOrURL.empty() ? recentCSV : fileOrURL);
-        // Update the most recently used CSV for the next round
-        recentCSV = fileOrURL;
-        if (inMemoryCSV.find(fileOrURL) != inMemoryCSV.end()) {
-            // Requested CSV is already in memory. Just return it.
-            return inMemoryCSV.at(fileOrURL);
-        }
-    }
-    // When control drops here, we need to load the CSV into memory.
-    // Loading or I/O is being done outside critical sections
-    CSV csv;  // Load data into this csv
+    if (recorder != nullptr) {
+        // Plans refer to the table as specified in the query.
+        recorder->fileOrURL = fileOrURL;
+        recorder->loads++;
+    }
+    // Use recent CSV if parameter was empty string. Otherwise update the
+    // most recently used CSV for the next round (if it has changed).
+    const auto recent = std::atomic_load(&recentCSV);
+    if (fileOrURL.empty()) {
+        fileOrURL = (recent != nullptr ? *recent : "");
+    } else if (recent == nullptr || *recent != fileOrURL) {
+        std::atomic_store(&recentCSV,
+                          std::make_shared<const std::string>(fileOrURL));
+    }
+    // Pin a table (once per request) so that it is not evicted while the
+    // request uses it. This is called while holding tablesMutex.
+    auto use = [this](ResidentTable& entry) -> Table& {
+        if (memoryBudget > 0) {
+            entry.lastUsed.store(++useClock, std::memory_order_relaxed);
+            if (pinned.depth > 0 && std::find(pinned.pins.begin(),
+                    pinned.pins.end(), &entry.pins) == pinned.pins.end()) {
+                entry.pins++;
+                pinned.pins.push_back(&entry.pins);
+            }
+        }
+        return entry.table;
+    };
+    while (true) {
+        {
+            // Tables that are already in memory just need a shared lock.
+            std::shared_lock<std::shared_mutex> lock(tablesMutex);
+            const auto entry = inMemoryCSV.find(fileOrURL);
+            if (entry != inMemoryCSV.end()) {
+                return use(entry->second);
+            }
+        }
+        // Only the first thread to request a table loads it. Other threads
+        // wait for that load to finish (or fail).
+        std::promise<void> loaded;
+        std::shared_future<void> pending;
+        std::vector<int> indexedCols;
+        {
+            std::unique_lock<std::shared_mutex> lock(tablesMutex);
+            if (inMemoryCSV.find(fileOrURL) != inMemoryCSV.end()) {
+                continue;  // Loaded since the check above.
+            }
+            const auto entry = loading.find(fileOrURL);
+            if (entry != loading.end()) {
+                pending = entry->second;
+            } else {
+                loading.emplace(fileOrURL, loaded.get_future().share());
+                const auto evicted = evictedIndexes.find(fileOrURL);
+                if (evicted != evictedIndexes.end()) {
+                    indexedCols = evicted->second;
+                }
+            }
+        }
+        if (pending.valid()) {
+            pending.get();  // Rethrows errors from loading the table
+            continue;
+        }
+        // Loading or I/O is being done outside critical sections
+        Table csv;  // Load data into this csv
+        size_t bytes = 0;
+        try {
+            const uint64_t start = Metrics::now();
+            loadTable(fileOrURL, csv);
+            // Recreate the indexes that the table had when it was evicted
+            for (const int col : indexedCols) {
+                if (col < csv.getColumnCount()) {
+                    csv.createIndex(col);
+                }
+            }
+            Metrics::add(Metrics::TableLoads);
+            Metrics::elapsed(Metrics::TableLoadNanos, start);
+            bytes = (memoryBudget > 0 ? csv.getMemoryBytes() : 0);
+        } catch (...) {
+            // Let the waiting threads report the same error. Subsequent
+            // requests try to load the table again.
+            std::unique_lock<std::shared_mutex> lock(tablesMutex);
+            loading.erase(fileOrURL);
+            loaded.set_exception(std::current_exception());
+            throw;
+        }
+        // Move (instead of copy) the CSV data into our in-memory CSVs. The
+        // reference remains valid as long as the table is pinned (or, if
+        // there is no memory budget, forever as tables are not evicted).
+        std::unique_lock<std::shared_mutex> lock(tablesMutex);
+        ResidentTable& entry = inMemoryCSV[fileOrURL];
+        entry.table.move(csv);
+        entry.savedVersion = entry.sizedVersion = entry.table.getVersion();
+        entry.bytes = bytes;
+        evictedIndexes.erase(fileOrURL);
+        loading.erase(fileOrURL);
+        loaded.set_value();
+        Table& table = use(entry);
+        lock.unlock();
+        if (memoryBudget > 0) {
+            evictTables();
+        }
+        return table;
+    }
+}
+
+// Load the data for a given file or URL into a table.
+void SQLAir::loadTable(const std::string& fileOrURL, Table& csv) {
     if (fileOrURL.find("http://") == 0) {
         // This is an URL. We have to get the stream from a web-server
-        // Implement this feature.
         std::string host, port, path;
         std::tie(host, port, path) = Helper::breakDownURL(fileOrURL);
-        tcp::iostream data;
-        setupDownload(host, path, data, port);
-        csv.load(data);
-    } else {
-        // We assume it is a local file on the server. Load that file.
-        std::ifstream data(fileOrURL);
-        // This method may throw exceptions on errors.
+        // The data is parsed while the rest is being downloaded.
+        HttpDownloadBuf download(host, port, path);
+        std::istream data(&download);
         csv.load(data);
+        download.finish();  // Reports errors that ended the download early
+        if (columnar) {
+            csv.makeColumnar();
+        }
+        return;
+    }
+    // Use a snapshot of the local file, if any, instead of parsing it
+    if (!snapshots || !csv.loadSnapshot(fileOrURL + ".snap", fileOrURL)) {
+        if (!memoryMapped || !csv.loadMapped(fileOrURL, pool.get())) {
+            // We assume it is a local file on the server. Load that file.
+            // Files that cannot be mapped are also loaded here so that the
+            // usual errors are reported.
+            std::ifstream data(fileOrURL);
+            // This method may throw exceptions on errors.
+            csv.load(data);
+        }
+        // Convert to columnar layout (if enabled)
+        if (columnar) {
+            csv.makeColumnar();
+        }
+        if (snapshots) {
+            try {
+                csv.saveSnapshot(fileOrURL + ".snap", fileOrURL);
+            } catch (const std::exception& exp) {
+                // The table is usable. It is just loaded slower next time.
+                std::cerr << exp.what() << std::endl;
+            }
+        }
+    } else if (!columnar) {
+        csv.makeRows();  // Snapshots are always in the columnar layout.
+    }
+    // Apply the changes that were logged since the file was last saved
+    if (writeAheadLog) {
+        replayLog(fileOrURL, csv);
+    }
+}
+
+// Open the log of a table and replay the changes recorded in it.
+void SQLAir::replayLog(const std::string& fileName, Table& table) const {
+    auto log = std::make_unique<WriteAheadLog>(fileName + ".wal");
+    const std::vector<StrVec> records = log->recover();
+    // A checkpoint record ("C", inode, size) is logged just before the
+    // saved data replaces the file. If the file is that data, then the
+    // records up to the checkpoint are already in the file.
+    struct stat info;
+    size_t start = 0;
+    if (::stat(fileName.c_str(), &info) == 0) {
+        const StrVec saved = {"C", std::to_string(info.st_ino),
+                              std::to_string(info.st_size)};
+        for (size_t i = 0; i < records.size(); i++) {
+            start = (records[i] == saved ? i + 1 : start);
+        }
+    }
+    const size_t colCount = table.getColumnCount();
+    for (size_t i = start; i < records.size(); i++) {
+        const StrVec& rec = records[i];
+        if (rec[0] == "I" && rec.size() == colCount + 1) {
+            table.appendRow(StrVec(rec.begin() + 1, rec.end()));
+        } else if ((rec[0] == "U" && rec.size() % 2 == 0) ||
+                   (rec[0] == "D" && rec.size() == 4)) {
+            // The where clause is evaluated again, on the same rows as when
+            // the statement was originally run.
+            std::vector<size_t>& rows = buffers.rows;
+            findRows(table, std::stoi(rec[1]), rec[2], rec[3], rows);
+            if (rec[0] == "D") {
+                table.eraseRows(rows);
+            }
+            for (size_t j = 4; j < rec.size(); j += 2) {
+                for (const size_t row : rows) {
+                    table.setValue(row, std::stoi(rec[j]), rec[j + 1]);
+                }
+            }
+        } else if (rec[0] != "C") {
+            throw Exp("Invalid record in log " + log->getPath());
+        }
+    }
+    if (table.needsCompaction()) {
+        table.compact();  // The table is not yet shared with other threads
+    }
+    table.setLog(std::move(log));
+}
+
+// Save a table to its file (via a temporary file) and clear its log.
+void SQLAir::checkpoint(const std::string& fileName, Table& table,
+                        bool binary) {
+    const std::string temp = fileName + ".tmp";
+    // Writers are blocked until the log is cleared, so that all the
+    // records in the log are in the saved data.
+    std::shared_lock<std::shared_mutex> lock(table.tableMutex);
+    std::scoped_lock<std::mutex> writer(table.writeMutex);
+    {
+        std::ofstream csvData(temp);
+        table.save(csvData);
+        if (!csvData.flush()) {
+            throw Exp("Unable to write " + temp);
+        }
+    }
+    WriteAheadLog::syncPath(temp);
+    WriteAheadLog* log = table.getLog();
+    struct stat info;
+    if (log != nullptr && ::stat(temp.c_str(), &info) == 0) {
+        log->append({"C", std::to_string(info.st_ino),
+                     std::to_string(info.st_size)});
+        log->sync();
+    }
+    if (std::rename(temp.c_str(), fileName.c_str()) != 0) {
+        throw Exp("Unable to replace " + fileName);
+    }
+    const size_t slash = fileName.rfind('/');
+    WriteAheadLog::syncPath(slash == std::string::npos ? "." :
+                            fileName.substr(0, slash + 1));
+    if (log != nullptr) {
+        log->clear();
+    }
+    // Refresh the snapshot, as the snapshot of the old file is not used.
+    const std::string snapshot = fileName + ".snap";
+    if (binary || snapshots || ::access(snapshot.c_str(), F_OK) == 0) {
+        table.saveSnapshot(snapshot, fileName);
+    }
+}
+
+// Periodically checkpoint tables with large logs
+void SQLAir::checkpointTables() {
+    std::unique_lock<std::mutex> lock(checkpointMutex);
+    while (!checkpointCond.wait_for(lock, CheckpointInterval,
+                                    [this]() { return stopCheckpoints; })) {
+        lock.unlock();
+        // Collect the tables first so that loads are not blocked while
+        // files are being written. The tables are pinned, so that they are
+        // not evicted in the meantime.
+        std::vector<std::pair<std::string, ResidentTable*>> tables;
+        {
+            std::shared_lock<std::shared_mutex> guard(tablesMutex);
+            for (auto& entry : inMemoryCSV) {
+                const WriteAheadLog* log = entry.second.table.getLog();
+                if (log != nullptr && log->size() >= CheckpointLogBytes) {
+                    entry.second.pins++;
+                    tables.emplace_back(entry.first, &entry.second);
+                }
+            }
+        }
+        for (const auto& entry : tables) {
+            try {
+                const uint64_t version = entry.second->table.getVersion();
+                checkpoint(entry.first, entry.second->table);
+                entry.second->savedVersion = version;
+            } catch (const std::exception& exp) {
+                // The log is intact. So try again later.
+                std::cerr << exp.what() << std::endl;
+            }
+            entry.second->pins--;
+        }
+        lock.lock();
+    }
+}
+
+// Evict the least recently used tables that are not in use
+void SQLAir::evictTables(const bool save) {
+    // Evicted tables are freed after the lock is released
+    std::list<Table> evicted;
+    std::vector<std::pair<std::string, ResidentTable*>> modified;
+    {
+        std::unique_lock<std::shared_mutex> lock(tablesMutex);
+        // Estimates are refreshed only for modified tables that are not in
+        // use, as their size cannot change while they are not pinned.
+        size_t total = 0;
+        std::vector<std::pair<uint64_t, std::string>> idle;
+        for (auto& [name, entry] : inMemoryCSV) {
+            if (entry.pins == 0 &&
+                entry.table.getVersion() != entry.sizedVersion) {
+                std::shared_lock<std::shared_mutex> guard(
+                    entry.table.tableMutex, std::try_to_lock);
+                if (guard.owns_lock()) {
+                    entry.sizedVersion = entry.table.getVersion();
+                    entry.bytes = entry.table.getMemoryBytes();
+                }
+            }
+            total += entry.bytes;
+            if (entry.pins == 0) {
+                idle.emplace_back(entry.lastUsed.load(), name);
+            }
+        }
+        std::sort(idle.begin(), idle.end());
+        std::scoped_lock<std::mutex> queued(compactMutex);
+        for (size_t i = 0; i < idle.size() && total > memoryBudget; i++) {
+            const auto pos = inMemoryCSV.find(idle[i].second);
+            ResidentTable& entry = pos->second;
+            // Parked waits are registered with the table (and not pinned)
+            if (&entry.table == compacting ||
+                std::find(compactions.begin(), compactions.end(),
+                          &entry.table) != compactions.end() ||
+                entry.table.hasWaiters()) {
+                continue;
+            }
+            // Changes that are not in a log would be lost. So they are
+            // saved first (where possible) and evicted by the next pass.
+            if (entry.table.getVersion() != entry.savedVersion &&
+                entry.table.getLog() == nullptr) {
+                if (save && pos->first.find("http://") != 0) {
+                    entry.pins++;
+                    modified.emplace_back(pos->first, &entry);
+                    total -= std::min(total, entry.bytes);
+                }
+                continue;
+            }
+            total -= std::min(total, entry.bytes);
+            evictedIndexes[pos->first] = entry.table.getIndexedColumns();
+            evicted.emplace_back().move(entry.table);
+            inMemoryCSV.erase(pos);
+            Metrics::add(Metrics::TableEvictions);
+        }
+        Metrics::setTableBytes(total);
+    }
+    if (modified.empty()) {
+        return;
+    }
+    for (const auto& [name, entry] : modified) {
+        try {
+            const uint64_t version = entry->table.getVersion();
+            checkpoint(name, entry->table);
+            entry->savedVersion = version;
+        } catch (const std::exception& exp) {
+            // The table is kept in memory with its changes.
+            std::cerr << exp.what() << std::endl;
+        }
+        entry->pins--;
+    }
+    evictTables(false);
+}
+
+// Queue a table to be compacted in the background
+void SQLAir::scheduleCompaction(Table& table) {
+    std::scoped_lock<std::mutex> guard(compactMutex);
+    if (stopCompactions) {
+        return;
+    }
+    if (std::find(compactions.begin(), compactions.end(), &table) ==
+        compactions.end()) {
+        compactions.push_back(&table);
     }
+    if (!compactor.joinable()) {
+        compactor = std::thread(&SQLAir::compactTables, this);
+    }
+    compactCond.notify_one();
+}
 
-    // We get to this line of code only if the above if-else to load the
-    // CSV did not throw any exceptions. In this case we have a valid CSV
-    // to add to our inMemoryCSV list. We need to do that in a thread-safe
-    // manner.
-    std::scoped_lock<std::mutex> guard(recentCSVMutex);
-    // Move (instead of copy) the CSV data into our in-memory CSVs
-    inMemoryCSV[fileOrURL].move(csv);
-    // Return a reference to the in-memory CSV (not temporary one)
-    return inMemoryCSV.at(fileOrURL);
+// Compact the queued tables until this object is destroyed
+void SQLAir::compactTables() {
+    std::unique_lock<std::mutex> lock(compactMutex);
+    while (true) {
+        compactCond.wait(lock, [this]() {
+            return stopCompactions || !compactions.empty(); });
+        if (stopCompactions) {
+            return;
+        }
+        Table& table = *compactions.back();
+        compactions.pop_back();
+        compacting = &table;
+        lock.unlock();
+        {   // Compaction moves rows. So it needs exclusive access.
+            std::unique_lock<std::shared_mutex> guard(table.tableMutex);
+            if (table.needsCompaction()) {
+                table.compact();
+            }
+        }
+        lock.lock();
+        compacting = nullptr;
+    }
 }
 
 // Save the currently loaded CSV file to a local file.
 void SQLAir::saveQuery(std::ostream& os) {
-    if (recentCSV.empty() || recentCSV.find("http://") == 0) {
+    const auto recent = std::atomic_load(&recentCSV);
+    const std::string fileName = (recent != nullptr ? *recent : "");
+    if (fileName.empty() || fileName.find("http://") == 0) {
         throw Exp("Saving CSV to an URL using POST is not implemented");
     }
-    // Create a local file and have the CSV write itself.
-    std::ofstream csvData(recentCSV);
-    inMemoryCSV.at(recentCSV).save(csvData);
-    os << recentCSV << " saved.\n";
+    saveTable(fileName);
+    os << fileName << " saved.\n";
+}
+
+// Save a table and record the version that was saved
+void SQLAir::saveTable(const std::string& fileName, const bool binary) {
+    Table& table = asTable(loadAndGet(fileName));  // Pinned by the request
+    const uint64_t version = table.getVersion();
+    checkpoint(fileName, table, binary);
+    std::shared_lock<std::shared_mutex> lock(tablesMutex);
+    const auto entry = inMemoryCSV.find(fileName);
+    if (entry != inMemoryCSV.end() && &entry->second.table == &table) {
+        entry->second.savedVersion = version;
+    }
 }
@@ -18,13 +18,91 @@
 #include <thread>
 #include <atomic>
 #include <condition_variable>
+#include <future>
+#include <shared_mutex>
+#include <array>
+#include <optional>
+#include <utility>
+#include <functional>
+#include <deque>
+#include <vector>
 #include "SQLAirBase.h"
+#include "Aggregation.h"
+#include "FileCache.h"
+#include "Filter.h"
+#include "PlanCache.h"
+#include "Predicate.h"
+#include "RowOrder.h"
+#include "Table.h"
+#include "WorkerPool.h"
 
 // Shortcut to smart pointer with TcpStream
 using TcpStreamPtr = std::shared_ptr<boost::asio::ip::tcp::iostream>;
 using namespace boost::asio;
 using namespace boost::asio::ip;
 using namespace std;
+
+/**
+ * The state associated with each client connection when SQLAir runs as an
+ * asynchronous web-server (see SQLAir::runAsyncServer()).
+ */
+struct AsyncClient {
+    /**
+     * Creates a client whose socket is yet to be connected.
+     *
+     * @param executor The executor (of the io_service) used for the socket.
+     */
+    explicit AsyncClient(const tcp::acceptor::executor_type& executor) :
+        socket(executor) {}
+
+    /** The non-blocking socket connected to the client. */
+    tcp::socket socket;
+
+    /** The buffer into which the requests from the client are read. */
+    boost::asio::streambuf request;
+
+    /**
+     * The buffer in which the response (or the current part of a long
+     * response) is generated (see SQLAir::processAsync()).
+     */
+    std::string response;
+
+    /**
+     * The parts of the response that are queued to be written. The first
+     * part is being written if the writing flag is set. These fields are
+     * protected by SQLAir::writesMutex.
+     */
+    std::deque<std::string> parts;
+
+    /** Flag to indicate if the first of the parts is being written. */
+    bool writing = false;
+
+    /** Flag to indicate if the last part of the response is queued. */
+    bool lastQueued = false;
+
+    /** Flag set once writing to the client fails (e.g., disconnected). */
+    bool writeFailed = false;
+
+    /** Flag to indicate if more requests are to be read after response. */
+    bool keepAlive = false;
+
+    /**
+     * The request (with its body) being processed. It is kept until the
+     * response is ready, so that a request whose wait was parked (see
+     * Table::Waiter::park()) can be processed again.
+     */
+    std::string pending;
+
+    /**
+     * Flag cleared once processing the request has taken effect (e.g.,
+     * the earlier statements in a batch), so that it is not processed
+     * again. Such requests block a worker while waiting instead.
+     */
+    bool restartable = true;
+};
+
+// Shortcut to smart pointer with an AsyncClient
+using AsyncClientPtr = std::shared_ptr<AsyncClient>;
 /**
  * The top-level class that facilitates processing SQL-like queries on CSV
  * files. The methods in this class override the default/dummy implementations
@@ -77,6 +155,31 @@ public:
         const int whereColIdx, const std::string& cond, 
         const std::string& value, std::ostream& os) override;
 
+    /**
+     * Method to print a given set of columns for the rows that match an
+     * optional condition, in the order given by an order by clause and
+     * restricted by a limit clause. This method's documentation uses the
+     * following query as an example:
+     *
+     *     select name, altitude from airports.csv where country = 'Peru'
+     *         order by altitude desc limit 10 offset 20;
+     *
+     * With a limit but no order by clause, the scan stops once enough rows
+     * are found. With an order by clause, only the first (offset + limit)
+     * rows in order are kept (see RowOrder) instead of sorting all of the
+     * matching rows. If the order by column is indexed and there is no
+     * where clause, the rows are read in order from the index instead.
+     *
+     * See selectQuery() above for details on the other parameters.
+     *
+     * @param order The order by and limit clauses. Given the above query,
+     * the order by column is altitude, descending is true, limit is 10, and
+     * offset is 20.
+     */
+    void selectQuery(CSV& csv, bool mustWait, StrVec colNames,
+        const int whereColIdx, const std::string& cond,
+        const std::string& value, const OrderLimit& order, std::ostream& os);
+
     /**
      * Method that is called to perform actual operations to update specified
      * values in the CSV. This method's documentation uses the following query
@@ -128,9 +231,7 @@ public:
      * Method that is called by updateQuery() to handle the process of looping
      * through rows of the csv and updating them with new values.
      * 
-     * @note This method will be called from multiple threads. Hence, this
-     * method must take care to ensure its operations are MT-Safe
-     * (multi-threading safe).
+     * @note The caller must hold an exclusive lock on the table's tableMutex.
      * 
      * @param csv The CSV whose values are to be updated. Given the above query,
      * the CSV will correspond to the data for "test.csv" (loaded into memory
@@ -158,25 +259,26 @@ public:
      * method).  Given the above example query, this vector will contain
      * {"2.5", "2"}.
      */
-    int processUpdateRow(CSV& csv, const int& whereColIdx, StrVec& colNames,
-                            const std::string& cond, const std::string& value,
-                            StrVec& values);
+    int processUpdateRow(CSV& csv, const int& whereColIdx,
+                            const StrVec& colNames, const std::string& cond,
+                            const std::string& value, const StrVec& values);
     
     /**
      * Method that is called by selectQuery() to handle the process of looping
      * through rows of the csv and selecting them to be output.
      * 
-     * @note This method will be reading data that may be updated by other
-     * at the same time. As a result, care must be taken to ensure its
-     * operations are MT-safe.
+     * @note The caller must hold (at least) a shared lock on the table's
+     * tableMutex. Consequently, rows are read in-place without copying.
      * 
      * @param colNames The names of the columns to be updated in each row.
      * This method may assume the colNames are valid (as they are validated 
      * in the the update method). Given the above example query, this vector 
      * will contain {"rating", "raters"}.
      * 
-     * @param toPrint The string to be filled with the selected rows. This will
-     * be output by selectQuery()
+     * @param os The output stream to where the column names (only if at
+     * least one row is selected) and the selected rows are written. Rows are
+     * written in small batches as they are selected, so that large results
+     * are streamed rather than buffered in memory.
      * 
      * @param csv The CSV whose values are to be updated. Given the above query,
      * the CSV will correspond to the data for "test.csv" (loaded into memory
@@ -193,36 +295,49 @@ public:
      * 
      * @param value The value to be compared against. Given the above query,
      * this parameter will contain the value "12345" (without quotes)
+     *
+     * @param order The optional order by and limit clauses (see
+     * selectRows()).
      */
-    int processSelectRow(StrVec& colNames, std::string& toPrint,
+    int processSelectRow(const StrVec& colNames, std::ostream& os,
                 CSV& csv, const int& whereColIdx, const std::string& cond,
-                const std::string& value);
+                const std::string& value,
+                const OrderLimit& order = OrderLimit());
 
     /**
-     * This method is called by threads to process queries and file requests,
+     * This method is called by threads to process a query or file request,
      * and puts the results into the output stream. Queries are processed via
-     * the process() method.
+     * the process() method. Connections are persistent (keep-alive) if the
+     * client uses HTTP/1.1 or sends a "Connection: keep-alive" header, unless
+     * the client sends a "Connection: close" header.
+     *
+     * A query is sent either in the query string of a GET request or in the
+     * body of a POST request (see getQueryFromBody()). A query may be a
+     * batch of statements separated by semicolons, whose results are sent
+     * in one response (see processBatch()). Files are served from memory
+     * (see FileCache), with "304 Not Modified" responses to conditional
+     * requests and gzip encoding for clients that accept it.
      * 
-     * @param is The input stream to get requests from.
+     * @param is The input stream to get a request from.
      * 
-     * @param os The output stream to where responses are sent.
+     * @param os The output stream to where the response is sent.
+     *
+     * @return This method returns true if the connection is persistent and
+     * more requests are to be read from the input stream.
      */
-    void serveClient(std::istream& is, std::ostream& os);
+    bool serveClient(std::istream& is, std::ostream& os);
 
     /**
-     * Helper method to load data from server responses and check to ensure
-     * connections are good and with a '200 ok' response header.
-     * 
-     * @param hostName The hostname of the connection.
-     * 
-     * @param path The path to the file.
-     * 
-     * @param data The i/o stream of the connection.
-     * 
-     * @param port The port number.
+     * This method is called by threads in runServer() to process all the
+     * requests on a client connection via serveClient(). Pipelined requests
+     * are processed in order and their responses are sent together. An idle
+     * persistent connection is closed after a timeout to free up the thread.
+     * So is a connection whose client stops reading a response (see
+     * ResponseWriteTimeout in SQLAir.cpp).
+     *
+     * @param client The socket stream connected to the client.
      */
-    void setupDownload(const std::string& hostName, const std::string& path,
-                   tcp::iostream& data, const std::string& port);
+    void serveConnection(tcp::iostream& client);
 
     /**
      * Helper method to perform the actual operations associated with inserting
@@ -251,7 +366,10 @@ public:
      * @param values The values to be set for each column. This method may 
      * assume the values and colNames match.  Given the above example query, 
      * this vector will contain {"title", "2.5", "2"}. Columns whose values
-     * are not specified are assumed to be empty strings.
+     * are not specified are assumed to be empty strings. For statements
+     * that insert several rows (see validateAndProcessInsert()), the values
+     * of the rows follow one another and all the rows are inserted under
+     * a single lock (see insertRows()).
      * 
      * @param os The output stream to where the number of rows updated must
      * be written -- e.g." "1 row inserted.\n"
@@ -296,6 +414,45 @@ public:
     void deleteQuery(CSV& csv, bool mustWait, const int whereColIdx, 
         const std::string& cond, const std::string& value, 
         std::ostream& os) override;
+
+    /**
+     * Method that is called to compute aggregate functions over the rows
+     * that match an optional condition (see Aggregation). This method's
+     * documentation uses the following query as an example:
+     *
+     *    select country, count(*), avg(altitude) from airports.csv
+     *        where altitude > 5000 group by country;
+     *
+     * Matching rows are aggregated in parallel (if enabled) into partial
+     * results that are merged at the end. The results are written in the
+     * same format as select statements, with one row for each group.
+     *
+     * @param csv The CSV whose rows are to be aggregated.
+     *
+     * @param mustWait If this flag is true then this method must wait until
+     * at least 1 row matches the where clause.
+     *
+     * @param items The items in the select list. Given the above query, this
+     * vector will contain {"country", "count(*)", "avg(altitude)"}.
+     *
+     * @param groupBy The columns in the group by clause, if any. Given the
+     * above query, this vector will contain {"country"}.
+     *
+     * @param whereColIdx The index of the column in the where clause, or -1
+     * if a where clause is not present.
+     *
+     * @param cond The condition in the where clause, e.g., ">".
+     *
+     * @param value The value to be compared against, e.g., "5000".
+     *
+     * @param os The output stream to where the results are to be written.
+     *
+     * @exception This method throws an exception if an item in the select
+     * list or a group by column is not valid.
+     */
+    void aggregateQuery(CSV& csv, bool mustWait, const StrVec& items,
+        const StrVec& groupBy, const int whereColIdx, const std::string& cond,
+        const std::string& value, std::ostream& os);
     
     /**
      * Saves the recently used CSV using the name specified in the recentCSV
@@ -315,8 +472,15 @@ public:
      * inMemoryCSV map.  If the requested file is not present, then this
      * method loads the data into the inMemoryCSV.   
      * 
-     * @note Currently, this method is not MT-safe. So avoid calling this 
-     * method from multiple threads simultaneously.
+     * @note This method is MT-safe. Tables that are already in memory are
+     * looked up with just a shared lock. If several threads request a table
+     * that is not in memory, then only the first thread loads it while the
+     * others wait for it to be loaded (or rethrow the error from loading).
+     *
+     * With a memory budget (see setMemoryBudget()), the tables returned to
+     * a request are pinned in memory until the request finishes. Loading a
+     * table may then evict other tables (see evictTables()), which are
+     * loaded again, transparently, when they are next requested.
      * 
      * @param fileOrURL Path to a CSV file or a URL to a CSV data to be returned
      * by this method.  If the path is empty string, then this method returns
@@ -348,6 +512,158 @@ public:
      */
     void runServer(boost::asio::ip::tcp::acceptor& server, const int maxThr);
 
+    /**
+     * Method to have this class run as an asynchronous web-server that runs
+     * forever and keeps processing requests. Unlike runServer(), this method
+     * does not use a thread per connection. Instead, a fixed pool of worker
+     * threads run the io_service and all socket operations are
+     * asynchronous. Hence many concurrent connections can be handled by a
+     * small number of threads.
+     *
+     * @note Queries with a "wait" clause do not block a worker. Instead,
+     * their waits are parked and the requests are processed again once a
+     * modification may satisfy them (see waitForRows()). Workers that do
+     * block (e.g., waiting in the middle of a batch) are replaced, so that
+     * numWorkers threads keep running the io_service. Blocked workers are
+     * stopped (cancelling their waits) once the io_service stops.
+     *
+     * @param service The io_service associated with the acceptor.
+     *
+     * @param server The BOOST acceptor that must be used to accept
+     * connections from clients.
+     *
+     * @param numWorkers The number of worker threads to run the io_service.
+     */
+    void runAsyncServer(boost::asio::io_service& service,
+        boost::asio::ip::tcp::acceptor& server, const int numWorkers);
+
+    /**
+     * Processes a single query. This method adds support for the following
+     * statement (that is not supported by the base class) to build a
+     * secondary index on a column of a CSV:
+     *
+     *     create index on airports.csv(iata);
+     *
+     * All other queries are processed by SQLAirBase::process().
+     *
+     * @param sql The query to be processed.
+     * @param os The output stream to where the results are to be written.
+     *
+     * @return This method returns false if the query was "exit".
+     *
+     * @exception This method throws an exception if errors occur when
+     * processing the query.
+     */
+    bool process(const std::string& sql, std::ostream& os) override;
+
+    /**
+     * Set the storage layout to be used for CSV files that are loaded
+     * subsequently by loadAndGet(). Tables that are already in memory are
+     * not changed.
+     *
+     * @param columnar If this flag is true, then the data is stored in a
+     * typed, column-oriented layout (see ColumnStore) that uses less memory
+     * and is faster to scan. Otherwise, data is stored as rows of strings.
+     */
+    void setColumnar(bool columnar) { this->columnar = columnar; }
+
+    /**
+     * Set how local CSV files that are loaded subsequently by loadAndGet()
+     * are read. Files loaded from a URL are not affected.
+     *
+     * @param memoryMapped If this flag is true, then local files are mapped
+     * into memory and parsed directly into the columnar layout (see
+     * Table::loadMapped()), regardless of setColumnar(). So callers that
+     * want the row layout must not set this flag (main.cpp rejects --mmap
+     * without --columnar). Otherwise, files are read via CSV::load().
+     */
+    void setMemoryMapped(bool memoryMapped) {
+        this->memoryMapped = memoryMapped;
+    }
+
+    /**
+     * Enable or disable caching of the responses to select statements sent
+     * by serveClient(). A cached response is sent as-is (including the
+     * HTTP headers) as long as the table it was computed from has not been
+     * modified since (see Table::getVersion()). Only responses short enough
+     * to be sent with a "Content-Length" header are cached.
+     *
+     * @param resultCaching If this flag is true, then responses are cached.
+     */
+    void setResultCaching(bool resultCaching) {
+        this->resultCaching = resultCaching;
+    }
+
+    /**
+     * Set the degree of parallelism used to scan tables in select and
+     * update statements. Scans of large tables (and formatting of large
+     * results) are split into ranges of rows that are processed by a
+     * shared pool of worker threads. This method must be called before
+     * queries are processed.
+     *
+     * @param parallelism The number of threads (including the thread
+     * running the query) to be used for each scan. A value of 1 disables
+     * parallel scans.
+     */
+    void setParallelism(const int parallelism);
+
+    /**
+     * Enable incremental persistence of changes to local CSV files that are
+     * loaded subsequently by loadAndGet(). Instead of rewriting the whole
+     * file (via a save statement), each update, insert, and delete that
+     * modifies rows appends a small record to a write-ahead log (the file
+     * name with a ".wal" suffix, see WriteAheadLog). The statement returns
+     * only after its record has been flushed to disk. When a table is
+     * loaded, the records in its log are replayed.
+     *
+     * A background thread periodically checkpoints tables with large logs,
+     * i.e., rewrites the CSV file and clears the log (see checkpoint()).
+     * The save statement also checkpoints the table.
+     *
+     * @param writeAheadLog If this flag is true, changes are logged.
+     */
+    void setWriteAheadLog(bool writeAheadLog);
+
+    /**
+     * Enable automatic binary snapshots of local CSV files. When a file is
+     * loaded (or saved), a snapshot of its typed columns is written to the
+     * file name with a ".snap" suffix (see Table::saveSnapshot()). When the
+     * file is loaded again (e.g., after a restart) the snapshot is mapped
+     * into memory instead of the CSV file being parsed. Snapshots (even
+     * those written via "save as binary") are used only if this flag is
+     * true. Tables loaded from snapshots are converted to the row layout,
+     * unless the columnar layout is enabled (see setColumnar()).
+     *
+     * @param snapshots If this flag is true, snapshots are written and
+     * used.
+     */
+    void setSnapshots(bool snapshots) { this->snapshots = snapshots; }
+
+    /**
+     * Set the memory budget for the tables loaded by loadAndGet(). The
+     * memory used by each table (its data and indexes) is estimated when
+     * it is loaded. Once the tables exceed the budget, the least recently
+     * used tables that are not in use by any request are evicted from
+     * memory, and reloaded on their next use (with the same indexes).
+     * Modified tables are evicted only if their changes are in a
+     * write-ahead log (see setWriteAheadLog()). Otherwise, they are first
+     * saved to their local CSV file (as by a save statement). Modified
+     * tables loaded from a URL are kept in memory. This method must be
+     * called before queries are processed.
+     *
+     * @param bytes The budget in bytes. A value of 0 (the default) keeps
+     * all tables in memory.
+     */
+    void setMemoryBudget(size_t bytes) { memoryBudget = bytes; }
+
+    /**
+     * Stops the background checkpointing thread (and compaction thread)
+     * and the blocked workers of the asynchronous server, if any. Changes that
+     * have not been checkpointed remain in the logs and are replayed when
+     * the tables are loaded again.
+     */
+    ~SQLAir();
+
 protected:
     /**
      * This method is a refactored utility method. This method is called from
@@ -458,6 +774,153 @@ protected:
      */
     void clientThread(TcpStreamPtr client);
 
+    /**
+     * Starts an asynchronous accept of the next client connection. When a
+     * client connects, this method is called again to accept the next
+     * client and the request from the client is read via readAsync().
+     *
+     * @param server The acceptor used to accept connections.
+     */
+    void acceptAsync(boost::asio::ip::tcp::acceptor& server);
+
+    /**
+     * Starts an asynchronous read of a request from a client. Once the
+     * request headers are read, the request is processed via serveClient()
+     * and the response is sent via writeAsync().
+     *
+     * @param client The client from which the request is to be read.
+     */
+    void readAsync(AsyncClientPtr client);
+
+    /**
+     * Processes a request read by readAsync() once its body (if any) is in
+     * the client's request buffer, and sends the response via writeAsync().
+     * The request is processed by processAsync().
+     * Responses are buffered in the client's response string. Longer
+     * responses are queued to be written in parts as they are generated
+     * (see AsyncResponseBuf in SQLAir.cpp), so that memory used is bounded.
+     *
+     * @param client The client from which the request was read.
+     * @param request The request line and headers.
+     * @param bodyLen The length of the body, which is taken from the
+     * client's request buffer.
+     */
+    void respondAsync(AsyncClientPtr client, std::string request,
+        const size_t bodyLen);
+
+    /**
+     * Processes the pending request of a client via serveClient() and
+     * sends the response via writeAsync(). If a query in the request
+     * parks its wait (see waitForRows()), nothing is sent and this method
+     * is called again (by a worker) once the wait may be satisfied.
+     *
+     * @param client The client whose pending request is to be processed.
+     */
+    void processAsync(AsyncClientPtr client);
+
+    /**
+     * Waits until a modification to a table could satisfy the where
+     * clause of a waiter. In the asynchronous server, waits of requests
+     * that can be processed again are parked (see Table::Waiter::park())
+     * and this method throws a ParkedWait (see SQLAir.cpp) to unwind the
+     * request. Other waits block the worker, which is then replaced (see
+     * blockWorker()). If too many workers are blocked already, an
+     * exception is thrown instead. Threads of the other servers just wait.
+     *
+     * @param waiter The waiter registered for the where clause.
+     * @param lock The shared or exclusive lock on the table's tableMutex
+     * held by the caller, which is released while waiting.
+     */
+    template<typename Lock>
+    void waitForRows(Table::Waiter& waiter, Lock& lock);
+
+    /**
+     * Called by a worker of the asynchronous server before it blocks. If
+     * fewer than the initial number of workers would then run the
+     * io_service, another worker is started (see runAddedWorker()). At
+     * most as many workers as the initial ones are added.
+     *
+     * @param mustReplace If true, the worker may block only if it is
+     * replaced (or not needed). Waits for rows must not block all the
+     * workers, as the rows are then never added. Other workers (e.g.,
+     * waiting for a slow client in writeAsync()) may block regardless.
+     *
+     * @return This method returns false if the worker must not block.
+     */
+    bool blockWorker(bool mustReplace);
+
+    /**
+     * The method run by a worker started by blockWorker(). It runs the
+     * io_service until it stops, or until more than the initial number of
+     * workers are running (i.e., blocked workers have resumed) and this
+     * worker retires. Retired workers are joined by the next call to
+     * blockWorker() (or by stopAsyncWorkers()).
+     *
+     * @param service The io_service run by the asynchronous server.
+     */
+    void runAddedWorker(boost::asio::io_service& service);
+
+    /**
+     * Called by a worker of the asynchronous server after it was blocked
+     * (see blockWorker()).
+     */
+    void unblockWorker();
+
+    /**
+     * Obtain the length of the body of an HTTP request from its
+     * "Content-Length" header.
+     *
+     * @param request The request line and headers.
+     *
+     * @return The length of the body, or zero if there is no such header.
+     */
+    static size_t getContentLength(const std::string& request);
+
+    /**
+     * Obtain the query sent in the body of a POST request. The body is
+     * either URL encoded form data with a "query" field (e.g., from a HTML
+     * form) or the text of the query itself.
+     *
+     * @param body The body of the request, which is replaced by the query.
+     */
+    static void getQueryFromBody(std::string& body);
+
+    /**
+     * Queues a part of the response to a client to be written without
+     * blocking (see writeNext()). Once the last part has been written, the
+     * next request is read from persistent connections. Otherwise the
+     * connection is closed. If more than AsyncQueuedParts (see SQLAir.cpp)
+     * are queued, this method waits for the client to read some of them.
+     * The worker is replaced while it waits (see blockWorker()). If the
+     * client reads none for ResponseWriteTimeout, the connection is shut
+     * down and the rest of the response is dropped.
+     *
+     * @param client The client whose response is to be sent.
+     * @param part The part of the response. Its data is moved to the queue.
+     * @param last Flag to indicate if this is the last part.
+     *
+     * @return This method returns false if the response can no longer be
+     * written (e.g., the client disconnected or the server is stopping).
+     */
+    bool writeAsync(AsyncClientPtr client, std::string& part, bool last);
+
+    /**
+     * Starts an asynchronous write of the first queued part of a client's
+     * response. Its handler writes the next part, if any. The caller must
+     * hold writesMutex.
+     *
+     * @param client The client whose response is being sent.
+     */
+    void writeNext(AsyncClientPtr client);
+
+    /**
+     * Stops and joins the workers of the asynchronous server, if any.
+     * Queries that are waiting are cancelled (see Table::cancelWaiters()),
+     * i.e., blocked ones respond with an error and parked ones are
+     * dropped.
+     */
+    void stopAsyncWorkers();
+
     /**
      * Internal helper method to obtain CSV file from a given URL. The URL
      * processing is initially done in the gloadAndGet method that calls
@@ -485,29 +948,1027 @@ protected:
      */
     void loadFromURL(CSV& csv, const std::string& hostName, 
         const std::string& port, const std::string& path);
-    
-private:
+
     /**
-     * The most recently referenced CSV in a query. This value is updated
-     * int he getOrLoadCSV method.
+     * Checks a condition in a where clause. In addition to the conditions
+     * supported by the base class, this method supports the relational
+     * conditions "<", ">", "<=", and ">=". Relational conditions compare
+     * values as numbers if both values are numbers and as strings otherwise.
+     *
+     * @param colVal The value in a column of the CSV to be checked.
+     * @param cond The condition to be checked.
+     * @param value The value specified by the user to be used.
+     *
+     * @return This method returns true if the condition is met.
      */
-    std::string recentCSV;
-    
+    bool matches(const std::string& colVal, const std::string& cond,
+        const std::string& value) const override;
+
     /**
-     * This is a convenience mutex that is used to enable thread-safe 
-     * operations on the recentCSV instance variable in this class. This
-     * mutex is locked and unlocked in the loadAndGet method in this class.
+     * Processes select statements. Where clauses with relational conditions
+     * and statements with aggregate functions or a group by clause (see
+     * validateAndProcessAggregate()) or joins (see validateAndProcessJoin())
+     * are validated by this method. All other statements are processed by
+     * SQLAirBase::validateAndProcessSelect().
+     *
+     * @param sql The tokens in the select statement to be processed.
+     * @param mustWait Flag to indicate if the query must keep running until
+     * at least 1 matching row is found.
+     * @param os The output stream to where the results are to be written.
      */
-    std::mutex recentCSVMutex;
-    
+    void validateAndProcessSelect(const StrVec& sql, bool mustWait,
+        std::ostream& os) override;
+
     /**
-     * An unordered map to maintain the CSV files that have been accessed
-     * in recent queries.  This map is used to provide convenient/rapid
-     * access to CSV files that the user has recently worked with. The most
-     * recent CSV used is tracked by the recentCSV instance variable. See the
-     * getOrLoadCSV() method in this class.
+     * Processes select statements that join two tables, e.g.,
+     *
+     *     select a.name, b.title from a.csv join b.csv on a.id = b.id
+     *         where b.year > 2000 limit 10;
+     *
+     * Each table may be followed by an alias. Columns may be qualified by
+     * the alias (or else the name of the file without its extension) and
+     * must be qualified if both tables have them. A where clause (with one
+     * or more conditions) is applied to the one table whose columns it uses,
+     * before the join. Limit and offset clauses are supported, but order by
+     * clauses, aggregate functions, and wait clauses are not. The rows are
+     * joined by joinQuery().
+     *
+     * @param sql The tokens in the select statement to be processed.
+     * @param mustWait Flag to indicate if the query must wait for rows. This
+     * must be false, as joins do not wait.
+     * @param os The output stream to where the results are to be written.
+     *
+     * @exception This method throws an exception if the statement is not
+     * valid.
+     */
+    void validateAndProcessJoin(const StrVec& sql, bool mustWait,
+        std::ostream& os);
+
+    /**
+     * Processes update statements. Where clauses with relational conditions
+     * are validated by this method. All other statements are processed by
+     * SQLAirBase::validateAndProcessUpdate().
+     *
+     * @param sql The tokens in the update statement to be processed.
+     * @param mustWait Flag to indicate if the query must keep running until
+     * at least 1 row is updated.
+     * @param os The output stream to where the results are to be written.
+     */
+    void validateAndProcessUpdate(const StrVec& sql, bool mustWait,
+        std::ostream& os) override;
+
+    /**
+     * Processes insert statements. This method adds support for inserting
+     * several rows with one statement, e.g.,
+     *
+     *     insert into test.csv (name, rating) values ('a', 4.5), ('b', 3);
+     *
+     * The column names are optional (all columns are set in order if they
+     * are not specified) but each row must have a value for each of the
+     * columns. All other statements are processed by
+     * SQLAirBase::validateAndProcessInsert().
+     *
+     * @param sql The tokens in the insert statement to be processed.
+     * @param mustWait This flag is not applicable for this statement.
+     * @param os The output stream to where the results are to be written.
+     */
+    void validateAndProcessInsert(const StrVec& sql, bool mustWait,
+        std::ostream& os) override;
+
+    /**
+     * Processes delete statements. Where clauses with relational conditions
+     * are validated by this method. All other statements are processed by
+     * SQLAirBase::validateAndProcessDelete().
+     *
+     * @param sql The tokens in the delete statement to be processed.
+     * @param mustWait Flag to indicate if the query must keep running until
+     * at least 1 row is deleted.
+     * @param os The output stream to where the results are to be written.
+     */
+    void validateAndProcessDelete(const StrVec& sql, bool mustWait,
+        std::ostream& os) override;
+
+    /**
+     * Processes save statements. This method adds support for saving a
+     * table as a binary snapshot, via statements of the form
+     * "save <file> as binary" where the file is optional (the most recent
+     * CSV is used if the file is not specified). The table is saved to
+     * its CSV file and to a binary snapshot (see setSnapshots()). The CSV
+     * file is also saved because a snapshot is used only along with the
+     * CSV file it was written from. All other save statements are
+     * processed by SQLAirBase::validateAndProcessSave().
+     *
+     * @param sql The tokens in the save statement to be processed.
+     * @param mustWait This flag is not applicable for this statement.
+     * @param os The output stream to where the results are to be written.
+     *
+     * @exception This method throws an exception if the files could not
+     * be written.
+     */
+    void validateAndProcessSave(const StrVec& sql, bool mustWait,
+        std::ostream& os) override;
+
+    /**
+     * Checks if a "create index" statement is valid and builds the index.
+     * The statement is of the form "create index on <file>(<col>)" where
+     * the file is optional (the most recent CSV is used if the file is not
+     * specified). The index is subsequently used (and maintained) by the
+     * select, update, insert, and delete statements.
+     *
+     * @param sql The tokens in the create statement to be processed.
+     * @param mustWait Flag to indicate if the statement has a "wait"
+     * clause, which is not supported for this statement.
+     * @param os The output stream to where the results are to be written.
+     *
+     * @exception This method throws an exception if the statement has a
+     * "wait" clause, is not valid, or if the column is already indexed.
+     */
+    void validateAndProcessCreate(const StrVec& sql, bool mustWait,
+        std::ostream& os);
+
+    /**
+     * Checks and stores a prepared statement. The statement is of the form
+     * "prepare <name> as <query>", where the query is a select, update,
+     * insert, or delete statement. A "?" in place of a value in the where
+     * clause or in the values to be stored is a placeholder for a parameter
+     * supplied via the "execute" statement. The query is validated (but not
+     * run) and its plan is saved, so that executing it skips parsing.
+     *
+     * @param sql The text of the prepare statement.
+     * @param os The output stream to where the results are to be written.
+     *
+     * @exception This method throws an exception if the statement is not
+     * valid.
      */
-    std::unordered_map<std::string, CSV> inMemoryCSV;
+    void validateAndProcessPrepare(const std::string& sql, std::ostream& os);
+
+    /**
+     * Processes "explain <query>" and "explain analyze <query>" statements,
+     * where the query is a select, update, insert, or delete statement.
+     * The first form only reports how the query would be run: the kind of
+     * statement, the table, and the access path (see getAccessPath()).
+     * The second form also runs the query (so changes are made as usual)
+     * and reports the rows scanned and matched, the time spent in each
+     * phase (parsing, loading the table, waiting for locks, finding rows,
+     * and processing the rows found), and the bytes of output produced.
+     * The output of the query itself is discarded, except for its last
+     * line (e.g., "3 row(s) selected.").
+     *
+     * @param sql The text of the explain statement.
+     * @param os The output stream to where the results are to be written.
+     *
+     * @exception This method throws an exception if the statement is not
+     * valid.
+     */
+    void validateAndProcessExplain(const std::string& sql, std::ostream& os);
+
+    /**
+     * Describes the way in which the rows for a query are found, in the
+     * same way as findRows() and selectRows() choose it, e.g., "index on
+     * iata (=)" or "scan of 7698 rows in 4 part(s)". The caller must hold
+     * a lock on the table.
+     *
+     * @param table The table on which the query is run.
+     * @param plan The plan of the query.
+     *
+     * @return The description of the access path.
+     */
+    std::string getAccessPath(const Table& table,
+                              const QueryPlan& plan) const;
+
+    /**
+     * Runs a prepared statement. The statement is of the form
+     * "execute <name>(<value1>, <value2>, ...)" where the values replace
+     * the placeholders in the prepared statement, in order. The parentheses
+     * are optional if there are no placeholders.
+     *
+     * @param sql The tokens in the execute statement to be processed.
+     * @param os The output stream to where the results are to be written.
+     *
+     * @exception This method throws an exception if the statement is not
+     * valid or if errors occur when running the prepared statement.
+     */
+    void validateAndProcessExecute(const StrVec& sql, std::ostream& os);
+
+    /**
+     * Runs a query from a HTTP request and sends the response to the
+     * client. If result caching is enabled (see setResultCaching()), then
+     * a cached response is sent if it is up to date. Otherwise, the
+     * response is cached if possible.
+     *
+     * @param sql The query to be run.
+     * @param keepAlive Flag to indicate if the connection is persistent.
+     * @param os The output stream to where the response is to be written.
+     */
+    void serveQuery(const std::string& sql, bool keepAlive, std::ostream& os);
+
+    /**
+     * Processes a single query whose normalized text (see
+     * PlanCache::normalize()) is already known. This method is the same as
+     * process(), except that the query is not normalized again. It is used
+     * by serveQuery(), which normalizes the query to check for a cached
+     * result.
+     *
+     * @param sql The query to be processed.
+     * @param key The normalized text of the query.
+     * @param os The output stream to where the results are to be written.
+     *
+     * @return This method returns false if the query was "exit".
+     */
+    bool processQuery(const std::string& sql, const std::string& key,
+        std::ostream& os);
+
+    /**
+     * Runs the statements of a batch, in order, writing all their results
+     * to the same output stream. Consecutive inserts into the same table
+     * (and columns) are combined and run together via insertRows(), so
+     * that the table is looked up and locked (and its write-ahead log is
+     * flushed) once for all of them. Each insert still reports its own
+     * number of rows. The batch stops at the first statement that fails,
+     * after the statements before it have taken effect.
+     *
+     * @param statements The statements in the batch (see
+     * splitStatements()).
+     * @param os The output stream to where the results are to be written.
+     *
+     * @return This method returns false if one of the statements was
+     * "exit".
+     */
+    bool processBatch(const StrVec& statements, std::ostream& os);
+
+    /**
+     * Splits a batch of queries separated by semicolons into statements.
+     * Semicolons within quoted values do not separate statements and blank
+     * statements are ignored.
+     *
+     * @param sql The text of the queries.
+     * @param statements The vector set to the text of each statement.
+     *
+     * @return The number of statements.
+     */
+    static size_t splitStatements(const std::string& sql, StrVec& statements);
+
+    /**
+     * Validates and plans (but does not run) a query, by having the base
+     * class process it while its plan is recorded.
+     *
+     * @param sql The query to be planned.
+     * @param plan The plan of the query.
+     * @param os The output stream passed to the base class.
+     *
+     * @return This method returns true if the query was planned, i.e., if
+     * it is a single query on one table.
+     *
+     * @exception This method throws an exception if the query is not valid.
+     */
+    bool planQuery(const std::string& sql, QueryPlan& plan, std::ostream& os);
+
+    /**
+     * Appends rows to a table. The table is locked, its version is bumped,
+     * waiters are notified, and its write-ahead log (if any) is flushed
+     * once for all the rows.
+     *
+     * @param csv The CSV to which rows are to be added.
+     * @param colNames The names of the columns set by the values, or an
+     * empty list if all columns are set in order.
+     * @param values The values of the rows, one row after another. The
+     * values are moved into the rows.
+     *
+     * @return The number of rows inserted.
+     */
+    size_t insertRows(CSV& csv, const StrVec& colNames, StrVec& values);
+
+    /**
+     * Writes the number of rows inserted by an insert statement, i.e.,
+     * "1 row inserted." or "<count> row(s) inserted.".
+     *
+     * @param count The number of rows inserted.
+     * @param os The output stream to where the message is written.
+     */
+    static void printInserted(const size_t count, std::ostream& os);
+
+    /**
+     * Runs a select statement. This method does the work of selectQuery()
+     * (once its plan has been recorded), but takes the column names by
+     * reference, so that running a cached plan does not copy them.
+     * See selectQuery() for details on the parameters.
+     */
+    void runSelect(CSV& csv, bool mustWait, const StrVec& colNames,
+        const int whereColIdx, const std::string& cond,
+        const std::string& value, const OrderLimit& order, std::ostream& os);
+
+    /**
+     * Runs an update statement. This method does the work of updateQuery()
+     * (once its plan has been recorded), but takes the column names and
+     * values by reference, so that running a cached plan does not copy
+     * them. See updateQuery() for details on the parameters.
+     */
+    void runUpdate(CSV& csv, bool mustWait, const StrVec& colNames,
+        const StrVec& values, const int whereColIdx, const std::string& cond,
+        const std::string& value, std::ostream& os);
+
+    /**
+     * Runs the query described by a given plan, by calling the query method
+     * (e.g., selectQuery()) corresponding to the kind of query.
+     *
+     * @param plan The plan of the query to be run.
+     * @param os The output stream to where the results are to be written.
+     */
+    void runPlan(const QueryPlan& plan, std::ostream& os);
+
+    /**
+     * Records the plan of a query when the plan of a query is being
+     * recorded by the calling thread (see process()). This method is called
+     * by the query methods (e.g., selectQuery()) with their parameters.
+     *
+     * @param csv The table on which the query is run.
+     * @param plan The parameters of the query method. The file or URL is
+     * filled in from the call to loadAndGet() and the name of the column
+     * in the where clause from the table.
+     *
+     * @return This method returns false if the query is only being planned
+     * (for a prepare statement) and must not be run.
+     */
+    static bool recordPlan(const CSV& csv, QueryPlan plan);
+
+    /**
+     * Helper method to extract a where clause with a relational condition
+     * from the tokens of a query. The where clause must be the last clause
+     * in the query. A compound where clause (see Filter) is returned as a
+     * clause on the column Filter::Column, whose value is the entire clause.
+     *
+     * @param csv The CSV used to validate the columns in the where clause.
+     * @param sql The tokens of the query.
+     * @param whereIdx The index of the "where" keyword in sql.
+     *
+     * @return The index of the column, the condition, and the value in the
+     * where clause.
+     *
+     * @exception This method throws an exception if the where clause is
+     * not valid.
+     */
+    std::tuple<int, std::string, std::string> getWhereClause(const CSV& csv,
+        const StrVec& sql, const int whereIdx) const;
+
+    /**
+     * Determine if the tokens of a select statement have aggregate
+     * functions (e.g., "count(*)") in the select list or a group by clause.
+     *
+     * @param sql The tokens of the select statement.
+     *
+     * @return This method returns true if the statement is an aggregate
+     * query.
+     */
+    static bool isAggregate(const StrVec& sql);
+
+    /**
+     * Determine if the tokens of a select statement have a join clause,
+     * i.e., the table (and its optional alias) is followed by "join".
+     *
+     * @param sql The tokens of the select statement.
+     *
+     * @return This method returns true if the statement is a join.
+     */
+    static bool isJoin(const StrVec& sql);
+
+    /** One of the two tables in a join. */
+    struct JoinSide {
+        /** The table, which the caller has loaded. */
+        Table* table = nullptr;
+
+        /** The alias (or name) by which columns of the table are qualified. */
+        std::string name;
+
+        /** The column compared by the join condition. */
+        int col = -1;
+
+        /** The where clause applied to this table, if any. */
+        std::optional<Filter> filter;
+    };
+
+    /**
+     * Compiles the where clause of a join for the one table whose columns
+     * it uses (see JoinSide::filter).
+     *
+     * @param clause The where clause, from Filter::encode().
+     * @param sides The tables in the join.
+     *
+     * @exception This method throws Exp if the clause is not valid for
+     * exactly one of the tables.
+     */
+    static void pushDownWhere(const std::string& clause,
+                              std::array<JoinSide, 2>& sides);
+
+    /**
+     * Prints the selected columns of the rows joined from two tables, with
+     * both tables locked (in a fixed order) with shared locks.
+     *
+     * @param sides The tables in the join.
+     * @param header The column names to be printed.
+     * @param cols The table (0 or 1) and the column of each column printed.
+     * @param order The limit and offset clauses, if any.
+     * @param os The output stream to where the results are to be written.
+     */
+    void joinQuery(const std::array<JoinSide, 2>& sides,
+                   const StrVec& header,
+                   const std::vector<std::pair<int, int>>& cols,
+                   const OrderLimit& order, std::ostream& os);
+
+    /**
+     * Finds the pairs of rows of two tables whose values in the join columns
+     * are equal (as strings). An existing index on a join column is used as
+     * the hash table, if there is one. Otherwise, the rows (satisfying the
+     * where clause) of the smaller table are added to a hash table. The rows
+     * of the other table are then checked against it in parallel (if
+     * enabled).
+     *
+     * @note The caller must hold (at least) shared locks on both tables.
+     *
+     * @param sides The tables in the join.
+     * @param pairs The vector set to the pairs of rows (of the first and
+     * second tables), in the order of the rows of the first table and then
+     * of the second table.
+     */
+    void joinRows(const std::array<JoinSide, 2>& sides,
+                  std::vector<std::pair<size_t, size_t>>& pairs) const;
+
+    /**
+     * Helper method to extract the optional order by and limit clauses at
+     * the end of the tokens of a select statement. The clauses must be of
+     * the form:
+     *
+     *     [order by <col> [asc | desc]] [limit <count> [offset <count>]]
+     *
+     * @param sql The tokens of the select statement.
+     * @param orderCol Set to the column in the order by clause, if any. The
+     * column is resolved by the caller, once the table is loaded.
+     * @param order Set to the direction, limit, and offset in the clauses.
+     *
+     * @return The number of tokens before the clauses. This is the size of
+     * sql if there are no clauses.
+     *
+     * @exception This method throws an exception if a count is not valid.
+     */
+    static size_t getOrderLimit(const StrVec& sql, std::string& orderCol,
+        OrderLimit& order);
+
+    /**
+     * Checks if a select statement with order by or limit clauses (see
+     * getOrderLimit()) is valid and runs it via selectQuery().
+     *
+     * @param sql The tokens of the select statement, without the clauses.
+     * @param orderCol The column in the order by clause, or an empty
+     * string if there is no order by clause.
+     * @param order The direction, limit, and offset in the clauses.
+     * @param mustWait Flag to indicate if the query must keep running until
+     * at least 1 matching row is found.
+     * @param os The output stream to where the results are to be written.
+     *
+     * @exception This method throws an exception if the statement is not
+     * valid.
+     */
+    void validateAndProcessOrdered(const StrVec& sql,
+        const std::string& orderCol, OrderLimit order, bool mustWait,
+        std::ostream& os);
+
+    /**
+     * Checks if a select statement with aggregate functions is valid and
+     * runs it via aggregateQuery(). The statement is of the form:
+     *
+     *     select <item1>, ... [from <file>] [where <col> <cond> <value>]
+     *         [group by <col1>, ...]
+     *
+     * where each item is a group by column or one of count(*), count(col),
+     * sum(col), avg(col), min(col), and max(col).
+     *
+     * @param sql The tokens in the select statement to be processed.
+     * @param mustWait Flag to indicate if the query must wait until at
+     * least 1 matching row is found.
+     * @param os The output stream to where the results are to be written.
+     *
+     * @exception This method throws an exception if the statement is not
+     * valid.
+     */
+    void validateAndProcessAggregate(const StrVec& sql, bool mustWait,
+        std::ostream& os);
+
+    /**
+     * Helper method to add the rows that match an optional where clause to
+     * an aggregation, using partial aggregations for ranges of rows when
+     * scans are parallel.
+     *
+     * @note The caller must hold (at least) a shared lock on the table's
+     * tableMutex.
+     *
+     * @param table The table whose rows are aggregated.
+     * @param whereColIdx The column in the where clause or -1 if there is
+     * no where clause.
+     * @param cond The condition to be checked.
+     * @param value The value to be compared against.
+     * @param result The aggregation to which the rows are added.
+     *
+     * @return The number of rows that matched the where clause.
+     */
+    size_t aggregateRows(const Table& table, const int whereColIdx,
+        const std::string& cond, const std::string& value,
+        Aggregation& result) const;
+
+    /**
+     * Determine if a condition is one of "<", ">", "<=", or ">=".
+     *
+     * @param cond The condition to be checked.
+     *
+     * @return This method returns true if cond is a relational condition.
+     */
+    static bool isRelational(const std::string& cond);
+
+    /**
+     * Compiles the condition in a where clause into a predicate that uses
+     * matches() for conditions not directly supported by Predicate.
+     *
+     * @param cond The condition in the where clause.
+     * @param value The value in the where clause.
+     *
+     * @return The compiled predicate.
+     */
+    Predicate makePredicate(const std::string& cond,
+        const std::string& value) const;
+
+    /**
+     * Determine the number of parts into which a range of items (e.g.,
+     * rows) is to be split to be processed in parallel.
+     *
+     * @param count The number of items to be processed.
+     * @param minPerPart The minimum number of items in each part.
+     *
+     * @return The number of parts. This is 1 if parallel scans are not
+     * enabled (see setParallelism()) or if there are too few items.
+     */
+    size_t getNumParts(const size_t count, const size_t minPerPart) const;
+
+    /**
+     * Process a range of items split into a given number of parts. The
+     * parts are processed in parallel by the worker pool, unless there is
+     * only one part. This method returns after all the parts are processed.
+     *
+     * @param numParts The number of parts obtained from getNumParts().
+     * @param count The number of items to be processed.
+     * @param process The method called for each part with the part number
+     * and the range [first, last) of items in the part.
+     */
+    void runParts(const size_t numParts, const size_t count,
+        const std::function<void(size_t part, size_t first, size_t last)>&
+        process) const;
+
+    /**
+     * Convenience method to obtain the Table associated with a CSV. All of
+     * the CSV objects passed to the query methods in this class are obtained
+     * via loadAndGet() and hence are always entries in inMemoryCSV.
+     *
+     * @param csv A CSV obtained from the loadAndGet() method.
+     *
+     * @return The table corresponding to the CSV.
+     */
+    static Table& asTable(CSV& csv) { return static_cast<Table&>(csv); }
+
+    /**
+     * Helper method to determine the rows in a table (in either layout) that
+     * match an optional where clause.
+     *
+     * @note The caller must hold (at least) a shared lock on the table's
+     * tableMutex.
+     *
+     * @note If the column in the where clause has an index (see
+     * Table::createIndex()) then the index is used instead of checking each
+     * row. Otherwise, the condition is compiled into a Predicate that is
+     * applied to each row. Compound where clauses are compiled into a
+     * Filter, which uses indexes if possible.
+     *
+     * @param table The table to be scanned.
+     * @param whereColIdx The column in the where clause, Filter::Column for
+     * a compound where clause, or -1 if a where clause was not specified.
+     * @param cond The condition to be checked.
+     * @param value The value to be compared against.
+     * @param rows The vector set to the zero-based indexes of matching rows
+     * in ascending order. Callers pass a vector that is reused across
+     * queries, so that its memory is not allocated for each query.
+     * @param maxRows The number of matching rows after which the scan may
+     * stop. The first maxRows matching rows (in ascending order) are found,
+     * but more rows may be returned.
+     */
+    void findRows(const Table& table, const int whereColIdx,
+        const std::string& cond, const std::string& value,
+        std::vector<size_t>& rows, const size_t maxRows = SIZE_MAX) const;
+
+    /**
+     * Helper method to scan all the rows of a table, with ranges of rows
+     * checked in parallel (if enabled) and the results merged in row order.
+     * If there is a limit, the scan proceeds in rounds of increasing size
+     * until enough rows match.
+     *
+     * @param table The table to be scanned.
+     * @param rows The vector set to the matching rows, in ascending order.
+     * @param maxRows The number of matching rows after which the scan may
+     * stop.
+     * @param filterRange The function called with a vector and a range of
+     * rows (first and last), which adds the matching rows to the vector.
+     *
+     * @return The number of rows checked.
+     */
+    template <typename FilterRange>
+    size_t scanRows(const Table& table, std::vector<size_t>& rows,
+                    const size_t maxRows,
+                    const FilterRange& filterRange) const;
+
+    /**
+     * Removes the deleted rows from the rows found via an index, as deleted
+     * rows remain in indexes until the table is compacted.
+     *
+     * @param table The table whose rows were found.
+     * @param rows The rows from which deleted rows are removed.
+     */
+    static void removeDeleted(const Table& table, std::vector<size_t>& rows);
+
+    /**
+     * Helper method to determine the rows in a table that match a compound
+     * where clause, via indexes if possible (see Filter::findIndexed()).
+     * This method is used by findRows() and joins.
+     *
+     * @param table The table to be scanned.
+     * @param filter The compiled where clause.
+     * @param rows The vector set to the matching rows, in ascending order.
+     * @param maxRows The number of matching rows after which the scan may
+     * stop.
+     *
+     * @return The number of rows (or index entries) checked.
+     */
+    size_t filterRows(const Table& table, const Filter& filter,
+                      std::vector<size_t>& rows,
+                      const size_t maxRows = SIZE_MAX) const;
+
+    /**
+     * Helper method to determine the rows selected by a select statement,
+     * in the order given by an optional order by clause. Rows are found via
+     * findRows(), which stops early if there is a limit but no order by
+     * clause. With an order by clause, the first rows in order are found
+     * via sortRows(), or read in order from the index on the order by
+     * column (if there is one and there is no where clause).
+     *
+     * @note The caller must hold (at least) a shared lock on the table's
+     * tableMutex.
+     *
+     * @param table The table to be scanned.
+     * @param whereColIdx The column in the where clause or -1 if a where
+     * clause was not specified.
+     * @param cond The condition to be checked.
+     * @param value The value to be compared against.
+     * @param order The order by and limit clauses.
+     * @param rows The vector set to the zero-based indexes of the first
+     * (offset + limit) rows in order. The rows to be skipped by the offset
+     * are included (first). Callers reuse this vector across queries.
+     */
+    void selectRows(const Table& table, const int whereColIdx,
+        const std::string& cond, const std::string& value,
+        const OrderLimit& order, std::vector<size_t>& rows) const;
+
+    /**
+     * Helper method to sort (just) the first rows in a given order, using
+     * bounded heaps for ranges of rows that are processed in parallel (if
+     * enabled) and then combined.
+     *
+     * @note The caller must hold (at least) a shared lock on the table's
+     * tableMutex.
+     *
+     * @param order The order of the rows.
+     * @param count The number of rows needed, in order.
+     * @param rows The rows to be sorted. On return, it has just the first
+     * count rows (or all rows, if there are fewer) in order.
+     */
+    void sortRows(const RowOrder& order, const size_t count,
+        std::vector<size_t>& rows) const;
+
+    /**
+     * Loads the data from a given file or URL into a table. This method is
+     * called (outside of critical sections) by loadAndGet() to load tables
+     * that are not yet in memory.
+     *
+     * @param fileOrURL Path to a local CSV file or a URL to CSV data.
+     * @param csv The table into which the data is to be loaded. The table
+     * is converted to columnar layout if enabled via setColumnar().
+     *
+     * @exception This method throws an exception if the data could not be
+     * loaded.
+     */
+    void loadTable(const std::string& fileOrURL, Table& csv);
+
+    /**
+     * Opens the write-ahead log of a table that has just been loaded from a
+     * local file and replays the changes recorded in the log. Records that
+     * precede a completed checkpoint (i.e., changes that are already in the
+     * file) are skipped.
+     *
+     * @param fileName The path to the local CSV file of the table.
+     * @param table The table loaded from the file. The log is set as the
+     * log of this table.
+     *
+     * @exception This method throws an exception if the log could not be
+     * opened or has an invalid record.
+     */
+    void replayLog(const std::string& fileName, Table& table) const;
+
+    /**
+     * Saves a table to its local CSV file and clears its write-ahead log,
+     * if any. The data is written to a temporary file that then replaces
+     * the CSV file. So a crash never leaves a partially written file and
+     * memory-mapped data (that refers to the old file) remains valid.
+     * Queries can select rows from the table while it is being saved.
+     *
+     * @param fileName The path to the local CSV file of the table.
+     * @param table The table to be saved. This method locks the table.
+     * @param binary If this flag is true, a binary snapshot is also written.
+     * A snapshot is also written (or refreshed) if snapshots are enabled or
+     * if the file already has a snapshot.
+     *
+     * @exception This method throws an exception if the file could not be
+     * written.
+     */
+    void checkpoint(const std::string& fileName, Table& table,
+        bool binary = false);
+
+    /**
+     * Saves a table for a save statement via checkpoint() and records the
+     * version that was saved (see ResidentTable::savedVersion), so that
+     * the table can be evicted without being saved again.
+     *
+     * @param fileName The path to the local CSV file of the table, which
+     * is loaded if needed.
+     * @param binary If this flag is true, a binary snapshot is also written.
+     *
+     * @exception This method throws an exception if the file could not be
+     * loaded or written.
+     */
+    void saveTable(const std::string& fileName, bool binary = false);
+
+    /**
+     * The method run by the background thread started by
+     * setWriteAheadLog(). Periodically checkpoints the tables whose logs
+     * exceed a size threshold, until this object is destroyed.
+     */
+    void checkpointTables();
+
+    /**
+     * Evicts the least recently used tables, until the tables in memory
+     * fit within the memory budget (see setMemoryBudget()). Only tables
+     * that are not pinned (see loadAndGet()) or being compacted are
+     * evicted. This method is called after a table is loaded.
+     *
+     * @param save If this flag is true, modified tables that have neither
+     * a log nor a URL are saved (without holding tablesMutex) and then
+     * evicted. Otherwise, they are kept in memory.
+     */
+    void evictTables(bool save = true);
+
+    /**
+     * Queues a table with many deleted rows to be compacted (see
+     * Table::compact()) by a background thread, which is started when the
+     * first table is queued. Compacting a table needs an exclusive lock on
+     * it. So it is not done by the delete statements themselves.
+     *
+     * @param table The table to be compacted.
+     */
+    void scheduleCompaction(Table& table);
+
+    /**
+     * The method run by the background thread started by
+     * scheduleCompaction(). Compacts the queued tables (that still need to
+     * be compacted), until this object is destroyed.
+     */
+    void compactTables();
+    
+private:
+    /**
+     * The most recently referenced CSV in a query. This value is updated
+     * in the loadAndGet method. It is accessed via std::atomic_load and
+     * std::atomic_store so that queries do not serialize on a mutex. The
+     * pointer is nullptr until the first CSV is referenced.
+     */
+    std::shared_ptr<const std::string> recentCSV;
+
+    /**
+     * The reader-writer lock used to enable thread-safe operations on the
+     * inMemoryCSV and loading maps. Look-ups of tables that are already in
+     * memory hold just a shared lock.
+     */
+    std::shared_mutex tablesMutex;
+
+    /**
+     * The tables that are currently being loaded by loadAndGet(). Threads
+     * requesting a table that is being loaded wait on its future instead
+     * of loading the same table again.
+     */
+    std::unordered_map<std::string, std::shared_future<void>> loading;
+    
+    /**
+     * A table in inMemoryCSV along with the information used to keep the
+     * tables within the memory budget (see evictTables()).
+     */
+    struct ResidentTable {
+        /** The data of the table. */
+        Table table;
+
+        /**
+         * The number of requests (and background tasks) using the table.
+         * It is increased only while holding tablesMutex. So a table is
+         * evicted only if this is 0 under an exclusive lock.
+         */
+        std::atomic<int> pins{0};
+
+        /** The value of useClock each time the table was requested. */
+        std::atomic<uint64_t> lastUsed{0};
+
+        /**
+         * The version of the data that is in the file (or the log), i.e.,
+         * the table is modified if its version is different.
+         */
+        std::atomic<uint64_t> savedVersion{0};
+
+        /**
+         * The estimated memory used by the table and the version for which
+         * it was estimated. These are used under an exclusive lock on
+         * tablesMutex.
+         */
+        size_t bytes = 0;
+        uint64_t sizedVersion = 0;
+    };
+
+    /**
+     * An unordered map to maintain the CSV files that have been accessed
+     * in recent queries.  This map is used to provide convenient/rapid
+     * access to CSV files that the user has recently worked with. The most
+     * recent CSV used is tracked by the recentCSV instance variable. See the
+     * getOrLoadCSV() method in this class. Entries are removed only when
+     * tables are evicted (see evictTables()).
+     */
+    std::unordered_map<std::string, ResidentTable> inMemoryCSV;
+
+    /**
+     * The indexed columns of the tables that were evicted, so that the
+     * indexes are created again when the tables are reloaded. This map is
+     * protected by tablesMutex.
+     */
+    std::unordered_map<std::string, std::vector<int>> evictedIndexes;
+
+    /**
+     * The memory budget for the tables in bytes, or 0 if there is none.
+     * This value is set via the setMemoryBudget() method.
+     */
+    size_t memoryBudget = 0;
+
+    /** The clock that orders the uses of tables, for evictTables(). */
+    std::atomic<uint64_t> useClock{0};
+
+    /**
+     * Flag to indicate if newly loaded CSV files are to be converted to the
+     * columnar layout. This value is set via the setColumnar() method.
+     */
+    bool columnar = false;
+
+    /**
+     * Flag to indicate if local CSV files are to be loaded by mapping them
+     * into memory. This value is set via the setMemoryMapped() method.
+     */
+    bool memoryMapped = false;
+
+    /**
+     * The number of threads used for each scan. This value is set via the
+     * setParallelism() method.
+     */
+    int parallelism = 1;
+
+    /**
+     * The pool of worker threads shared by parallel scans. This pool is
+     * created only if parallelism is more than 1.
+     */
+    std::unique_ptr<WorkerPool> pool;
+
+    /**
+     * The plans of recently processed queries, keyed on their normalized
+     * text. Queries whose plan is in this cache are run without being
+     * parsed and validated again.
+     */
+    PlanCache planCache{1024};
+
+    /** The prepared statements, keyed on their (lowercase) names. */
+    std::unordered_map<std::string, std::shared_ptr<const QueryPlan>>
+        prepared;
+
+    /** The mutex to protect the prepared statements. */
+    std::mutex preparedMutex;
+
+    /** A response to a select statement, cached by serveQuery(). */
+    struct CachedResult {
+        /** The version of the table from which the response was computed. */
+        uint64_t version;
+
+        /** The complete HTTP response, including headers. */
+        std::string response;
+    };
+
+    /**
+     * Flag to indicate if responses to select statements are cached. This
+     * value is set via the setResultCaching() method.
+     */
+    bool resultCaching = false;
+
+    /**
+     * The cached responses, keyed on the connection type ("k " for
+     * keep-alive or "c " for close) followed by the normalized query.
+     */
+    LruCache<std::shared_ptr<const CachedResult>> resultCache{256};
+
+    /** The static files (e.g., of the web UI) served by serveClient(). */
+    FileCache fileCache{64};
+
+    /**
+     * Flag to indicate if changes to newly loaded local CSV files are to be
+     * logged. This value is set via the setWriteAheadLog() method.
+     */
+    bool writeAheadLog = false;
+
+    /**
+     * Flag to indicate if binary snapshots of local CSV files are to be
+     * written. This value is set via the setSnapshots() method.
+     */
+    bool snapshots = false;
+
+    /** The background thread that runs checkpointTables(), if any. */
+    std::thread checkpointer;
+
+    /** Flag set by the destructor to stop the checkpointer thread. */
+    bool stopCheckpoints = false;
+
+    /** The mutex to protect the stopCheckpoints flag. */
+    std::mutex checkpointMutex;
+
+    /** The condition variable used to wake up the checkpointer thread. */
+    std::condition_variable checkpointCond;
+
+    /** The background thread that runs compactTables(), if any. */
+    std::thread compactor;
+
+    /** The tables queued to be compacted by the compactor thread. */
+    std::vector<Table*> compactions;
+
+    /**
+     * The table being compacted by the compactor thread, if any. Neither
+     * this table nor the queued tables are evicted.
+     */
+    const Table* compacting = nullptr;
+
+    /** Flag set by the destructor to stop the compactor thread. */
+    bool stopCompactions = false;
+
+    /** The mutex to protect the compactions queue and its flag. */
+    std::mutex compactMutex;
+
+    /** The condition variable used to wake up the compactor thread. */
+    std::condition_variable compactCond;
+
+    /**
+     * The io_service run by the asynchronous server, or nullptr if the
+     * server is not running (see runAsyncServer()).
+     */
+    boost::asio::io_service* asyncService = nullptr;
+
+    /** The threads (other than the first) running the io_service. */
+    std::vector<std::thread> asyncWorkers;
+
+    /** The workers started by blockWorker() that have retired. */
+    std::vector<std::thread::id> retiredWorkers;
+
+    /** The number of workers started by blockWorker() still running. */
+    int addedWorkers = 0;
+
+    /**
+     * The number of workers running the io_service that are not blocked,
+     * and the number that is maintained by starting more workers.
+     */
+    int runningWorkers = 0, minRunningWorkers = 0;
+
+    /** The mutex to protect the workers and their counts. */
+    std::mutex workersMutex;
+
+    /**
+     * The mutex to protect the queued parts of responses (and their flags)
+     * of all the clients of the asynchronous server (see writeAsync()).
+     */
+    std::mutex writesMutex;
+
+    /** The condition variable on which workers wait for queued parts. */
+    std::condition_variable writesCond;
+
+    /** Flag set by stopAsyncWorkers() to stop waiting for clients. */
+    bool writesStopped = false;
     
     // -------------[ Limit number of threads ]-------------------    
     /** The atomic counter that tracks the number of active threads.
@@ -0,0 +1,70 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+/*
+ * Vectorized search for delimiters, used by SQL-Air to quickly find the
+ * fields and lines when loading large CSV files.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Finds the first occurrence of any one of three characters in a range of
+ * memory. The characters need not be distinct. This is similar to
+ * std::find_first_of but compares 32 (with AVX2) or 16 (with SSE2) bytes
+ * at a time. A scalar loop is used for the remaining bytes and on
+ * platforms without these instruction sets.
+ *
+ * @param pos The start of the range to be searched.
+ * @param end The end of the range. Memory at or after end is never read.
+ * @param c1 The first character to be found.
+ * @param c2 The second character to be found.
+ * @param c3 The third character to be found.
+ *
+ * @return A pointer to the first matching character or end if none of the
+ * characters occur in the range.
+ */
+inline const char* findFirstOf(const char* pos, const char* end, char c1,
+                               char c2, char c3) {
+#if defined(__AVX2__)
+    const __m256i v1 = _mm256_set1_epi8(c1), v2 = _mm256_set1_epi8(c2),
+        v3 = _mm256_set1_epi8(c3);
+    for (; end - pos >= 32; pos += 32) {
+        const __m256i block = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(pos));
+        const __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(block, v1),
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, v2),
+                            _mm256_cmpeq_epi8(block, v3)));
+        const unsigned mask = _mm256_movemask_epi8(hits);
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i v1 = _mm_set1_epi8(c1), v2 = _mm_set1_epi8(c2),
+        v3 = _mm_set1_epi8(c3);
+    for (; end - pos >= 16; pos += 16) {
+        const __m128i block = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(pos));
+        const __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(block, v1),
+            _mm_or_si128(_mm_cmpeq_epi8(block, v2),
+                         _mm_cmpeq_epi8(block, v3)));
+        const unsigned mask = _mm_movemask_epi8(hits);
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; pos < end; pos++) {
+        if (*pos == c1 || *pos == c2 || *pos == c3) {
+            break;
+        }
+    }
+    return pos;
+}
+
+#endif /* SIMD_SCAN_H */
@@ -0,0 +1,405 @@
+/*
+ * A table in SQL-Air, i.e., a CSV loaded into memory along with the
+ * additional data structures SQL-Air uses to manage it.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include "Table.h"
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include "Helper.h"
+
+/**
+ * The first bytes in a binary snapshot file (see Table::saveSnapshot()).
+ * The last character is the version of the snapshot format.
+ */
+const std::string SnapshotMagic = "SQLAirS1";
+
+// Versions are unique across tables. So version 0 is never used.
+std::atomic<uint64_t> Table::lastVersion{0};
+
+// Obtain the size and modification time (in nanoseconds) of a file
+bool Table::getStamp(const std::string& path, int64_t stamp[2]) {
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+    stamp[0] = info.st_size;
+    stamp[1] = info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+    return true;
+}
+
+// Load the data and remember the column names
+void Table::load(std::istream& is) {
+    CSV::load(is);
+    columnNames = CSV::getColumnNames();
+    // Release the rows (and their per-row mutexes) once their values are
+    // in the row store.
+    rowStore.assign(*this, getColumnCount());
+    std::vector<CSVRow>().swap(*this);
+}
+
+// Convert the rows into columns and release the row storage.
+void Table::makeColumnar() {
+    if (columnar) {
+        return;
+    }
+    columns.build(rowStore, getColumnCount());
+    rowStore.clear();
+    columnar = true;
+}
+
+// Convert the columns back into rows and release the column storage.
+void Table::makeRows() {
+    if (!columnar) {
+        return;
+    }
+    const size_t rowCount = columns.getRowCount();
+    const int colCount = getColumnCount();
+    std::vector<StrVec> rows(rowCount, StrVec(colCount));
+    for (size_t r = 0; r < rowCount; r++) {
+        for (int c = 0; c < colCount; c++) {
+            rows[r][c] = columns.getValue(r, c);
+        }
+    }
+    rowStore.assign(rows, colCount);
+    columns = ColumnStore();
+    columnar = false;
+}
+
+// Load the data directly from a memory-mapped file into columnar layout.
+bool Table::loadMapped(const std::string& path, WorkerPool* pool) {
+    const auto mapping = std::make_shared<const MappedFile>(path);
+    if (!mapping->isOpen()) {
+        return false;
+    }
+    const std::string_view data = mapping->data();
+    const size_t nl = std::min(data.find('\n'), data.size());
+    // Only the header is loaded via the base class to set up column names.
+    std::istringstream header(std::string(data.substr(0, nl)));
+    load(header);
+    columns.build(mapping, data.substr(std::min(nl + 1, data.size())),
+                  getColumnCount(), pool);
+    columnar = true;
+    return true;
+}
+
+// Write the column names and the typed columns to a snapshot file.
+void Table::saveSnapshot(const std::string& path,
+                         const std::string& source) const {
+    int64_t stamp[2];
+    if (!getStamp(source, stamp)) {
+        throw Exp("Unable to access " + source);
+    }
+    const std::string temp = path + ".tmp";
+    {
+        std::ofstream os(temp, std::ios::binary);
+        os.write(SnapshotMagic.data(), SnapshotMagic.size());
+        os.write(reinterpret_cast<const char*>(stamp), sizeof(stamp));
+        const StrVec& names = getColumnNames();
+        const uint32_t count = names.size();
+        os.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        for (const auto& name : names) {
+            const uint32_t len = name.size();
+            os.write(reinterpret_cast<const char*>(&len), sizeof(len));
+            os.write(name.data(), len);
+        }
+        if (columnar) {
+            columns.saveBinary(os);
+        } else {
+            ColumnStore store;  // Temporary columns for the row layout
+            store.build(rowStore, getColumnCount());
+            store.saveBinary(os);
+        }
+        if (!os.flush()) {
+            throw Exp("Unable to write " + temp);
+        }
+    }
+    WriteAheadLog::syncPath(temp);
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+        throw Exp("Unable to replace " + path);
+    }
+}
+
+// Load the data from a snapshot file, if it is of the current CSV file.
+bool Table::loadSnapshot(const std::string& path, const std::string& source) {
+    int64_t stamp[2], saved[2];
+    uint32_t count;
+    const auto mapping = std::make_shared<const MappedFile>(path);
+    if (!getStamp(source, stamp) || !mapping->isOpen()) {
+        return false;
+    }
+    std::string_view data = mapping->data();
+    const size_t fixed = SnapshotMagic.size() + sizeof(saved) + sizeof(count);
+    if (data.size() < fixed || data.substr(0, SnapshotMagic.size()) !=
+        SnapshotMagic) {
+        return false;
+    }
+    std::memcpy(saved, data.data() + SnapshotMagic.size(), sizeof(saved));
+    std::memcpy(&count, data.data() + fixed - sizeof(count), sizeof(count));
+    if (saved[0] != stamp[0] || saved[1] != stamp[1]) {
+        return false;  // The CSV file has changed since the snapshot.
+    }
+    data.remove_prefix(fixed);
+    // Column names are loaded via the base class as a quoted header line.
+    std::string header;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t len;
+        if (data.size() < sizeof(len)) {
+            return false;
+        }
+        std::memcpy(&len, data.data(), sizeof(len));
+        data.remove_prefix(sizeof(len));
+        if (data.size() < len) {
+            return false;
+        }
+        header += (i > 0 ? ",\"" : "\"");
+        for (const char c : data.substr(0, len)) {
+            header += (c == '"' || c == '\\' ? "\\" : "");
+            header += c;
+        }
+        header += '"';
+        data.remove_prefix(len);
+    }
+    ColumnStore store;
+    if (!store.loadBinary(mapping, data) ||
+        store.getColumnCount() != static_cast<int>(count)) {
+        return false;
+    }
+    std::istringstream is(header);
+    load(is);
+    columns  = std::move(store);
+    columnar = true;
+    return true;
+}
+
+// Find the matching rows in the layout in use
+void Table::filter(int col, const Predicate& pred, std::vector<size_t>& rows,
+                   size_t first, size_t last) const {
+    if (columnar) {
+        columns.filter(col, pred, rows, first, last);
+    } else {
+        rowStore.filter(col, pred, rows, first, last);
+    }
+}
+
+// Change the value in a given row and column
+void Table::setValue(size_t row, int col, const std::string& value) {
+    const auto entry = indexes.find(col);
+    if (entry != indexes.end()) {
+        entry->second.remove(getValue(row, col), row);
+        entry->second.add(value, row);
+    }
+    if (columnar) {
+        columns.setValue(row, col, value);
+    } else {
+        rowStore.set(row, col, value);
+    }
+}
+
+// Append a new row at the end of the table
+void Table::appendRow(const StrVec& row) {
+    if (columnar) {
+        columns.appendRow(row);
+    } else {
+        rowStore.append(row);
+    }
+    for (auto& entry : indexes) {
+        entry.second.add(row.at(entry.first), getRowCount() - 1);
+    }
+}
+
+// Remove a given set of rows, preserving the order of remaining rows.
+void Table::eraseRows(const std::vector<size_t>& rows) {
+    if (rows.empty()) {
+        return;
+    }
+    if (!columnar) {
+        // The rows stay in place (until compaction). So indexes are still
+        // valid, as their entries for deleted rows are skipped.
+        for (const size_t row : rows) {
+            rowStore.erase(row);
+        }
+        return;
+    }
+    columns.eraseRows(rows);
+    // Positions of the remaining rows have changed. So rebuild indexes.
+    for (auto& entry : indexes) {
+        createIndex(entry.first);
+    }
+}
+
+// Remove the deleted rows and rebuild indexes for the new positions
+void Table::compact() {
+    if (!hasDeleted()) {
+        return;
+    }
+    rowStore.compact();
+    for (auto& entry : indexes) {
+        createIndex(entry.first);
+    }
+}
+
+// Create or rebuild the index on a given column
+void Table::createIndex(int col) {
+    Index& index = indexes[col];
+    index.clear();
+    std::string value;
+    for (int row = 0; row < getRowCount(); row++) {
+        if (isDeleted(row)) {
+            continue;
+        }
+        value.clear();
+        appendValue(row, col, value);
+        index.add(value, row);
+    }
+}
+
+// List the columns of the indexes, which are not kept in any order
+std::vector<int> Table::getIndexedColumns() const {
+    std::vector<int> cols;
+    for (const auto& entry : indexes) {
+        cols.push_back(entry.first);
+    }
+    std::sort(cols.begin(), cols.end());
+    return cols;
+}
+
+// Add up the data in the layout in use and the indexes
+size_t Table::getMemoryBytes() const {
+    size_t bytes = (columnar ? columns.getMemoryBytes() :
+                    rowStore.getMemoryBytes());
+    for (const auto& entry : indexes) {
+        bytes += entry.second.getMemoryBytes();
+    }
+    return bytes;
+}
+
+// Register a waiter with a table
+Table::Waiter::Waiter(Table& table, int col, const Predicate& pred) :
+    table(table), col(col), pred(pred) {
+    std::scoped_lock<std::mutex> guard(table.waitersMutex);
+    pos = table.waiters.insert(table.waiters.end(), this);
+    Metrics::addWaiters(1);
+}
+
+// Remove a waiter from its table
+Table::Waiter::~Waiter() {
+    std::scoped_lock<std::mutex> guard(table.waitersMutex);
+    table.waiters.erase(pos);
+    Metrics::addWaiters(-1);
+}
+
+// Park a waiter by registering a copy of it along with its callback
+void Table::Waiter::park(std::function<void()> resume) {
+    {
+        std::scoped_lock<std::mutex> guard(table.waitersMutex);
+        if (table.waitersCancelled) {
+            return;
+        }
+        if (!ready) {
+            table.parked.push_back({col, pred, std::move(resume)});
+            Metrics::addWaiters(1);
+            return;
+        }
+    }
+    resume();  // Notified before being parked.
+}
+
+// Check if there are waiting or parked statements
+bool Table::hasWaiters() {
+    std::scoped_lock<std::mutex> guard(waitersMutex);
+    return !waiters.empty() || !parked.empty();
+}
+
+// Wake up waiters whose where clause is satisfied by the modified rows
+void Table::notifyWaiters(const std::vector<size_t>& rows,
+                          const std::vector<int>& cols) {
+    if (rows.empty()) {
+        return;
+    }
+    // Convenience lambda to check if a modification is relevant to a
+    // where clause. Only the modified rows are checked.
+    auto affects = [&](const int col, const Predicate& pred) {
+        if (col < 0) {
+            return true;
+        }
+        if (!cols.empty() &&
+            std::find(cols.begin(), cols.end(), col) == cols.end()) {
+            return false;
+        }
+        for (const size_t row : rows) {
+            if (pred(getValue(row, col))) {
+                return true;
+            }
+        }
+        return false;
+    };
+    // Parked waiters are resumed after the mutex is released
+    std::vector<std::function<void()>> resumes;
+    {
+        std::scoped_lock<std::mutex> guard(waitersMutex);
+        for (Waiter* waiter : waiters) {
+            if (waiter->ready) {
+                continue;  // Already woken up, but yet to run.
+            }
+            if (affects(waiter->col, waiter->pred)) {
+                waiter->ready = true;
+                waiter->cond.notify_one();
+            }
+        }
+        for (auto it = parked.begin(); it != parked.end();) {
+            if (affects(it->col, it->pred)) {
+                resumes.push_back(std::move(it->resume));
+                it = parked.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+    Metrics::addWaiters(-static_cast<int>(resumes.size()));
+    for (auto& resume : resumes) {
+        resume();
+    }
+}
+
+// Wake up all the waiters, which then find the flag set
+void Table::cancelWaiters() {
+    std::list<ParkedWaiter> dropped;  // Destroyed after the mutex is released
+    std::scoped_lock<std::mutex> guard(waitersMutex);
+    waitersCancelled = true;
+    for (Waiter* waiter : waiters) {
+        waiter->cond.notify_one();
+    }
+    Metrics::addWaiters(-static_cast<int>(parked.size()));
+    dropped.swap(parked);
+}
+
+// Save the data in this table to a given output stream
+void Table::save(std::ostream& os, const std::string& delim, bool quote,
+                 const std::string& nl) const {
+    if (columnar) {
+        columns.save(os, getColumnNames(), delim, quote, nl);
+    } else {
+        rowStore.save(os, getColumnNames(), delim, quote, nl);
+    }
+}
+
+// Move the data from another table into this table
+void Table::move(Table& other) {
+    CSV::move(other);
+    columnNames = std::move(other.columnNames);
+    rowStore    = std::move(other.rowStore);
+    columns     = std::move(other.columns);
+    columnar    = other.columnar;
+    indexes     = std::move(other.indexes);
+    log         = std::move(other.log);
+    bumpVersion();
+}
@@ -0,0 +1,646 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+/*
+ * A table in SQL-Air, i.e., a CSV loaded into memory along with the
+ * additional data structures SQL-Air uses to manage it.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <functional>
+#include "CSV.h"
+#include "ColumnStore.h"
+#include "Helper.h"
+#include "Index.h"
+#include "Metrics.h"
+#include "Predicate.h"
+#include "RowStore.h"
+#include "WriteAheadLog.h"
+
+/**
+ * A CSV that has been loaded into SQL-Air's inMemoryCSV. In addition to the
+ * rows and column names managed by the CSV base class, this class holds the
+ * optional columnar representation of the data and the secondary indexes
+ * on its columns.
+ *
+ * The data is held in exactly one of two layouts:
+ *
+ *   1. Row layout (default) -- the data is in a RowStore. The rows loaded
+ *      into the std::vector<CSVRow> managed by the CSV base class are moved
+ *      into the store and the vector is released. Low-cardinality columns
+ *      are dictionary-encoded by the store.
+ *   2. Columnar layout -- after a call to makeColumnar(), the data is held
+ *      in the columns instance variable. The column names continue to be
+ *      managed by the base class.
+ *
+ * The methods in this class work with either layout and should be used in
+ * preference to the corresponding methods in the CSV base class. The methods
+ * that modify data also keep the indexes up to date. In the row layout,
+ * deleted rows remain in place (as tombstones, see isDeleted()) until the
+ * table is compacted. So the positions of rows and the entries in indexes
+ * are left unchanged by deletes. Instead, scans and index look-ups skip
+ * the deleted rows.
+ *
+ * @note This class does not perform any locking. Instead, SQLAir uses the
+ * tableMutex reader-writer lock: select (and save) statements hold a shared
+ * lock for the duration of the statement, while update statements hold an
+ * exclusive lock. Hence selects never block each other and rows are read
+ * in-place without per-row locks or copies. Inserts and deletes that only
+ * append rows or mark rows as deleted in the RowStore (see
+ * canAppendShared() and canEraseShared()) hold a shared lock along with
+ * writeMutex, so that they run concurrently with selects. All other
+ * inserts and deletes hold an exclusive lock.
+ *
+ * Statements with a "wait" clause register a Waiter with the table. After
+ * modifying rows, SQLAir calls notifyWaiters() to wake up only the waiters
+ * whose where clause is satisfied by one of the modified rows. Waiters
+ * that are parked (see Waiter::park()) are resumed via a callback instead.
+ */
+class Table : public CSV {
+public:
+    /**
+     * A statement (with a "wait" clause) that is waiting for at least one
+     * row in this table to satisfy its where clause. A waiter registers
+     * itself with the table when it is created and removes itself when it
+     * is destroyed.
+     */
+    class Waiter {
+    public:
+        /**
+         * Creates and registers a waiter with a table.
+         *
+         * @note The caller must hold (at least) a shared lock on the
+         * table's tableMutex.
+         *
+         * @param table The table whose rows the statement is waiting on.
+         * @param col The column in the where clause or a negative value if
+         * the statement does not have a where clause or has a compound
+         * where clause (see Filter), as any change may then be relevant.
+         * @param pred The compiled condition in the where clause. The
+         * predicate must remain valid for the lifetime of this object.
+         */
+        Waiter(Table& table, int col, const Predicate& pred);
+
+        /**
+         * Removes this waiter from its table.
+         */
+        ~Waiter();
+
+        /**
+         * Waits until a modification to the table could satisfy the where
+         * clause of this waiter. The lock on the table's tableMutex is
+         * released while waiting.
+         *
+         * @param lock The shared or exclusive lock on the table's
+         * tableMutex held by the caller.
+         *
+         * @throws Exp If the waiters of the table have been cancelled (see
+         * cancelWaiters()). The lock is not held in this case.
+         */
+        template<typename Lock>
+        void wait(Lock& lock) {
+            // Writers holding just a shared lock may notify waiters at any
+            // time. So the flag is checked under waitersMutex (instead of
+            // the table's lock) to not miss notifications.
+            lock.unlock();
+            {
+                std::unique_lock<std::mutex> guard(table.waitersMutex);
+                cond.wait(guard, [this]() {
+                    return ready || table.waitersCancelled; });
+                if (table.waitersCancelled) {
+                    throw Exp("Wait cancelled as the server is stopping.");
+                }
+                ready = false;
+            }
+            Metrics::add(Metrics::WaiterWakeups);
+            const uint64_t start = Metrics::now();
+            lock.lock();
+            Metrics::elapsed(Metrics::LockWaitNanos, start);
+        }
+
+        /**
+         * Parks this waiter instead of waiting, so that no thread is
+         * blocked (e.g., in the asynchronous server). A copy of this
+         * waiter remains registered with the table after this object is
+         * destroyed. Once a modification to the table could satisfy the
+         * where clause, the copy is removed and the given callback is
+         * called, typically to run the statement again. The callback is
+         * called right away if such a modification has already happened.
+         *
+         * @note The callback is called by the writer that notifies the
+         * waiters (see notifyWaiters()), which may hold a lock on the
+         * table. So it must not block or use the table.
+         *
+         * @param resume The callback to be called (once) to resume the
+         * statement. It is dropped if the waiters are cancelled (see
+         * cancelWaiters()).
+         */
+        void park(std::function<void()> resume);
+
+    private:
+        friend class Table;
+
+        /** The table with which this waiter is registered. */
+        Table& table;
+
+        /** The column in the where clause or -1 if there is none. */
+        const int col;
+
+        /** The compiled condition in the where clause. */
+        const Predicate& pred;
+
+        /** The condition variable on which this waiter sleeps. */
+        std::condition_variable cond;
+
+        /** Flag set by notifyWaiters() to wake up this waiter. */
+        bool ready = false;
+
+        /** The position of this waiter in the table's list of waiters. */
+        std::list<Waiter*>::iterator pos;
+    };
+
+    /**
+     * Loads the data from a given stream via CSV::load() and records the
+     * column names (see getColumnNames()). The rows are moved into the
+     * RowStore of the row layout.
+     *
+     * @param is The input stream from where the data is to be read.
+     */
+    void load(std::istream& is);
+
+    /**
+     * Obtain the names of the columns in this table. Unlike
+     * CSV::getColumnNames(), the names are not built on each call.
+     *
+     * @return The column names in the order they appear in the table.
+     */
+    const StrVec& getColumnNames() const { return columnNames; }
+
+    /**
+     * Converts the data in this table into the columnar layout. The rows
+     * in the RowStore are released after conversion (and deleted rows are
+     * dropped). This method has no effect if the table is already in
+     * columnar layout.
+     */
+    void makeColumnar();
+
+    /**
+     * Converts the data in this table back into the row layout (e.g.,
+     * after loading a snapshot, which is always columnar). The columns are
+     * released after conversion. This method has no effect if the table
+     * is already in row layout.
+     */
+    void makeRows();
+
+    /**
+     * Loads a local CSV file by mapping it into memory (see MappedFile).
+     * The column names are loaded via CSV::load() and the data rows are
+     * parsed directly from the mapping into the columnar layout, without
+     * creating intermediate rows of strings. The values in String columns
+     * refer to the mapping instead of holding copies.
+     *
+     * @param path The path to the local CSV file to be loaded.
+     * @param pool The worker pool used to parse large files in parallel
+     * (see ColumnStore::build()), or nullptr to parse on the calling thread.
+     *
+     * @return This method returns false (without changing this table) if
+     * the file could not be mapped, e.g., because it does not exist or is
+     * empty. In this case, the caller should use CSV::load() instead.
+     */
+    bool loadMapped(const std::string& path, WorkerPool* pool = nullptr);
+
+    /**
+     * Writes this table (in either layout) to a binary snapshot file. The
+     * file holds the column names and the typed columns (see
+     * ColumnStore::saveBinary()). It also records the size and modification
+     * time of the CSV file from which the data is loaded, so that the
+     * snapshot is used only as long as that file is unchanged. The snapshot
+     * is written to a temporary file that then replaces the given path.
+     *
+     * @note The data in this table must be the same as the data in the
+     * source CSV file (e.g., just after it is loaded or saved).
+     *
+     * @param path The path to the snapshot file.
+     * @param source The path to the CSV file that has the same data.
+     *
+     * @exception This method throws an exception if the file could not be
+     * written.
+     */
+    void saveSnapshot(const std::string& path,
+        const std::string& source) const;
+
+    /**
+     * Loads this table from a binary snapshot written by saveSnapshot().
+     * The snapshot is mapped into memory (see MappedFile) and the table is
+     * in the columnar layout, without the CSV file being parsed.
+     *
+     * @param path The path to the snapshot file.
+     * @param source The path to the CSV file from which the snapshot was
+     * written.
+     *
+     * @return This method returns false (without changing this table) if
+     * the snapshot does not exist, is not valid, or if the CSV file has
+     * changed since the snapshot was written. In this case, the caller
+     * should load the CSV file instead.
+     */
+    bool loadSnapshot(const std::string& path, const std::string& source);
+
+    /**
+     * Determine if this table uses the columnar layout.
+     *
+     * @return This method returns true if the data is in columnar layout.
+     */
+    bool isColumnar() const { return columnar; }
+
+    /**
+     * Obtain the number of rows in this table, in either layout. In the row
+     * layout, this includes the rows that are deleted but not yet removed
+     * (see isDeleted()).
+     *
+     * @return The number of rows in the table.
+     */
+    int getRowCount() const {
+        return (columnar ? columns.getRowCount() : rowStore.size());
+    }
+
+    /**
+     * Returns the value in a given row and column in the row layout,
+     * without copying it.
+     *
+     * @param row The zero-based row number.
+     * @param col The zero-based column number.
+     *
+     * @return The value in the given row and column.
+     */
+    const std::string& getRowValue(size_t row, int col) const {
+        return rowStore.get(row, col);
+    }
+
+    /**
+     * Rows are not stored as vectors of values (see RowStore). This hides
+     * the corresponding method of the std::vector<CSVRow> base class, which
+     * is not used after rows are loaded.
+     */
+    const StrVec& operator[](size_t row) const = delete;
+
+    /**
+     * Determine if a given row has been deleted (but not yet removed).
+     * Rows are removed right away in the columnar layout.
+     *
+     * @param row The zero-based row number.
+     *
+     * @return This method returns true if the row is deleted.
+     */
+    bool isDeleted(size_t row) const {
+        return !columnar && rowStore.isDeleted(row);
+    }
+
+    /**
+     * Determine if any rows are deleted (but not yet removed), i.e., if
+     * scans need to check isDeleted().
+     *
+     * @return This method returns true if there are deleted rows.
+     */
+    bool hasDeleted() const {
+        return !columnar && rowStore.getDeletedCount() > 0;
+    }
+
+    /**
+     * Returns the value in a given row and column, in either layout.
+     *
+     * @param row The zero-based row number.
+     * @param col The zero-based column number.
+     *
+     * @return A copy of the value in the given row and column.
+     */
+    std::string getValue(size_t row, int col) const {
+        return (columnar ? columns.getValue(row, col) : rowStore.get(row, col));
+    }
+
+    /**
+     * Appends the value in a given row and column to a string, in either
+     * layout. This method is used to generate outputs without creating
+     * temporary strings.
+     *
+     * @param row The zero-based row number.
+     * @param col The zero-based column number.
+     * @param out The string to which the value is to be appended.
+     */
+    void appendValue(size_t row, int col, std::string& out) const {
+        if (columnar) {
+            columns.appendValue(row, col, out);
+        } else {
+            out += rowStore.get(row, col);
+        }
+    }
+
+    /**
+     * Determines the rows whose value in a given column satisfies a
+     * predicate, in either layout (see ColumnStore::filter() and
+     * RowStore::filter()). Deleted rows are skipped.
+     *
+     * @param col The zero-based column in the where clause.
+     * @param pred The compiled condition in the where clause.
+     * @param rows The vector to which the zero-based row numbers that
+     * satisfy the condition are appended, in ascending order.
+     * @param first The first row to be checked.
+     * @param last The row after the last row to be checked.
+     */
+    void filter(int col, const Predicate& pred, std::vector<size_t>& rows,
+        size_t first, size_t last) const;
+
+    /**
+     * Changes the value in a given row and column, in either layout.
+     *
+     * @param row The zero-based row number.
+     * @param col The zero-based column number.
+     * @param value The new value to be stored.
+     */
+    void setValue(size_t row, int col, const std::string& value);
+
+    /**
+     * Appends a new row at the end of this table, in either layout.
+     *
+     * @param row The values for each column in the new row. The number of
+     * values must be the same as the number of columns.
+     */
+    void appendRow(const StrVec& row);
+
+    /**
+     * Removes a given set of rows from this table, in either layout. The
+     * order of the remaining rows is unchanged. In the row layout, the rows
+     * are just marked as deleted. Otherwise, the remaining rows are moved
+     * and the indexes are rebuilt.
+     *
+     * @param rows The zero-based indexes of the rows to be removed, in
+     * ascending order.
+     */
+    void eraseRows(const std::vector<size_t>& rows);
+
+    /**
+     * Determine if given rows can be appended via appendRow() while other
+     * threads read this table, i.e., by a writer holding a shared lock on
+     * tableMutex along with writeMutex. This is the case in the row
+     * layout, as long as there are no indexes to be updated and the
+     * RowStore need not grow its directory or dictionaries (see
+     * RowStore::canAppend()).
+     *
+     * @note The caller must hold (at least) a shared lock on tableMutex.
+     *
+     * @param rows The rows to be appended.
+     *
+     * @return This method returns true if the rows can be appended under a
+     * shared lock.
+     */
+    bool canAppendShared(const std::vector<StrVec>& rows) const {
+        return !columnar && indexes.empty() && rowStore.canAppend(rows);
+    }
+
+    /**
+     * Determine if rows can be removed via eraseRows() while other threads
+     * read this table, i.e., by a writer holding a shared lock on
+     * tableMutex along with writeMutex. This is the case in the row
+     * layout, where rows are just marked as deleted.
+     *
+     * @return This method returns true if rows can be removed under a
+     * shared lock.
+     */
+    bool canEraseShared() const { return !columnar; }
+
+    /**
+     * Determine if enough rows are deleted (but not yet removed) for the
+     * table to be compacted, i.e., at least a segment's worth of rows and
+     * at least a quarter of all the rows.
+     *
+     * @return This method returns true if compact() should be called.
+     */
+    bool needsCompaction() const {
+        const size_t count = (columnar ? 0 : rowStore.getDeletedCount());
+        return count >= RowStore::SegmentRows && 4 * count >= rowStore.size();
+    }
+
+    /**
+     * Removes the rows that are deleted and rebuilds the indexes, as the
+     * positions of the remaining rows change.
+     *
+     * @note The caller must hold an exclusive lock on tableMutex.
+     */
+    void compact();
+
+    /**
+     * Creates (or rebuilds) a secondary index on a given column.
+     *
+     * @param col The zero-based column to be indexed.
+     */
+    void createIndex(int col);
+
+    /**
+     * Obtain the secondary index on a given column, if any.
+     *
+     * @param col The zero-based column number.
+     *
+     * @return A pointer to the index on the column or nullptr if the column
+     * is not indexed.
+     */
+    const Index* getIndex(int col) const {
+        const auto entry = indexes.find(col);
+        return (entry != indexes.end() ? &entry->second : nullptr);
+    }
+
+    /**
+     * Obtain the columns that have a secondary index, e.g., so that the
+     * indexes can be created again when the table is reloaded.
+     *
+     * @return The zero-based indexed columns, in ascending order.
+     */
+    std::vector<int> getIndexedColumns() const;
+
+    /**
+     * Estimates the memory used by this table, i.e., its data (in either
+     * layout) and its indexes. SQLAir uses this value to keep the tables
+     * in memory within a budget (see SQLAir::setMemoryBudget()).
+     *
+     * @note The caller must hold (at least) a shared lock on tableMutex.
+     *
+     * @return The approximate number of bytes used by this table.
+     */
+    size_t getMemoryBytes() const;
+
+    /**
+     * Determine if statements are waiting (or are parked) for rows in
+     * this table. Such tables must stay in memory, as parked waiters are
+     * registered with the table (see Waiter::park()).
+     *
+     * @return This method returns true if there are waiters.
+     */
+    bool hasWaiters();
+
+    /**
+     * Wakes up the waiters whose where clause is satisfied by one of a
+     * given set of modified rows. Only the modified rows are checked.
+     * Waiters whose column in the where clause was not modified are not
+     * woken up, as the rows matching their where clause are unchanged.
+     *
+     * @note The caller must be the writer that modified the rows, i.e., it
+     * holds an exclusive lock on tableMutex (or a shared lock along with
+     * writeMutex).
+     *
+     * @param rows The zero-based indexes of the rows that were modified.
+     * @param cols The zero-based indexes of the columns that were
+     * modified. An empty list indicates all columns (e.g., for new rows).
+     */
+    void notifyWaiters(const std::vector<size_t>& rows,
+        const std::vector<int>& cols = {});
+
+    /**
+     * Wakes up all the waiters, current and future, and makes them throw
+     * an exception instead of waiting (e.g., when the server is stopping).
+     * The callbacks of parked waiters are dropped without being called.
+     */
+    void cancelWaiters();
+
+    /**
+     * Obtain the version of the data in this table. The version changes
+     * each time rows are modified (see bumpVersion()). Versions are unique
+     * across all tables, so a version also identifies its table.
+     *
+     * @return The current version of the data.
+     */
+    uint64_t getVersion() const { return version; }
+
+    /**
+     * Assigns a new version to this table. SQLAir calls this method after
+     * modifying rows, while still holding an exclusive lock on tableMutex.
+     * Results computed from an earlier version are then out of date.
+     */
+    void bumpVersion() { version = ++lastVersion; }
+
+    /**
+     * Obtain the write-ahead log in which changes to this table are
+     * recorded, if any.
+     *
+     * @return The log of this table or nullptr if changes are not logged.
+     */
+    WriteAheadLog* getLog() const { return log.get(); }
+
+    /**
+     * Set the write-ahead log in which changes to this table are recorded.
+     * SQLAir appends a record to the log for each update, insert, or delete
+     * statement that modifies rows, while holding an exclusive lock on
+     * tableMutex.
+     *
+     * @param log The log to be used. Any existing log is closed.
+     */
+    void setLog(std::unique_ptr<WriteAheadLog> log) {
+        this->log = std::move(log);
+    }
+
+    /**
+     * Saves the data in this table to a given stream, in either layout. See
+     * CSV::save() for details on the parameters.
+     */
+    void save(std::ostream& os, const std::string& delim = ",",
+        bool quote = true, const std::string& nl = "\n") const;
+
+    /**
+     * Move the data (in either layout) from another table into this table.
+     *
+     * @param other The other table from where the data is to be moved.
+     * Existing data in this table is lost.
+     */
+    void move(Table& other);
+
+    /**
+     * The columnar representation of the data. This is used only if
+     * isColumnar() returns true.
+     */
+    ColumnStore columns;
+
+    /**
+     * The reader-writer lock used to enable MT-safe operations on this table
+     * (in either layout). This lock replaces the per-row mutexes in CSVRow.
+     */
+    std::shared_mutex tableMutex;
+
+    /**
+     * The mutex held by writers (and checkpoints) along with a shared lock
+     * on tableMutex, e.g., to append rows while selects are running (see
+     * canAppendShared()). So there is at most one writer at a time.
+     */
+    std::mutex writeMutex;
+
+private:
+    /**
+     * Obtain the size and modification time of a file. These values are
+     * used to check if a snapshot was written from the current version of
+     * a CSV file.
+     *
+     * @param path The path to the file.
+     * @param stamp The size and the modification time (in nanoseconds).
+     *
+     * @return This method returns false if the file does not exist.
+     */
+    static bool getStamp(const std::string& path, int64_t stamp[2]);
+
+    /** The names of the columns, as set via load(). */
+    StrVec columnNames;
+
+    /** The rows of the data in the row layout. */
+    RowStore rowStore;
+
+    /** Flag to indicate if the data is in columnar layout. */
+    bool columnar = false;
+
+    /**
+     * The secondary indexes on this table. The key is the zero-based index
+     * of the column and the value is the index on that column.
+     */
+    std::unordered_map<int, Index> indexes;
+
+    /**
+     * The statements waiting for rows in this table. Waiters register
+     * while holding just a shared lock on tableMutex. Hence, this list is
+     * protected by waitersMutex.
+     */
+    std::list<Waiter*> waiters;
+
+    /** A waiter parked by Waiter::park() and the callback to resume it. */
+    struct ParkedWaiter {
+        int col;
+        Predicate pred;
+        std::function<void()> resume;
+    };
+
+    /** The parked waiters, which are also protected by waitersMutex. */
+    std::list<ParkedWaiter> parked;
+
+    /** The mutex used to protect the waiters lists. */
+    std::mutex waitersMutex;
+
+    /**
+     * Flag set by cancelWaiters() to stop all waiting. This flag is
+     * protected by waitersMutex.
+     */
+    bool waitersCancelled = false;
+
+    /** The optional log in which changes to this table are recorded. */
+    std::unique_ptr<WriteAheadLog> log;
+
+    /** The last version assigned to any table. */
+    static std::atomic<uint64_t> lastVersion;
+
+    /** The current version of the data in this table. */
+    std::atomic<uint64_t> version{++lastVersion};
+};
+
+#endif /* TABLE_H */
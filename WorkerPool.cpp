@@ -0,0 +1,92 @@
+/*
+ * A fixed pool of worker threads shared by all queries in SQL-Air to run
+ * parts of a scan in parallel.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+// Start the worker threads that wait for jobs
+WorkerPool::WorkerPool(const int numWorkers) {
+    for (int i = 0; i < numWorkers; i++) {
+        workers.emplace_back([this]() {
+            while (true) {
+                std::shared_ptr<Job> job;
+                {
+                    std::unique_lock<std::mutex> lock(queueMutex);
+                    queueCond.wait(lock,
+                        [this]() { return stop || !jobs.empty(); });
+                    if (stop) {
+                        return;
+                    }
+                    job = jobs.front();
+                    jobs.pop();
+                }
+                work(*job);
+            }
+        });
+    }
+}
+
+// Stop and join the worker threads
+WorkerPool::~WorkerPool() {
+    {
+        std::scoped_lock<std::mutex> lock(queueMutex);
+        stop = true;
+    }
+    queueCond.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// Run the tasks in parallel with the workers
+void WorkerPool::run(const size_t numTasks,
+                     const std::function<void(size_t)>& task) {
+    if (numTasks == 0) {
+        return;
+    }
+    auto job = std::make_shared<Job>();
+    job->task     = &task;
+    job->numTasks = numTasks;
+    // Let workers help with all but the task this thread starts with
+    const size_t helpers = std::min(workers.size(), numTasks - 1);
+    if (helpers > 0) {
+        {
+            std::scoped_lock<std::mutex> lock(queueMutex);
+            for (size_t i = 0; i < helpers; i++) {
+                jobs.push(job);
+            }
+        }
+        queueCond.notify_all();
+    }
+    work(*job);
+    // Wait for tasks claimed by the workers to finish
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finished.wait(lock, [&job]() { return job->done == job->numTasks; });
+    if (job->error) {
+        std::rethrow_exception(job->error);
+    }
+}
+
+// Claim and run tasks until all the tasks have been claimed
+void WorkerPool::work(Job& job) {
+    for (size_t t = job.next++; t < job.numTasks; t = job.next++) {
+        std::exception_ptr error;
+        try {
+            (*job.task)(t);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        std::scoped_lock<std::mutex> lock(job.mutex);
+        if (error && !job.error) {
+            job.error = error;
+        }
+        if (++job.done == job.numTasks) {
+            job.finished.notify_all();
+        }
+    }
+}
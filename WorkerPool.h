@@ -0,0 +1,106 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+/*
+ * A fixed pool of worker threads shared by all queries in SQL-Air to run
+ * parts of a scan in parallel.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed pool of worker threads used to run the tasks of a parallel
+ * operation (e.g., scanning different ranges of rows in a table). The
+ * thread calling run() also works on the tasks. Tasks are not assigned to
+ * threads up front. Instead, each thread repeatedly claims the next
+ * unclaimed task, so that threads that finish early pick up the remaining
+ * work (similar to work stealing). Consequently, a call to run() always
+ * makes progress even if all the workers are busy with other queries.
+ */
+class WorkerPool {
+public:
+    /**
+     * Creates a pool with a given number of worker threads.
+     *
+     * @param numWorkers The number of worker threads in addition to the
+     * threads calling run().
+     */
+    explicit WorkerPool(const int numWorkers);
+
+    /**
+     * Stops and joins all the worker threads.
+     */
+    ~WorkerPool();
+
+    /**
+     * Runs a given number of tasks in parallel and waits for all of them
+     * to finish. If a task throws an exception, the exception is rethrown
+     * by this method (after all the tasks have finished).
+     *
+     * @param numTasks The number of tasks to be run.
+     *
+     * @param task The method to be called for each task. The method is
+     * called with the zero-based number of the task. It may be called from
+     * different threads concurrently.
+     */
+    void run(const size_t numTasks, const std::function<void(size_t)>& task);
+
+private:
+    /** The information shared by the threads working on a call to run(). */
+    struct Job {
+        /** The method to be called for each task. */
+        const std::function<void(size_t)>* task;
+
+        /** The total number of tasks in this job. */
+        size_t numTasks;
+
+        /** The number of the next task to be claimed by a thread. */
+        std::atomic<size_t> next = {0};
+
+        /** The number of tasks that have been completed. */
+        size_t done = 0;
+
+        /** The first exception thrown by a task, if any. */
+        std::exception_ptr error;
+
+        /** The mutex to protect done and error. */
+        std::mutex mutex;
+
+        /** The condition variable to wait for all the tasks to finish */
+        std::condition_variable finished;
+    };
+
+    /**
+     * Claims and runs tasks from a job until all of its tasks are claimed.
+     *
+     * @param job The job whose tasks are to be run.
+     */
+    static void work(Job& job);
+
+    /** The worker threads in this pool. */
+    std::vector<std::thread> workers;
+
+    /** The queue of jobs that the workers can help with. */
+    std::queue<std::shared_ptr<Job>> jobs;
+
+    /** The mutex to protect the jobs queue and the stop flag. */
+    std::mutex queueMutex;
+
+    /** The condition variable on which idle workers wait for jobs. */
+    std::condition_variable queueCond;
+
+    /** Flag to indicate the workers must stop. */
+    bool stop = false;
+};
+
+#endif /* WORKER_POOL_H */
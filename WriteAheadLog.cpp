@@ -0,0 +1,148 @@
+/*
+ * An append-only log of the changes made to a table in SQL-Air. The log is
+ * used to persist changes without rewriting the CSV file of the table.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include "WriteAheadLog.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include "Helper.h"
+
+// Open (or create) the log file for appending records
+WriteAheadLog::WriteAheadLog(const std::string& path) : path(path) {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        throw Exp("Unable to open log " + path);
+    }
+}
+
+// Close the log file
+WriteAheadLog::~WriteAheadLog() {
+    ::close(fd);
+}
+
+// Compute the 32-bit FNV-1a hash of the data
+uint32_t WriteAheadLog::checksum(const std::string& data) {
+    uint32_t hash = 2166136261U;
+    for (const char c : data) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 16777619U;
+    }
+    return hash;
+}
+
+// Read the complete records and discard a partially written record, if any
+std::vector<StrVec> WriteAheadLog::recover() {
+    std::scoped_lock<std::mutex> guard(mutex);
+    std::vector<StrVec> records;
+    std::ifstream is(path, std::ios::binary);
+    written = 0;
+    // Each record is "<checksum>\t<field>\t<field>...\n" with tabs, new
+    // lines, and backslashes in fields escaped with a backslash.
+    for (std::string line; std::getline(is, line) && !is.eof();) {
+        if (line.size() < 9 || line[8] != '\t' || checksum(line.substr(9))
+            != std::strtoul(line.substr(0, 8).c_str(), nullptr, 16)) {
+            break;  // A partially written (or corrupted) record
+        }
+        StrVec record(1);
+        for (size_t i = 9; i < line.size(); i++) {
+            if (line[i] == '\t') {
+                record.emplace_back();
+            } else if (line[i] == '\\' && i + 1 < line.size()) {
+                const char c = line[++i];
+                record.back() += (c == 't' ? '\t' : (c == 'n' ? '\n' : c));
+            } else {
+                record.back() += line[i];
+            }
+        }
+        records.push_back(std::move(record));
+        written += line.size() + 1;
+    }
+    // Remove any partial record so that new records follow complete ones.
+    if (::ftruncate(fd, written) != 0) {
+        throw Exp("Unable to truncate log " + path);
+    }
+    return records;
+}
+
+// Append a record to the log
+void WriteAheadLog::append(const StrVec& record) {
+    std::string data;
+    for (size_t i = 0; i < record.size(); i++) {
+        data += (i > 0 ? "\t" : "");
+        for (const char c : record[i]) {
+            if (c == '\t' || c == '\n' || c == '\\') {
+                data += '\\';
+            }
+            data += (c == '\t' ? 't' : (c == '\n' ? 'n' : c));
+        }
+    }
+    char prefix[16];
+    std::snprintf(prefix, sizeof(prefix), "%08x\t", checksum(data));
+    data = prefix + data + "\n";
+    std::scoped_lock<std::mutex> guard(mutex);
+    for (size_t done = 0; done < data.size();) {
+        const ssize_t len = ::write(fd, data.data() + done,
+                                    data.size() - done);
+        if (len < 0) {
+            throw Exp("Unable to write to log " + path);
+        }
+        done += len;
+    }
+    written += data.size();
+    total   += data.size();
+}
+
+// Flush the log to disk, sharing the flush with concurrent threads
+void WriteAheadLog::sync() {
+    std::unique_lock<std::mutex> lock(mutex);
+    const uint64_t target = total;
+    while (synced < target) {
+        if (syncing) {
+            flushed.wait(lock);  // Another thread is flushing the log
+            continue;
+        }
+        // Flush everything appended so far, including other threads'
+        // records, without holding the lock.
+        syncing = true;
+        const uint64_t end = total;
+        lock.unlock();
+        ::fdatasync(fd);
+        lock.lock();
+        synced  = std::max(synced, end);
+        syncing = false;
+        flushed.notify_all();
+    }
+}
+
+// Remove all the records from the log
+void WriteAheadLog::clear() {
+    std::scoped_lock<std::mutex> guard(mutex);
+    if (::ftruncate(fd, 0) != 0) {
+        throw Exp("Unable to truncate log " + path);
+    }
+    ::fdatasync(fd);
+    written = 0;
+    synced  = total;
+}
+
+// Flush a file or a directory to disk
+void WriteAheadLog::syncPath(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        throw Exp("Unable to open " + path);
+    }
+    ::fsync(fd);
+    ::close(fd);
+}
+
+// Return the size of the log file
+uint64_t WriteAheadLog::size() const {
+    std::scoped_lock<std::mutex> guard(mutex);
+    return written;
+}
@@ -0,0 +1,149 @@
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+/*
+ * An append-only log of the changes made to a table in SQL-Air. The log is
+ * used to persist changes without rewriting the CSV file of the table.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "CSV.h"
+
+/**
+ * An append-only (write-ahead) log of the changes made to a table. Each
+ * record in the log is a list of strings (the format of a record is
+ * decided by the caller). Records are stored one per line, along with a
+ * checksum, so that a partially written record at the end of the log (due
+ * to a crash) is detected and discarded by recover().
+ *
+ * Records are made durable via group commit: threads append their records
+ * and then call sync(). One of the threads calling sync() flushes the log
+ * to disk (via fdatasync) for all the records appended so far, while the
+ * other threads wait for it. Hence, concurrent writers share a flush.
+ *
+ * @note This class is MT-safe.
+ */
+class WriteAheadLog {
+public:
+    /**
+     * Opens (or creates) a log file.
+     *
+     * @param path The path to the log file.
+     *
+     * @exception This method throws an exception if the file could not be
+     * opened.
+     */
+    explicit WriteAheadLog(const std::string& path);
+
+    /**
+     * Closes the log file. Records that were appended are in the file, but
+     * may not have been flushed to disk.
+     */
+    ~WriteAheadLog();
+
+    // Logs cannot be copied as they own the file descriptor.
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    /**
+     * Reads all the complete records in the log. Any partially written
+     * record at the end of the log (and anything after it) is removed from
+     * the file, so that subsequent records are appended after the last
+     * complete record. This method must be called before records are
+     * appended.
+     *
+     * @return The records in the log, in the order they were appended.
+     */
+    std::vector<StrVec> recover();
+
+    /**
+     * Appends a record to the log. The record is not durable until sync()
+     * has been called.
+     *
+     * @param record The fields in the record.
+     *
+     * @exception This method throws an exception if the record could not
+     * be written.
+     */
+    void append(const StrVec& record);
+
+    /**
+     * Waits until all the records appended so far have been flushed to
+     * disk, flushing the log if no other thread is doing so.
+     */
+    void sync();
+
+    /**
+     * Removes all the records from the log and flushes the change to disk.
+     * This method is used after the table is saved (i.e., checkpointed).
+     */
+    void clear();
+
+    /**
+     * Obtain the number of bytes in the log file.
+     *
+     * @return The size of the log in bytes.
+     */
+    uint64_t size() const;
+
+    /**
+     * Obtain the path to the log file.
+     *
+     * @return The path specified when this log was created.
+     */
+    const std::string& getPath() const { return path; }
+
+    /**
+     * Flushes a file or directory to disk (via fsync). Directories are
+     * flushed to make a file that was renamed (or created) durable.
+     *
+     * @param path The path to the file or directory to be flushed.
+     *
+     * @exception This method throws an exception if the file or directory
+     * could not be opened.
+     */
+    static void syncPath(const std::string& path);
+
+private:
+    /**
+     * Computes the checksum stored with a record (the 32-bit FNV-1a hash).
+     *
+     * @param data The encoded fields of the record.
+     *
+     * @return The checksum of the data.
+     */
+    static uint32_t checksum(const std::string& data);
+
+    /** The path to the log file. */
+    const std::string path;
+
+    /** The file descriptor of the log file. */
+    int fd = -1;
+
+    /** The number of bytes in the log file. */
+    uint64_t written = 0;
+
+    /**
+     * The position (in total bytes ever written) up to which the log has
+     * been flushed to disk, and the total bytes ever written. These are
+     * used to determine if a sync() is needed.
+     */
+    uint64_t synced = 0, total = 0;
+
+    /** Flag to indicate if a thread is currently flushing the log. */
+    bool syncing = false;
+
+    /** The mutex to protect the instance variables. */
+    mutable std::mutex mutex;
+
+    /** The condition variable on which threads wait for a flush. */
+    std::condition_variable flushed;
+};
+
+#endif /* WRITE_AHEAD_LOG_H */
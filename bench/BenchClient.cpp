@@ -0,0 +1,106 @@
+/*
+ * The clients used by the SQL-Air benchmark to run queries, either directly
+ * via SQLAir::process() or via HTTP requests to a running server.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include "BenchClient.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iterator>
+#include "Helper.h"
+
+// Run the query in this process, reporting exceptions as main.cpp does
+const std::string& InProcessClient::run(const std::string& sql) {
+    os.str("");
+    os.clear();
+    try {
+        air.process(sql, os);
+    } catch (const std::exception& exp) {
+        os << "Error: " << exp.what() << std::endl;
+    }
+    response = os.str();
+    return response;
+}
+
+// Send the query to the server and read its response
+const std::string& HttpClient::run(const std::string& sql) {
+    if (stream == nullptr) {
+        stream = std::make_unique<boost::asio::ip::tcp::iostream>(host, port);
+        if (!stream->good()) {
+            stream.reset();
+            throw Exp("Unable to connect to " + host + ":" + port);
+        }
+    }
+    request.assign("GET /sql-air?query=");
+    urlEncode(sql, line);
+    request.append(line).append(" HTTP/1.1\r\nHost: ").append(host);
+    request.append(keepAlive ? "\r\nConnection: keep-alive\r\n\r\n" :
+                   "\r\nConnection: Close\r\n\r\n");
+    if (!(*stream << request << std::flush) || !readResponse()) {
+        // The connection is not reused, e.g., the server closed it.
+        stream.reset();
+    }
+    return response;
+}
+
+// Read the status line, headers, and the body of the response
+bool HttpClient::readResponse() {
+    if (!std::getline(*stream, line) ||
+        line.find(" 200 ") == std::string::npos) {
+        stream.reset();
+        throw Exp("Invalid response from server: " + line);
+    }
+    bool chunked = false, reuse = keepAlive;
+    size_t length = std::string::npos;
+    while (std::getline(*stream, line) && line != "\r" && !line.empty()) {
+        std::transform(line.begin(), line.end(), line.begin(), ::tolower);
+        if (line.find("content-length:") == 0) {
+            length = std::strtoul(line.c_str() + 15, nullptr, 10);
+        } else if (line.find("transfer-encoding:") == 0) {
+            chunked = (line.find("chunked") != std::string::npos);
+        } else if (line.find("connection:") == 0) {
+            reuse = reuse && (line.find("close") == std::string::npos);
+        }
+    }
+    response.clear();
+    if (chunked) {
+        // Each chunk is "<hex size>\r\n<data>\r\n". The last chunk is empty.
+        for (size_t size; std::getline(*stream, line) &&
+             (size = std::strtoul(line.c_str(), nullptr, 16)) > 0;) {
+            const size_t start = response.size();
+            response.resize(start + size);
+            stream->read(&response[start], size);
+            std::getline(*stream, line);
+        }
+        std::getline(*stream, line);  // The empty line after the last chunk
+    } else if (length != std::string::npos) {
+        response.resize(length);
+        stream->read(&response[0], length);
+    } else {
+        // Without a length, the body ends when the connection is closed.
+        response.assign(std::istreambuf_iterator<char>(*stream), {});
+        return false;
+    }
+    if (!stream->good()) {
+        stream.reset();
+        throw Exp("Connection closed while reading response");
+    }
+    return reuse;
+}
+
+// Replace characters that are not unreserved in URLs with "%XX"
+void HttpClient::urlEncode(const std::string& sql, std::string& encoded) {
+    static const char Hex[] = "0123456789ABCDEF";
+    encoded.clear();
+    for (const unsigned char c : sql) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            encoded.push_back(c);
+        } else {
+            encoded.append({'%', Hex[c >> 4], Hex[c & 15]});
+        }
+    }
+}
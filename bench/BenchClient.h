@@ -0,0 +1,149 @@
+#ifndef BENCH_CLIENT_H
+#define BENCH_CLIENT_H
+
+/*
+ * The clients used by the SQL-Air benchmark to run queries, either directly
+ * via SQLAir::process() or via HTTP requests to a running server.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <boost/asio.hpp>
+#include <memory>
+#include <sstream>
+#include <string>
+#include "SQLAir.h"
+
+/**
+ * The interface used by the load generator to run queries. Each thread of
+ * the load generator uses its own client. So clients need not be
+ * thread-safe.
+ */
+class BenchClient {
+public:
+    /** The destructor. */
+    virtual ~BenchClient() = default;
+
+    /**
+     * Runs a query and returns the response.
+     *
+     * @param sql The query to be run.
+     *
+     * @return The output of the query, e.g., the rows selected or
+     * "Error: ..." if the query failed. The string is reused by the next
+     * call to this method.
+     *
+     * @exception This method throws Exp if the query could not be sent or
+     * its response could not be read (e.g., the server is not running).
+     */
+    virtual const std::string& run(const std::string& sql) = 0;
+
+    /**
+     * Determines if a response returned by run() reports an error.
+     *
+     * @param response The response to be checked.
+     *
+     * @return This method returns true if the response has an error.
+     */
+    static bool isError(const std::string& response) {
+        return response.find("Error: ") != std::string::npos;
+    }
+};
+
+/**
+ * A client that runs queries on an SQLAir object in this process, in the
+ * same way as the console mode of main.cpp. This measures the engine
+ * without the costs of parsing and sending HTTP requests.
+ */
+class InProcessClient : public BenchClient {
+public:
+    /**
+     * Creates a client for a given SQLAir object, which is shared by all
+     * the clients of this process.
+     *
+     * @param air The object used to process the queries.
+     */
+    explicit InProcessClient(SQLAir& air) : air(air) {}
+
+    /** Runs a query via SQLAir::process(). */
+    const std::string& run(const std::string& sql) override;
+
+private:
+    /** The object used to process the queries. */
+    SQLAir& air;
+
+    /** The stream to which the output of each query is written. */
+    std::ostringstream os;
+
+    /** The output of the last query. */
+    std::string response;
+};
+
+/**
+ * A client that sends queries (as "GET /sql-air?query=..." requests) to a
+ * SQL-Air server, in the same way as web/sqlair.js. By default the
+ * client uses a persistent connection for all its requests. Responses with
+ * either a "Content-Length" header or chunked transfer encoding are
+ * supported.
+ */
+class HttpClient : public BenchClient {
+public:
+    /**
+     * Creates a client for a given server. The connection to the server is
+     * established when the first query is run.
+     *
+     * @param host The host name or address of the server.
+     * @param port The port on which the server is listening.
+     * @param keepAlive If this flag is false, a new connection is used for
+     * each query (to include the costs of setting up connections).
+     */
+    HttpClient(const std::string& host, const std::string& port,
+               bool keepAlive = true) :
+        host(host), port(port), keepAlive(keepAlive) {}
+
+    /** Runs a query by sending a request to the server. */
+    const std::string& run(const std::string& sql) override;
+
+private:
+    /**
+     * Reads the response to a request from the server. The body of the
+     * response (with the chunked encoding removed) is stored in response.
+     *
+     * @return This method returns true if the connection can be used for
+     * the next request.
+     */
+    bool readResponse();
+
+    /**
+     * Convenience method to encode a query for use in a URL. Letters,
+     * digits, and "-_.~" are not changed. All other characters, including
+     * spaces, are replaced by "%XX".
+     *
+     * @param sql The query to be encoded.
+     * @param encoded The string set to the encoded query.
+     */
+    static void urlEncode(const std::string& sql, std::string& encoded);
+
+    /** The host name or address of the server. */
+    const std::string host;
+
+    /** The port on which the server is listening. */
+    const std::string port;
+
+    /** Flag to indicate if the connection is reused for all queries. */
+    const bool keepAlive;
+
+    /** The connection to the server, if one is open. */
+    std::unique_ptr<boost::asio::ip::tcp::iostream> stream;
+
+    /** The request sent for the current query. */
+    std::string request;
+
+    /** The line of the response being read. */
+    std::string line;
+
+    /** The body of the last response. */
+    std::string response;
+};
+
+#endif /* BENCH_CLIENT_H */
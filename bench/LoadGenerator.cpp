@@ -0,0 +1,327 @@
+/*
+ * A load generator that runs a configurable mix of queries on a table from
+ * many threads and reports the throughput and latencies of the queries.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include "LoadGenerator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "Helper.h"
+
+// Add the latencies from another thread
+void LatencyStats::merge(const LatencyStats& other) {
+    latencies.insert(latencies.end(), other.latencies.begin(),
+                     other.latencies.end());
+    errors += other.errors;
+    sorted  = false;
+}
+
+// Use the nearest-rank method on the sorted latencies
+uint64_t LatencyStats::percentile(const double pct) {
+    if (latencies.empty()) {
+        return 0;
+    }
+    if (!sorted) {
+        std::sort(latencies.begin(), latencies.end());
+        sorted = true;
+    }
+    const size_t rank = std::ceil(pct / 100 * latencies.size());
+    return latencies[std::min(std::max(rank, size_t(1)),
+                              latencies.size()) - 1];
+}
+
+// Check the settings and compute the total of the weights
+LoadGenerator::LoadGenerator(const BenchConfig& config,
+                             ClientFactory makeClient) :
+    config(config), makeClient(std::move(makeClient)) {
+    for (const int weight : config.weights) {
+        if (weight < 0) {
+            throw Exp("The weights of queries cannot be negative");
+        }
+        totalWeight += weight;
+    }
+    if (totalWeight == 0) {
+        throw Exp("The mix of queries is empty");
+    }
+    if (config.weights[size_t(QueryKind::Wait)] > 0 &&
+        config.weights[size_t(QueryKind::Insert)] == 0) {
+        throw Exp("Wait queries need inserts in the mix to notify them");
+    }
+    if (config.threads < 1 || config.seconds <= 0) {
+        throw Exp("The number of threads and duration must be positive");
+    }
+    if (config.weights[size_t(QueryKind::Wait)] > 0 && config.threads < 2) {
+        throw Exp("Wait queries need at least 2 threads");
+    }
+}
+
+// Write rows with the columns of airports.csv and random values
+void LoadGenerator::generateTable(const std::string& path, const size_t rows,
+    const size_t countries, const unsigned seed) {
+    std::ofstream out(path);
+    if (!out.good()) {
+        throw Exp("Unable to write " + path);
+    }
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<size_t> country(0, countries - 1);
+    std::uniform_int_distribution<int> altitude(-100, 14000), utz(-12, 12);
+    std::uniform_real_distribution<double> lat(-90, 90), lng(-180, 180);
+    const std::string dst = "EANUSOZ";
+    // Convenience lambda to make an upper-case code of a given length
+    auto code = [](size_t num, const int len) {
+        std::string str(len, 'A');
+        for (int i = len - 1; i >= 0; i--, num /= 26) {
+            str[i] += num % 26;
+        }
+        return str;
+    };
+    out << "id,name,city,country,iata,icao,latitude,longitude,altitude,utz,"
+        << "dst,timezone\n";
+    char coords[64];
+    for (size_t id = 1; id <= rows; id++) {
+        const size_t ctry = country(rng);
+        std::snprintf(coords, sizeof(coords), "%.6f,%.6f", lat(rng),
+                      lng(rng));
+        out << id << ",Airport " << id << ",City " << (id % (countries * 8))
+            << ",Country " << ctry << ',' << code(id, 3) << ','
+            << code(id, 4) << ',' << coords << ',' << altitude(rng) << ','
+            << utz(rng) << ',' << dst[id % dst.size()] << ",Zone/" << ctry
+            << '\n';
+    }
+    if (!out.good()) {
+        throw Exp("Unable to write " + path);
+    }
+}
+
+// Parse comma-separated "kind=weight" pairs
+std::array<int, NumQueryKinds> LoadGenerator::parseMix(
+    const std::string& mix) {
+    std::array<int, NumQueryKinds> weights{};
+    std::istringstream is(mix);
+    for (std::string item; std::getline(is, item, ',');) {
+        const size_t eq = item.find('=');
+        const std::string name = item.substr(0, eq);
+        size_t kind = 0;
+        while (kind < NumQueryKinds && name != getName(QueryKind(kind))) {
+            kind++;
+        }
+        if (kind == NumQueryKinds || eq == std::string::npos) {
+            throw Exp("Invalid query mix entry " + item);
+        }
+        weights[kind] = std::stoi(item.substr(eq + 1));
+    }
+    return weights;
+}
+
+// The names of the kinds of queries, in QueryKind order
+const char* LoadGenerator::getName(const QueryKind kind) {
+    static const char* const Names[NumQueryKinds] = {
+        "select", "scan", "update", "insert", "delete", "wait"};
+    return Names[size_t(kind)];
+}
+
+// Load the table and find its largest id and its countries
+void LoadGenerator::prepare() {
+    std::unique_ptr<BenchClient> client = makeClient();
+    const std::string& maxRes =
+        client->run("select max(id) from " + config.table);
+    // The result is a header line, the value, and the number of rows
+    std::istringstream is(maxRes);
+    std::string line;
+    if (BenchClient::isError(maxRes) || !std::getline(is, line) ||
+        !std::getline(is, line)) {
+        throw Exp("Unable to load " + config.table + ": " + maxRes);
+    }
+    maxId  = std::strtoull(line.c_str(), nullptr, 10);
+    nextId = maxId + 1;
+    const std::string& ctryRes = client->run(
+        "select country, count(*) from " + config.table + " group by country");
+    is.str(ctryRes);
+    is.clear();
+    for (std::getline(is, line); std::getline(is, line);) {
+        const size_t tab = line.find('\t');
+        // Names with quotes cannot be used in the where clause as is
+        if (tab != std::string::npos && tab > 0 &&
+            line.find('\'') == std::string::npos) {
+            countries.push_back(line.substr(0, tab));
+        }
+    }
+    if (maxId == 0 || countries.empty()) {
+        throw Exp("The table " + config.table + " has no ids or countries");
+    }
+}
+
+// Create a query of the given kind with random values
+size_t LoadGenerator::makeQuery(const QueryKind kind, std::mt19937_64& rng,
+                                std::string& sql) {
+    const std::string& table = config.table;
+    const size_t anyId = rng() % maxId + 1;
+    const std::string& country = countries[rng() % countries.size()];
+    size_t id = 0;
+    switch (kind) {
+    case QueryKind::Select:
+        sql = "select name, city, altitude from " + table + " where id = " +
+            std::to_string(anyId);
+        break;
+    case QueryKind::Scan:
+        sql = "select count(*), avg(altitude) from " + table +
+            " where country = '" + country + "'";
+        break;
+    case QueryKind::Update:
+        sql = "update " + table + " set altitude = " +
+            std::to_string(rng() % 14000) + " where id = " +
+            std::to_string(anyId);
+        break;
+    case QueryKind::Insert:
+        id  = nextId++;
+        sql = "insert into " + table + " (id, name, city, country, " +
+            "altitude) values (" + std::to_string(id) + ", 'Bench " +
+            std::to_string(id) + "', 'Bench', '" + country + "', " +
+            std::to_string(rng() % 14000) + ")";
+        break;
+    case QueryKind::Delete: {
+        // Rows that have not been inserted (id 0) are not found
+        std::lock_guard<std::mutex> lock(insertedMutex);
+        if (!inserted.empty()) {
+            std::swap(inserted[rng() % inserted.size()], inserted.back());
+            id = inserted.back();
+            inserted.pop_back();
+        }
+        sql = "delete from " + table + " where id = " + std::to_string(id);
+        break;
+    }
+    case QueryKind::Wait:
+        // The rows inserted (by other threads) from now on
+        id = nextId;
+        for (size_t max = maxWaitId; max < id &&
+             !maxWaitId.compare_exchange_weak(max, id);) {}
+        sql = "wait select id from " + table + " where id >= " +
+            std::to_string(id);
+        break;
+    }
+    return id;
+}
+
+// Run random queries until the run is stopped
+void LoadGenerator::worker(std::array<LatencyStats, NumQueryKinds>& stats,
+                           const unsigned seed) {
+    std::unique_ptr<BenchClient> client = makeClient();
+    std::mt19937_64 rng(seed);
+    std::string sql;
+    while (!stop) {
+        int pick = rng() % totalWeight;
+        size_t kind = 0;
+        while (pick >= config.weights[kind]) {
+            pick -= config.weights[kind++];
+        }
+        // At least one thread must not be waiting, to insert the rows that
+        // the waiting threads are waiting for
+        const bool wait = (QueryKind(kind) == QueryKind::Wait);
+        if (wait && waiting.fetch_add(1) >= config.threads - 1) {
+            waiting--;
+            continue;
+        }
+        const size_t id = makeQuery(QueryKind(kind), rng, sql);
+        const auto start = std::chrono::steady_clock::now();
+        bool error = true;
+        try {
+            error = BenchClient::isError(client->run(sql));
+        } catch (const std::exception&) {
+            // Failures to reach the server are also errors
+        }
+        const auto end = std::chrono::steady_clock::now();
+        waiting -= wait;
+        stats[kind].add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            end - start).count(), error);
+        if (QueryKind(kind) == QueryKind::Insert && !error) {
+            std::lock_guard<std::mutex> lock(insertedMutex);
+            inserted.push_back(id);
+        }
+    }
+    running--;
+}
+
+// Insert rows while wait queries could be blocked for them
+void LoadGenerator::releaseWaiters(BenchClient& client) {
+    std::mt19937_64 rng(config.seed);
+    std::string sql;
+    while (running > 0) {
+        if (nextId <= maxWaitId) {
+            makeQuery(QueryKind::Insert, rng, sql);
+            try {
+                client.run(sql);
+            } catch (const std::exception&) {
+                // The server is gone. So the waiters have failed too.
+            }
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+// Run the threads for the configured duration and merge their latencies
+void LoadGenerator::run() {
+    std::vector<std::array<LatencyStats, NumQueryKinds>> stats(
+        config.threads);
+    std::vector<std::thread> threads;
+    running = config.threads;
+    stop    = false;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < config.threads; i++) {
+        threads.emplace_back(&LoadGenerator::worker, this, std::ref(stats[i]),
+                             config.seed + i + 1);
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(config.seconds));
+    stop = true;
+    if (config.weights[size_t(QueryKind::Wait)] > 0) {
+        releaseWaiters(*makeClient());
+    }
+    for (auto& thr : threads) {
+        thr.join();
+    }
+    elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    for (const auto& threadStats : stats) {
+        for (size_t kind = 0; kind < NumQueryKinds; kind++) {
+            results[kind].merge(threadStats[kind]);
+        }
+    }
+}
+
+// Write one line per kind of query (that was run) and one for all queries
+void LoadGenerator::report(std::ostream& os) {
+    LatencyStats all;
+    for (const auto& stats : results) {
+        all.merge(stats);
+    }
+    char line[160];
+    // Convenience lambda to write the line for one kind (or all queries)
+    auto write = [&](const char* name, LatencyStats& stats) {
+        std::snprintf(line, sizeof(line),
+                      "%-8s %10zu %8zu %12.1f %10.1f %10.1f %10.1f %10.1f\n",
+                      name, stats.getCount(), stats.getErrors(),
+                      stats.getCount() / elapsed, stats.percentile(50) / 1e3,
+                      stats.percentile(99) / 1e3, stats.percentile(99.9) / 1e3,
+                      stats.percentile(100) / 1e3);
+        os << line;
+    };
+    std::snprintf(line, sizeof(line),
+                  "%-8s %10s %8s %12s %10s %10s %10s %10s\n", "query",
+                  "count", "errors", "queries/s", "p50(us)", "p99(us)",
+                  "p999(us)", "max(us)");
+    os << line;
+    for (size_t kind = 0; kind < NumQueryKinds; kind++) {
+        if (results[kind].getCount() > 0) {
+            write(getName(QueryKind(kind)), results[kind]);
+        }
+    }
+    write("all", all);
+}
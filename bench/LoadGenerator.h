@@ -0,0 +1,289 @@
+#ifndef LOAD_GENERATOR_H
+#define LOAD_GENERATOR_H
+
+/*
+ * A load generator that runs a configurable mix of queries on a table from
+ * many threads and reports the throughput and latencies of the queries.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include "BenchClient.h"
+
+/**
+ * The kinds of queries run by the load generator. The queries are run on a
+ * table with the same columns as airports.csv (see generateTable()):
+ *
+ *   1. Select -- a point query: "select name, city, altitude from <table>
+ *      where id = <id>".
+ *   2. Scan -- an aggregate over a full scan: "select count(*),
+ *      avg(altitude) from <table> where country = '<country>'".
+ *   3. Update -- "update <table> set altitude = <n> where id = <id>".
+ *   4. Insert -- insert a new row with the next unused id.
+ *   5. Delete -- delete a row added by an earlier insert, so that the size
+ *      of the table stays roughly the same.
+ *   6. Wait -- "wait select id from <table> where id >= <id>" for rows
+ *      that are yet to be inserted (by other threads). The latency is the
+ *      time until the waiting query is notified of the next insert. So it
+ *      depends on the rate of inserts. At most threads-1 threads wait at a
+ *      time, so that the others can insert rows.
+ */
+enum class QueryKind { Select, Scan, Update, Insert, Delete, Wait };
+
+/** The number of different kinds of queries. */
+constexpr size_t NumQueryKinds = 6;
+
+/**
+ * The settings of a benchmark run. The defaults are a read-mostly mix,
+ * similar to a dashboard (see web/sqlair.js) with occasional changes.
+ */
+struct BenchConfig {
+    /** The table (a CSV file) on which the queries are run. */
+    std::string table = "bench.csv";
+
+    /** The number of client threads running queries. */
+    int threads = 8;
+
+    /** The duration of the run, in seconds. */
+    double seconds = 10;
+
+    /** The seed for the random numbers of the queries. */
+    unsigned seed = 1;
+
+    /** The relative weights of the kinds of queries, in QueryKind order. */
+    std::array<int, NumQueryKinds> weights = {{80, 10, 5, 3, 2, 0}};
+};
+
+/**
+ * The latencies of one kind of query (or of all queries), from which
+ * percentiles are computed at the end of a run.
+ */
+class LatencyStats {
+public:
+    /**
+     * Records the latency of a query.
+     *
+     * @param nanos The latency of the query in nanoseconds.
+     * @param error Flag to indicate if the query failed.
+     */
+    void add(const uint64_t nanos, const bool error) {
+        latencies.push_back(nanos);
+        errors += error;
+    }
+
+    /**
+     * Adds the latencies recorded by another thread to this object.
+     *
+     * @param other The latencies to be added.
+     */
+    void merge(const LatencyStats& other);
+
+    /**
+     * Obtain the number of queries recorded.
+     *
+     * @return The number of queries.
+     */
+    size_t getCount() const { return latencies.size(); }
+
+    /**
+     * Obtain the number of queries that failed.
+     *
+     * @return The number of queries that failed.
+     */
+    size_t getErrors() const { return errors; }
+
+    /**
+     * Obtain a percentile of the latencies (using the nearest-rank
+     * method). The latencies are sorted by the first call.
+     *
+     * @param pct The percentile, e.g., 99.9.
+     *
+     * @return The latency in nanoseconds or zero if there are no queries.
+     */
+    uint64_t percentile(const double pct);
+
+private:
+    /** The latencies (in nanoseconds) of the queries. */
+    std::vector<uint64_t> latencies;
+
+    /** The number of queries that failed. */
+    size_t errors = 0;
+
+    /** Flag to indicate if the latencies are sorted. */
+    bool sorted = false;
+};
+
+/**
+ * The load generator. Each thread repeatedly picks a kind of query (at
+ * random, based on the weights in BenchConfig), runs it via its own
+ * BenchClient, and records its latency, until the duration of the run
+ * has elapsed. Queries are run back-to-back (a closed loop). So the
+ * throughput is the maximum for the given number of threads.
+ */
+class LoadGenerator {
+public:
+    /**
+     * The method used to create a client for each thread of the run.
+     */
+    using ClientFactory = std::function<std::unique_ptr<BenchClient>()>;
+
+    /**
+     * Creates a load generator.
+     *
+     * @param config The settings of the run.
+     * @param makeClient The method used to create the client of each
+     * thread.
+     *
+     * @exception This method throws Exp if the settings are not valid,
+     * e.g., if there are wait queries but no inserts to notify them.
+     */
+    LoadGenerator(const BenchConfig& config, ClientFactory makeClient);
+
+    /**
+     * Writes a table with the same columns as airports.csv and synthetic
+     * values. The ids are 1 to rows. The countries are "Country 0" to
+     * "Country <countries-1>", chosen at random. So the selectivity of the
+     * scan queries is about 1/countries.
+     *
+     * @param path The path of the CSV file to be written.
+     * @param rows The number of rows in the table.
+     * @param countries The number of different countries in the table.
+     * @param seed The seed for the random values.
+     *
+     * @exception This method throws Exp if the file cannot be written.
+     */
+    static void generateTable(const std::string& path, const size_t rows,
+        const size_t countries, const unsigned seed);
+
+    /**
+     * Parses a mix of queries, e.g., "select=90,update=10".
+     *
+     * @param mix Comma-separated kinds of queries (select, scan, update,
+     * insert, delete, or wait) and their weights. Kinds that are not
+     * listed have a weight of zero.
+     *
+     * @return The weights of the kinds of queries, in QueryKind order.
+     *
+     * @exception This method throws Exp if the mix is not valid.
+     */
+    static std::array<int, NumQueryKinds> parseMix(const std::string& mix);
+
+    /**
+     * Obtains the name of a kind of query, as used by parseMix() and
+     * report().
+     *
+     * @param kind The kind of query.
+     *
+     * @return The name of the kind, e.g., "select".
+     */
+    static const char* getName(const QueryKind kind);
+
+    /**
+     * Loads the table (so that loading is not part of the first queries)
+     * and finds the largest id and the countries in the table. So any
+     * table with the columns of airports.csv can be used.
+     *
+     * @exception This method throws Exp if the table cannot be loaded.
+     */
+    void prepare();
+
+    /**
+     * Runs the queries from the configured number of threads for the
+     * configured duration and collects their latencies.
+     */
+    void run();
+
+    /**
+     * Writes the number of queries, errors, throughput, and latency
+     * percentiles (p50, p99, and p999) of each kind of query and of all
+     * queries.
+     *
+     * @param os The output stream to where the report is written.
+     */
+    void report(std::ostream& os);
+
+private:
+    /**
+     * The queries run by each thread.
+     *
+     * @param stats The latencies recorded by this thread, for each kind of
+     * query.
+     * @param seed The seed for the random numbers of this thread.
+     */
+    void worker(std::array<LatencyStats, NumQueryKinds>& stats,
+                const unsigned seed);
+
+    /**
+     * Creates a query of a given kind.
+     *
+     * @param kind The kind of query.
+     * @param rng The random numbers of the calling thread.
+     * @param sql The string set to the query.
+     *
+     * @return The id of the row inserted, deleted, or waited for, if any.
+     */
+    size_t makeQuery(const QueryKind kind, std::mt19937_64& rng,
+                     std::string& sql);
+
+    /**
+     * Inserts rows until all the wait queries that are still running have
+     * been notified, at the end of a run.
+     *
+     * @param client The client used to insert the rows.
+     */
+    void releaseWaiters(BenchClient& client);
+
+    /** The settings of the run. */
+    const BenchConfig config;
+
+    /** The method used to create the client of each thread. */
+    const ClientFactory makeClient;
+
+    /** The total of the weights of the kinds of queries. */
+    int totalWeight = 0;
+
+    /** The largest id in the table when the run starts. */
+    size_t maxId = 0;
+
+    /** The countries in the table, used by the scan queries. */
+    StrVec countries;
+
+    /** The id of the next row to be inserted. */
+    std::atomic<size_t> nextId{0};
+
+    /** The largest id for which a wait query has been run. */
+    std::atomic<size_t> maxWaitId{0};
+
+    /** The number of threads running wait queries. */
+    std::atomic<int> waiting{0};
+
+    /** The number of threads that are still running queries. */
+    std::atomic<int> running{0};
+
+    /** Flag to indicate that the threads should stop running queries. */
+    std::atomic<bool> stop{false};
+
+    /** The ids of the inserted rows that are yet to be deleted. */
+    std::vector<size_t> inserted;
+
+    /** The mutex to protect the inserted vector. */
+    std::mutex insertedMutex;
+
+    /** The latencies of each kind of query, merged from all threads. */
+    std::array<LatencyStats, NumQueryKinds> results;
+
+    /** The actual duration of the run, in seconds. */
+    double elapsed = 0;
+};
+
+#endif /* LOAD_GENERATOR_H */
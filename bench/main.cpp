@@ -0,0 +1,132 @@
+/**
+ * A benchmark for SQL-Air that runs a mix of queries from many threads,
+ * either on an SQLAir object in this process or on a running server, and
+ * reports the throughput and latency percentiles of the queries.
+ *
+ * Copyright (C) lavertgt@miamioh.edu
+ */
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "BenchClient.h"
+#include "LoadGenerator.h"
+#include "SQLAir.h"
+
+/**
+ * Prints the usage of this program.
+ *
+ * @param os The output stream to where the usage is written.
+ */
+void printUsage(std::ostream& os) {
+    os << "Usage: sqlair_bench [options] [engine flags]\n"
+       << "  --rows=N         Generate a table with N rows (default 100000)\n"
+       << "  --countries=N    Number of countries in the table (default 200)\n"
+       << "  --table=FILE     Use an existing table with the columns of\n"
+       << "                   airports.csv instead of generating one\n"
+       << "  --threads=N      Number of client threads (default 8)\n"
+       << "  --seconds=S      Duration of the run (default 10)\n"
+       << "  --mix=SPEC       Weights of queries, e.g., select=80,scan=10,\n"
+       << "                   update=5,insert=3,delete=2,wait=0 (default)\n"
+       << "  --seed=N         Seed for the random values (default 1)\n"
+       << "  --server=HOST:PORT  Send queries to a server, instead of\n"
+       << "                   running them in this process. The server must\n"
+       << "                   be able to load the table by the same name.\n"
+       << "  --close          Use a new connection for each query (server)\n"
+       << "  --memory-budget=MB  Evict idle tables beyond MB megabytes\n"
+       << "Engine flags (as in main.cpp): --columnar, --mmap, --result-cache,"
+       << "\n  --wal, --snapshot, --parallel=N\n";
+}
+
+/**
+ * Generates a table (unless an existing one is given), runs the
+ * benchmark, and prints the results.
+ *
+ * \param[in] argc The number of command-line arguments.
+ *
+ * \param[in] argv The options (see printUsage()).
+ */
+int main(int argc, char *argv[]) {
+    BenchConfig config;
+    size_t rows = 100000, countries = 200;
+    bool generate = true, keepAlive = true, columnar = false;
+    bool memoryMapped = false;
+    std::string server;
+    SQLAir air;
+    try {
+        for (int i = 1; i < argc; i++) {
+            const std::string arg = argv[i];
+            const std::string val = arg.substr(arg.find('=') + 1);
+            if (arg.find("--rows=") == 0) {
+                rows = std::stoul(val);
+            } else if (arg.find("--countries=") == 0) {
+                countries = std::stoul(val);
+            } else if (arg.find("--table=") == 0) {
+                config.table = val;
+                generate = false;
+            } else if (arg.find("--threads=") == 0) {
+                config.threads = std::stoi(val);
+            } else if (arg.find("--seconds=") == 0) {
+                config.seconds = std::stod(val);
+            } else if (arg.find("--mix=") == 0) {
+                config.weights = LoadGenerator::parseMix(val);
+            } else if (arg.find("--seed=") == 0) {
+                config.seed = std::stoul(val);
+            } else if (arg.find("--server=") == 0) {
+                server = val;
+            } else if (arg == "--close") {
+                keepAlive = false;
+            } else if (arg.find("--memory-budget=") == 0) {
+                air.setMemoryBudget(std::stoul(val) << 20);
+            } else if (arg == "--columnar") {
+                air.setColumnar(columnar = true);
+            } else if (arg == "--mmap") {
+                air.setMemoryMapped(memoryMapped = true);
+            } else if (arg == "--result-cache") {
+                air.setResultCaching(true);
+            } else if (arg == "--wal") {
+                air.setWriteAheadLog(true);
+            } else if (arg == "--snapshot") {
+                air.setSnapshots(true);
+            } else if (arg.find("--parallel=") == 0) {
+                air.setParallelism(std::stoi(val));
+            } else {
+                printUsage(std::cerr);
+                return 1;
+            }
+        }
+        if (memoryMapped && !columnar) {
+            std::cerr << "The --mmap flag requires --columnar\n";
+            return 1;
+        }
+        if (generate) {
+            config.table = "bench_" + std::to_string(rows) + ".csv";
+            LoadGenerator::generateTable(config.table, rows, countries,
+                                         config.seed);
+            std::cout << "Generated " << config.table << " with " << rows
+                      << " rows\n";
+        }
+        LoadGenerator::ClientFactory makeClient = [&air] {
+            return std::make_unique<InProcessClient>(air);
+        };
+        if (!server.empty()) {
+            const std::string host = server.substr(0, server.rfind(':'));
+            const std::string port = server.substr(server.rfind(':') + 1);
+            makeClient = [host, port, keepAlive] {
+                return std::make_unique<HttpClient>(host, port, keepAlive);
+            };
+        }
+        LoadGenerator bench(config, makeClient);
+        bench.prepare();
+        std::cout << "Running for " << config.seconds << " seconds with "
+                  << config.threads << " threads on "
+                  << (server.empty() ? "SQLAir::process" : server) << "\n";
+        bench.run();
+        bench.report(std::cout);
+    } catch (const std::exception& exp) {
+        std::cerr << "Error: " << exp.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -10,8 +10,10 @@
 //------------------------------------------------------------------
 
 #include <boost/asio.hpp>
+#include <algorithm>
 #include <iostream>
 #include <string>
+#include <thread>
 #include "SQLAir.h"
 #include "Helper.h"
 
@@ -23,8 +25,11 @@
  * Runs the program as a server that listens to incoming connections.
  * 
  * @param port The port number on which the server should listen.
+ *
+ * @param async If true, the asynchronous server with a fixed pool of
+ * worker threads (one per core) is used instead of a thread per client.
  */
-void runServer(SQLAir& air, int port, int maxThr) {
+void runServer(SQLAir& air, int port, int maxThr, bool async) {
     // Convenience namespace to streamline the code below.
     using namespace boost::asio;
     using namespace boost::asio::ip;
@@ -38,6 +43,12 @@ void runServer(SQLAir& air, int port, int maxThr) {
     std::cout << "SQL-Air server is listening on "
               << server.local_endpoint().port()
               << " & ready to process clients...\n";
+    if (async) {
+        const int numWorkers =
+            std::max(1U, std::thread::hardware_concurrency());
+        air.runAsyncServer(service, server, numWorkers);
+        return;
+    }
     // Process client connections one-by-one..until user enters "exit"
     air.runServer(server, maxThr);
 }
@@ -58,7 +69,19 @@ void checkRunClient(const int port, const bool printResp = false);
  *
  * \param[in] argv The actual command-line arguments.  If this is an
  * number it is assumed to be a port number.  Otherwise it is assumed
- * to be an file name that contains inputs for testing.
+ * to be an file name that contains inputs for testing. The optional
+ * arguments after the maximum number of threads are flags:
+ *     --columnar      Store newly loaded CSV files in columnar layout.
+ *     --mmap          Load local CSV files via memory-mapping. Mapped
+ *                     files are parsed into the columnar layout. So this
+ *                     flag requires --columnar.
+ *     --async         Use the asynchronous server (maximum threads ignored).
+ *     --result-cache  Cache responses to selects until tables are modified.
+ *     --wal           Log changes to local CSV files instead of rewriting.
+ *     --snapshot      Write binary snapshots of local CSV files when loaded.
+ *     --parallel=N    Use N threads to scan large tables in a query.
+ *     --memory-budget=MB  Evict idle tables once the loaded tables use more
+ *                     than MB megabytes. They are reloaded when used again.
  */
 int main(int argc, char *argv[]) {
     // Check and use first command-line argument, if any as port or input file.
@@ -68,6 +91,34 @@ int main(int argc, char *argv[]) {
 
     // Our SQLAir object for further use.
     SQLAir air;
+    bool async = false, columnar = false, memoryMapped = false;
+    // Process optional flags to configure SQLAir.
+    for (int i = 3; i < argc; i++) {
+        const std::string flag = argv[i];
+        if (flag == "--columnar") {
+            air.setColumnar(columnar = true);
+        } else if (flag == "--mmap") {
+            air.setMemoryMapped(memoryMapped = true);
+        } else if (flag == "--result-cache") {
+            air.setResultCaching(true);
+        } else if (flag == "--snapshot") {
+            air.setSnapshots(true);
+        } else if (flag == "--wal") {
+            air.setWriteAheadLog(true);
+        } else if (flag == "--async") {
+            async = true;
+        } else if (flag.find("--parallel=") == 0) {
+            air.setParallelism(std::stoi(flag.substr(11)));
+        } else if (flag.find("--memory-budget=") == 0) {
+            air.setMemoryBudget(std::stoul(flag.substr(16)) << 20);
+        } else {
+            std::cerr << "Ignoring unknown flag " << flag << std::endl;
+        }
+    }
+    if (memoryMapped && !columnar) {
+        std::cerr << "The --mmap flag requires --columnar\n";
+        return 1;
+    }
     
     // Check and use a given input data file for testing.
     if (port.find_first_not_of("1234567890") == std::string::npos) {
@@ -77,7 +128,7 @@ int main(int argc, char *argv[]) {
 #ifdef TEST_CLIENT
         checkRunClient(portNum);
 #endif
-        runServer(air, portNum, maxThr);
+        runServer(air, portNum, maxThr, async);
     } else {
         // In this situation, this program processes inputs from the
         // console, repeatedly until the user types "exit;"
@@ -0,0 +1,36 @@
+#!/bin/bash
+# Checks that tables beyond the memory budget are evicted and reloaded on
+# their next use without losing changes: a modified table is saved to its
+# CSV file when it is evicted, and its changes are seen once it is reloaded.
+#
+# Usage: tests/eviction_test.sh <sqlair-binary> [flags...]
+# (e.g., "make check" runs it with and without --async)
+
+set -u
+source "$(dirname "$0")/server_test_lib.sh"
+# airports.csv alone is larger than the budget of 1 MB
+startServer "$1" test.csv airports.csv -- --memory-budget=1 "${@:2}"
+
+expect "use%20test.csv" "Loaded test.csv"
+expect "update%20test.csv%20set%20title='Evicted'%20where%20movieid=193579" \
+    "1 row(s) updated."
+
+# Loading airports.csv saves test.csv (unless its changes are in a log)
+# and evicts it
+expect "use%20airports.csv" "Loaded airports.csv"
+if [[ " $* " != *" --wal "* ]] && ! grep -qF '"193579","Evicted"' test.csv
+then
+    echo "FAIL: the modified table was not saved when it was evicted"
+    exit 1
+fi
+
+# Each table is reloaded (evicting the other one) with the same rows
+expect "select%20title%20from%20test.csv%20where%20movieid=193579" "Evicted"
+expect "select%20count(*)%20from%20airports.csv" "1 row(s) selected."
+expect "select%20count(*)%20from%20test.csv" "1 row(s) selected."
+evictions=$(request 10 stats | awk '/^sqlair_table_evictions_total/ { print $2 }')
+if [ "${evictions:-0}" -lt 3 ]; then
+    echo "FAIL: expected at least 3 evictions, but found ${evictions:-none}"
+    exit 1
+fi
+echo "ok   eviction ($evictions tables evicted and reloaded)"
@@ -0,0 +1,48 @@
+# Functions shared by the server tests (tests/*_test.sh). Each test runs
+# in a temporary directory with a server of its own.
+
+# Start a server (the binary and its flags) in a new temporary directory,
+# into which the given CSV files of the repository are first copied.
+# Usage: startServer <sqlair-binary> <csv-files> -- [flags...]
+startServer() {
+    local server repo
+    server=$(realpath "$1")
+    repo=$(dirname "$(realpath "${BASH_SOURCE[0]}")")/..
+    shift
+    DIR=$(mktemp -d)
+    trap 'kill $PID 2> /dev/null; rm -rf "$DIR"' EXIT
+    while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+        cp "$repo/$1" "$DIR/"
+        shift
+    done
+    shift
+    cd "$DIR" || exit 1
+    PORT=$((20000 + RANDOM % 20000))
+    "$server" $PORT 20 "$@" > server.log 2>&1 &
+    PID=$!
+    until (exec 3<> /dev/tcp/localhost/$PORT) 2> /dev/null; do
+        sleep 0.1
+    done
+}
+
+# Send a request (e.g., a query with spaces as %20) and print the response
+# within the given number of seconds.
+# Usage: request <seconds> <path>
+request() {
+    local fd status
+    exec {fd}<> /dev/tcp/localhost/$PORT || return 1
+    printf 'GET /%s HTTP/1.0\r\n\r\n' "$2" >&$fd
+    timeout "$1" cat <&$fd
+    status=$?
+    exec {fd}>&-
+    return $status
+}
+
+# Check that the response to a query contains the given text.
+# Usage: expect <query> <text>
+expect() {
+    if ! request 60 "sql-air?query=$1" | grep -qF "$2"; then
+        echo "FAIL: \"$1\" did not respond with \"$2\""
+        exit 1
+    fi
+}
@@ -0,0 +1,33 @@
+#!/bin/bash
+# Checks that a client that stops reading a large select response does not
+# block the writers of the table: an insert and an update of the table must
+# finish within the response write timeout (10 seconds) plus some slack.
+#
+# Usage: tests/stalled_reader_test.sh <sqlair-binary> [flags...]
+# (e.g., "make check" runs it with and without --async)
+
+set -u
+source "$(dirname "$0")/server_test_lib.sh"
+startServer "$1" -- "${@:2}"
+
+# A table whose select response is far larger than the socket buffers
+awk 'BEGIN { print "\"id\",\"name\",\"value\"";
+             for (i = 0; i < 1000000; i++)
+                 printf "\"%d\",\"row%d\",\"%d\"\n", i, i, i % 97 }' > big.csv
+expect "use%20big.csv" "Loaded big.csv"
+
+# The stalled client sends a select but never reads the response
+exec 5<> /dev/tcp/localhost/$PORT
+printf 'GET /sql-air?query=select%%20*%%20from%%20big.csv HTTP/1.1\r\n\r\n' >&5
+sleep 2
+
+# Inserts run alongside selects, while updates need exclusive access
+start=$SECONDS
+expect "insert%20into%20big.csv%20(id,%20name,%20value)%20values%20(-1,%20'x',%200)" \
+    "1 row inserted."
+expect "update%20big.csv%20set%20value=1%20where%20id=-1" "1 row(s) updated."
+if [ $((SECONDS - start)) -gt 30 ]; then
+    echo "FAIL: the writers were blocked by a stalled reader"
+    exit 1
+fi
+echo "ok   stalled reader ($((SECONDS - start))s for the insert and update)"